@@ -0,0 +1,964 @@
+// Host-side fleet load generator: N virtual soil sensors against one broker, to size the broker and the ingest side before the fleet grows
+//
+// Every node runs the firmware's wake itself, compiled from mt_soil_quality_sensor/src: the same wakeRunner.cpp that setup() and MQTTTask call
+// decides the flushes, retries the join and the CONNECT through linkFsm, publishes the batches (and the flash backlog after a failure) with QoS 1
+// and MQTT_INFLIGHT_WINDOW, asks for the shared attributes and plans the sleeps. This file only brings WakeHooks and the hal.h underneath:
+// one thread per node with its own TCP + TLS + MQTT connection, session ticket, token, battery, clock jitter and injected faults.
+// A broker that does not answer v1/devices/me/attributes/request/+ keeps every flush up for CONFIG_RESPONSE_TIMEOUT_MS, as it would a device.
+//
+//   ./fleetLoad -n 2000 -H localhost -p 8883 --ca ca.pem --burst                 # thundering herd: every node wakes at once
+//   ./fleetLoad -n 500 -p 1883 --plain --monitor --wifi-fail 10 --drop 2         # local broker, faults, broker backlog through a subscriber
+//   ./fleetLoad -n 3 --devices ../nvsProvision/devices.csv ...                   # ThingsBoard: real tokens, same CSV as nvsProvision
+//
+//   -n N            virtual sensors (100)                 --devices FILE   clientId,token,treeId lines, generated identities after the last one
+//   -H HOST -p PORT broker (localhost 8883)               --ca FILE        CA bundle for TLS, or --insecure, or --plain for MQTT over TCP
+//   -t S            test length in real seconds (300)     --scale K        simulated seconds per real second while asleep (60)
+//   --burst         all nodes wake at t = 0               --jitter PCT     random spread of every sleep, +-PCT (10)
+//   --join-ms MS    simulated Wi-Fi join (1500)           --wifi-fail PCT  joins that fail as if the AP were down (0)
+//   --drop PCT      publishes that kill the connection (0) --soc-min X     initial charge drawn from [X, 1] (0.5)
+//   --monitor       subscribe to the telemetry topic and count what the broker delivers (local brokers only: ThingsBoard does not allow it)
+//   --report S      progress line period (10)
+//
+// Prints connect, handshake, CONNACK and PUBACK latency percentiles, publish throughput and the backlog: QoS 1 messages waiting for their
+// PUBACK across the fleet and, with --monitor, messages acknowledged by the broker and not delivered to the subscriber yet.
+//
+// Build (from this folder):
+//   M=../../mt_soil_quality_sensor; S="acquisitionPolicy deviceConfig deviceIdentity energyAccount linkFsm loraFrame loraUplink maintenanceWindow moisturePower otaPull
+//   probeBus sampling sleepScheduler telemetryBuffer telemetryLog timeUtils tlsSession uplink wakeCycle wakeProfiler wakeRunner"
+//   g++ -std=gnu++17 -O2 -pthread -I$M/include -I$M/lib/TelemetrySerializer -I$M/lib/SignalFilters -I$M/lib/MqttPacket fleetLoad.cpp $(printf "$M/src/%s.cpp " $S)
+//       -o fleetLoad -lssl -lcrypto
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/hmac.h>
+#include "hal.h"
+#include "macros.h"
+#include "mqttPacket.h"
+#include "wakeRunner.h"                                                                                          // The firmware's wake, driven by every virtual node
+#include "energyAccount.h"
+#include "tlsSession.h"
+
+// ===========================================================================================================================================================
+// MODELS AND OPTIONS
+// ===========================================================================================================================================================
+#define FLEET_CPU_MA 45.0f                                                                                       // Same currents as the host simulation (native/halNative.cpp)
+#define FLEET_RADIO_MA 95.0f
+#define FLEET_SLEEP_MA 0.2f
+#define FLEET_BATTERY_MAH 3000.0f
+#define FLEET_SAMPLING_MS 1000                                                                                   // Simulated awake time of a wake that keeps the radio off, compressed like the sleeps
+#define FLEET_LOG_SECTORS 4                                                                                      // Per node flash log, the smallest ring telemetryLog accepts plus room for an outage
+#define FLEET_SOCKET_TIMEOUT_S 5                                                                                 // Reads inside a packet and writes, like the PubSubClient socket timeout
+#define FLEET_STACK_SIZE (256 * 1024)
+#define FLEET_TLS_SESSION_MAX_LEN 2048                                                                           // OpenSSL keeps the peer certificate in the session, the device drops it to fit TLS_SESSION_MAX_LEN
+
+struct Options {
+  uint32_t nodes = 100;
+  const char* host = "localhost";
+  uint16_t port = 8883;
+  const char* caFile = NULL;
+  bool insecure = false;
+  bool plain = false;
+  const char* devicesFile = NULL;
+  uint32_t durationS = 300;
+  float scale = 60.0f;
+  bool burst = false;
+  float jitterPct = 10.0f;
+  uint32_t joinMs = 1500;
+  float wifiFailPct = 0.0f;
+  float dropPct = 0.0f;
+  float socMin = 0.5f;
+  bool monitor = false;
+  uint32_t reportS = 10;
+};
+
+static Options options;
+static SSL_CTX* tlsContext = NULL;
+static std::chrono::steady_clock::time_point startTime;
+static uint64_t startEpochMs = 0;
+// MODELS AND OPTIONS END ====================================================================================================================================
+
+// ===========================================================================================================================================================
+// FLEET STATE
+// ===========================================================================================================================================================
+struct Connection {
+  int fd = -1;
+  SSL* ssl = NULL;
+};
+
+struct Latencies {                                                                                               // Per node, merged at the end so the threads never share a vector
+  std::vector<uint32_t> tcpUs, tlsUs, connackUs, pubackUs;
+};
+
+struct HostTlsSession {                                                                                          // TlsSessionCache with room for the OpenSSL encoding
+  uint16_t len;
+  uint8_t data[FLEET_TLS_SESSION_MAX_LEN];
+};
+
+struct FleetNode {
+  uint32_t index;
+  DeviceIdentity identity;
+  WakeRetained kept;                                                                                             // Its RTC memory
+  WakeRunner run;
+  HostTlsSession tlsSession;
+  TlsSessionStats tlsStats;
+  uint8_t flash[FLEET_LOG_SECTORS * HAL_LOG_SECTOR_SIZE];
+  Connection mqtt;
+  bool linkUp;
+  uint16_t subscribeId;
+  uint64_t sleepS;                                                                                               // Asked for through halDeepSleep()
+  uint64_t sentUs[65536 / 64];                                                                                   // PUBLISH time by packet id modulo the table, 0 once acknowledged
+  uint32_t rng;
+  float drawnmAh;
+  float soc;
+  float moisture;
+  bool dead;
+  Latencies latencies;
+  pthread_t thread;
+};
+
+struct FleetCounters {
+  std::atomic<uint64_t> wakes{0}, flushes{0}, delivered{0}, expired{0};
+  std::atomic<uint64_t> connects{0}, connectFailures{0}, wifiFailures{0}, drops{0}, rewinds{0};
+  std::atomic<uint64_t> messagesAcked{0}, readingsAcked{0}, bytesSent{0}, telemetrySent{0};
+  std::atomic<uint64_t> monitorReceived{0};
+  std::atomic<int64_t> inflight{0}, awake{0};
+  std::atomic<uint32_t> deadBatteries{0};
+};
+
+static FleetCounters counters;
+static std::vector<FleetNode*> fleet;
+static thread_local FleetNode* node = NULL;                                                                      // The node whose wake this thread runs, what every hal call acts on
+static std::atomic<bool> stopping{false};
+static std::mutex stopMutex;
+static std::condition_variable stopSignal;
+// FLEET STATE END ===========================================================================================================================================
+
+// ===========================================================================================================================================================
+// CONNECTION (TCP, OPTIONALLY TLS) AND MQTT 3.1.1 FRAMING
+// ===========================================================================================================================================================
+static uint64_t hostMicros(){
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+static bool tcpOpen(Connection& c){
+  char service[8];
+  snprintf(service, sizeof(service), "%u", options.port);
+  struct addrinfo hints = {};
+  struct addrinfo* result = NULL;
+  hints.ai_socktype = SOCK_STREAM;
+  if(getaddrinfo(options.host, service, &hints, &result) != 0) return false;
+  for(struct addrinfo* ai = result; ai != NULL && c.fd < 0; ai = ai->ai_next){
+    c.fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if(c.fd < 0) continue;
+    struct timeval timeout = {FLEET_SOCKET_TIMEOUT_S, 0};
+    setsockopt(c.fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(c.fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    int noDelay = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));                                       // Nagle is off on the device too (main.cpp)
+    if(connect(c.fd, ai->ai_addr, ai->ai_addrlen) != 0){
+      close(c.fd);
+      c.fd = -1;
+    }
+  }
+  freeaddrinfo(result);
+  return c.fd >= 0;
+}
+
+static bool tlsOpen(Connection& c, HostTlsSession* cache, bool& resumed){
+  c.ssl = SSL_new(tlsContext);
+  if(c.ssl == NULL) return false;
+  SSL_set_fd(c.ssl, c.fd);
+  SSL_set_tlsext_host_name(c.ssl, options.host);                                                                 // SNI, as setHostname() does on the device
+  if(!options.insecure) SSL_set1_host(c.ssl, options.host);
+  SSL_SESSION* session = NULL;
+  if(cache != NULL && cache->len > 0){                                                                           // Ticket kept from the previous flush, like the RTC copy (tlsSession.h)
+    const uint8_t* data = cache->data;
+    session = d2i_SSL_SESSION(NULL, &data, cache->len);
+    if(session != NULL) SSL_set_session(c.ssl, session);
+  }
+  bool ok = SSL_connect(c.ssl) == 1;
+  resumed = ok && SSL_session_reused(c.ssl);
+  SSL_SESSION_free(session);
+  return ok;
+}
+
+static void keepTlsSession(Connection& c, HostTlsSession& cache){                                                // At the end of the flush, TLS 1.3 tickets arrive after the handshake
+  SSL_SESSION* session = SSL_get1_session(c.ssl);
+  if(session == NULL) return;
+  int len = i2d_SSL_SESSION(session, NULL);
+  uint8_t* out = cache.data;
+  cache.len = len > 0 && len <= FLEET_TLS_SESSION_MAX_LEN && SSL_SESSION_is_resumable(session) ? i2d_SSL_SESSION(session, &out) : 0;
+  SSL_SESSION_free(session);
+}
+
+static void connClose(Connection& c){
+  if(c.ssl != NULL) SSL_free(c.ssl);
+  if(c.fd >= 0) close(c.fd);
+  c.ssl = NULL;
+  c.fd = -1;
+}
+
+static bool connWrite(Connection& c, const uint8_t* data, size_t len){
+  while(len > 0){
+    ssize_t sent = c.ssl != NULL ? SSL_write(c.ssl, data, len) : send(c.fd, data, len, MSG_NOSIGNAL);
+    if(sent <= 0) return false;
+    data += sent;
+    len -= sent;
+  }
+  return true;
+}
+
+static bool connRead(Connection& c, uint8_t* data, size_t len){
+  while(len > 0){
+    ssize_t got = c.ssl != NULL ? SSL_read(c.ssl, data, len) : recv(c.fd, data, len, 0);
+    if(got <= 0) return false;
+    data += got;
+    len -= got;
+  }
+  return true;
+}
+
+static bool connWait(Connection& c, uint32_t waitMs){                                                            // Something to read within waitMs
+  if(c.ssl != NULL && SSL_pending(c.ssl) > 0) return true;
+  struct pollfd ready = {c.fd, POLLIN, 0};
+  return poll(&ready, 1, waitMs) > 0;
+}
+
+static bool mqttReadPacket(Connection& c, uint8_t& type, uint8_t* body, size_t bodySize, size_t& length){        // Oversized bodies are read and dropped (length 0)
+  uint8_t digit;
+  uint32_t remaining = 0;
+  int more = 1;
+  if(!connRead(c, &type, 1)) return false;
+  for(uint8_t i = 0; more > 0; i++){
+    if(!connRead(c, &digit, 1) || (more = mqttLengthDigit(remaining, i, digit)) < 0) return false;
+  }
+  length = remaining;
+  if(length <= bodySize) return connRead(c, body, length);
+  for(uint8_t skip[256]; length > 0; ){
+    size_t n = std::min(length, sizeof(skip));
+    if(!connRead(c, skip, n)) return false;
+    length -= n;
+  }
+  return true;
+}
+
+static bool mqttSendConnect(Connection& c, const char* clientId, const char* user){
+  uint8_t packet[512];
+  size_t len = mqttConnectPacket(packet, sizeof(packet), clientId, user, 60);                                    // Keep alive (s)
+  return len > 0 && connWrite(c, packet, len);
+}
+
+static bool mqttReadConnack(Connection& c){
+  uint8_t type, body[4];
+  size_t length;
+  return mqttReadPacket(c, type, body, sizeof(body), length) && mqttConnackAccepted(type, body, length);
+}
+
+static bool mqttSendPublish(Connection& c, const char* topic, const uint8_t* payload, size_t len, int32_t packetId){
+  uint8_t header[MQTT_PUBLISH_HEADER_MAX_LEN(256)];
+  size_t n = mqttPublishHeader(header, sizeof(header), topic, len, packetId);
+  return n > 0 && connWrite(c, header, n) && connWrite(c, payload, len);
+}
+// CONNECTION END ============================================================================================================================================
+
+// ===========================================================================================================================================================
+// HAL (ONE VIRTUAL NODE PER THREAD)
+// ===========================================================================================================================================================
+// CLOCK -----------------------------------------------------------------------------------------------------------------------------------------------------
+static float randomUniform(){                                                                                    // xorshift32 per node, repeatable runs
+  node->rng ^= node->rng << 13;
+  node->rng ^= node->rng >> 17;
+  node->rng ^= node->rng << 5;
+  return (node->rng >> 8) / 16777216.0f;
+}
+
+uint32_t halMillis(){
+  return hostMicros() / 1000;                                                                                    // Real time: the network and the broker are real
+}
+
+uint64_t halMicros(){
+  return hostMicros();
+}
+
+void halDelayMs(uint32_t ms){
+  usleep(ms * 1000ULL);
+}
+
+uint64_t halEpochMs(){
+  return startEpochMs + (uint64_t)(hostMicros() / 1000 * options.scale);                                         // Simulated wall clock: readings, batch ages and the sleep plans run --scale times faster
+}
+
+void halDeepSleep(uint64_t seconds){
+  node->sleepS = seconds;                                                                                        // nodeThread() sleeps it, compressed, once the wake returns
+}
+// CLOCK END -------------------------------------------------------------------------------------------------------------------------------------------------
+
+// POWER -----------------------------------------------------------------------------------------------------------------------------------------------------
+bool halPowerBegin(){
+  return true;
+}
+
+void halSensorPower(bool){}
+
+void halMoisturePower(bool){}
+
+float halBatteryVoltage(){
+  float low = 3.0f, high = 4.25f;
+  for(uint8_t i = 0; i < 20; i++){                                                                               // Inverse of the firmware's LiPo curve, so the scheduler sees the charge the model holds
+    float mid = (low + high) / 2.0f;
+    if(batteryStateOfCharge(mid) < node->soc) low = mid;
+    else high = mid;
+  }
+  return (low + high) / 2.0f;
+}
+
+static void drawCharge(float mA, float seconds){
+  node->drawnmAh += mA * seconds / 3600.0f;
+  node->soc -= mA * seconds / 3600.0f / FLEET_BATTERY_MAH;
+  if(node->soc <= 0.0f && !node->dead){                                                                          // Brown-out: the node leaves the fleet
+    node->soc = 0.0f;
+    node->dead = true;
+    counters.deadBatteries++;
+  }
+}
+float halBatteryCurrentmA(){
+  return node->linkUp ? FLEET_CPU_MA + FLEET_RADIO_MA : FLEET_CPU_MA;
+}
+
+float halBatteryDrawnmAh(){
+  return node->drawnmAh;
+}
+
+float halVbusVoltage(){
+  return 0.0f;                                                                                                   // Never on USB
+}
+// POWER END -------------------------------------------------------------------------------------------------------------------------------------------------
+
+// SENSORS ---------------------------------------------------------------------------------------------------------------------------------------------------
+void halTemperatureBegin(){}                                                                                     // The readings come from acquire() below, the buses stay idle
+
+uint8_t halTemperatureSearch(uint8_t (*)[HAL_PROBE_ROM_LEN], uint8_t){
+  return 0;
+}
+
+void halTemperatureResolution(uint8_t){}
+
+uint32_t halTemperatureConversionMs(){
+  return 0;
+}
+
+void halTemperatureRequest(){}
+
+bool halTemperatureReady(){
+  return true;
+}
+
+float halTemperatureReadC(const uint8_t*){
+  return NAN;
+}
+
+void halAnalogBegin(){}
+
+size_t halAnalogBurst(uint8_t, uint16_t*, size_t){
+  return 0;
+}
+
+uint32_t halAnalogMillivolts(uint16_t raw){
+  return raw;
+}
+// SENSORS END -----------------------------------------------------------------------------------------------------------------------------------------------
+
+// NETWORK LINK ----------------------------------------------------------------------------------------------------------------------------------------------
+bool halNetworkUp(uint32_t timeoutMs){
+  if(node->linkUp) return true;
+  if(randomUniform() * 100.0f < options.wifiFailPct || timeoutMs < options.joinMs){                              // AP down, the whole attempt is spent scanning
+    halDelayMs(timeoutMs);
+    counters.wifiFailures++;
+    return false;
+  }
+  halDelayMs(options.joinMs);
+  node->linkUp = true;
+  return true;
+}
+
+void halNetworkDown(){
+  node->linkUp = false;
+}
+
+bool halNetworkConnected(){
+  return node->linkUp;
+}
+// NETWORK LINK END ------------------------------------------------------------------------------------------------------------------------------------------
+
+// MQTT TRANSPORT --------------------------------------------------------------------------------------------------------------------------------------------
+static void forgetInflight(){                                                                                    // Connection gone: uplinkRewind() sends them again under new ids
+  for(uint64_t& sentUs : node->sentUs){
+    if(sentUs != 0) counters.inflight--;
+    sentUs = 0;
+  }
+}
+
+bool halMqttConnect(const char* host, uint16_t port, const char* clientId, const char* user){
+  (void)host;
+  (void)port;
+  if(node->mqtt.fd >= 0) return true;
+  if(!node->linkUp) return false;
+
+  uint64_t t0 = hostMicros();
+  bool ok = tcpOpen(node->mqtt);
+  uint64_t t1 = hostMicros();
+  bool resumed = false;
+  if(ok && !options.plain){
+    ok = tlsOpen(node->mqtt, &node->tlsSession, resumed);
+    if(ok) recordTlsHandshake(node->tlsStats, resumed, (hostMicros() - t1) / 1000);
+    else recordTlsHandshakeFailure(node->tlsStats);
+  }
+  uint64_t t2 = hostMicros();
+  ok = ok && mqttSendConnect(node->mqtt, clientId, user) && mqttReadConnack(node->mqtt);
+  if(!ok){
+    connClose(node->mqtt);
+    counters.connectFailures++;
+    return false;
+  }
+  node->latencies.tcpUs.push_back(t1 - t0);
+  if(!options.plain) node->latencies.tlsUs.push_back(t2 - t1);
+  node->latencies.connackUs.push_back(hostMicros() - t2);
+  counters.connects++;
+  return true;
+}
+
+bool halMqttPublish(const char* topic, const uint8_t* payload, size_t len){
+  if(node->mqtt.fd < 0 || !mqttSendPublish(node->mqtt, topic, payload, len, -1)) return false;
+  if(strcmp(topic, MQTT_TOPIC_PUB) == 0) counters.telemetrySent++;                                               // Link stats: QoS 0, counted as delivered to the broker once written
+  return true;
+}
+
+bool halMqttPublishQos1(const char* topic, const uint8_t* payload, size_t len, uint16_t packetId){
+  if(node->mqtt.fd < 0) return false;
+  if(randomUniform() * 100.0f < options.dropPct){                                                                // Injected: the AP or the broker drops the connection mid-flush
+    counters.drops++;
+    return false;
+  }
+  if(!mqttSendPublish(node->mqtt, topic, payload, len, packetId)) return false;
+  counters.bytesSent += len;
+  uint64_t& sentUs = node->sentUs[packetId % (sizeof(node->sentUs) / sizeof(node->sentUs[0]))];
+  if(sentUs == 0) counters.inflight++;
+  sentUs = hostMicros();
+  return true;
+}
+
+bool halMqttSubscribe(const char* topic){
+  if(node->mqtt.fd < 0) return false;
+  uint8_t packet[5 + 2 + 2 + 256 + 1];
+  node->subscribeId = node->subscribeId == 0xFFFF ? 1 : node->subscribeId + 1;
+  size_t n = mqttSubscribePacket(packet, sizeof(packet), topic, node->subscribeId);
+  return n > 0 && connWrite(node->mqtt, packet, n);
+}
+
+static HalMqttHandler mqttHandler = NULL;                                                                        // Same for every node, it acts on the calling thread's one
+
+void halMqttOnMessage(HalMqttHandler handler){
+  mqttHandler = handler;
+}
+
+static int readPacket(uint32_t waitMs, uint8_t& type, uint8_t* body, size_t& length){                            // 1 with a packet, 0 if none started within waitMs, HAL_MQTT_LOST
+  if(!connWait(node->mqtt, waitMs)) return 0;
+  if(!mqttReadPacket(node->mqtt, type, body, HAL_MQTT_RX_MAX_LEN, length)) return HAL_MQTT_LOST;
+  char topic[257];
+  const uint8_t* payload;
+  size_t payloadLen;
+  if(mqttIsQos0Publish(type) && mqttHandler != NULL && mqttSplitPublish(body, length, topic, sizeof(topic), payload, payloadLen)){
+    mqttHandler(topic, payload, payloadLen);                                                                     // Attribute responses, subscribed at QoS 0 as on the device
+  }
+  return 1;
+}
+
+bool halMqttConnected(){
+  return node->mqtt.fd >= 0;
+}
+
+bool halMqttLoop(){
+  if(node->mqtt.fd < 0) return false;
+  uint8_t type, body[HAL_MQTT_RX_MAX_LEN];
+  size_t length;
+  int got;
+  while((got = readPacket(0, type, body, length)) > 0){}                                                         // Whatever is queued, SUBACK dropped
+  if(got == HAL_MQTT_LOST){
+    connClose(node->mqtt);
+    forgetInflight();
+    return false;
+  }
+  return true;
+}
+
+int32_t halMqttPollAck(uint32_t waitMs){
+  if(node->mqtt.fd < 0) return HAL_MQTT_LOST;
+  uint64_t startUs = hostMicros();
+  while(true){
+    uint64_t elapsedMs = (hostMicros() - startUs) / 1000;
+    uint8_t type, body[HAL_MQTT_RX_MAX_LEN];
+    size_t length;
+    int got = readPacket(elapsedMs < waitMs ? waitMs - elapsedMs : 0, type, body, length);
+    if(got <= 0) return got == 0 ? HAL_MQTT_NO_ACK : HAL_MQTT_LOST;
+    if(!mqttIsPuback(type, length)) continue;
+
+    int32_t packetId = (body[0] << 8) | body[1];
+    uint64_t& sentUs = node->sentUs[packetId % (sizeof(node->sentUs) / sizeof(node->sentUs[0]))];
+    if(sentUs != 0){
+      node->latencies.pubackUs.push_back(hostMicros() - sentUs);
+      counters.inflight--;
+      counters.messagesAcked++;
+      sentUs = 0;
+    }
+    return packetId;
+  }
+}
+
+void halMqttDisconnect(){
+  if(node->mqtt.fd < 0) return;
+  static const uint8_t disconnect[] = {MQTT_DISCONNECT, 0x00};
+  connWrite(node->mqtt, disconnect, sizeof(disconnect));
+  if(node->mqtt.ssl != NULL) keepTlsSession(node->mqtt, node->tlsSession);
+  connClose(node->mqtt);
+  forgetInflight();
+}
+// MQTT TRANSPORT END ----------------------------------------------------------------------------------------------------------------------------------------
+
+// SETTINGS AND TELEMETRY LOG FLASH --------------------------------------------------------------------------------------------------------------------------
+bool halSettingsGetU32(const char* key, uint32_t& value){
+  (void)key;
+  (void)value;
+  return false;                                                                                                  // Blank NVS: build defaults for the shared attributes
+}
+
+bool halSettingsSetU32(const char* key, uint32_t value){
+  (void)key;
+  (void)value;
+  return true;
+}
+
+bool halIdentityGetStr(const char*, char*, size_t){
+  return false;                                                                                                  // Identities come from --devices or are generated (loadDevices())
+}
+
+bool halIdentityGetI32(const char*, int32_t&){
+  return false;
+}
+
+uint32_t halLogSize(){
+  return sizeof(node->flash);
+}
+
+bool halLogRead(uint32_t offset, void* data, size_t len){
+  if(offset + len > sizeof(node->flash)) return false;
+  memcpy(data, node->flash + offset, len);
+  return true;
+}
+
+bool halLogWrite(uint32_t offset, const void* data, size_t len){
+  if(offset + len > sizeof(node->flash)) return false;
+  for(size_t i = 0; i < len; i++) node->flash[offset + i] &= ((const uint8_t*)data)[i];                          // NOR flash: bits only go from 1 to 0
+  return true;
+}
+
+bool halLogErase(uint32_t offset){
+  if(offset >= sizeof(node->flash)) return false;
+  memset(node->flash + offset / HAL_LOG_SECTOR_SIZE * HAL_LOG_SECTOR_SIZE, 0xFF, HAL_LOG_SECTOR_SIZE);
+  return true;
+}
+// SETTINGS AND TELEMETRY LOG FLASH END ----------------------------------------------------------------------------------------------------------------------
+
+// NOT MODELLED: LORA, FIRMWARE UPDATES ----------------------------------------------------------------------------------------------------------------------
+bool halLoraTransmit(const uint8_t*, size_t){
+  return false;
+}
+
+void halHmacSha256(const uint8_t* key, size_t keyLen, const uint8_t* data, size_t len, uint8_t* mac){
+  HMAC(EVP_sha256(), key, keyLen, data, len, mac, NULL);
+}
+
+uint32_t halRandom(){
+  return 0;                                                                                                      // LoRa session nonce only
+}
+
+bool halHttpOpen(const char*, uint32_t){
+  return false;                                                                                                  // No fwUrl is ever offered to the fleet
+}
+
+bool halHttpRead(uint8_t*, size_t){
+  return false;
+}
+
+void halHttpClose(){}
+
+uint32_t halOtaSlotSize(){
+  return 0;
+}
+
+bool halOtaWrite(uint32_t, const void*, size_t){
+  return false;
+}
+
+bool halOtaDigest(uint32_t, uint8_t*){
+  return false;
+}
+
+bool halOtaActivate(){
+  return false;
+}
+
+bool halOtaTrialBoot(){
+  return false;
+}
+
+void halOtaConfirm(){}
+
+size_t halInflate(const uint8_t*, size_t, uint8_t*, size_t){
+  return 0;
+}
+
+bool halVerifySignature(const uint8_t*, size_t, const uint8_t*, size_t){
+  return false;
+}
+// NOT MODELLED END ------------------------------------------------------------------------------------------------------------------------------------------
+// HAL END ===================================================================================================================================================
+
+// ===========================================================================================================================================================
+// VIRTUAL NODE
+// ===========================================================================================================================================================
+// WakeHooks of a virtual node: modelled readings, the simulated Wi-Fi join and the real broker ------------------------------------------------------------
+static void acquire(WakeRunner&, float* temperaturesC, float& moisturePercent){
+  uint64_t nowMs = halEpochMs();
+  float dayPhase = 6.2831853f * ((nowMs / 1000) % 86400) / 86400.0f;
+  for(uint8_t slot = 0; slot < PROBE_MAX_COUNT; slot++){                                                         // Daily wave, damped and late with depth, plus probe noise
+    temperaturesC[slot] = 16.0f + 3.0f * expf(-slot * 1.25f) * sinf(dayPhase - 2.6f - slot * 1.25f) + (randomUniform() - 0.5f) * 0.2f;
+  }
+  node->moisture = fminf(fmaxf(node->moisture + (randomUniform() - 0.52f) * 2.0f, 5.0f), 95.0f);                 // Slowly drying random walk
+  moisturePercent = node->moisture;
+  usleep(FLEET_SAMPLING_MS * 1000.0f / options.scale);
+  drawCharge(FLEET_CPU_MA, FLEET_SAMPLING_MS / 1000.0f);
+}
+
+static bool join(WakeRunner&, uint32_t timeoutMs){
+  return halNetworkUp(timeoutMs);
+}
+
+static bool connect(WakeRunner& run){
+  return halMqttConnect(options.host, options.port, run.identity->clientId, run.identity->token);
+}
+
+static void report(WakeRunner&, WakeNote note, uint32_t){
+  if(note == WAKE_FLUSHED) counters.delivered++;
+  if(note == WAKE_BUDGET_SPENT) counters.expired++;
+}
+
+static const WakeHooks hooks = {acquire, join, connect, NULL, NULL, NULL, NULL, report, NULL};
+
+static void handleAttributes(const char* topic, const uint8_t* payload, size_t len){
+  wakeHandleAttributes(node->run, topic, payload, len);
+}
+
+// One wake, as setup() and MQTTTask in main.cpp run it ------------------------------------------------------------------------------------------------------
+static void runWake(){
+  WakeRunner& run = node->run;
+  counters.wakes++;
+  counters.awake++;
+  wakeBegin(run, node->kept, node->identity, hooks);
+  wakePlanAcquisition(run);
+  switch(wakeDecide(run)){
+    case WAKE_QUIET:
+    case WAKE_LORA:                                                                                              // Never: the fleet has no uplink=lora identities
+      runQuietWake(run);
+      break;
+    case WAKE_RADIO:{
+      uint64_t flushStartUs = hostMicros();
+      counters.flushes++;
+      runRadioWake(run, node->rng);
+      drawCharge(FLEET_CPU_MA + FLEET_RADIO_MA, (hostMicros() - flushStartUs) / 1e6f);                           // Real time: the joins, the backoff and the broker are not compressed
+      counters.readingsAcked += run.uplink.readingsAcked;
+      counters.rewinds += run.uplink.rewinds;
+      break;
+    }
+  }
+  halMqttDisconnect();                                                                                           // What the deep sleep does to the connection
+  halNetworkDown();
+  counters.awake--;
+}
+
+static bool sleepReal(double seconds){                                                                           // False once the test is over
+  std::unique_lock<std::mutex> lock(stopMutex);
+  return !stopSignal.wait_for(lock, std::chrono::duration<double>(seconds), []{ return stopping.load(); });
+}
+
+static void* nodeThread(void* arg){
+  node = (FleetNode*)arg;
+  deviceConfigBegin(node->kept.config);
+  telemetryLogBegin(node->kept.log);
+  double firstS = options.burst ? 0.0 : randomUniform() * BATCH_DEPTH * SLEEP_DURATION_S;                        // Power-ons scattered over one batch, so the flushes are too
+  if(!sleepReal(firstS / options.scale)) return NULL;
+  while(!node->dead){
+    runWake();
+    double sleepS = node->sleepS * (1.0 + options.jitterPct / 100.0 * (2.0 * randomUniform() - 1.0));            // RTC drift, boot time and the scheduler's own changes
+    drawCharge(FLEET_SLEEP_MA, sleepS);
+    if(!sleepReal(sleepS / options.scale)) break;
+  }
+  return NULL;
+}
+// VIRTUAL NODE END ==========================================================================================================================================
+
+// ===========================================================================================================================================================
+// BROKER BACKLOG MONITOR
+// ===========================================================================================================================================================
+static void* monitorThread(void*){
+  Connection c;
+  bool resumed;
+  uint8_t subscribe[5 + 2 + 2 + 64 + 1];
+  size_t n = mqttSubscribePacket(subscribe, sizeof(subscribe), MQTT_TOPIC_PUB, 1);
+  if(!tcpOpen(c) || (!options.plain && !tlsOpen(c, NULL, resumed)) || !mqttSendConnect(c, "fleetLoad_monitor", NULL) || !mqttReadConnack(c) ||
+     !connWrite(c, subscribe, n)){
+    fprintf(stderr, "monitor: cannot subscribe to %s, no broker backlog\n", MQTT_TOPIC_PUB);
+    connClose(c);
+    return NULL;
+  }
+  while(true){
+    if(!connWait(c, 1000)) continue;
+    uint8_t type, body[64];
+    size_t length;
+    if(!mqttReadPacket(c, type, body, sizeof(body), length)) break;
+    if((type & 0xF0) == MQTT_PUBLISH) counters.monitorReceived++;
+  }
+  connClose(c);
+  return NULL;
+}
+// BROKER BACKLOG MONITOR END ================================================================================================================================
+
+// ===========================================================================================================================================================
+// REPORT
+// ===========================================================================================================================================================
+static int64_t brokerBacklog(){
+  return (int64_t)(counters.messagesAcked + counters.telemetrySent) - (int64_t)counters.monitorReceived;
+}
+
+static void printPercentiles(const char* name, std::vector<uint32_t>& us){
+  if(us.empty()){
+    printf("  %-14s %8s\n", name, "-");
+    return;
+  }
+  std::sort(us.begin(), us.end());
+  auto at = [&](double p){ return us[std::min(us.size() - 1, (size_t)(us.size() * p))] / 1000.0; };
+  printf("  %-14s %8.1f %8.1f %8.1f %8.1f %8u\n", name, at(0.5), at(0.9), at(0.99), us.back() / 1000.0, (unsigned)us.size());
+}
+
+static void loadDevices(){
+  FILE* csv = options.devicesFile ? fopen(options.devicesFile, "r") : NULL;
+  if(options.devicesFile && csv == NULL) fprintf(stderr, "cannot read %s, generated identities only\n", options.devicesFile);
+  char line[512];
+  static const WakeRetained powerOn = WAKE_RETAINED_INIT;
+  for(uint32_t i = 0; i < options.nodes; i++){
+    FleetNode* n = new FleetNode();
+    n->index = i;
+    n->rng = 0x9E3779B9u * (i + 1);
+    n->kept = powerOn;
+    n->moisture = 40.0f;
+    bool fromFile = false;
+    while(csv != NULL && !fromFile && fgets(line, sizeof(line), csv) != NULL){                                   // nvsProvision format, the Wi-Fi fields are not used here
+      if(line[0] == '#' || strncmp(line, "clientId,", 9) == 0) continue;
+      long treeId;
+      fromFile = sscanf(line, "%32[^,],%32[^,],%ld", n->identity.clientId, n->identity.token, &treeId) == 3;
+      n->identity.treeId = treeId;
+    }
+    if(!fromFile){
+      snprintf(n->identity.clientId, sizeof(n->identity.clientId), "fleet_%05u", i);
+      snprintf(n->identity.token, sizeof(n->identity.token), "FLEET%015u", i);                                   // 20 characters, like a ThingsBoard token
+      n->identity.treeId = 1000 + i;
+    }
+    n->identity.provisioned = true;
+    node = n;
+    n->soc = options.socMin + (1.0f - options.socMin) * randomUniform();
+    fleet.push_back(n);
+  }
+  node = NULL;
+  if(csv != NULL) fclose(csv);
+}
+// REPORT END ================================================================================================================================================
+
+// ===========================================================================================================================================================
+// MAIN
+// ===========================================================================================================================================================
+static bool parseOptions(int argc, char** argv){
+  static const struct option longOptions[] = {
+    {"ca", required_argument, NULL, 'c'}, {"insecure", no_argument, NULL, 'k'}, {"plain", no_argument, NULL, 'P'},
+    {"devices", required_argument, NULL, 'd'}, {"scale", required_argument, NULL, 's'}, {"burst", no_argument, NULL, 'b'},
+    {"jitter", required_argument, NULL, 'j'}, {"join-ms", required_argument, NULL, 'J'}, {"wifi-fail", required_argument, NULL, 'w'},
+    {"drop", required_argument, NULL, 'D'}, {"soc-min", required_argument, NULL, 'S'}, {"monitor", no_argument, NULL, 'm'},
+    {"report", required_argument, NULL, 'r'}, {NULL, 0, NULL, 0},
+  };
+  int option;
+  while((option = getopt_long(argc, argv, "n:H:p:t:", longOptions, NULL)) != -1){
+    switch(option){
+      case 'n': options.nodes = strtoul(optarg, NULL, 10); break;
+      case 'H': options.host = optarg; break;
+      case 'p': options.port = atoi(optarg); break;
+      case 't': options.durationS = strtoul(optarg, NULL, 10); break;
+      case 'c': options.caFile = optarg; break;
+      case 'k': options.insecure = true; break;
+      case 'P': options.plain = true; break;
+      case 'd': options.devicesFile = optarg; break;
+      case 's': options.scale = atof(optarg); break;
+      case 'b': options.burst = true; break;
+      case 'j': options.jitterPct = atof(optarg); break;
+      case 'J': options.joinMs = strtoul(optarg, NULL, 10); break;
+      case 'w': options.wifiFailPct = atof(optarg); break;
+      case 'D': options.dropPct = atof(optarg); break;
+      case 'S': options.socMin = atof(optarg); break;
+      case 'm': options.monitor = true; break;
+      case 'r': options.reportS = strtoul(optarg, NULL, 10); break;
+      default: return false;
+    }
+  }
+  return optind == argc && options.nodes > 0 && options.scale > 0.0f && options.reportS > 0 &&
+         (options.plain || options.insecure || options.caFile != NULL);
+}
+
+int main(int argc, char** argv){
+  if(!parseOptions(argc, argv)){
+    fprintf(stderr, "usage: %s [-n nodes] [-H host] [-p port] [-t seconds] (--ca FILE | --insecure | --plain) [--devices FILE] [--scale K] [--burst]\n"
+                    "       [--jitter PCT] [--join-ms MS] [--wifi-fail PCT] [--drop PCT] [--soc-min X] [--monitor] [--report S]\n", argv[0]);
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  struct rlimit files;
+  getrlimit(RLIMIT_NOFILE, &files);
+  files.rlim_cur = files.rlim_max;                                                                               // One socket per node
+  setrlimit(RLIMIT_NOFILE, &files);
+
+  if(!options.plain){
+    tlsContext = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_mode(tlsContext, SSL_MODE_AUTO_RETRY);
+    SSL_CTX_set_session_cache_mode(tlsContext, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);        // Sessions live in each node's TlsSessionCache only
+    if(options.insecure){
+      SSL_CTX_set_verify(tlsContext, SSL_VERIFY_NONE, NULL);
+    }else if(SSL_CTX_load_verify_locations(tlsContext, options.caFile, NULL) != 1){
+      fprintf(stderr, "cannot load %s\n", options.caFile);
+      return 1;
+    }else{
+      SSL_CTX_set_verify(tlsContext, SSL_VERIFY_PEER, NULL);
+    }
+  }
+
+  startTime = std::chrono::steady_clock::now();
+  startEpochMs = (uint64_t)time(NULL) * 1000ULL;
+  loadDevices();
+  printf("%u nodes against %s:%u (%s), %u s at %.0fx, %s, batch %u, window %u\n", options.nodes, options.host, options.port,
+         options.plain ? "plain MQTT" : "MQTT over TLS", options.durationS, options.scale, options.burst ? "all waking at once" : "spread wakes",
+         BATCH_DEPTH, MQTT_INFLIGHT_WINDOW);
+
+  halMqttOnMessage(handleAttributes);
+  pthread_t monitor;
+  if(options.monitor) pthread_create(&monitor, NULL, monitorThread, NULL);
+  pthread_attr_t attributes;
+  pthread_attr_init(&attributes);
+  pthread_attr_setstacksize(&attributes, FLEET_STACK_SIZE);
+  for(FleetNode* n : fleet){
+    if(pthread_create(&n->thread, &attributes, nodeThread, n) != 0){
+      fprintf(stderr, "cannot start node %u, raise the thread limit (ulimit -u)\n", n->index);
+      return 1;
+    }
+  }
+
+  printf("%6s %6s %10s %10s %10s %10s %9s %8s\n", "t s", "awake", "connects/s", "messages/s", "readings/s", "failures/s", "in flight", "backlog");
+  uint64_t lastConnects = 0, lastMessages = 0, lastReadings = 0, lastFailures = 0;
+  int64_t maxInflight = 0, maxBacklog = 0;
+  for(uint32_t t = options.reportS; t <= options.durationS; t += options.reportS){
+    for(uint32_t i = 0; i < options.reportS * 10; i++){                                                          // Gauges sampled at 10 Hz, the line at --report
+      usleep(100000);
+      maxInflight = std::max(maxInflight, counters.inflight.load());
+      if(options.monitor) maxBacklog = std::max(maxBacklog, brokerBacklog());
+    }
+    uint64_t failures = counters.connectFailures + counters.wifiFailures + counters.drops;
+    printf("%6u %6ld %10.1f %10.1f %10.1f %10.1f %9ld %8s\n", t, (long)counters.awake.load(), (counters.connects - lastConnects) / (double)options.reportS,
+           (counters.messagesAcked - lastMessages) / (double)options.reportS, (counters.readingsAcked - lastReadings) / (double)options.reportS,
+           (failures - lastFailures) / (double)options.reportS, (long)counters.inflight.load(),
+           options.monitor ? std::to_string(brokerBacklog()).c_str() : "-");
+    fflush(stdout);
+    lastConnects = counters.connects;
+    lastMessages = counters.messagesAcked;
+    lastReadings = counters.readingsAcked;
+    lastFailures = failures;
+  }
+
+  double elapsedS = hostMicros() / 1e6;
+  uint64_t bytesUntilStop = counters.bytesSent, messagesUntilStop = counters.messagesAcked, readingsUntilStop = counters.readingsAcked;
+  {
+    std::lock_guard<std::mutex> lock(stopMutex);
+    stopping = true;
+  }
+  stopSignal.notify_all();
+  for(FleetNode* n : fleet) pthread_join(n->thread, NULL);                                                       // Wakes in progress finish, bounded by LINK_WAKE_BUDGET_MS
+  double drainS = -1.0;
+  if(options.monitor){
+    uint64_t drainStartUs = hostMicros();
+    while(brokerBacklog() > 0 && hostMicros() - drainStartUs < 10000000ULL) usleep(10000);
+    if(brokerBacklog() <= 0) drainS = (hostMicros() - drainStartUs) / 1e6;
+  }
+
+  Latencies all;
+  uint32_t fullHandshakes = 0, resumedHandshakes = 0;
+  float minSoc = 1.0f;
+  for(FleetNode* n : fleet){
+    all.tcpUs.insert(all.tcpUs.end(), n->latencies.tcpUs.begin(), n->latencies.tcpUs.end());
+    all.tlsUs.insert(all.tlsUs.end(), n->latencies.tlsUs.begin(), n->latencies.tlsUs.end());
+    all.connackUs.insert(all.connackUs.end(), n->latencies.connackUs.begin(), n->latencies.connackUs.end());
+    all.pubackUs.insert(all.pubackUs.end(), n->latencies.pubackUs.begin(), n->latencies.pubackUs.end());
+    fullHandshakes += n->tlsStats.fullHandshakes;
+    resumedHandshakes += n->tlsStats.resumedHandshakes;
+    minSoc = std::min(minSoc, n->soc);
+  }
+
+  printf("\n%lu wakes, %lu flushes: %lu delivered, %lu out of wake budget, %u batteries flat (lowest %.0f %%)\n", (unsigned long)counters.wakes.load(),
+         (unsigned long)counters.flushes.load(), (unsigned long)counters.delivered.load(), (unsigned long)counters.expired.load(),
+         counters.deadBatteries.load(), minSoc * 100.0f);
+  printf("%lu connects, %lu refused or timed out, %lu Wi-Fi joins failed, %lu connections dropped, %lu rewinds\n", (unsigned long)counters.connects.load(),
+         (unsigned long)counters.connectFailures.load(), (unsigned long)counters.wifiFailures.load(), (unsigned long)counters.drops.load(),
+         (unsigned long)counters.rewinds.load());
+  if(!options.plain) printf("TLS: %u full handshakes, %u resumed (%u %%)\n", fullHandshakes, resumedHandshakes,
+                            fullHandshakes + resumedHandshakes ? 100 * resumedHandshakes / (fullHandshakes + resumedHandshakes) : 0);
+  printf("latency (ms)        p50      p90      p99      max  samples\n");
+  printPercentiles("TCP connect", all.tcpUs);
+  if(!options.plain) printPercentiles("TLS handshake", all.tlsUs);
+  printPercentiles("CONNACK", all.connackUs);
+  printPercentiles("PUBACK", all.pubackUs);
+  printf("throughput: %.1f messages/s, %.1f readings/s acknowledged, %.1f kB/s of QoS 1 payload sent, over %.0f s\n", messagesUntilStop / elapsedS,
+         readingsUntilStop / elapsedS, bytesUntilStop / elapsedS / 1000.0, elapsedS);
+  printf("backlog: up to %ld QoS 1 messages waiting for a PUBACK", (long)maxInflight);
+  if(options.monitor){
+    printf(", up to %ld acknowledged and not yet delivered to a subscriber, ", (long)maxBacklog);
+    if(drainS >= 0.0) printf("drained %.2f s after the last wake\n", drainS);
+    else printf("%ld still undelivered 10 s after the last wake\n", (long)brokerBacklog());
+  }else{
+    printf("\n");
+  }
+  return 0;
+}
+// MAIN END ==================================================================================================================================================
\ No newline at end of file
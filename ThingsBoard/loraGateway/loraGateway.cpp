@@ -0,0 +1,238 @@
+// Host-side gateway for the LoRa uplink (UPLINK_LORA in macros.h, loraUplink.h)
+//
+// Reads one received frame per line from stdin, as the receiver in front of it prints them: a second T-Beam listening with the same LORA_* settings, a
+// concentrator's packet forwarder, or the SIM_LORA file of the host simulation:
+//
+//   <rx epoch ms> <rssi dBm> <snr dB> <hex frame>                                # rx time 0: stamped with this host's clock
+//
+// Each frame is checked against the token of the device its address belongs to (the devices.csv of nvsProvision), repeats heard by several receivers are
+// dropped, and the readings are written on stdout as ThingsBoard gateway API telemetry, one line per frame, so every node still shows up as its own device:
+//
+//   <receiver> | ./loraGateway ../nvsProvision/devices.csv |
+//     mosquitto_pub -h <thingsboard> -p 1883 -u <GATEWAY_TOKEN> -t 'v1/gateway/telemetry' -l
+//
+// Devices are named by their clientId. loraFcnt, loraRssi and loraSnr go with every reading, lost frames (gaps in the counter) are reported on stderr.
+//
+// Build (from this folder):
+//   M=../../mt_soil_quality_sensor
+//   g++ -std=c++11 -O2 -I$M/include -I$M/lib/TelemetrySerializer loraGateway.cpp $M/src/loraFrame.cpp $M/src/telemetryBuffer.cpp -o loraGateway -lcrypto
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include "loraFrame.h"                                                                                           // Frame layout, MIC and schema (LORA_FIELDS) shared with the firmware
+#include "deviceIdentity.h"
+
+#define GATEWAY_RECENT_FRAMES 16                                                                                 // Counters remembered per device to drop repeats, forgotten when the session changes
+#define GATEWAY_MAX_GAP 1000                                                                                     // A jump larger than this is a frame from long ago, not lost frames
+#define GATEWAY_JSON_MAX_LEN 8192
+
+struct Device {
+  std::string clientId;
+  std::string token;
+  long treeId;
+  bool heard;
+  uint16_t session;
+  uint16_t recent[GATEWAY_RECENT_FRAMES];
+  uint8_t recentCount;
+  uint8_t recentNext;
+  uint32_t frames;
+  uint32_t lost;
+};
+
+// DEVICE LIST (devices.csv OF nvsProvision) -----------------------------------------------------------------------------------------------------------------
+static std::vector<std::string> splitLine(const char* line){
+  std::vector<std::string> fields(1);
+  for(const char* c = line; *c != '\0' && *c != '\n' && *c != '\r'; c++){
+    if(*c == ',') fields.push_back("");
+    else fields.back() += *c;
+  }
+  return fields;
+}
+
+static bool loadDevices(const char* path, std::map<uint32_t, Device>& devices){
+  FILE* csv = fopen(path, "r");
+  if(csv == NULL){
+    fprintf(stderr, "cannot read %s\n", path);
+    return false;
+  }
+  char line[512];
+  unsigned lineNumber = 0, errors = 0;
+  while(fgets(line, sizeof(line), csv) != NULL){
+    lineNumber++;
+    if(line[0] == '#' || line[0] == '\n' || line[0] == '\r' || strncmp(line, "clientId,", 9) == 0) continue;
+    std::vector<std::string> fields = splitLine(line);
+    if(fields.size() < 3 || fields[0].empty() || fields[1].empty()){
+      fprintf(stderr, "%s:%u: expected clientId,token,treeId,...\n", path, lineNumber);
+      errors++;
+      continue;
+    }
+    Device device = {};
+    device.clientId = fields[0];
+    device.token = fields[1];
+    device.treeId = strtol(fields[2].c_str(), NULL, 10);
+    uint32_t address = loraDeviceAddress(device.clientId.c_str());
+    if(!devices.insert(std::make_pair(address, device)).second){                                                 // Both nodes would be told apart by the MIC only, and the second one would always fail it
+      fprintf(stderr, "%s:%u: %s has the same LoRa address (%08x) as %s, rename one\n", path, lineNumber, device.clientId.c_str(), (unsigned)address,
+              devices[address].clientId.c_str());
+      errors++;
+    }
+  }
+  fclose(csv);
+  return errors == 0 && !devices.empty();
+}
+// DEVICE LIST END -------------------------------------------------------------------------------------------------------------------------------------------
+
+// FRAME CHECKS ----------------------------------------------------------------------------------------------------------------------------------------------
+static size_t hexToBytes(const char* hex, uint8_t* out, size_t outSize){                                         // Same as telemetryBridge, 0 on bad input
+  size_t len = 0;
+  while(*hex && !isspace((unsigned char)*hex)){
+    unsigned int b;
+    if(!isxdigit((unsigned char)hex[0]) || !isxdigit((unsigned char)hex[1]) || len >= outSize) return 0;
+    if(sscanf(hex, "%2x", &b) != 1) return 0;
+    out[len++] = (uint8_t)b;
+    hex += 2;
+  }
+  return len;
+}
+
+static bool micValid(const Device& device, const uint8_t* frame, size_t len){                                    // len includes the MIC
+  uint8_t mac[EVP_MAX_MD_SIZE];
+  unsigned int macLen = 0;
+  HMAC(EVP_sha256(), device.token.data(), (int)device.token.size(), frame, len - LORA_MIC_LEN, mac, &macLen);
+  return CRYPTO_memcmp(mac, frame + len - LORA_MIC_LEN, LORA_MIC_LEN) == 0;
+}
+
+static bool repeated(Device& device, const LoraFrameHeader& header){                                             // Remembers the counter when it is new
+  if(device.heard && header.session != device.session){                                                          // Power-on of the node, its counter starts over
+    fprintf(stderr, "%s: new session, frame counter restarted at %u\n", device.clientId.c_str(), header.counter);
+    device.heard = false;
+    device.recentCount = 0;
+    device.recentNext = 0;
+  }
+  device.session = header.session;
+
+  uint16_t counter = header.counter;
+  for(uint8_t i = 0; i < device.recentCount; i++) if(device.recent[i] == counter) return true;
+
+  if(device.heard){
+    uint16_t gap = (uint16_t)(counter - device.recent[(device.recentNext + GATEWAY_RECENT_FRAMES - 1) % GATEWAY_RECENT_FRAMES] - 1);
+    if(gap > 0 && gap < GATEWAY_MAX_GAP){
+      device.lost += gap;
+      fprintf(stderr, "%s: %u frames lost before %u (%u in total)\n", device.clientId.c_str(), gap, counter, (unsigned)device.lost);
+    }else if(gap >= GATEWAY_MAX_GAP){
+      fprintf(stderr, "%s: frame %u out of sequence\n", device.clientId.c_str(), counter);
+    }
+  }
+  device.recent[device.recentNext] = counter;
+  device.recentNext = (device.recentNext + 1) % GATEWAY_RECENT_FRAMES;
+  if(device.recentCount < GATEWAY_RECENT_FRAMES) device.recentCount++;
+  device.heard = true;
+  device.frames++;
+  return false;
+}
+// FRAME CHECKS END ------------------------------------------------------------------------------------------------------------------------------------------
+
+// GATEWAY API JSON: {"<clientId>":[{"ts":..,"values":{..}},..]} ---------------------------------------------------------------------------------------------
+static size_t frameToJson(const Device& device, const LoraFrameHeader& header, const LoraReading* readings, uint64_t rxMs, int rssi, float snr,
+                          char* out, size_t outSize){
+  JsonWriter writer(out, outSize);
+  writer.raw('{');
+  writer.key(device.clientId.c_str());
+  writer.raw('[');
+  for(uint8_t r = 0; r < header.records; r++){
+    const LoraReading& reading = readings[r];
+    if(r) writer.raw(',');
+    writer.raw("{\"ts\":");
+    writer.number((uint64_t)(rxMs - (uint64_t)reading.ageS * 1000ULL));                                          // Whole seconds: the node rounds every age on its own
+    writer.raw(",\"values\":{");
+    writer.key("treeId");
+    writer.number((int64_t)device.treeId);
+    writer.raw(',');
+    writer.key("bootCnt");
+    writer.number((uint64_t)reading.bootCnt);
+    for(size_t i = 0; i < LORA_FIELD_COUNT; i++){
+      writer.raw(',');
+      writer.key(LORA_FIELDS[i].key);
+      writer.value(reading.values[i], LORA_FIELDS[i].decimals);
+    }
+    writer.raw(',');
+    writer.key("loraFcnt");
+    writer.number((uint64_t)header.counter);
+    writer.raw(',');
+    writer.key("loraRssi");
+    writer.number((int64_t)rssi);
+    writer.raw(',');
+    writer.key("loraSnr");
+    writer.fixed(snr, 1);
+    writer.raw("}}");
+  }
+  writer.raw("]}");
+  return writer.finish();
+}
+// GATEWAY API JSON END --------------------------------------------------------------------------------------------------------------------------------------
+
+// ===========================================================================================================================================================
+// MAIN
+// ===========================================================================================================================================================
+int main(int argc, char** argv){
+  if(argc != 2){
+    fprintf(stderr, "usage: %s <devices.csv> < received frames\n", argv[0]);
+    return 1;
+  }
+  std::map<uint32_t, Device> devices;
+  if(!loadDevices(argv[1], devices)){
+    fprintf(stderr, "no usable device list\n");
+    return 1;
+  }
+
+  static char line[2 * LORA_FRAME_MAX_LEN + 128];
+  static uint8_t frame[LORA_FRAME_MAX_LEN];
+  static LoraReading readings[LORA_FRAME_MAX_RECORDS];
+  static char json[GATEWAY_JSON_MAX_LEN];
+  unsigned long long rxMs;
+  int rssi;
+  float snr;
+  int hexStart;
+  while(fgets(line, sizeof(line), stdin)){
+    size_t len = 0;
+    if(sscanf(line, "%llu %d %f %n", &rxMs, &rssi, &snr, &hexStart) == 3) len = hexToBytes(line + hexStart, frame, sizeof(frame));
+
+    LoraFrameHeader header;
+    if(len < LORA_FRAME_HEADER_LEN + LORA_MIC_LEN || !decodeLoraFrame(frame, len - LORA_MIC_LEN, header, readings, LORA_FRAME_MAX_RECORDS)){
+      fprintf(stderr, "Dropped malformed frame: %s", line);
+      continue;
+    }
+    std::map<uint32_t, Device>::iterator device = devices.find(header.address);
+    if(device == devices.end()){
+      fprintf(stderr, "Dropped frame from unknown address %08x\n", (unsigned)header.address);
+      continue;
+    }
+    if(!micValid(device->second, frame, len)){                                                                   // Corrupted past the radio CRC, or not sent by this node
+      fprintf(stderr, "Dropped frame %u of %s: bad MIC\n", header.counter, device->second.clientId.c_str());
+      continue;
+    }
+    if(repeated(device->second, header)) continue;                                                               // Heard by another receiver already
+
+    if(rxMs == 0){
+      struct timeval tv;
+      gettimeofday(&tv, NULL);
+      rxMs = (unsigned long long)tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+    }
+    if(frameToJson(device->second, header, readings, rxMs, rssi, snr, json, sizeof(json)) == 0){
+      fprintf(stderr, "Dropped frame %u of %s: too long for the output buffer\n", header.counter, device->second.clientId.c_str());
+      continue;
+    }
+    printf("%s\n", json);
+    fflush(stdout);                                                                                              // One line per frame, right away, for the piped publisher
+  }
+  return 0;
+}
+// MAIN END ==================================================================================================================================================
\ No newline at end of file
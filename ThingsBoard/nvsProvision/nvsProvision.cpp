@@ -0,0 +1,220 @@
+// Host-side generator of the per-device identity partitions (deviceIdentity.h)
+//
+// Reads one device per line of a CSV file and writes, for each one, an image of the 'ident' NVS partition (partitions.csv) holding its ThingsBoard
+// access token, MQTT client ID, tree ID and, optionally, its own Wi-Fi credentials and uplink. Every node then runs the same firmware.bin:
+//
+//   clientId,token,treeId,wifiSsid,wifiPassword,uplink                           # header line, '#' starts a comment line
+//   soil_quality_sensor_0,c0ar6qni65ev6515q845,0,,,                              # empty Wi-Fi and uplink fields: the firmware defaults (macros.h)
+//   soil_quality_sensor_7,Hq3mX8Wc2ZbL0nTe5RjA,7,,,lora                          # wifi or lora, LoRa frames go to ThingsBoard/loraGateway (same file)
+//
+//   ./nvsProvision devices.csv images/
+//   pio run -e soil_quality_sensor -t upload                                     # once per device, the same image for the whole fleet
+//   esptool.py --port COM5 write_flash 0x3ED000 images/soil_quality_sensor_0.bin # its identity, printed for every image
+//
+// No quoting, so tokens and passwords cannot hold commas. The images follow the ESP-IDF NVS format (version 2), the same nvs_partition_gen.py writes.
+//
+// Build (from this folder):
+//   g++ -std=c++11 -O2 -I../../mt_soil_quality_sensor/include nvsProvision.cpp -o nvsProvision -lz
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <zlib.h>
+#include "deviceIdentity.h"                                                                                      // Partition, namespace and keys shared with the firmware
+
+#define IDENTITY_PARTITION_OFFSET 0x3ED000                                                                       // ident in partitions.csv
+#define NVS_PAGE_SIZE 4096
+#define NVS_ENTRY_SIZE 32
+#define NVS_ENTRIES 126                                                                                          // After the 32 byte header and the 32 byte entry state bitmap
+#define NVS_PAGE_ACTIVE 0xFFFFFFFEUL
+#define NVS_VERSION_2 0xFE
+#define NVS_TYPE_U8 0x01
+#define NVS_TYPE_I32 0x14
+#define NVS_TYPE_STR 0x21
+#define NVS_NAMESPACE_INDEX 1                                                                                    // First and only namespace of the partition
+
+struct Device {
+  std::string clientId;
+  std::string token;
+  long treeId;
+  std::string wifiSsid;
+  std::string wifiPassword;
+  int32_t uplink;                                                                                                // IDENTITY_UPLINK_KEY value, -1 leaves the key out
+};
+
+// NVS PAGE --------------------------------------------------------------------------------------------------------------------------------------------------
+struct NvsPage {
+  uint8_t data[NVS_PAGE_SIZE];
+  uint8_t next;                                                                                                  // First free entry
+};
+
+static uint32_t nvsCrc(const uint8_t* data, size_t len){
+  return crc32(0xFFFFFFFF, data, len);                                                                           // esp_rom_crc32_le(0xFFFFFFFF, ...) on the device
+}
+
+static void nvsPageBegin(NvsPage& page){
+  memset(page.data, 0xFF, sizeof(page.data));
+  uint32_t state = NVS_PAGE_ACTIVE;
+  uint32_t sequence = 0;
+  memcpy(page.data, &state, 4);
+  memcpy(page.data + 4, &sequence, 4);
+  page.data[8] = NVS_VERSION_2;
+  uint32_t crc = nvsCrc(page.data + 4, 24);                                                                      // Sequence, version and the reserved bytes
+  memcpy(page.data + 28, &crc, 4);
+  page.next = 0;
+}
+
+// WRITES ONE ITEM: ITS HEADER ENTRY, THEN span - 1 DATA ENTRIES
+static bool nvsWrite(NvsPage& page, uint8_t ns, uint8_t type, const char* key, const uint8_t* value, size_t len){
+  uint8_t span = type == NVS_TYPE_STR ? 1 + (len + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE : 1;
+  if(page.next + span > NVS_ENTRIES || strlen(key) > 15) return false;                                           // One page is plenty for an identity, items never straddle two
+
+  uint8_t* entry = page.data + 64 + page.next * NVS_ENTRY_SIZE;
+  memset(entry, 0xFF, NVS_ENTRY_SIZE * span);
+  entry[0] = ns;
+  entry[1] = type;
+  entry[2] = span;
+  entry[3] = 0xFF;                                                                                               // Chunk index, only blobs use it
+  memset(entry + 8, 0, 16);
+  memcpy(entry + 8, key, strlen(key));
+  if(type == NVS_TYPE_STR){
+    uint16_t size = len;
+    uint32_t dataCrc = nvsCrc(value, len);
+    memcpy(entry + 24, &size, 2);                                                                                // Then 2 reserved bytes left at 0xFF
+    memcpy(entry + 28, &dataCrc, 4);
+    memcpy(entry + NVS_ENTRY_SIZE, value, len);
+  }else{
+    memcpy(entry + 24, value, len);
+  }
+  uint8_t crcInput[28];
+  memcpy(crcInput, entry, 4);
+  memcpy(crcInput + 4, entry + 8, 24);
+  uint32_t crc = nvsCrc(crcInput, sizeof(crcInput));
+  memcpy(entry + 4, &crc, 4);
+
+  for(uint8_t i = page.next; i < page.next + span; i++) page.data[32 + i / 4] &= ~(1 << (i % 4 * 2));            // 11 (empty) to 10 (written)
+  page.next += span;
+  return true;
+}
+
+static bool nvsWriteString(NvsPage& page, const char* key, const std::string& value){
+  return nvsWrite(page, NVS_NAMESPACE_INDEX, NVS_TYPE_STR, key, (const uint8_t*)value.c_str(), value.size() + 1); // Terminator included
+}
+// NVS PAGE END ----------------------------------------------------------------------------------------------------------------------------------------------
+
+// CSV INPUT -------------------------------------------------------------------------------------------------------------------------------------------------
+static std::vector<std::string> splitLine(const char* line){
+  std::vector<std::string> fields(1);
+  for(const char* c = line; *c != '\0' && *c != '\n' && *c != '\r'; c++){
+    if(*c == ',') fields.push_back("");
+    else fields.back() += *c;
+  }
+  return fields;
+}
+
+static bool validClientId(const std::string& clientId){                                                          // Also the image file name
+  if(clientId.empty() || clientId.size() > IDENTITY_CLIENT_MAX_LEN) return false;
+  for(char c : clientId) if(!isalnum((unsigned char)c) && c != '_' && c != '-') return false;
+  return true;
+}
+
+static bool parseDevice(const char* line, Device& device, const char*& problem){
+  std::vector<std::string> fields = splitLine(line);
+  if(fields.size() != 5 && fields.size() != 6){                                                                  // The uplink column is optional, older files have 5
+    problem = "expected 5 or 6 fields";
+    return false;
+  }
+  char* end;
+  device.clientId = fields[0];
+  device.token = fields[1];
+  device.treeId = strtol(fields[2].c_str(), &end, 10);
+  device.wifiSsid = fields[3];
+  device.wifiPassword = fields[4];
+  std::string uplink = fields.size() == 6 ? fields[5] : "";
+  device.uplink = uplink == "lora" ? 1 : uplink == "wifi" ? 0 : -1;
+  if(!validClientId(device.clientId)) problem = "bad clientId (letters, digits, '_' and '-', 32 at most)";
+  else if(device.token.empty() || device.token.size() > IDENTITY_TOKEN_MAX_LEN) problem = "bad token";
+  else if(fields[2].empty() || *end != '\0') problem = "bad treeId";
+  else if(device.wifiSsid.size() > IDENTITY_SSID_MAX_LEN || device.wifiPassword.size() > IDENTITY_PASSWORD_MAX_LEN) problem = "Wi-Fi field too long";
+  else if(device.wifiSsid.empty() != device.wifiPassword.empty()) problem = "Wi-Fi SSID and password go together";
+  else if(!uplink.empty() && device.uplink < 0) problem = "uplink is wifi, lora or empty";
+  else return true;
+  return false;
+}
+// CSV INPUT END ---------------------------------------------------------------------------------------------------------------------------------------------
+
+// ===========================================================================================================================================================
+// MAIN
+// ===========================================================================================================================================================
+int main(int argc, char** argv){
+  if(argc != 3){
+    fprintf(stderr, "usage: %s <devices.csv> <output folder>\n", argv[0]);
+    return 1;
+  }
+  FILE* csv = fopen(argv[1], "r");
+  if(csv == NULL){
+    fprintf(stderr, "cannot read %s\n", argv[1]);
+    return 1;
+  }
+
+  std::vector<Device> devices;
+  std::set<std::string> clientIds, tokens;
+  char line[512];
+  unsigned lineNumber = 0, errors = 0;
+  while(fgets(line, sizeof(line), csv) != NULL){
+    lineNumber++;
+    if(line[0] == '#' || line[0] == '\n' || line[0] == '\r' || strncmp(line, "clientId,", 9) == 0) continue;
+    Device device;
+    const char* problem = NULL;
+    if(!parseDevice(line, device, problem)){
+      fprintf(stderr, "%s:%u: %s\n", argv[1], lineNumber, problem);
+      errors++;
+    }else if(!clientIds.insert(device.clientId).second || !tokens.insert(device.token).second){                  // Two nodes on one token would overwrite each other's telemetry
+      fprintf(stderr, "%s:%u: clientId or token already used\n", argv[1], lineNumber);
+      errors++;
+    }else{
+      devices.push_back(device);
+    }
+  }
+  fclose(csv);
+  if(errors > 0 || devices.empty()){                                                                             // All or nothing, a half provisioned batch is harder to track
+    fprintf(stderr, "%u bad lines, no image written\n", errors);
+    return 1;
+  }
+
+  static uint8_t image[IDENTITY_PARTITION_SIZE];
+  for(const Device& device : devices){
+    NvsPage page;
+    nvsPageBegin(page);
+    int32_t treeId = device.treeId;
+    bool ok = nvsWrite(page, 0, NVS_TYPE_U8, IDENTITY_NAMESPACE, (const uint8_t*)"\x01", 1) &&                   // Namespace entry: its name and NVS_NAMESPACE_INDEX
+              nvsWriteString(page, IDENTITY_TOKEN_KEY, device.token) &&
+              nvsWriteString(page, IDENTITY_CLIENT_KEY, device.clientId) &&
+              nvsWrite(page, NVS_NAMESPACE_INDEX, NVS_TYPE_I32, IDENTITY_TREE_KEY, (const uint8_t*)&treeId, sizeof(treeId));
+    if(ok && !device.wifiSsid.empty()){
+      ok = nvsWriteString(page, IDENTITY_SSID_KEY, device.wifiSsid) && nvsWriteString(page, IDENTITY_PASSWORD_KEY, device.wifiPassword);
+    }
+    if(ok && device.uplink >= 0){
+      ok = nvsWrite(page, NVS_NAMESPACE_INDEX, NVS_TYPE_I32, IDENTITY_UPLINK_KEY, (const uint8_t*)&device.uplink, sizeof(device.uplink));
+    }
+    memset(image, 0xFF, sizeof(image));                                                                          // The other pages stay erased, the library needs a free one anyway
+    memcpy(image, page.data, sizeof(page.data));
+
+    std::string path = std::string(argv[2]) + "/" + device.clientId + ".bin";
+    FILE* file = fopen(path.c_str(), "wb");
+    if(!ok || file == NULL || fwrite(image, 1, sizeof(image), file) != sizeof(image)){
+      fprintf(stderr, "cannot write %s\n", path.c_str());
+      return 1;
+    }
+    fclose(file);
+    printf("esptool.py write_flash 0x%X %s    # tree %ld, Wi-Fi %s%s\n", IDENTITY_PARTITION_OFFSET, path.c_str(), device.treeId,
+           device.wifiSsid.empty() ? "firmware default" : device.wifiSsid.c_str(), device.uplink == 1 ? ", LoRa uplink" : device.uplink == 0 ? ", Wi-Fi uplink" : "");
+  }
+  printf("%u identity images, one firmware image for all of them\n", (unsigned)devices.size());
+  return 0;
+}
+// MAIN END ==================================================================================================================================================
\ No newline at end of file
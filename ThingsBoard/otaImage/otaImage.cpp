@@ -0,0 +1,110 @@
+// Host-side packer for the pull OTA images (otaImage.h, otaPull.h)
+//
+// Splits a PlatformIO firmware.bin into OTA_BLOCK_MAX_LEN blocks, deflates each one on its own, and writes them after a header carrying the version,
+// the SHA-256 of the firmware and an ECDSA P-256 signature the devices check against OTA_PUBLIC_KEY (macros.h) before writing anything:
+//
+//   openssl ecparam -genkey -name prime256v1 -noout -out ota.key                 # once, keep it off the repository
+//   openssl ec -in ota.key -pubout                                               # PEM to paste into OTA_PUBLIC_KEY
+//   ./otaImage .pio/build/soil_quality_sensor/firmware.bin 2 ota.key firmware-2.sqota
+//
+// Then serve the file over HTTPS and set the fwUrl and fwVersion (same number as FIRMWARE_VERSION in that build) shared attributes, URL first.
+//
+// Build (from this folder):
+//   g++ -std=c++11 -O2 -I../../mt_soil_quality_sensor/include otaImage.cpp -o otaImage -lz -lcrypto
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <zlib.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/sha.h>
+#include "otaImage.h"                                                                                            // File format shared with the firmware
+
+// READ A WHOLE FILE ------------------------------------------------------------------------------------------------------------------------------------------
+static bool readFile(const char* path, std::vector<uint8_t>& data){
+  FILE* file = fopen(path, "rb");
+  if(file == NULL) return false;
+  uint8_t chunk[4096];
+  size_t n;
+  while((n = fread(chunk, 1, sizeof(chunk), file)) > 0) data.insert(data.end(), chunk, chunk + n);
+  fclose(file);
+  return true;
+}
+// READ A WHOLE FILE END -------------------------------------------------------------------------------------------------------------------------------------
+
+// SIGN THE HEADER -------------------------------------------------------------------------------------------------------------------------------------------
+static bool signHeader(OtaImageHeader& header, const char* keyPath){
+  FILE* file = fopen(keyPath, "r");
+  if(file == NULL) return false;
+  EVP_PKEY* key = PEM_read_PrivateKey(file, NULL, NULL, NULL);
+  fclose(file);
+
+  size_t signatureLen = sizeof(header.signature);
+  EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+  bool ok = key != NULL && ctx != NULL && EVP_DigestSignInit(ctx, NULL, EVP_sha256(), NULL, key) == 1 &&
+            EVP_DigestSign(ctx, header.signature, &signatureLen, (const uint8_t*)&header, OTA_SIGNED_LEN) == 1;  // DER, 70 to 72 bytes
+  header.signatureLen = ok ? signatureLen : 0;
+  EVP_MD_CTX_free(ctx);
+  EVP_PKEY_free(key);
+  return ok;
+}
+// SIGN THE HEADER END ---------------------------------------------------------------------------------------------------------------------------------------
+
+// ===========================================================================================================================================================
+// MAIN
+// ===========================================================================================================================================================
+int main(int argc, char** argv){
+  if(argc != 5){
+    fprintf(stderr, "usage: %s <firmware.bin> <version> <private key PEM> <output>\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<uint8_t> firmware;
+  if(!readFile(argv[1], firmware) || firmware.empty()){
+    fprintf(stderr, "cannot read %s\n", argv[1]);
+    return 1;
+  }
+
+  OtaImageHeader header = {};
+  header.magic = OTA_IMAGE_MAGIC;
+  header.version = strtoul(argv[2], NULL, 10);
+  header.imageSize = firmware.size();
+  header.blockSize = OTA_BLOCK_MAX_LEN;
+  SHA256(firmware.data(), firmware.size(), header.sha256);
+  if(header.version == 0 || !signHeader(header, argv[3])){
+    fprintf(stderr, "bad version or cannot sign with %s\n", argv[3]);
+    return 1;
+  }
+
+  std::vector<uint8_t> out((const uint8_t*)&header, (const uint8_t*)&header + sizeof(header));
+  uint32_t blocks = 0;
+  for(size_t offset = 0; offset < firmware.size(); offset += header.blockSize, blocks++){
+    size_t blockLen = firmware.size() - offset < header.blockSize ? firmware.size() - offset : header.blockSize;
+    uint8_t packed[OTA_BLOCK_MAX_LEN + 64];
+    uLongf packedLen = sizeof(packed);
+    uint32_t record;
+    const uint8_t* data = packed;
+    if(compress2(packed, &packedLen, &firmware[offset], blockLen, Z_BEST_COMPRESSION) == Z_OK && packedLen < blockLen){
+      record = packedLen;
+    }else{                                                                                                       // Already dense (tables, certificates): stored, the device copies it
+      record = blockLen | OTA_BLOCK_STORED;
+      packedLen = blockLen;
+      data = &firmware[offset];
+    }
+    out.insert(out.end(), (const uint8_t*)&record, (const uint8_t*)&record + sizeof(record));
+    out.insert(out.end(), data, data + packedLen);
+  }
+
+  FILE* file = fopen(argv[4], "wb");
+  if(file == NULL || fwrite(out.data(), 1, out.size(), file) != out.size()){
+    fprintf(stderr, "cannot write %s\n", argv[4]);
+    return 1;
+  }
+  fclose(file);
+  printf("version %u: %u bytes in %u blocks -> %u bytes (%.0f %%)\n", header.version, header.imageSize, blocks, (unsigned)out.size(),
+         100.0 * out.size() / header.imageSize);
+  return 0;
+}
+// MAIN END ==================================================================================================================================================
\ No newline at end of file
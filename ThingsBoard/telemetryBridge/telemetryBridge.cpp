@@ -0,0 +1,54 @@
+// Host-side bridge for the binary telemetry frames (TELEMETRY_BINARY in macros.h)
+//
+// Reads one hex encoded frame per line from stdin and writes the ThingsBoard JSON array it expands to on stdout, one line per frame,
+// so it can sit between two MQTT clients, e.g.:
+//
+//   mosquitto_sub -h <broker> -t 'v1/devices/me/telemetry/bin' -F %x | ./telemetryBridge |
+//     mosquitto_pub -h <thingsboard> -p 1883 -u <ACCESS_TOKEN> -t 'v1/devices/me/telemetry' -l
+//
+// Build (from this folder):
+//   g++ -std=c++11 -O2 -I../../mt_soil_quality_sensor/include -I../../mt_soil_quality_sensor/lib/TelemetrySerializer telemetryBridge.cpp -o telemetryBridge
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include "telemetryBuffer.h"                                                                                     // Schema (TELEMETRY_FIELDS) and buffer sizes shared with the firmware
+#include "telemetryCodec.h"
+
+// HEX LINE TO BYTES (0 ON BAD INPUT) ------------------------------------------------------------------------------------------------------------------------
+static size_t hexToBytes(const char* hex, uint8_t* out, size_t outSize){
+  size_t len = 0;
+  while(*hex && !isspace((unsigned char)*hex)){
+    unsigned int b;
+    if(!isxdigit((unsigned char)hex[0]) || !isxdigit((unsigned char)hex[1]) || len >= outSize) return 0;
+    if(sscanf(hex, "%2x", &b) != 1) return 0;
+    out[len++] = (uint8_t)b;
+    hex += 2;
+  }
+  return len;
+}
+// HEX LINE TO BYTES END -------------------------------------------------------------------------------------------------------------------------------------
+
+// ===========================================================================================================================================================
+// MAIN
+// ===========================================================================================================================================================
+int main(){
+  static char line[2 * TELEMETRY_FRAME_MAX_LEN + 2];
+  static uint8_t frame[TELEMETRY_FRAME_MAX_LEN];
+  static char json[TELEMETRY_BATCH_MAX_LEN];
+
+  while(fgets(line, sizeof(line), stdin)){
+    size_t frameLen = hexToBytes(line, frame, sizeof(frame));
+    size_t jsonLen = frameLen ? binaryFrameToJson(frame, frameLen, TELEMETRY_FIELDS, json, sizeof(json)) : 0;
+
+    if(jsonLen == 0){
+      fprintf(stderr, "Dropped malformed frame: %s", line);                                                      // Never forward something ThingsBoard would half-parse
+      continue;
+    }
+    printf("%s\n", json);
+    fflush(stdout);                                                                                              // One line per frame, right away, for the piped publisher
+  }
+  return 0;
+}
+// MAIN END ==================================================================================================================================================
\ No newline at end of file
@@ -0,0 +1,122 @@
+// Fleet view of the wake-cycle profile (wakeProfiler.h, WAKE_PROFILE_EVERY in macros.h)
+//
+// Takes one ThingsBoard timeseries export per device, as returned by the REST API, and prints the median and p90 of every phase plus a bar with
+// the share of the flush wake each phase takes, per device and for the whole fleet:
+//
+//   KEYS=tBoot,tPower,tSensors,tSampling,tWifi,tOta,tMqtt,tPublish,tWake,tQuietWake
+//   curl -s -H "X-Authorization: Bearer $JWT" "$TB/api/plugins/telemetry/DEVICE/$DEVICE_ID/values/timeseries?keys=$KEYS&startTs=0&endTs=9999999999999&limit=10000" > tree0.json
+//   ./wakeProfile tree0.json tree1.json ...
+//
+// Build (from this folder):
+//   g++ -std=c++11 -O2 wakeProfile.cpp -o wakeProfile
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// ===========================================================================================================================================================
+// PHASES
+// ===========================================================================================================================================================
+struct Phase {
+  const char* key;
+  char symbol;                                                                                                   // Used in the share bar
+};
+
+static const Phase PHASES[] = {                                                                                  // Same keys as WAKE_PROFILE_FIELDS, tWake and tQuietWake are handled apart
+  {"tBoot", 'B'}, {"tPower", 'P'}, {"tSensors", 'S'}, {"tSampling", 's'}, {"tWifi", 'W'}, {"tOta", 'O'}, {"tMqtt", 'M'}, {"tPublish", 'U'},
+};
+static const size_t PHASE_COUNT = sizeof(PHASES) / sizeof(PHASES[0]);
+static const int BAR_WIDTH = 60;
+
+typedef std::map<std::string, std::vector<double>> Series;                                                       // Key to values, one per flush wake
+// PHASES END ================================================================================================================================================
+
+// LOAD A THINGSBOARD TIMESERIES EXPORT ({"key":[{"ts":..,"value":".."},..],..}) -----------------------------------------------------------------------------
+static bool loadSeries(const char* path, Series& series){
+  std::ifstream file(path);
+  if(!file) return false;
+  std::stringstream text;
+  text << file.rdbuf();
+  const std::string json = text.str();
+
+  static const std::regex keyRegex("\"(t[A-Za-z]+)\"\\s*:\\s*\\[([^\\]]*)\\]");
+  static const std::regex valueRegex("\"value\"\\s*:\\s*\"?(-?[0-9.eE+-]+)\"?");
+  for(std::sregex_iterator k(json.begin(), json.end(), keyRegex), end; k != end; ++k){
+    const std::string key = (*k)[1];
+    const std::string points = (*k)[2];
+    for(std::sregex_iterator v(points.begin(), points.end(), valueRegex); v != end; ++v){
+      series[key].push_back(atof((*v)[1].str().c_str()));
+    }
+  }
+  return true;
+}
+// LOAD END --------------------------------------------------------------------------------------------------------------------------------------------------
+
+// STATISTICS ------------------------------------------------------------------------------------------------------------------------------------------------
+static double percentile(std::vector<double> values, double p){
+  if(values.empty()) return 0.0;
+  std::sort(values.begin(), values.end());
+  return values[(size_t)(p * (values.size() - 1) + 0.5)];
+}
+
+static void printSeries(const std::string& name, const Series& series){
+  Series::const_iterator wake = series.find("tWake");
+  if(wake == series.end() || wake->second.empty()){
+    printf("%-16s no tWake samples\n", name.c_str());
+    return;
+  }
+  double wakeMedian = percentile(wake->second, 0.5);
+  Series::const_iterator quiet = series.find("tQuietWake");
+  printf("%-16s %5zu flushes, flush wake p50 %.0f ms p90 %.0f ms, sample-only wake p50 %.0f ms\n", name.c_str(), wake->second.size(), wakeMedian,
+         percentile(wake->second, 0.9), quiet == series.end() ? 0.0 : percentile(quiet->second, 0.5));
+
+  std::string bar;
+  for(size_t i = 0; i < PHASE_COUNT; i++){
+    Series::const_iterator phase = series.find(PHASES[i].key);
+    if(phase == series.end()) continue;
+    double median = percentile(phase->second, 0.5);
+    double share = wakeMedian > 0.0 ? median / wakeMedian : 0.0;
+    printf("  %-10s p50 %8.1f ms  p90 %8.1f ms  %5.1f %%\n", PHASES[i].key, median, percentile(phase->second, 0.9), 100.0 * share);
+    bar.append((size_t)(share * BAR_WIDTH + 0.5), PHASES[i].symbol);                                             // Phases overlap (sampling runs during Wi-Fi/TLS), so the bar may run past the wake
+  }
+  printf("  [%s]\n\n", bar.c_str());
+}
+// STATISTICS END --------------------------------------------------------------------------------------------------------------------------------------------
+
+// ===========================================================================================================================================================
+// MAIN
+// ===========================================================================================================================================================
+int main(int argc, char** argv){
+  if(argc < 2){
+    fprintf(stderr, "usage: %s <device export.json>...\n", argv[0]);
+    return 1;
+  }
+
+  Series fleet;
+  for(int i = 1; i < argc; i++){
+    Series device;
+    if(!loadSeries(argv[i], device)){
+      fprintf(stderr, "Cannot read %s\n", argv[i]);
+      continue;
+    }
+    std::string name = argv[i];
+    name = name.substr(name.find_last_of('/') + 1);
+    name = name.substr(0, name.find_last_of('.'));
+    printSeries(name, device);
+
+    for(Series::const_iterator it = device.begin(); it != device.end(); ++it){
+      fleet[it->first].insert(fleet[it->first].end(), it->second.begin(), it->second.end());
+    }
+  }
+
+  printSeries("FLEET", fleet);
+  printf("B boot  P power  S sensors  s sampling  W wifi  O ota  M mqtt/tls  U publish\n");
+  return 0;
+}
+// MAIN END ==================================================================================================================================================
\ No newline at end of file
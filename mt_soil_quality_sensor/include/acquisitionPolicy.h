@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+#define POLICY_HISTORY_LEN 8                                                                                     // Past wakes used to estimate variance and trend
+
+struct AcquisitionHistory {                                                                                      // Last POLICY_HISTORY_LEN medians, oldest first from head
+  float values[POLICY_HISTORY_LEN];
+  uint8_t head;                                                                                                  // Index of the oldest value
+  uint8_t count;
+};
+
+struct AcquisitionLimits {
+  float quietStdDev;                                                                                             // At or below this (and a quiet trend) the cheapest acquisition is used
+  float noisyStdDev;                                                                                             // At or above this the most expensive acquisition is used
+  float quietTrend;                                                                                              // Same thresholds for the absolute slope, in units per wake
+  float noisyTrend;
+  uint8_t minSamples;
+  uint8_t maxSamples;
+};
+
+struct AcquisitionPlan {
+  uint8_t resolutionBits;                                                                                        // 9 to 12 (DS18B20: 94 to 750 ms per conversion)
+  uint8_t samples;
+};
+
+void recordAcquisition(AcquisitionHistory& history, float value);
+float historyStdDev(const AcquisitionHistory& history);
+float historyTrend(const AcquisitionHistory& history);
+AcquisitionPlan planAcquisition(const AcquisitionHistory& history, const AcquisitionLimits& limits);
\ No newline at end of file
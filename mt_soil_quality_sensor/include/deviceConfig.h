@@ -0,0 +1,52 @@
+#pragma once                                                                                                     // Runtime settings from ThingsBoard shared attributes: validated, versioned, kept in NVS and cached in RTC memory
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetrySerializer.h"
+#include "sampling.h"
+
+#define DEVICE_CONFIG_MAGIC 0x43464731UL                                                                         // "CFG1", the RTC copy is trusted only with it, NVS is read again otherwise
+#define DEVICE_CONFIG_VERSION_KEY "cfgVersion"                                                                   // Shared attribute and NVS key. Bumped on the server after the values, a set is only applied with a newer one
+#define DEVICE_CONFIG_MESSAGE_MAX_LEN 512                                                                        // Shared attributes response, every key below with five digit values fits twice over
+#define DEVICE_CONFIG_REPORT_MAX_LEN 64
+
+static constexpr TelemetryField DEVICE_CONFIG_REPORT_FIELDS[] = {                                                // Client attributes, published once a set has been applied or rejected
+  {"cfgApplied", 0},                                                                                             // Running cfgVersion, 0 for the compiled-in defaults
+  {"cfgRejected", 0},                                                                                            // Last version that failed validation, 0 if none did
+};
+
+struct DeviceConfig {                                                                                            // NVS settings, read once per power-on
+  uint32_t magic;
+  uint32_t version;
+  uint32_t rejectedVersion;
+  uint16_t sleepMinS;                                                                                            // Sleep scheduler bounds (SLEEP_MIN_S, SLEEP_MAX_S)
+  uint16_t sleepMaxS;
+  uint16_t batchDepth;                                                                                           // Readings per radio wake (BATCH_DEPTH), at most TELEMETRY_BUFFER_CAPACITY
+  uint16_t tempMinSamples;                                                                                       // Adaptive acquisition bounds (TEMPERATURE_ADAPTIVE_*, MOISTURE_ADAPTIVE_*)
+  uint16_t tempMaxSamples;
+  uint16_t tempMaxBits;                                                                                          // DS18B20 resolution cap, 9 to 12
+  uint16_t moistMinSamples;
+  uint16_t moistMaxSamples;
+  uint16_t moistDryMv;                                                                                           // FC-38 calibration points, same NVS keys as SOIL_MOIST_DRY_KEY and SOIL_MOIST_WET_KEY
+  uint16_t moistWetMv;
+};
+
+struct ConfigSync {                                                                                              // Current wake, plain RAM
+  uint32_t requestedMs;
+  const char* extraKeys;                                                                                         // Shared keys other modules asked for along with the settings
+  bool pending;                                                                                                  // Shared attributes requested, no response yet
+  bool reportDue;                                                                                                // Applied or rejected a set, cfgVersion/cfgRejected not published yet
+};
+
+enum ConfigResult : uint8_t { CONFIG_IGNORED, CONFIG_APPLIED, CONFIG_REJECTED, CONFIG_REQUESTED };
+
+void deviceConfigBegin(DeviceConfig& config);                                                                    // RTC copy if valid, NVS (or the macros) after a power-on
+MoistureCalibration deviceMoistureCalibration(const DeviceConfig& config);
+bool requestDeviceConfig(ConfigSync& sync, uint32_t nowMs, const char* extraKeys);                               // Subscribes (clean session) and asks for every shared key, right after each connect
+ConfigResult handleDeviceConfigMessage(DeviceConfig& config, ConfigSync& sync, const char* topic, const uint8_t* payload, size_t len, uint32_t nowMs,
+                                       const char** badKey);                                                     // Any halMqttOnMessage() publish. NULL or the offending key in badKey
+bool deviceConfigPending(ConfigSync& sync, uint32_t nowMs);                                                      // Worth staying awake for the response, false after CONFIG_RESPONSE_TIMEOUT_MS
+bool publishDeviceConfig(const DeviceConfig& config, ConfigSync& sync);                                          // Client attributes, only when reportDue
+const char* findAttribute(const char* json, const char* key);                                                    // Right after "key":, NULL if absent. Flat or nested in {"shared":{...}}
+bool parseAttributeUnsigned(const char* text, uint32_t& value);                                                  // 30 or "30", no sign, no fraction
+bool parseAttributeString(const char* text, char* out, size_t outSize);                                          // False if it is not a string or does not fit
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once                                                                                                     // Per-device identity read from its own NVS partition, so every node runs the same firmware image
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define IDENTITY_PARTITION "ident"                                                                               // NVS data partition (partitions.csv), written by ThingsBoard/nvsProvision and flashed once per device
+#define IDENTITY_PARTITION_SIZE 0x3000                                                                           // Same size as in partitions.csv, the smallest NVS partition ESP-IDF accepts (3 pages)
+#define IDENTITY_NAMESPACE "identity"
+#define IDENTITY_TOKEN_KEY "token"                                                                               // NVS string keys (15 characters at most)...
+#define IDENTITY_CLIENT_KEY "clientId"
+#define IDENTITY_SSID_KEY "wifiSsid"
+#define IDENTITY_PASSWORD_KEY "wifiPass"
+#define IDENTITY_TREE_KEY "treeId"                                                                               // ...and the i32s
+#define IDENTITY_UPLINK_KEY "uplink"                                                                             // 0 Wi-Fi, 1 LoRa
+#define IDENTITY_TOKEN_MAX_LEN 32                                                                                // ThingsBoard access tokens are 20 characters
+#define IDENTITY_CLIENT_MAX_LEN 32
+#define IDENTITY_SSID_MAX_LEN 32                                                                                 // 802.11 limits
+#define IDENTITY_PASSWORD_MAX_LEN 63
+
+struct DeviceIdentity {                                                                                          // Plain RAM, read again on every boot (a few ms of NVS lookups)
+  char token[IDENTITY_TOKEN_MAX_LEN + 1];
+  char clientId[IDENTITY_CLIENT_MAX_LEN + 1];
+  char wifiSsid[IDENTITY_SSID_MAX_LEN + 1];
+  char wifiPassword[IDENTITY_PASSWORD_MAX_LEN + 1];
+  int32_t treeId;
+  bool loraUplink;                                                                                               // Out of Wi-Fi reach: compact frames over the SX1276 (loraUplink.h)
+  bool provisioned;                                                                                              // The token came from the partition, not from the build defaults
+};
+
+void loadDeviceIdentity(DeviceIdentity& identity);                                                               // Each key from the partition, the build default (macros.h) for the ones missing
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once                                                                                                     // Battery accounting: per-wake charge from the profiler, long-run average current from the AXP192 coulomb counter
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetrySerializer.h"
+#include "wakeProfiler.h"
+#include "signalFilters.h"
+
+#define ENERGY_MAX_LEN 320
+#define ENERGY_WINDOW_MAH 5.0f                                                                                   // ~14 counter steps, enough for a <10 % quantization error on the average
+#define ENERGY_WINDOW_MAX_S 604800UL                                                                             // A longer window means the clock jumped (first NTP sync), it is discarded
+
+static constexpr TelemetryField WAKE_ENERGY_FIELDS[] = {                                                         // mAh, same order as WakePhase plus the totals
+  {"eBoot", 3}, {"ePower", 3}, {"eSensors", 3}, {"eSampling", 3}, {"eWifi", 3}, {"eOta", 3}, {"eMqtt", 3}, {"ePublish", 3},
+  {"eWake", 3}, {"eWakemJ", 0}, {"eQuietWake", 3},
+  {"eAvgmA", 3},                                                                                                 // Coulomb counter average, sleep included
+  {"eReportmAh", 2}, {"eReportmJ", 0},                                                                           // One report interval (BATCH_DEPTH wakes and sleeps) at the average current
+  {"runtimeH", 0},                                                                                               // Remaining runtime at the average current, null while charging or before the first window
+  {"vbusV", 2},
+};
+
+struct EnergyLedger {                                                                                            // Charge drawn per wake window, since power-on
+  float windowStartmAh;
+  uint64_t windowStartMs;
+  Ewma<float, 4> avgCurrentmA;                                                                                   // Over closed windows, seeded by the first one
+  float batteryVolts;                                                                                            // Last reading, converts charge to energy
+  bool windowOpen;
+};
+
+void updateEnergyLedger(EnergyLedger& ledger, float drawnmAh, uint64_t nowMs, float batteryVolts);
+float batteryStateOfCharge(float volts);                                                                         // 0..1 from the open-circuit LiPo curve
+float remainingRuntimeH(const EnergyLedger& ledger, float capacitymAh);
+float reportChargemAh(const EnergyLedger& ledger, uint32_t reportIntervalS);
+float mAhTomJ(float mAh, float volts);
+size_t serializeWakeEnergy(const WakeProfileHistory& history, const EnergyLedger& ledger, uint32_t reportIntervalS, float vbusVolts, char* out,
+                           size_t outSize);
+bool publishWakeEnergy(const WakeProfileHistory& history, const EnergyLedger& ledger, uint32_t reportIntervalS);
\ No newline at end of file
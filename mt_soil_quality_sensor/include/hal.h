@@ -0,0 +1,86 @@
+#pragma once                                                                                                     // Thin hardware layer: halEsp32.cpp on the T-Beam, native/halNative.cpp for the host simulation
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HAL_PROBE_DISCONNECTED_C -127.0f                                                                         // Same error value as DallasTemperature's DEVICE_DISCONNECTED_C
+#define HAL_PROBE_RESET_C 85.0f                                                                                  // Power-on scratchpad of a DS18B20: it browned out before converting, the CRC is still good
+#define HAL_PROBE_ROM_LEN 8                                                                                      // OneWire ROM code: family, 48-bit serial, CRC
+#define HAL_MQTT_NO_ACK -1                                                                                       // halMqttPollAck() results that are not a packet id
+#define HAL_MQTT_LOST -2
+#define HAL_MQTT_RX_MAX_LEN 640                                                                                  // Incoming PUBLISH (topic and payload) handed to the halMqttOnMessage() handler, longer ones are dropped
+#define HAL_LOG_SECTOR_SIZE 4096                                                                                 // Erase unit of the SPI NOR flash
+#define HAL_LORA_MAX_LEN 255                                                                                     // SX127x FIFO, one explicit header packet
+
+typedef void (*HalMqttHandler)(const char* topic, const uint8_t* payload, size_t len);
+
+// Clock and sleep -------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t halMillis();                                                                                            // Since the start of the current wake
+uint64_t halMicros();                                                                                            // Since reset, so the first reading covers the ROM and bootloader too
+void halDelayMs(uint32_t ms);                                                                                    // Yields to the other tasks on the ESP32
+uint64_t halEpochMs();
+void halDeepSleep(uint64_t seconds);                                                                             // Never returns on the ESP32, on the host it only records the request
+// PMU -------------------------------------------------------------------------------------------------------------------------------------------------------
+bool halPowerBegin();
+void halSensorPower(bool on);                                                                                    // DCDC1 rail feeding the DS18B20s
+void halMoisturePower(bool on);                                                                                  // FC-38 supply on MOIST_POWER_PIN, see moisturePower.h
+float halBatteryVoltage();
+float halBatteryCurrentmA();                                                                                     // Discharge minus charge, NAN until halPowerBegin()
+float halBatteryDrawnmAh();                                                                                      // Coulomb counter: net charge drawn since it was enabled, keeps counting in deep sleep
+float halVbusVoltage();                                                                                          // 0 without USB power
+// OneWire temperature probes --------------------------------------------------------------------------------------------------------------------------------
+void halTemperatureBegin();
+uint8_t halTemperatureSearch(uint8_t (*roms)[HAL_PROBE_ROM_LEN], uint8_t max);                                   // Full ROM search, DS18B20s only. Slow, the caller caches the result
+void halTemperatureResolution(uint8_t bits);                                                                     // Every probe at once (skip ROM)
+uint32_t halTemperatureConversionMs();
+void halTemperatureRequest();                                                                                    // Skip ROM broadcast: every probe starts converting, returns right away
+bool halTemperatureReady();                                                                                      // All of them done
+float halTemperatureReadC(const uint8_t* rom);                                                                   // Addressed scratchpad read, HAL_PROBE_DISCONNECTED_C if absent or the CRC fails
+// ADC -------------------------------------------------------------------------------------------------------------------------------------------------------
+void halAnalogBegin();                                                                                           // 11 dB attenuation and the eFuse calibration (two-point or Vref) of this chip
+size_t halAnalogBurst(uint8_t pin, uint16_t* raw, size_t count);                                                 // Continuous (DMA) conversions at ADC_BURST_RATE_HZ, 12 bits. Returns how many arrived
+uint32_t halAnalogMillivolts(uint16_t raw);                                                                      // Through the calibration curve of halAnalogBegin()
+// Network link ----------------------------------------------------------------------------------------------------------------------------------------------
+bool halNetworkUp(uint32_t timeoutMs);
+void halNetworkDown();
+bool halNetworkConnected();                                                                                      // Still associated, no waiting
+// MQTT transport --------------------------------------------------------------------------------------------------------------------------------------------
+bool halMqttConnect(const char* host, uint16_t port, const char* clientId, const char* user);
+bool halMqttPublish(const char* topic, const uint8_t* payload, size_t len);                                      // QoS 0, true once written to the socket
+bool halMqttPublishQos1(const char* topic, const uint8_t* payload, size_t len, uint16_t packetId);
+bool halMqttSubscribe(const char* topic);                                                                        // QoS 0, the SUBACK is not waited for
+void halMqttOnMessage(HalMqttHandler handler);                                                                   // Publishes of the subscriptions, whether they arrive while idle or in halMqttPollAck()
+bool halMqttConnected();
+bool halMqttLoop();                                                                                              // Keepalive and incoming publishes, false once the session is gone
+int32_t halMqttPollAck(uint32_t waitMs);                                                                         // Packet id of the next PUBACK. Keeps the keepalive going and hands publishes to the handler meanwhile
+void halMqttDisconnect();
+// Settings (NVS) --------------------------------------------------------------------------------------------------------------------------------------------
+bool halSettingsGetU32(const char* key, uint32_t& value);                                                        // False if the key was never written, value is left alone
+bool halSettingsSetU32(const char* key, uint32_t value);
+// Device identity (read-only NVS partition) -----------------------------------------------------------------------------------------------------------------
+bool halIdentityGetStr(const char* key, char* value, size_t len);                                                // False if the partition or the key is missing, or the string does not fit in len with its terminator
+bool halIdentityGetI32(const char* key, int32_t& value);
+// LoRa radio (SX127x) ---------------------------------------------------------------------------------------------------------------------------------------
+bool halLoraTransmit(const uint8_t* frame, size_t len);                                                          // Powers the radio, sends one packet with the LORA_* settings (macros.h) and powers it off. False if it never finished
+// Frame authentication --------------------------------------------------------------------------------------------------------------------------------------
+void halHmacSha256(const uint8_t* key, size_t keyLen, const uint8_t* data, size_t len, uint8_t* mac);            // 32 bytes into mac, hardware SHA on the ESP32
+uint32_t halRandom();                                                                                            // Session nonces, esp_random() on the ESP32
+// Telemetry log flash ---------------------------------------------------------------------------------------------------------------------------------------
+uint32_t halLogSize();                                                                                           // Bytes of the log partition, 0 if the partition table has none
+bool halLogRead(uint32_t offset, void* data, size_t len);
+bool halLogWrite(uint32_t offset, const void* data, size_t len);                                                 // NOR flash: bits only go from 1 to 0 until the sector is erased
+bool halLogErase(uint32_t offset);                                                                               // Whole sector holding offset
+// HTTP download ---------------------------------------------------------------------------------------------------------------------------------------------
+bool halHttpOpen(const char* url, uint32_t offset);                                                              // GET from offset on: Range request, bytes skipped here if the server ignores it
+bool halHttpRead(uint8_t* data, size_t len);                                                                     // Exactly len bytes, false on a timeout or a closed connection
+void halHttpClose();
+// Firmware update slot --------------------------------------------------------------------------------------------------------------------------------------
+uint32_t halOtaSlotSize();                                                                                       // Inactive app partition, 0 if the partition table has none
+bool halOtaWrite(uint32_t offset, const void* data, size_t len);                                                 // Sectors are erased as the writes reach them, so a block rewritten after a reset starts on erased flash
+bool halOtaDigest(uint32_t len, uint8_t* sha256);                                                                // SHA-256 of the first len bytes, read back from the flash
+bool halOtaActivate();                                                                                           // Boot the slot on the next reset
+bool halOtaTrialBoot();                                                                                          // First run of a new image: the bootloader rolls it back on the next reset unless halOtaConfirm() is called
+void halOtaConfirm();
+// Image checks ----------------------------------------------------------------------------------------------------------------------------------------------
+size_t halInflate(const uint8_t* in, size_t inLen, uint8_t* out, size_t outSize);                                // One zlib stream, bytes out. 0 if it is corrupt or does not fit
+bool halVerifySignature(const uint8_t* data, size_t len, const uint8_t* signature, size_t signatureLen);         // ECDSA P-256 over the SHA-256 of data (DER signature), against OTA_PUBLIC_KEY
\ No newline at end of file
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <axp20x.h>
+#include <PubSubClient.h>
+#include "hal.h"
+
+AXP20X_Class& halPmu();                                                                                          // PEK IRQ and the power rails setup still talk to the AXP192 directly
+void halBindMqtt(PubSubClient& client, Client& transport);                                                       // MQTT client (TLS, cached session and broker address) owned by main.cpp over transport. Puts the PUBACK tap in between (setClient())
\ No newline at end of file
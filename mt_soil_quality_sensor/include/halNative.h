@@ -0,0 +1,46 @@
+#pragma once                                                                                                     // Host-only side of hal.h: wake bookkeeping and the simulated models
+
+#include <stdint.h>
+
+struct SimStats {
+  uint32_t wakes;
+  uint32_t radioWakes;                                                                                           // Wakes that brought the network up
+  uint32_t publishes;
+  uint32_t publishFailures;
+  uint64_t awakeMs;
+  uint64_t radioMs;
+  float consumedmAh;
+  uint32_t flashWrites;
+  uint32_t flashErases;
+  uint32_t probeSearches;                                                                                        // OneWire ROM searches, once per power-on with the cache
+  uint32_t probeReads;
+  uint64_t moistureOnMs;                                                                                         // Time the FC-38 was powered
+  uint64_t otaBytes;                                                                                             // HTTP bytes read for firmware images, headers included
+  uint32_t otaActivations;
+  uint32_t otaRollbacks;                                                                                         // Activated images reset before halOtaConfirm()
+  uint32_t loraFrames;
+  uint32_t loraLost;                                                                                             // Sent but never received, see simSetLoraLossPercent()
+  uint64_t loraAirtimeMs;
+};
+
+struct SimPmuReading {                                                                                           // AXP192 registers as a test scripts them
+  float drawnmAh;
+  float batteryVolts;
+  float vbusVolts;
+};
+
+void simBeginWake();
+uint64_t simEndWake();                                                                                           // Applies the deep sleep requested through halDeepSleep(), returns its length in s
+float simBatteryVoltage();
+void simSetWifiFailurePercent(uint8_t percent);                                                                  // Joins that fail as if the AP were down
+void simSetProbeCount(uint8_t count);                                                                            // DS18B20s on the bus, SIM_PROBE_SPACING_CM apart. Fewer than before unplugs the deepest
+void simSetProbeGlitchPercent(uint8_t percent);                                                                  // Reads that return 85 C or a value 16 C off
+void simSetMqttLatencyMs(uint32_t ms);                                                                           // Broker round trip, every PUBACK is held back until that long after its PUBLISH
+uint64_t simHostMicros();                                                                                        // Real time, for throughput measurements (the simulated clock runs much faster)
+bool simSetLogFile(const char* path);                                                                            // Flash image of the telemetry log, so the next run starts like a power cycle
+bool simSetIdentityFile(const char* path);                                                                       // NVS partition image from ThingsBoard/nvsProvision, read by halIdentityGetStr() and halIdentityGetI32()
+bool simSetLoraFile(const char* path);                                                                           // Appends '<rx epoch ms> <rssi dBm> <snr dB> <hex frame>' per frame received, the input of ThingsBoard/loraGateway
+void simSetLoraLossPercent(uint8_t percent);                                                                     // Frames that never reach the gateway
+void simSetPmuReading(const SimPmuReading* reading);                                                             // Returned by the PMU calls instead of the discharge model, NULL goes back to the model
+void simSetOtaPublicKey(const char* pem);                                                                        // Checked by halVerifySignature() instead of OTA_PUBLIC_KEY, so tests sign images with their own key. NULL restores it
+const SimStats& simStats();
\ No newline at end of file
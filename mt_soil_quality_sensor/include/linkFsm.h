@@ -0,0 +1,66 @@
+#pragma once                                                                                                     // Wi-Fi + MQTT connection state machine with jittered exponential backoff and a per-wake deadline. Pure: the drivers (main.cpp, native/simMain.cpp) perform the actions and feed back the outcomes
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetrySerializer.h"
+
+#define LINK_STATS_MAX_LEN 160
+
+enum LinkState : uint8_t {
+  LINK_JOIN,                                                                                                     // Wi-Fi needed
+  LINK_CONNECT,                                                                                                  // Wi-Fi up, MQTT CONNECT needed
+  LINK_BACKOFF,                                                                                                  // Waiting before retrying the step in retryState
+  LINK_UP,
+  LINK_EXPIRED,                                                                                                  // Wake budget spent, terminal
+};
+
+enum LinkEvent : uint8_t {
+  LINK_TICK,                                                                                                     // Nothing happened, time went by
+  LINK_WIFI_UP,
+  LINK_WIFI_FAILED,
+  LINK_WIFI_LOST,
+  LINK_MQTT_UP,
+  LINK_MQTT_FAILED,
+  LINK_MQTT_LOST,                                                                                                // Also a failed publish
+};
+
+enum LinkAction : uint8_t {
+  LINK_DO_JOIN,                                                                                                  // One join attempt bounded by linkAttemptMs(), then LINK_WIFI_UP or LINK_WIFI_FAILED
+  LINK_DO_CONNECT,                                                                                               // One MQTT CONNECT, then LINK_MQTT_UP or LINK_MQTT_FAILED
+  LINK_DO_WAIT,                                                                                                  // Block for linkWaitMs(), then LINK_TICK
+  LINK_DO_SERVE,                                                                                                 // Connected: publish, keep the client alive, report LINK_*_LOST
+  LINK_DO_SLEEP,                                                                                                 // Give up: keep the reading in RTC memory and deep sleep
+};
+
+static constexpr TelemetryField LINK_STATS_FIELDS[] = {                                                          // Counted since the last report, published once the broker is reachable again
+  {"linkWifiFail", 0}, {"linkMqttFail", 0}, {"linkLost", 0}, {"linkExpired", 0}, {"linkAttempts", 0}, {"linkUpMs", 0},
+};
+
+struct LinkFsm {                                                                                                 // One wake, plain RAM
+  LinkState state;
+  LinkState retryState;
+  uint32_t deadlineMs;
+  uint32_t resumeMs;                                                                                             // End of the current backoff
+  uint8_t failures;                                                                                              // Consecutive, drives the backoff
+  uint16_t attempts;
+  uint32_t rng;                                                                                                  // xorshift32 for the jitter
+};
+
+struct LinkStats {                                                                                               // Link failures since the last successful publish
+  uint16_t wifiFailures;
+  uint16_t mqttFailures;
+  uint16_t linkLosses;
+  uint16_t expiredWakes;
+  uint16_t lastAttempts;                                                                                         // Join + CONNECT attempts of the last successful wake
+  uint32_t lastUpMs;                                                                                             // Wake start to MQTT up
+  uint8_t consecutiveExpired;
+  uint8_t skipWakes;                                                                                             // Flush-due wakes left before the radio is tried again
+};
+
+void linkBegin(LinkFsm& fsm, uint32_t nowMs, uint32_t budgetMs, uint32_t seed);
+LinkAction linkStep(LinkFsm& fsm, LinkStats& stats, LinkEvent event, uint32_t nowMs);
+uint32_t linkWaitMs(const LinkFsm& fsm, uint32_t nowMs);
+uint32_t linkAttemptMs(const LinkFsm& fsm, uint32_t nowMs, uint32_t maxMs);                                      // Timeout for the next join or CONNECT, never past the deadline
+bool linkRadioDue(LinkStats& stats);                                                                             // Call once per flush-due wake, false while backing off across wakes
+size_t serializeLinkStats(const LinkStats& stats, char* out, size_t outSize);
+bool publishLinkFailures(LinkStats& stats);                                                                      // Clears the counters once delivered
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once                                                                                                     // Compact frame of the LoRa uplink, shared by the firmware (loraUplink.h) and the decoder of ThingsBoard/loraGateway
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetryBuffer.h"
+
+// Frame layout (varints and values as in telemetryCodec.h):
+//   version (1 byte) | device address (4 bytes LE) | session (2 bytes LE) | frame counter (2 bytes LE) | record count (1 byte) | records... | MIC (4 bytes)
+//   record = age in s (signed delta, the first one is the age of the oldest reading when the frame is sent) | bootCnt (signed delta, the first one from 0)
+//            | one value per LORA_FIELDS entry
+// The session is drawn at every power-on, when the RTC frame counter starts over: the gateway keeps its repeat window per session.
+// Ages instead of timestamps: a LoRa node never sees NTP, the gateway stamps the readings with its own clock at reception.
+// The MIC is the first 4 bytes of HMAC-SHA256(device token, everything before it): the token never goes on air and a forged or corrupted frame is dropped.
+#define LORA_FRAME_VERSION 2                                                                                     // 2: session nonce
+#define LORA_FRAME_HEADER_LEN 10
+#define LORA_MIC_LEN 4
+#define LORA_FRAME_MAX_LEN 222                                                                                   // Largest loraMaxPayload(), SF7 and SF8
+#define LORA_FRAME_MAX_RECORDS TELEMETRY_BUFFER_CAPACITY                                                         // One RTC batch at most, a frame never gets near it at any data rate
+
+static constexpr TelemetryField LORA_FIELDS[] = {                                                                // Same keys as TELEMETRY_FIELDS minus treeId (the gateway knows it from the address)
+  {"soilTemperature", 2},                                                                                        // 2 bytes each up to 81.91 C: no need to drop the DS18B20's resolution
+  {"soilTemperature2", 2},
+  {"soilTemperature3", 2},
+  {"soilTemperature4", 2},
+  {"soilMoisture", 1},                                                                                           // 1 decimal keeps it at 2 bytes, far below what the FC-38 resolves anyway
+  {"batVoltage", 3},
+  {"sleepS", 0},
+};
+#define LORA_FIELD_COUNT (sizeof(LORA_FIELDS) / sizeof(LORA_FIELDS[0]))
+
+struct LoraFrameHeader {
+  uint8_t version;
+  uint32_t address;
+  uint16_t session;
+  uint16_t counter;
+  uint8_t records;
+};
+
+struct LoraReading {                                                                                             // One decoded record
+  uint32_t ageS;                                                                                                 // Before the frame went out
+  uint32_t bootCnt;
+  TelemetryValue values[LORA_FIELD_COUNT];                                                                       // Same order as LORA_FIELDS
+};
+
+uint32_t loraDeviceAddress(const char* clientId);                                                                // FNV-1a of the client ID: every node runs the same image, no address to provision
+uint32_t loraAirtimeMs(size_t len, uint8_t spreadingFactor, uint32_t bandwidthHz, uint8_t codingRate);           // Semtech AN1200.13, explicit header and CRC, rounded up
+size_t loraMaxPayload(uint8_t spreadingFactor);                                                                  // EU868 dwell limits per data rate (LoRaWAN regional parameters), whole frame
+size_t encodeLoraFrame(const TelemetryBuffer& buffer, uint32_t address, uint16_t session, uint16_t counter, uint64_t nowMs, uint8_t* out, size_t outSize,
+                       uint8_t& records);                                                                        // The oldest readings that fit in outSize (MIC not included), returns the length, 0 if not even one fits
+bool decodeLoraFrame(const uint8_t* frame, size_t len, LoraFrameHeader& header, LoraReading* readings, uint8_t maxReadings); // len without the MIC
\ No newline at end of file
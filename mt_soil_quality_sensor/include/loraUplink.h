@@ -0,0 +1,39 @@
+#pragma once                                                                                                     // LoRa uplink for plots out of Wi-Fi reach: the batch goes out as compact frames (loraFrame.h), within the duty cycle and a daily airtime
+
+#include <stdint.h>
+#include <stddef.h>
+#include "wakeCycle.h"
+#include "telemetryLog.h"
+#include "deviceIdentity.h"
+#include "loraFrame.h"
+
+#define LORA_UPLINK_MAGIC 0x4C4F5241UL                                                                           // "LORA", the RTC state is trusted only with it
+#define LORA_DAY_MS 86400000ULL
+
+enum LoraStatus : uint8_t {
+  LORA_SENT,                                                                                                     // One frame out, its readings are released: no downlink, the gateway counts the gaps in the frame counter
+  LORA_IDLE,                                                                                                     // Nothing waiting, in RTC memory or flash
+  LORA_DEFERRED,                                                                                                 // Duty cycle or daily airtime used up, the readings wait
+  LORA_FAILED,                                                                                                   // The radio did not answer, nothing released
+};
+
+struct LoraUplink {                                                                                              // RTC memory (RTC_DATA_ATTR): the duty cycle spans the deep sleeps
+  uint32_t magic;
+  uint16_t session;                                                                                              // Drawn after a power-on, sent in every frame
+  uint16_t frameCounter;                                                                                         // Next frame, wraps. The gateway drops a repeat within the session
+  uint64_t channelFreeMs;                                                                                        // halEpochMs() from which the duty cycle allows the next frame
+  uint32_t day;                                                                                                  // Day of airtimeTodayMs, in halEpochMs() days
+  uint32_t airtimeTodayMs;
+  uint32_t lastAirtimeMs;                                                                                        // Of the last frame sent...
+  uint8_t lastReadings;                                                                                          // ...and what it carried
+  uint32_t frames;                                                                                               // Since power-on
+  uint32_t readings;
+  uint32_t deferred;
+  uint32_t failures;
+};
+
+void loraUplinkBegin(LoraUplink& lora);                                                                          // Starts over with a new session after a power-on (bad magic), free after a deep sleep
+bool loraFlushDue(const LoraUplink& lora, const WakeState& state, const TelemetryLog& log, uint8_t depth, uint64_t nowMs,
+                  uint8_t pending = 0);                                                                          // A full batch or a flash backlog, and the channel free
+LoraStatus loraUplinkSend(LoraUplink& lora, WakeState& state, TelemetryLog& log, TelemetryBuffer& batch, const DeviceIdentity& identity,
+                          uint8_t depth, uint64_t nowMs);                                                        // One frame at most per call: the flash backlog first, the RTC batch once it is due
\ No newline at end of file
@@ -9,6 +9,13 @@
 #define SDA_PIN 21
 #define SCL_PIN 22
 #define PMU_IRQ_PIN 35                                                                                           // PEK (PWR) button interrupt pin on T-Beam
+#define PMU_IRQ_PIN_MASK (1ULL << PMU_IRQ_PIN)                                                                   // EXT1 deep sleep wakeup, so a short press wakes the device
+#define LORA_SCK_PIN 5                                                                                           // SX1276 on VSPI, powered from the AXP192 LDO2
+#define LORA_MISO_PIN 19
+#define LORA_MOSI_PIN 27
+#define LORA_CS_PIN 18
+#define LORA_RST_PIN 23
+#define LORA_DIO0_PIN 26                                                                                         // TxDone
 // Serial Monitor macros -------------------------------------------------------------------------------------------------------------------------------------
 #define ENABLE_SERIAL true
 
@@ -24,7 +31,7 @@
 // Wi-Fi and MQTT macros -------------------------------------------------------------------------------------------------------------------------------------
 #define WI_FI false
 
-#if WI_FI
+#if WI_FI                                                                                                        // Build defaults, a device can carry its own wifiSsid and wifiPass in the ident partition
   #define WIFI_SSID "WiFi-Rguez-Moya"
   #define WIFI_PASSWORD "Trece131313!"
 #else
@@ -35,10 +42,27 @@
 #define MQTT_SERVER "srv-iot.diatel.upm.es"                                                                      // UPM MQTT broker
 #define MQTT_PORT 8883                                                                                           // MQTT broker port
 #define MQTT_TOPIC_PUB "v1/devices/me/telemetry"
-#define MQTT_CLIENT "soil_quaity_sensor_2"
+#define TELEMETRY_BINARY false                                                                                   // If set to true, readings go out as compact binary frames (telemetryCodec.h) instead of JSON
+#define MQTT_TOPIC_PUB_BINARY "v1/devices/me/telemetry/bin"                                                      // Binary frames topic, ThingsBoard/telemetryBridge republishes them as JSON
+#define MQTT_TOPIC_ATTRIBUTES "v1/devices/me/attributes"                                                         // Shared attribute updates in, client attributes out (deviceConfig.h)
+#define MQTT_TOPIC_ATTRIBUTES_REQUEST "v1/devices/me/attributes/request/1"
+#define MQTT_TOPIC_ATTRIBUTES_RESPONSE "v1/devices/me/attributes/response/+"
+#define MQTT_CLIENT "soil_quaity_sensor_2"                                                                       // Build default, clientId in the ident partition
+#define FAST_REJOIN_TIMEOUT_MS 3000                                                                              // Max time to rejoin with the cached BSSID, channel and lease before falling back to scan + DHCP
+#define WIFI_CONNECT_TIMEOUT_MS 20000                                                                            // Max time for a full scan + DHCP join
+#define WIFI_LEASE_REUSE_S 3600UL                                                                                // Age after which the cached DHCP lease is not reused as static IP any more
+#define BROKER_DNS_TTL_S 3600UL                                                                                  // Lifetime of the cached MQTT_SERVER address
+#define LINK_WAKE_BUDGET_MS 40000UL                                                                              // Radio time allowed per wake, then the reading stays in RTC memory and the node sleeps
+#define LINK_BACKOFF_BASE_MS 500UL                                                                               // First retry delay, doubled on every consecutive failure...
+#define LINK_BACKOFF_MAX_MS 8000UL                                                                               // ...up to this, both jittered by up to -50 %
+#define LINK_MQTT_TIMEOUT_S 5                                                                                    // Socket timeout of the MQTT CONNECT, bounds a stalled broker
+#define LINK_MAX_SKIP_WAKES 8                                                                                    // Flush-due wakes skipped after repeated expired wakes, readings keep being taken
+#define MQTT_INFLIGHT_WINDOW 8                                                                                   // QoS 1 telemetry messages published before waiting for a PUBACK (1 to UPLINK_WINDOW_MAX)
+#define MQTT_ACK_TIMEOUT_MS 5000UL                                                                               // Oldest PUBACK still missing after this: reconnect and send again from RTC memory or flash
+#define CONFIG_RESPONSE_TIMEOUT_MS 3000UL                                                                        // Radio wakes stay up this long at most for the shared attributes asked for on connect
 
 #ifndef ACCESS_TOKEN
-#define ACCESS_TOKEN "UNDEFINED_TOKEN"                                                                           // Unique ThingsBoard device token, MOVED TO plaformio.ini
+#define ACCESS_TOKEN "UNDEFINED_TOKEN"                                                                           // Build default of boards without an ident partition (deviceIdentity.h), the fleet is provisioned with ThingsBoard/nvsProvision
 #endif
 
 #define ROOT_CA "-----BEGIN CERTIFICATE-----\n" \
@@ -77,13 +101,93 @@
 "-----END CERTIFICATE-----\n"                                                                                    // Certificate for MQTT over TLS on Thingsboard
 
 #ifndef TREE_ID
-#define TREE_ID -1                                                                                               // ID of the tree the sensor is measuring its soil, -1 in here IN CASE platformio.ini DOES NOT HAVE THE DECLARATION
+#define TREE_ID -1                                                                                               // Tree whose soil is measured. Build default as well, -1 marks a board that was never provisioned
 #endif
 // Deep sleep macros -----------------------------------------------------------------------------------------------------------------------------------------
-#define SLEEP_DURATION_S 30ULL                                                                                   // Sleep time between messages
+#define SLEEP_DURATION_S 30ULL                                                                                   // First wake after power-on and fallback, the scheduler picks every other interval
+#define SLEEP_MIN_S 30                                                                                           // Soil changing fast (after irrigation, midday). Default of the sleepMinS shared attribute (deviceConfig.h)
+#define SLEEP_MAX_S 900                                                                                          // Stable soil, or critical battery. Default of sleepMaxS
+#define SLEEP_FAST_TEMPERATURE_CPH 1.0f                                                                          // Soil temperature rate (C/h) that gets the shortest sleep
+#define SLEEP_FAST_MOISTURE_PPH 5.0f                                                                             // Moisture rate (percentage points per hour) that gets the shortest sleep
+#define SLEEP_LOW_SOC 0.3f                                                                                       // Below 30 % charge the sleep is stretched...
+#define SLEEP_LOW_SOC_STRETCH 4.0f                                                                               // ...up to 4x on an empty battery
+#define SLEEP_CRITICAL_SOC 0.05f                                                                                 // SLEEP_MAX_S whatever the soil does
+#define SLEEP_DRAIN_VPH 0.05f                                                                                    // Battery falling faster than this (V/h) doubles the sleep, a healthy node loses about 1 mV/h
+#define BATTERY_TREND_PERIOD_S 3600UL                                                                            // Spacing of the battery voltages behind that trend
+#define SLEEP_NIGHT_STRETCH 2.0f                                                                                 // Soil barely moves at night and nobody irrigates
+#define SLEEP_NIGHT_START_H 22
+#define SLEEP_NIGHT_END_H 6                                                                                      // Same value as the start disables it
+#define SLEEP_UTC_OFFSET_H 1                                                                                     // Local time of the orchard (CET, no DST)
+// Batching macros -------------------------------------------------------------------------------------------------------------------------------------------
+#define TELEMETRY_BUFFER_CAPACITY 32                                                                             // Readings that fit in the RTC ring buffer, the oldest one is overwritten when full
+#define BATCH_DEPTH 10                                                                                           // Readings stored before the radio is brought up to flush them (must be <= TELEMETRY_BUFFER_CAPACITY). Default of batchDepth
+#define BATCH_MAX_AGE_S 3600UL                                                                                   // Flush anyway if the oldest stored reading is older than this (several long sleeps)
+#define TELEMETRY_LOG_PARTITION "tlog"                                                                           // Data partition (partitions.csv) with the store-and-forward log, readings that could not be delivered
+#define TELEMETRY_LOG_SUBTYPE 0x40                                                                               // Custom data subtype, nothing in ESP-IDF touches it
+#define TELEMETRY_LOG_DRAIN_MS 30000UL                                                                           // Radio time per wake spent replaying that backlog, TELEMETRY_BUFFER_CAPACITY readings per publish
+#define NTP_SERVER "pool.ntp.org"                                                                                // Used to timestamp the readings, the RTC keeps the time during deep sleep
+#define NTP_SYNC_TIMEOUT_MS 5000                                                                                 // Max wait for the first sync after power-on
 // Sensor macros ---------------------------------------------------------------------------------------------------------------------------------------------
 #define ONE_WIRE_PIN 13                                                                                          // Perfectly fine to use as it is a digital I/O
 #define SOIL_MOIST_PIN 32                                                                                        // Very carefully selected not to use a pin that is already being used by Wi-Fi (ADC2 pins), or other peripherals included on the T-Beam
+#define MOIST_POWER_PIN 25                                                                                       // FC-38 VCC: a GPIO sources its few mA and floats in deep sleep, so the probe is only powered while sampling
 #define TEMPERATURE_SAMPLES 5
+#define PROBE_MAX_COUNT 4                                                                                        // DS18B20s on ONE_WIRE_PIN, one soilTemperature key each in TELEMETRY_FIELDS
+#define PROBE_RESEARCH_WAKES 16                                                                                  // Wakes with a silent probe before the bus is searched again, the ROM codes are cached otherwise
+#define TEMPERATURE_MAX_SAMPLES 16
+#define TEMPERATURE_TIMEOUT_MS 20000                                                                             // Upper bound to wait for a background acquisition (16 samples at 12 bits take 12 s)
 #define MOISTURE_SAMPLES 5
+#define MOISTURE_BLOCK_LEN 64                                                                                    // Raw conversions averaged into one decimated value, the adaptive plan picks how many blocks
+#define ADC_BURST_RATE_HZ 100000                                                                                 // Continuous ADC rate: a 64 sample block takes 0.64 ms
+#define SETTINGS_NAMESPACE "soil"                                                                                // NVS namespace of the per-device settings (calibration points...)
+#define MOISTURE_SETTLE_MS 80                                                                                    // FC-38 output after power-up (comparator board and electrode charge), hidden behind the rest of the wake
+#define MOISTURE_TIMEOUT_MS 1000                                                                                 // Upper bound to wait for the background moisture burst
+#define MOISTURE_MEASURE_EVERY 32                                                                                // Wakes between two measurements of the probe current
+#define PMU_ADC_PERIOD_MS 40                                                                                     // AXP192 current ADC at its default 25 Hz
+// Adaptive acquisition macros -------------------------------------------------------------------------------------------------------------------------------
+#define TEMPERATURE_ADAPTIVE_MIN_SAMPLES 1                                                                       // Used at 9 bits when the soil temperature is stable. Default of tempMinSamples
+#define TEMPERATURE_ADAPTIVE_MAX_SAMPLES 9                                                                       // Used at 12 bits when readings are noisy or changing. Default of tempMaxSamples
+#define TEMPERATURE_QUIET_STDDEV_C 0.1f
+#define TEMPERATURE_NOISY_STDDEV_C 0.5f
+#define TEMPERATURE_QUIET_TREND_C 0.05f                                                                          // Slope per wake
+#define TEMPERATURE_NOISY_TREND_C 0.3f
+#define MOISTURE_ADAPTIVE_MIN_SAMPLES 1                                                                          // Default of moistMinSamples
+#define MOISTURE_ADAPTIVE_MAX_SAMPLES 15                                                                         // Default of moistMaxSamples
+#define MOISTURE_QUIET_STDDEV 0.5f                                                                               // Moisture percentage points
+#define MOISTURE_NOISY_STDDEV 3.0f
+#define MOISTURE_QUIET_TREND 0.5f
+#define MOISTURE_NOISY_TREND 3.0f
+#define OUTLIER_WINDOW 7                                                                                         // Past wakes per probe in the Hampel filter, a step has to last OUTLIER_WINDOW / 2 + 1 wakes to be believed
+#define OUTLIER_K 3.0f                                                                                           // Scaled MADs from the median before a temperature is rejected
+#define TEMPERATURE_OUTLIER_MIN_SIGMA_C 0.25f                                                                    // Spread floor: a steady, quantized probe has a MAD of 0
+// Profiling and energy macros -------------------------------------------------------------------------------------------------------------------------------
+#define WAKE_PROFILE_EVERY 1                                                                                     // Publish the per-phase breakdown of the previous flush on every Nth flush, 0 disables it
+#define BATTERY_CAPACITY_MAH 3000.0f                                                                             // 18650 cell in the T-Beam holder, used for the remaining runtime estimate
+// Maintenance window macros ---------------------------------------------------------------------------------------------------------------------------------
+#define MAINTENANCE_WINDOW_S 120                                                                                 // ArduinoOTA and mDNS stay up this long once a window opens, the node sleeps right after
+#define MAINTENANCE_MIN_SOC 0.3f                                                                                 // Power policy: no window below this state of charge, and an open one closes if the battery sags under it...
+#define MAINTENANCE_USB_VOLTS 4.5f                                                                               // ...unless VBUS is above this: on the technician's cable the battery does not pay for it
+// Pull OTA macros -------------------------------------------------------------------------------------------------------------------------------------------
+#define FIRMWARE_VERSION 1                                                                                       // This build, compared with the fwVersion shared attribute. Bump it for every image packed with ThingsBoard/otaImage
+#define OTA_WAKE_BUDGET_MS 20000UL                                                                               // Download time per flush once the readings are acked, the rest of the image comes on the next flushes
+#define OTA_BYTES_PER_WAKE 262144UL                                                                              // Image file bytes per flush, bounds the radio energy a single wake spends on an update
+#define OTA_MIN_SOC 0.4f                                                                                         // No download below this state of charge, a half written slot just waits
+#define OTA_HTTP_TIMEOUT_S 10                                                                                    // Socket timeout of the image download
+#define OTA_ROOT_CA ROOT_CA                                                                                      // fwUrl served by the ThingsBoard host, replace it for another server
+#define OTA_PUBLIC_KEY "-----BEGIN PUBLIC KEY-----\n" \
+"MFkwEwYHKoZIzj0CAQYIKoZIzj0DAQcDQgAEH3MXubKkBBQKpiNMgYVu5k5ZWiTC\n" \
+"7M2kVZ7YBxGgJFpXM7CwhDYASKwj6LTBbMzT0QH3i+KAwijbclkQU3tMHA==\n" \
+"-----END PUBLIC KEY-----\n"                                                                                     // DEVELOPMENT KEY: generate your own pair (ThingsBoard/otaImage) and paste its public half here before deploying
+// LoRa uplink macros ----------------------------------------------------------------------------------------------------------------------------------------
+#define UPLINK_LORA false                                                                                        // Build default of the uplink identity key: true sends the readings over the SX1276 to ThingsBoard/loraGateway instead of Wi-Fi
+#define LORA_FREQUENCY_HZ 868100000UL                                                                            // EU868 sub-band g1 (868.0-868.6 MHz): 14 dBm ERP, 1 % duty cycle
+#define LORA_SPREADING_FACTOR 9                                                                                  // 7 to 12: each step doubles the airtime and adds about 2.5 dB of link budget
+#define LORA_BANDWIDTH_HZ 125000UL
+#define LORA_CODING_RATE 5                                                                                       // 4/5
+#define LORA_PREAMBLE_LEN 8
+#define LORA_SYNC_WORD 0x12                                                                                      // Private network, LoRaWAN gateways (0x34) ignore these frames
+#define LORA_TX_POWER_DBM 14                                                                                     // PA_BOOST
+#define LORA_TX_TIMEOUT_MS 3000UL                                                                                // TxDone wait, the longest SF12 frame takes about 2.5 s
+#define LORA_DUTY_CYCLE_PCT 1.0f                                                                                 // Regulatory limit of the sub-band: after a frame the node stays quiet for 99 times its airtime
+#define LORA_DAILY_AIRTIME_MS 120000UL                                                                           // Fleet policy on top of it: one channel and one gateway shared by every node, pure ALOHA
 // MACROS END ================================================================================================================================================
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once                                                                                                     // Opt-in maintenance window: ArduinoOTA and mDNS only run when one is asked for, by the PEK, a shared attribute or a flag left in RTC memory
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetrySerializer.h"
+
+#define MAINTENANCE_MAGIC 0x4D4E5431UL                                                                           // "MNT1", the RTC copy is trusted only with it
+#define MAINTENANCE_ATTRIBUTE_KEY "maintenanceReq"                                                               // Shared attribute and NVS key: bumped on the server to ask for one window
+#define MAINTENANCE_REPORT_MAX_LEN 96
+
+static constexpr TelemetryField MAINTENANCE_REPORT_FIELDS[] = {                                                  // Client attributes, published once after each window or refusal
+  {"maintHandled", 0},                                                                                           // Last maintenanceReq served
+  {"maintReason", 0},                                                                                            // MaintenanceReason of the last window
+  {"maintOpenS", 0},                                                                                             // How long it stayed open
+  {"maintRefused", 0},                                                                                           // Requests turned down by the power policy since power-on
+};
+
+enum MaintenanceReason : uint8_t { MAINTENANCE_NONE, MAINTENANCE_PEK, MAINTENANCE_ATTRIBUTE };
+
+struct MaintenanceState {                                                                                        // A request waits here for the next radio wake
+  uint32_t magic;
+  uint32_t handledRequest;                                                                                       // maintenanceReq already served, also in NVS
+  uint8_t requested;                                                                                             // The RTC flag: MaintenanceReason of a window not opened yet, it forces the next wake to bring the radio up
+  uint8_t lastReason;
+  uint16_t lastOpenS;
+  uint16_t refused;
+  bool reportDue;
+};
+
+struct MaintenanceWindow {                                                                                       // Current wake, plain RAM
+  uint32_t openedMs;
+  uint32_t endMs;
+  uint8_t reason;
+  bool open;
+};
+
+void maintenanceBegin(MaintenanceState& state);                                                                  // RTC copy if valid, the handled request from NVS after a power-on
+void requestMaintenance(MaintenanceState& state, MaintenanceReason reason);                                      // Sets the flag, any task. Served by this wake if the link is up, by the next radio wake otherwise
+bool handleMaintenanceAttributes(MaintenanceState& state, const uint8_t* payload, size_t len);                   // True when a newer maintenanceReq set the flag
+bool maintenanceRadioDue(const MaintenanceState& state);
+bool openMaintenance(MaintenanceState& state, MaintenanceWindow& window, float batteryVolts, float vbusVolts, uint32_t nowMs); // Power policy first. True if the services have to be started
+bool maintenanceActive(MaintenanceState& state, MaintenanceWindow& window, float batteryVolts, float vbusVolts, uint32_t nowMs); // Closes the window on its timeout or a sagging battery
+bool publishMaintenance(MaintenanceState& state);                                                                // Client attributes, only when reportDue
\ No newline at end of file
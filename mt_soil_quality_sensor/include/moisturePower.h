@@ -0,0 +1,39 @@
+#pragma once                                                                                                     // FC-38 supply on MOIST_POWER_PIN: on from MOISTURE_SETTLE_MS before the ADC burst until right after it, not the whole wake
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetrySerializer.h"
+#include "signalFilters.h"
+
+#define MOISTURE_POWER_MAGIC 0x4D4F4953UL                                                                        // "MOIS", the RTC stats are trusted only with it
+#define MOISTURE_POWER_MAX_LEN 160
+
+static constexpr TelemetryField MOISTURE_POWER_FIELDS[] = {
+  {"moistOnMs", 0},                                                                                              // Probe powered during the last wake
+  {"moistWaitMs", 0},                                                                                            // Part of the settle time that nothing else overlapped
+  {"moistmA", 2},                                                                                                // Probe current, PMU reading across the power-off edge. Null until measured
+  {"moistDutyPpm", 0},                                                                                           // Powered share of one wake and sleep period
+  {"moistAvguA", 1},                                                                                             // Probe current averaged over that period
+};
+
+struct MoisturePowerStats {                                                                                      // Probe warm-up measured every MOISTURE_MEASURE_EVERY wakes
+  uint32_t magic;
+  uint32_t lastOnMs;
+  uint32_t lastWaitMs;
+  Ewma<float, 4> probemA;                                                                                        // Of the measurements
+  uint16_t wakesToMeasure;                                                                                       // Each measurement costs PMU_ADC_PERIOD_MS, one every MOISTURE_MEASURE_EVERY wakes
+};
+
+struct MoisturePower {                                                                                           // Current wake, plain RAM
+  uint32_t onAtMs;
+  uint32_t waitedMs;
+  bool on;
+};
+
+void moisturePowerOn(MoisturePower& power, MoisturePowerStats& stats);                                           // As early in the wake as possible, the settle time then overlaps with the rest of it
+uint32_t moistureSettleLeftMs(const MoisturePower& power);                                                       // 0 once the output has settled
+void moisturePowerWait(MoisturePower& power);                                                                    // Delays (yielding) for whatever is left of the settle time
+void moisturePowerOff(MoisturePower& power, MoisturePowerStats& stats, bool radioOff);                           // Right after the burst. Measures the probe current now and then, never with the radio on
+float moisturePowerDuty(const MoisturePowerStats& stats, uint32_t sleepS);
+size_t serializeMoisturePower(const MoisturePowerStats& stats, uint32_t sleepS, char* out, size_t outSize);
+bool publishMoisturePower(const MoisturePowerStats& stats, uint32_t sleepS);
\ No newline at end of file
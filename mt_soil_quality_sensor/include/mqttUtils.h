@@ -1,7 +1,8 @@
 #pragma once
 
 #include <PubSubClient.h>
-#include <WiFiClientSecure.h>
+#include "tlsSessionClient.h"
 
-void connectToMQTT(PubSubClient& client, WiFiClientSecure &clientSecure, const char* rootCa, const char* mqttServer, const uint16_t mqttPort);
-void reconnectToMQTT(PubSubClient& client, const char* clientId, const char* token, SemaphoreHandle_t serialSemaphore);
+void connectToMQTT(PubSubClient& client, SessionTLSClient& clientSecure, const char* rootCa, const char* mqttServer, const uint16_t mqttPort);
+void connectToMQTT(PubSubClient& client, SessionTLSClient& clientSecure, const char* rootCa, const char* mqttServer, IPAddress mqttServerIp, const uint16_t mqttPort);
+bool reconnectToMQTT(PubSubClient& client, const char* clientId, const char* token, const char* mqttServer, const uint16_t mqttPort, SemaphoreHandle_t serialSemaphore);
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once                                                                                                     // Pull OTA file format, shared by the firmware (otaPull.cpp) and the host packer (ThingsBoard/otaImage)
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Header, then one record per block of blockSize firmware bytes (the last one shorter): a uint32_t length and that many bytes of zlib stream.
+// Each block is compressed on its own, so a download resumes at any block boundary without the inflater state. Little endian on both ends.
+#define OTA_IMAGE_MAGIC 0x544F5153UL                                                                             // "SQOT"
+#define OTA_BLOCK_MAX_LEN 8192                                                                                   // Firmware bytes per block, one block is inflated into RAM at a time
+#define OTA_BLOCK_STORED 0x80000000UL                                                                            // Flag in the record length: raw bytes, deflate did not shrink them
+#define OTA_SIGNATURE_MAX_LEN 72                                                                                 // DER encoded ECDSA P-256 signature
+
+struct __attribute__((packed)) OtaImageHeader {
+  uint32_t magic;
+  uint32_t version;                                                                                              // FIRMWARE_VERSION of the image, has to match the fwVersion attribute
+  uint32_t imageSize;                                                                                            // Firmware bytes once inflated
+  uint32_t blockSize;
+  uint8_t sha256[32];                                                                                            // Of the inflated firmware
+  uint16_t signatureLen;
+  uint8_t signature[OTA_SIGNATURE_MAX_LEN];                                                                      // ECDSA P-256 over the SHA-256 of the fields above, OTA_PUBLIC_KEY verifies it
+};
+
+#define OTA_SIGNED_LEN offsetof(OtaImageHeader, signatureLen)
\ No newline at end of file
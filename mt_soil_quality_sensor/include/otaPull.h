@@ -0,0 +1,39 @@
+#pragma once                                                                                                     // Pull OTA: the image named by the fwVersion/fwUrl shared attributes is fetched over HTTPS a slice per flush, verified, then booted
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetrySerializer.h"
+#include "otaImage.h"
+
+#define OTA_PULL_MAGIC 0x4F544150UL                                                                              // "OTAP", download progress is kept across deep sleep only with it
+#define OTA_ATTRIBUTE_KEYS "fwVersion,fwUrl"                                                                     // Asked for along with the settings (requestDeviceConfig())
+#define OTA_URL_MAX_LEN 160
+#define OTA_REPORT_MAX_LEN 96
+
+static constexpr TelemetryField OTA_REPORT_FIELDS[] = {                                                          // Client attributes, published while an update is offered and once after it ends
+  {"fwRunning", 0},
+  {"fwOffered", 0},                                                                                              // fwVersion being downloaded, 0 if none
+  {"fwProgress", 0},                                                                                             // Percent of the image in the inactive slot
+  {"fwFailed", 0},                                                                                               // Last version that failed its checks, not fetched again until a newer one is offered
+};
+
+struct OtaPull {                                                                                                 // A download spans many wakes
+  uint32_t magic;
+  uint32_t runningVersion;                                                                                       // FIRMWARE_VERSION, set by otaPullBegin()
+  uint32_t offeredVersion;
+  char url[OTA_URL_MAX_LEN];
+  OtaImageHeader header;                                                                                         // Checked and its signature verified once fileOffset is past it
+  uint32_t fileOffset;                                                                                           // Image file bytes consumed, always at a record boundary
+  uint32_t written;                                                                                              // Firmware bytes in the inactive slot
+  uint32_t failedVersion;
+  bool reportDue;                                                                                                // Offer ended (activated, rejected, confirmed), not published yet
+};
+
+enum OtaStatus : uint8_t { OTA_IDLE, OTA_PARTIAL, OTA_READY, OTA_RETRY, OTA_REJECTED };
+
+void otaPullBegin(OtaPull& ota, uint32_t runningVersion);
+bool handleOtaAttributes(OtaPull& ota, const uint8_t* payload, size_t len);                                      // Shared attributes response or push. True on a new offer, progress restarts from 0
+bool otaPullDue(const OtaPull& ota, float batteryVolts);                                                         // Offered, newer than the running image, not failed, and enough charge
+OtaStatus otaPullStep(OtaPull& ota, uint32_t budgetMs, uint32_t maxBytes);                                       // One slice. OTA_READY: slot verified and activated, reset to boot it
+void otaPullConfirm(OtaPull& ota);                                                                               // First flush of a new image acked: cancels the rollback
+bool publishOtaStatus(OtaPull& ota);                                                                             // Client attributes, on every flush while an offer is open and once after it ends
\ No newline at end of file
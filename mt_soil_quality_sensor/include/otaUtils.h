@@ -1,3 +1,4 @@
 #pragma once
 
-void setupOTA();
\ No newline at end of file
+void setupOTA();
+void stopOTA();
\ No newline at end of file
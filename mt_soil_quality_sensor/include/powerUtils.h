@@ -3,4 +3,9 @@
 #include <axp20x.h>
 
 void setupPower(AXP20X_Class& axp192, const uint8_t pmuIRQPin, void (*isr)());
-void pekThreadRoutine(volatile bool* pekPressedFlag, AXP20X_Class& axp192, SemaphoreHandle_t serialSemaphore);
\ No newline at end of file
+enum PekAction : uint8_t {
+  PEK_NONE,                                                                                                      // Another AXP192 IRQ, cleared all the same
+  PEK_SHORT,                                                                                                     // A long press never returns, the device is already off
+};
+
+PekAction pekThreadRoutine(AXP20X_Class& axp192, SemaphoreHandle_t serialSemaphore);                             // Reads and clears the AXP192 IRQs, serialSemaphore may be NULL before the tasks exist
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once                                                                                                     // DS18B20 probes sharing ONE_WIRE_PIN: ROM codes searched once, then every probe is addressed directly
+
+#include <stdint.h>
+#include "hal.h"
+#include "macros.h"
+
+#define PROBE_BUS_MAGIC 0x50524F42UL                                                                             // "PROB", the RTC cache is trusted only with it
+
+struct ProbeBus {                                                                                                // Bus map of the last ROM search
+  uint32_t magic;
+  uint8_t count;                                                                                                 // Slots in use
+  uint8_t roms[PROBE_MAX_COUNT][HAL_PROBE_ROM_LEN];                                                              // A slot keeps its probe, so its depth, across searches
+  uint8_t silentWakes;                                                                                           // Consecutive wakes with a slot that went silent since the last search
+  uint8_t missing;                                                                                               // Bit per slot the last search did not find: its silence is known, no search for it
+};
+
+uint8_t probeBusBegin(ProbeBus& bus);                                                                            // Searches after a power-on (added probes) or PROBE_RESEARCH_WAKES silent wakes (replaced ones)
+void probeBusReport(ProbeBus& bus, const float* temperaturesC);                                                  // PROBE_MAX_COUNT medians of this wake, see sampleTemperatureMediansC()
\ No newline at end of file
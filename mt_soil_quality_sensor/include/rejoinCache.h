@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+struct RejoinCache {                                                                                             // Last AP, lease and broker address
+  bool valid;                                                                                                    // Set once a join succeeded, cleared when the fast path fails
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip;                                                                                                   // DHCP lease reused as a static configuration
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint64_t leaseObtainedMs;
+  uint32_t brokerIp;                                                                                             // Resolved MQTT_SERVER, 0 when unknown
+  uint64_t brokerExpiresMs;
+  uint32_t lastRejoinMs;                                                                                         // Association + IP time of this wake
+  bool lastRejoinFast;
+  bool lastBrokerCached;
+};
+
+bool leaseReusable(const RejoinCache& cache, uint64_t nowMs, uint32_t maxAgeS);
+bool brokerAddressCached(const RejoinCache& cache, uint64_t nowMs);
+void storeBrokerAddress(RejoinCache& cache, uint32_t ip, uint64_t nowMs, uint32_t ttlS);
+void forgetRejoin(RejoinCache& cache);
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma once                                                                                                     // Sample loops on top of hal.h, shared by the firmware and the host simulation
+
+#include <stdint.h>
+#include <stddef.h>
+#include "probeBus.h"
+
+#define SOIL_MOIST_DRY_MV 625.0f                                                                                 // FC-38 in air (raw 605 through a typical 11 dB curve), until the bench value is in NVS
+#define SOIL_MOIST_WET_MV 540.0f                                                                                 // FC-38 in water (raw 500)
+#define SOIL_MOIST_DRY_KEY "moistDryMv"                                                                          // NVS u32 keys in SETTINGS_NAMESPACE, millivolts. Also shared attributes, loaded with the rest of deviceConfig.h
+#define SOIL_MOIST_WET_KEY "moistWetMv"
+
+struct MoistureCalibration {                                                                                     // Per device: probes and ADC references differ by tens of mV
+  float dryMv;
+  float wetMv;
+};
+
+void sampleTemperatureMediansC(const ProbeBus& bus, uint8_t samples, float* mediansC);                           // One median per slot (PROBE_MAX_COUNT values), NAN for unused slots
+float decimatedMedian(const uint16_t* raw, size_t count, uint16_t blockLen);                                     // Block means (decimation), then their median, in one pass
+float soilMoisturePercent(float millivolts, const MoistureCalibration& calibration);
+float sampleMoistureMillivolts(uint8_t blocks);                                                                  // One DMA burst of blocks * MOISTURE_BLOCK_LEN conversions
+float sampleMoisturePercent(const MoistureCalibration& calibration, uint8_t blocks);
\ No newline at end of file
@@ -1,5 +1,14 @@
 #pragma once
 
-void initSensors();
-float getMedianTemperatureC(uint8_t samples);
-float getMedianSoilMoisture(uint8_t samples);
\ No newline at end of file
+#include <stdint.h>
+#include "probeBus.h"
+#include "moisturePower.h"
+#include "sampling.h"
+
+void initSensors(const MoistureCalibration& calibration);                                                        // From the RTC copy of the device settings, no NVS read
+void startTemperatureAcquisition(const ProbeBus& bus, uint8_t samples);
+bool waitMedianTemperaturesC(float* mediansC, uint32_t timeoutMs);                                               // PROBE_MAX_COUNT values, all HAL_PROBE_DISCONNECTED_C on a timeout
+void getMedianTemperaturesC(const ProbeBus& bus, uint8_t samples, float* mediansC);
+float getMoisturePercent(uint8_t blocks);                                                                        // One ADC burst through the calibration given to initSensors()
+void startMoistureAcquisition(MoisturePower& power, MoisturePowerStats& stats, uint8_t blocks, bool radioOff);   // Burst once the probe has settled, then powers it off
+float waitMoisturePercent(uint32_t timeoutMs);                                                                   // NAN on a timeout
\ No newline at end of file
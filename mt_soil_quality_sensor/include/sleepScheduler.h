@@ -0,0 +1,36 @@
+#pragma once                                                                                                     // Next deep sleep length from the battery, the soil dynamics and the time of day. Pure, so the host simulation runs the same decisions
+
+#include <stdint.h>
+
+struct SleepLimits {
+  uint32_t minS;                                                                                                 // Used while the soil is changing fast
+  uint32_t maxS;                                                                                                 // Used while it is stable, and whenever the battery is critical
+  float fastTemperatureCph;                                                                                      // |dT/dt| (C/h) at or above which the shortest sleep is used
+  float fastMoisturePph;                                                                                         // Same for moisture, percentage points per hour
+  float lowSoc;                                                                                                  // Below this state of charge the sleep is stretched...
+  float lowSocStretch;                                                                                           // ...up to this factor when the battery is empty
+  float criticalSoc;                                                                                             // Below this the longest sleep is always used
+  float drainVph;                                                                                                // Falling faster than this (V/h) doubles the sleep
+  float nightStretch;
+  uint8_t nightStartH;                                                                                           // Local hours, the night may wrap around midnight
+  uint8_t nightEndH;
+  int8_t utcOffsetH;
+};
+
+struct SleepInputs {
+  float batteryVolts;
+  float batteryTrendVph;
+  float temperatureTrendC;                                                                                       // Per wake, from the acquisition histories
+  float moistureTrend;
+  uint32_t lastSleepS;                                                                                           // Turns the per-wake trends into rates
+  uint64_t epochMs;                                                                                              // The night is only applied once the clock is valid
+};
+
+struct SleepPlan {
+  uint32_t seconds;
+  float dynamics;                                                                                                // 0 (stable soil) to 1 (fast changes)
+  float batteryStretch;                                                                                          // 1 unless the battery is low or draining fast
+  bool night;
+};
+
+SleepPlan planSleep(const SleepInputs& inputs, const SleepLimits& limits);
\ No newline at end of file
@@ -1,4 +1,5 @@
 #pragma once
 
 void sleep_interrupt(gpio_num_t gpio, uint8_t mode);
+void sleep_interrupt_low(uint64_t gpioMask);
 void sleep_seconds(uint64_t seconds);
\ No newline at end of file
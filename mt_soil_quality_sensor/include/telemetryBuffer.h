@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "macros.h"
+#include "telemetrySerializer.h"
+#include "telemetryCodec.h"
+
+#define TELEMETRY_RECORD_MAX_LEN 240                                                                             // Worst case length of one serialized '{"ts":..,"values":{..}}' record
+#define TELEMETRY_BATCH_MAX_LEN (2 + TELEMETRY_BUFFER_CAPACITY * (TELEMETRY_RECORD_MAX_LEN + 1) + 1)             // Whole buffer as a JSON array, null terminator included
+#define TELEMETRY_FRAME_MAX_LEN (2 + TELEMETRY_VARINT_MAX_LEN + TELEMETRY_BUFFER_CAPACITY * 10 * TELEMETRY_VARINT_MAX_LEN) // Worst case binary frame (timestamp delta plus nine fields per record)
+
+static constexpr TelemetryField TELEMETRY_FIELDS[] = {                                                           // Schema of every reading, the key names and precision live only here
+  {"treeId", 0},
+  {"bootCnt", 0},
+  {"soilTemperature", 2},                                                                                        // First probe slot, same key as with a single probe
+  {"soilTemperature2", 2},                                                                                       // Deeper slots, null without a probe
+  {"soilTemperature3", 2},
+  {"soilTemperature4", 2},
+  {"soilMoisture", 2},
+  {"batVoltage", 3},
+  {"sleepS", 0},
+};
+static_assert(PROBE_MAX_COUNT == 4, "TELEMETRY_FIELDS has one soilTemperature key per probe slot");
+
+struct TelemetryRecord {
+  uint64_t timestampMs;                                                                                          // Epoch time in ms (may be unsynced, see shiftUnsyncedTimestamps)
+  uint32_t bootCnt;
+  float soilTemp[PROBE_MAX_COUNT];                                                                               // One median per probe slot, see probeBus.h
+  float soilMoist;
+  float batVolt;
+  uint32_t sleepS;                                                                                               // Deep sleep chosen after this reading, so the scheduler can be audited
+};
+
+struct TelemetryBuffer {                                                                                         // Readings not acknowledged yet
+  TelemetryRecord records[TELEMETRY_BUFFER_CAPACITY];
+  uint8_t head;                                                                                                  // Index of the oldest record
+  uint8_t count;
+};
+
+void clearTelemetryBuffer(TelemetryBuffer& buffer);
+void pushTelemetryRecord(TelemetryBuffer& buffer, const TelemetryRecord& record);
+const TelemetryRecord& telemetryRecordAt(const TelemetryBuffer& buffer, uint8_t index);
+void popTelemetryRecords(TelemetryBuffer& buffer, uint8_t count);                                                // Drops the 'count' oldest, once they are delivered or in flash
+bool telemetryFlushDue(const TelemetryBuffer& buffer, uint64_t nowMs, uint8_t depth, uint32_t maxAgeS, uint8_t pending = 0);
+void shiftUnsyncedTimestamps(TelemetryBuffer& buffer, int64_t deltaMs);
+size_t serializeTelemetryBatch(const TelemetryBuffer& buffer, int treeId, char* out, size_t outSize);
+size_t encodeTelemetryBatch(const TelemetryBuffer& buffer, int treeId, uint8_t* out, size_t outSize);
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once                                                                                                     // Store-and-forward log of readings in a dedicated flash partition, survives outages of any length and power cycles
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetryBuffer.h"
+
+#define TELEMETRY_LOG_MAGIC 0x544C4F47UL                                                                         // "TLOG", the RTC cursor is trusted only with it
+#define TELEMETRY_LOG_MARK 0x00000000UL                                                                          // Commit and consumed markers are programmed over erased (0xFFFFFFFF) words
+
+struct TelemetryLogEntry {                                                                                       // Fixed size slots, a flash sector never holds a partial one
+  uint32_t seq;                                                                                                  // Monotonic across power cycles, erased in a free slot
+  uint32_t crc;                                                                                                  // CRC-32 of seq and record
+  TelemetryRecord record;
+  uint32_t committed;                                                                                            // Programmed after the rest, a slot torn by a reset is skipped
+  uint32_t consumed;                                                                                             // Programmed on the last slot of every delivered batch
+};
+
+struct TelemetryLog {                                                                                            // Flash ring cursor, only a power-on pays the scan
+  uint32_t magic;
+  uint32_t slots;                                                                                                // 0 without a log partition, every call is then a no-op
+  uint32_t readSlot;                                                                                             // Oldest undelivered slot
+  uint32_t writeSlot;                                                                                            // Next free slot, the ring never lets it catch up with readSlot
+  uint32_t nextSeq;
+  uint32_t sessionSeq;                                                                                           // First sequence number written since power-on
+  int64_t clockShiftMs;                                                                                          // First NTP sync correction of this power-on, 0 until then
+  uint32_t dropped;                                                                                              // Readings lost since power-on: overwritten by the ring or stamped by a clock never synced
+};
+
+bool telemetryLogBegin(TelemetryLog& log);                                                                       // Recovers the cursor from flash after a power-on, free after a deep sleep
+uint32_t telemetryLogPending(const TelemetryLog& log);                                                           // Slots not delivered yet, torn ones included until they are skipped
+bool telemetryLogAppend(TelemetryLog& log, const TelemetryRecord& record);
+uint8_t spillTelemetryBuffer(TelemetryLog& log, TelemetryBuffer& buffer);                                        // Moves the RTC readings to flash, returns how many
+void telemetryLogClockSynced(TelemetryLog& log, int64_t deltaMs);                                                // Same delta as shiftUnsyncedTimestamps(), applied when replaying
+uint32_t loadTelemetryLog(const TelemetryLog& log, uint32_t fromSlot, TelemetryBuffer& batch, uint8_t& skipped,
+                          uint8_t maxRecords = TELEMETRY_BUFFER_CAPACITY);                                       // Readings from fromSlot on, returns the slot after the last one read
+void consumeTelemetryLog(TelemetryLog& log, uint32_t endSlot, uint8_t skipped);                                  // Everything before endSlot was delivered, 'skipped' from loadTelemetryLog() is dropped
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once                                                                                                     // Stats and client attribute reports: serialized on the stack, one QoS 0 publish
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal.h"
+#include "macros.h"
+#include "telemetrySerializer.h"
+
+inline bool publishReport(const char* topic, const char* payload, size_t len){                                   // len 0: did not fit, nothing sent
+  return len > 0 && halMqttPublish(topic, (const uint8_t*)payload, len);
+}
+
+template <size_t Len, size_t N>
+bool publishReport(const char* topic, const TelemetryField (&fields)[N], const TelemetryValue (&values)[N]){
+  char payload[Len];
+  return publishReport(topic, payload, serializeTelemetry(payload, sizeof(payload), fields, values));
+}
+
+template <size_t Len, size_t N>
+bool publishAttributeReport(bool& due, const TelemetryField (&fields)[N], const TelemetryValue (&values)[N]){    // Clears due once sent
+  if(!publishReport<Len>(MQTT_TOPIC_ATTRIBUTES, fields, values)) return false;
+  due = false;
+  return true;
+}
\ No newline at end of file
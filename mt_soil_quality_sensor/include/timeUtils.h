@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+#define VALID_EPOCH_MS 1577836800000ULL                                                                          // 2020-01-01, anything older means the clock was never synced since power-on
+
+uint64_t epochMs();
+bool clockIsValid();
+bool syncClock(const char* ntpServer, uint32_t timeoutMs);
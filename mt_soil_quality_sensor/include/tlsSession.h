@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+#define TLS_SESSION_MAX_LEN 512                                                                                  // Serialized mbedTLS session without the peer certificate: ticket, ID and master secret
+#define TLS_MASTER_SECRET_LEN 48
+
+struct TlsSessionCache {                                                                                         // Session of the last full handshake
+  uint16_t len;                                                                                                  // 0 when there is nothing to resume
+  uint8_t data[TLS_SESSION_MAX_LEN];
+};
+
+struct TlsSessionStats {                                                                                         // Resumption hit rate and time saved, published after each flush
+  uint32_t fullHandshakes;
+  uint32_t resumedHandshakes;
+  uint32_t failedHandshakes;
+  uint32_t fullAvgMs;                                                                                            // Running averages (1/8 weight for the newest handshake)
+  uint32_t resumedAvgMs;
+  uint32_t lastHandshakeMs;
+  uint32_t savedMs;                                                                                              // Accumulated time saved by resumed handshakes against the full average
+};
+
+void recordTlsHandshake(TlsSessionStats& stats, bool resumed, uint32_t elapsedMs);
+void recordTlsHandshakeFailure(TlsSessionStats& stats);
+uint8_t tlsResumptionRate(const TlsSessionStats& stats);
+bool tlsSessionResumed(const uint8_t* offeredMaster, const uint8_t* negotiatedMaster);                           // NULL when nothing was offered
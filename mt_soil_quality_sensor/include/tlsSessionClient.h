@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Client.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#include "tlsSession.h"
+
+#define TLS_HANDSHAKE_TIMEOUT_MS 15000
+
+// TLS client that resumes the previous session (ticket or ID) stored in RTC memory and falls back to a full handshake ---------------------------------------
+class SessionTLSClient : public Client {
+public:
+  SessionTLSClient(Client& transport, TlsSessionCache& cache, TlsSessionStats& stats);
+  ~SessionTLSClient();
+
+  void setCACert(const char* rootCa);
+  void setHostname(const char* hostname);                                                                        // Needed for SNI and certificate checks when connecting by IP
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char* host, uint16_t port) override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size) override;
+  int peek() override;
+  void flush() override;
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+
+private:
+  int handshake();
+  void saveSession(mbedtls_ssl_session& session);
+  void freeContexts();
+  static int sendCallback(void* ctx, const unsigned char* buf, size_t len);
+  static int recvCallback(void* ctx, unsigned char* buf, size_t len);
+
+  Client& transport;
+  TlsSessionCache& cache;
+  TlsSessionStats& stats;
+  const char* rootCa = NULL;
+  const char* hostname = NULL;
+  bool secured = false;
+  int peeked = -1;
+
+  mbedtls_ssl_context ssl;
+  mbedtls_ssl_config conf;
+  mbedtls_ctr_drbg_context drbg;
+  mbedtls_entropy_context entropy;
+  mbedtls_x509_crt caCert;
+};
@@ -0,0 +1,44 @@
+#pragma once                                                                                                     // Telemetry uplink: QoS 1 publishes with a window of unacknowledged messages, the RTC batch first and then the flash backlog
+
+#include <stdint.h>
+#include <stddef.h>
+#include "wakeCycle.h"
+#include "telemetryLog.h"
+
+#define UPLINK_WINDOW_MAX 16                                                                                     // Upper bound of MQTT_INFLIGHT_WINDOW
+#define UPLINK_POLL_MS 100                                                                                       // Longest wait for a PUBACK per uplinkPump() call, the MQTT task keeps its 100 ms tick
+
+enum UplinkStatus : uint8_t {
+  UPLINK_BUSY,                                                                                                   // Messages in flight or still to send
+  UPLINK_DONE,                                                                                                   // RTC batch acknowledged, backlog drained (or not asked for) and nothing in flight
+  UPLINK_FAILED,                                                                                                 // A PUBACK timed out or the connection dropped: reconnect, then uplinkRewind()
+};
+
+struct UplinkMessage {                                                                                           // One PUBLISH waiting for its PUBACK
+  uint16_t packetId;
+  uint32_t sentMs;
+  bool live;                                                                                                     // The RTC batch, otherwise the flash slots up to endSlot
+  bool acked;
+  uint32_t endSlot;
+  uint8_t readings;
+  uint8_t skipped;
+};
+
+struct Uplink {                                                                                                  // One wake, plain RAM
+  UplinkMessage inflight[UPLINK_WINDOW_MAX];                                                                     // Oldest first, storage is released in this order only
+  uint8_t window;
+  uint8_t count;
+  uint16_t nextPacketId;
+  uint32_t sendSlot;                                                                                             // Next flash slot to publish, ahead of the log read cursor by what is in flight
+  bool liveSent;
+  bool liveAcked;
+  uint32_t messagesAcked;
+  uint32_t readingsAcked;
+  uint16_t rewinds;                                                                                              // Reconnections that had messages in flight
+};
+
+void uplinkBegin(Uplink& up, uint8_t window);
+void uplinkRewind(Uplink& up, const TelemetryLog& log);                                                          // After every MQTT CONNECT (clean session): whatever was in flight is sent again
+UplinkStatus uplinkPump(Uplink& up, WakeState& state, TelemetryLog& log, TelemetryBuffer& batch, int treeId, uint8_t* payload, size_t payloadSize,
+                        bool drainLog);
+bool uplinkIdle(const Uplink& up);                                                                               // Nothing in flight
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once                                                                                                     // Per-wake logic shared by main.cpp and the host simulation (native/simMain.cpp)
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetryBuffer.h"
+#include "telemetryLog.h"
+#include "acquisitionPolicy.h"
+#include "sleepScheduler.h"
+#include "signalFilters.h"
+#include "deviceConfig.h"
+#include "macros.h"
+
+struct WakeState {                                                                                               // Everything a wake inherits from the previous ones, RTC memory (RTC_DATA_ATTR) on the ESP32
+  uint32_t bootCount;
+  TelemetryBuffer buffer;
+  AcquisitionHistory temperatureHistory;
+  AcquisitionHistory moistureHistory;
+  AcquisitionHistory batteryHistory;                                                                             // Voltage trend for the sleep scheduler, one value every BATTERY_TREND_PERIOD_S
+  uint64_t batteryRecordedMs;
+  uint32_t sleepS;                                                                                               // Chosen by the last storeWakeReading()
+  HampelFilter<float, OUTLIER_WINDOW> temperatureFilters[PROBE_MAX_COUNT];                                       // Per probe slot across wakes, an 85 C reset reading or a glitch is replaced by the median
+};
+
+#define WAKE_PAYLOAD_MAX_LEN TELEMETRY_BATCH_MAX_LEN                                                             // Fits the JSON array, so the binary frame (TELEMETRY_FRAME_MAX_LEN) too
+
+AcquisitionPlan planWakeTemperature(const WakeState& state, const DeviceConfig& config);                         // Sample and resolution bounds from the device settings
+uint8_t planWakeMoistureSamples(const WakeState& state, const DeviceConfig& config);
+SleepPlan storeWakeReading(WakeState& state, const DeviceConfig& config, uint64_t timestampMs, const float* soilTemps, float soilMoist,
+                           float batVolt);                                                                       // Filters the temperatures, plans the next sleep (state.sleepS)
+uint32_t temperatureOutliers(const WakeState& state);                                                            // Rejected by the Hampel filters since power-on, every probe
+uint8_t spillWakeBatch(WakeState& state, TelemetryLog& log, bool linkFailed);                                    // Readings go to flash when the link failed or the RTC ring is full
\ No newline at end of file
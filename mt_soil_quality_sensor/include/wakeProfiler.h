@@ -0,0 +1,58 @@
+#pragma once                                                                                                     // Per-phase wake timing, the breakdown of the last flush is kept in RTC memory and published on the next one
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetrySerializer.h"
+
+#define WAKE_PROFILE_MAX_LEN 256
+
+enum WakePhase : uint8_t {                                                                                       // Phases may overlap (sampling runs during the network ones), so they do not add up to the total
+  PHASE_BOOT,                                                                                                    // Reset to setup(): ROM, bootloader and static init
+  PHASE_POWER,                                                                                                   // AXP192 bring-up and rails
+  PHASE_SENSORS,                                                                                                 // Probe init and acquisition plan
+  PHASE_SAMPLING,                                                                                                // First conversion until the reading is stored
+  PHASE_WIFI,
+  PHASE_OTA,
+  PHASE_MQTT,                                                                                                    // Broker address, TLS handshake and MQTT CONNECT
+  PHASE_PUBLISH,                                                                                                 // Clock sync, serialization and publish
+  PHASE_COUNT
+};
+
+static constexpr TelemetryField WAKE_PROFILE_FIELDS[] = {                                                        // ms, same order as WakePhase plus the totals
+  {"tBoot", 1}, {"tPower", 1}, {"tSensors", 1}, {"tSampling", 1}, {"tWifi", 1}, {"tOta", 1}, {"tMqtt", 1}, {"tPublish", 1},
+  {"tWake", 1},                                                                                                  // Whole flush wake, reset to deep sleep
+  {"tQuietWake", 1},                                                                                             // Last sample-only wake
+};
+
+struct WakeProfile {
+  uint32_t phaseUs[PHASE_COUNT];
+  uint32_t totalUs;
+  float phasemAh[PHASE_COUNT];                                                                                   // Battery charge drawn during each phase, integrated from the PMU current ADC
+  float totalmAh;
+};
+
+struct WakeProfileHistory {                                                                                      // Published on the flush after the one it describes
+  WakeProfile lastFlush;                                                                                         // Last wake that brought the radio up
+  uint32_t lastQuietUs;
+  float lastQuietmAh;
+  uint16_t flushes;                                                                                              // Drives the sampled publishing
+  bool valid;
+};
+
+struct WakeProfiler {                                                                                            // Current wake, plain RAM
+  uint64_t startUs[PHASE_COUNT];
+  float startmAh[PHASE_COUNT];
+  float chargemAh;                                                                                               // Running integral since the end of boot
+  uint64_t lastSampleUs;
+  float lastmA;
+  bool currentValid;                                                                                             // False until the PMU answers, the gap is charged at the first valid reading
+  WakeProfile current;
+};
+
+void profileBegin(WakeProfiler& profiler);
+void profileStart(WakeProfiler& profiler, WakePhase phase);
+void profileEnd(WakeProfiler& profiler, WakePhase phase);                                                        // Adds up, a phase may run more than once (e.g. MQTT reconnects)
+void profileFinish(WakeProfiler& profiler, WakeProfileHistory& history, bool flushed);
+bool profilePublishDue(const WakeProfileHistory& history, uint16_t every);
+size_t serializeWakeProfile(const WakeProfileHistory& history, char* out, size_t outSize);
+bool publishWakeProfile(const WakeProfileHistory& history);
\ No newline at end of file
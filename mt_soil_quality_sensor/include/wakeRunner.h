@@ -0,0 +1,107 @@
+#pragma once                                                                                                     // One wake from the first reading to deep sleep, shared by main.cpp, native/simMain.cpp and ThingsBoard/fleetLoad. The drivers only bring the hardware specific steps (WakeHooks)
+
+#include <stdint.h>
+#include <stddef.h>
+#include "wakeCycle.h"
+#include "wakeProfiler.h"
+#include "energyAccount.h"
+#include "linkFsm.h"
+#include "uplink.h"
+#include "telemetryLog.h"
+#include "deviceConfig.h"
+#include "deviceIdentity.h"
+#include "otaPull.h"
+#include "maintenanceWindow.h"
+#include "loraUplink.h"
+#include "probeBus.h"
+#include "moisturePower.h"
+
+#define WAKE_SERVE_TICK_MS 100                                                                                   // Idle step of the connected loop: keepalive, attributes and the maintenance window
+
+enum WakeKind : uint8_t {
+  WAKE_QUIET,                                                                                                    // Reading stored, radio off
+  WAKE_LORA,                                                                                                     // One frame at most, then sleep
+  WAKE_RADIO,                                                                                                    // Wi-Fi and MQTT: flush, backlog, settings, firmware and maintenance
+};
+
+enum WakeNote : uint8_t {                                                                                        // What WakeHooks::report() is told, detail in brackets
+  WAKE_READING,                                                                                                  // Stored in the RTC batch, see lastTemperaturesC and lastMoisturePercent
+  WAKE_SPILLED,                                                                                                  // [readings moved to flash]
+  WAKE_LORA_SENT,                                                                                                // [LoraStatus]
+  WAKE_PUBLISH_FAILED,
+  WAKE_ACKED,                                                                                                    // Live batch acknowledged, the stats frames follow
+  WAKE_TRIAL_CONFIRMED,                                                                                          // [firmware version kept]
+  WAKE_CONFIG,                                                                                                   // [ConfigResult], badKey set when rejected
+  WAKE_FIRMWARE_OFFERED,                                                                                         // [offered version]
+  WAKE_MAINTENANCE_REQUESTED,
+  WAKE_MAINTENANCE_OPENED,
+  WAKE_MAINTENANCE_CLOSED,                                                                                       // [seconds it stayed open]
+  WAKE_MAINTENANCE_REFUSED,
+  WAKE_FIRMWARE,                                                                                                 // [OtaStatus of the slice pulled before sleeping]
+  WAKE_FLUSHED,                                                                                                  // Everything done, about to sleep
+  WAKE_BUDGET_SPENT,                                                                                             // [readings moved to flash]
+};
+
+struct WakeRetained {                                                                                            // What the wakes pass on to each other: one RTC_DATA_ATTR object on the ESP32
+  WakeState wake;
+  DeviceConfig config;
+  LinkStats linkStats;
+  TelemetryLog log;
+  WakeProfileHistory profileHistory;
+  EnergyLedger energyLedger;
+  ProbeBus probeBus;
+  MoisturePowerStats moisturePowerStats;
+  OtaPull otaPull;
+  MaintenanceState maintenance;
+  LoraUplink lora;
+};
+
+#define WAKE_RETAINED_INIT \
+  {{1, {}, {}, {}, {}, 0, SLEEP_DURATION_S, {}}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}}                         // Boot counter from 1 and the default sleep, everything else zero
+
+struct WakeRunner;
+
+struct WakeHooks {                                                                                               // Driver specific steps. The optional ones may be NULL
+  void (*acquire)(WakeRunner& run, float* temperaturesC, float& moisturePercent);                                // The readings: waits for the background tasks on the ESP32, samples in place on the host
+  bool (*join)(WakeRunner& run, uint32_t timeoutMs);                                                             // One network join bounded by timeoutMs
+  bool (*connect)(WakeRunner& run);                                                                              // One MQTT CONNECT, broker lookup and TLS included
+  void (*publishStats)(WakeRunner& run);                                                                         // Optional: extra counters after the flush (TLS, rejoin)
+  void (*maintenanceOpen)();                                                                                     // Optional: ArduinoOTA and mDNS
+  void (*maintenanceServe)();
+  void (*maintenanceClose)();
+  void (*report)(WakeRunner& run, WakeNote note, uint32_t detail);                                               // Optional: serial log or the simulation line
+  void (*restart)();                                                                                             // Optional: boot the verified image, the host keeps running
+};
+
+struct WakeRunner {                                                                                              // Current wake, plain RAM
+  WakeRetained* kept;
+  const DeviceIdentity* identity;
+  const WakeHooks* hooks;
+  WakeKind kind;
+  bool forceFlush;                                                                                               // PEK press or trial image: radio wake whatever the batch says
+  bool trialBoot;
+  AcquisitionPlan temperaturePlan;
+  uint8_t moistureSamples;
+  uint64_t readingTimestampMs;                                                                                   // Start of the acquisition
+  bool readingStored;
+  float lastTemperaturesC[PROBE_MAX_COUNT];
+  float lastMoisturePercent;
+  const char* badKey;                                                                                            // Of the last rejected settings
+  LinkFsm link;
+  Uplink uplink;
+  WakeProfiler profiler;
+  ConfigSync configSync;
+  MoisturePower moisturePower;
+  MaintenanceWindow maintenanceWindow;
+  TelemetryBuffer logBatch;                                                                                      // Flash backlog batch being replayed
+  uint8_t payload[WAKE_PAYLOAD_MAX_LEN];                                                                         // Too big for a task stack
+};
+
+void wakeBegin(WakeRunner& run, WakeRetained& kept, const DeviceIdentity& identity, const WakeHooks& hooks);     // First thing after the reset, starts the profiler
+AcquisitionPlan wakePlanAcquisition(WakeRunner& run);                                                            // Timestamp, temperature plan (resolution set) and moisture blocks
+WakeKind wakeDecide(WakeRunner& run);                                                                            // Once per wake, after forceFlush, trialBoot and the settings are known
+void wakeStoreReading(WakeRunner& run);                                                                          // Once per wake, later calls return right away
+void wakeHandleAttributes(WakeRunner& run, const char* topic, const uint8_t* payload, size_t len);               // From the halMqttOnMessage() handler
+void runQuietWake(WakeRunner& run);                                                                              // These three end in halDeepSleep(), which only returns on the host
+void runLoraWake(WakeRunner& run);
+void runRadioWake(WakeRunner& run, uint32_t linkSeed);                                                           // Seeds the backoff jitter
\ No newline at end of file
@@ -1,4 +1,8 @@
 #pragma once
 
-void connectToWiFi(bool stateLED, AXP20X_Class& axp192, const char* ssid, const char* password, const uint8_t ledPin, const uint8_t pmuIRQPin);
-void reconnectToWiFi(bool stateLED, const char* ssid, const char* password, uint8_t ledPin, SemaphoreHandle_t serialSemaphore);
\ No newline at end of file
+#include <IPAddress.h>
+#include "rejoinCache.h"
+
+bool connectToWiFi(bool stateLED, const char* ssid, const char* password, const uint8_t ledPin, RejoinCache& cache, uint32_t timeoutMs);
+IPAddress resolveBroker(RejoinCache& cache, const char* host);
+void rememberBrokerAddress(RejoinCache& cache, IPAddress ip);
\ No newline at end of file
@@ -0,0 +1,169 @@
+#pragma once                                                                                                     // Header-only MQTT 3.1.1 framing for the packets the node sends and the fixed header of the ones it reads
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Shared by the host HAL (native/halNative.cpp), the ESP32 QoS 1 path (halEsp32.cpp) and ThingsBoard/fleetLoad. Only the framing lives here:
+// sockets, TLS and timeouts stay with each transport. Builders return the bytes written, 0 if out is too small for the packet.
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_SUBSCRIBE 0x82                                                                                      // Reserved flag bits 0010 included
+#define MQTT_DISCONNECT 0xE0
+#define MQTT_QOS1 0x02                                                                                           // PUBLISH flag bits
+
+#define MQTT_LENGTH_MAX_LEN 4                                                                                    // Remaining length: up to 4 varint digits
+#define MQTT_PUBLISH_HEADER_MAX_LEN(topicLen) (1 + MQTT_LENGTH_MAX_LEN + 2 + (topicLen) + 2)                     // Fixed header, topic and packet id, the payload goes out after it
+
+// ===========================================================================================================================================================
+// WRITING
+// ===========================================================================================================================================================
+inline size_t mqttPutRemainingLength(uint8_t* out, size_t len){
+  size_t n = 0;
+  do{
+    uint8_t b = len % 128;
+    len /= 128;
+    out[n++] = len ? (b | 0x80) : b;
+  }while(len);
+  return n;
+}
+
+inline size_t mqttPutString(uint8_t* out, const char* s){                                                        // Length prefixed UTF-8
+  size_t len = strlen(s);
+  out[0] = len >> 8;
+  out[1] = len & 0xFF;
+  memcpy(out + 2, s, len);
+  return len + 2;
+}
+
+inline size_t mqttConnectPacket(uint8_t* out, size_t size, const char* clientId, const char* user, uint16_t keepAliveS){
+  size_t len = 2 + 4 + 1 + 1 + 2 + 2 + strlen(clientId) + (user ? 2 + strlen(user) : 0);
+  if(1 + MQTT_LENGTH_MAX_LEN + len > size) return 0;
+  size_t n = 0;
+  out[n++] = MQTT_CONNECT;
+  n += mqttPutRemainingLength(out + n, len);
+  n += mqttPutString(out + n, "MQTT");
+  out[n++] = 4;                                                                                                  // Protocol level 3.1.1
+  out[n++] = 0x02 | (user ? 0x80 : 0x00);                                                                        // Clean session, user name (ThingsBoard access token)
+  out[n++] = keepAliveS >> 8;
+  out[n++] = keepAliveS & 0xFF;
+  n += mqttPutString(out + n, clientId);
+  if(user) n += mqttPutString(out + n, user);
+  return n;
+}
+
+inline size_t mqttPublishHeader(uint8_t* out, size_t size, const char* topic, size_t payloadLen, int32_t packetId){ // QoS 1 with a packet id, QoS 0 if it is negative
+  size_t topicLen = strlen(topic);
+  if(MQTT_PUBLISH_HEADER_MAX_LEN(topicLen) > size) return 0;
+  size_t n = 0;
+  out[n++] = packetId >= 0 ? MQTT_PUBLISH | MQTT_QOS1 : MQTT_PUBLISH;                                            // Not retained, never a duplicate: a resend goes under a new id
+  n += mqttPutRemainingLength(out + n, 2 + topicLen + (packetId >= 0 ? 2 : 0) + payloadLen);
+  n += mqttPutString(out + n, topic);
+  if(packetId >= 0){
+    out[n++] = packetId >> 8;
+    out[n++] = packetId & 0xFF;
+  }
+  return n;
+}
+
+inline size_t mqttSubscribePacket(uint8_t* out, size_t size, const char* topic, uint16_t packetId){              // One topic at QoS 0
+  size_t topicLen = strlen(topic);
+  if(1 + MQTT_LENGTH_MAX_LEN + 2 + 2 + topicLen + 1 > size) return 0;
+  size_t n = 0;
+  out[n++] = MQTT_SUBSCRIBE;
+  n += mqttPutRemainingLength(out + n, 2 + 2 + topicLen + 1);
+  out[n++] = packetId >> 8;
+  out[n++] = packetId & 0xFF;
+  n += mqttPutString(out + n, topic);
+  out[n++] = 0;
+  return n;
+}
+// WRITING END ===============================================================================================================================================
+
+// ===========================================================================================================================================================
+// READING
+// ===========================================================================================================================================================
+inline int mqttLengthDigit(uint32_t& length, uint8_t index, uint8_t digit){                                      // Feed the bytes after the type from index 0: 1 more to come, 0 done, -1 malformed
+  if(index == 0) length = 0;
+  if(index >= MQTT_LENGTH_MAX_LEN) return -1;
+  length |= (uint32_t)(digit & 0x7F) << (7 * index);
+  return (digit & 0x80) ? 1 : 0;
+}
+
+inline bool mqttIsPuback(uint8_t type, uint32_t length){
+  return (type & 0xF0) == MQTT_PUBACK && length == 2;
+}
+
+inline bool mqttIsQos0Publish(uint8_t type){                                                                     // What the QoS 0 subscriptions deliver
+  return (type & 0xF6) == MQTT_PUBLISH;
+}
+
+inline bool mqttConnackAccepted(uint8_t type, const uint8_t* body, uint32_t length){                             // Refused by the broker: bad token, server unavailable...
+  return type == MQTT_CONNACK && length == 2 && body[1] == 0;
+}
+
+inline bool mqttSplitPublish(const uint8_t* body, uint32_t length, char* topic, size_t topicSize, const uint8_t*& payload, size_t& payloadLen){
+  if(length < 2) return false;
+  size_t topicLen = (body[0] << 8) | body[1];                                                                    // QoS 0 body: no packet id between the topic and the payload
+  if(topicLen >= topicSize || 2 + topicLen > length) return false;
+  memcpy(topic, body + 2, topicLen);
+  topic[topicLen] = '\0';
+  payload = body + 2 + topicLen;
+  payloadLen = length - 2 - topicLen;
+  return true;
+}
+
+#define MQTT_ACK_SCANNER_CAPACITY 32                                                                             // More than UPLINK_WINDOW_MAX, the oldest id goes first on overflow
+
+struct MqttAckScanner {                                                                                          // PUBACK ids picked out of a stream someone else parses (PubSubClient on the ESP32). Zero-initialized = empty
+  uint8_t type;
+  uint8_t lengthIndex;                                                                                           // 0 between packets: the next byte is a type
+  bool inBody;
+  uint32_t length;
+  uint32_t got;
+  uint8_t idHigh;
+  uint16_t acks[MQTT_ACK_SCANNER_CAPACITY];
+  uint8_t head;
+  uint8_t count;
+
+  void reset(){
+    memset(this, 0, sizeof(*this));
+  }
+
+  void feed(uint8_t b){
+    if(!inBody && lengthIndex == 0){
+      type = b;
+      lengthIndex = 1;
+      return;
+    }
+    if(!inBody){
+      int more = mqttLengthDigit(length, lengthIndex - 1, b);
+      lengthIndex = more > 0 ? lengthIndex + 1 : 0;
+      inBody = more == 0 && length > 0;                                                                          // PINGRESP and the other empty packets end at their length
+      got = 0;
+      return;
+    }
+    if(got == 0) idHigh = b;
+    if(++got < length) return;
+    if(mqttIsPuback(type, length)){
+      if(count == MQTT_ACK_SCANNER_CAPACITY){
+        head = (head + 1) % MQTT_ACK_SCANNER_CAPACITY;
+        count--;
+      }
+      acks[(head + count++) % MQTT_ACK_SCANNER_CAPACITY] = (idHigh << 8) | b;
+    }
+    inBody = false;
+  }
+
+  bool take(uint16_t& packetId){                                                                                 // Oldest PUBACK not taken yet
+    if(count == 0) return false;
+    packetId = acks[head];
+    head = (head + 1) % MQTT_ACK_SCANNER_CAPACITY;
+    count--;
+    return true;
+  }
+};
+// READING END ===============================================================================================================================================
\ No newline at end of file
@@ -0,0 +1,141 @@
+#pragma once                                                                                                     // Header-only streaming filters: fixed capacity, no heap, plain structs that can live in RTC memory (RTC_DATA_ATTR)
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+// Every filter is an aggregate with no constructor, so a zero-initialized instance (static, RTC_DATA_ATTR, '= {}') is a valid empty one.
+// Samples go in one at a time as they arrive: no array of the whole acquisition is ever collected. NaN must be kept out by the caller.
+
+// ===========================================================================================================================================================
+// RUNNING MEDIAN
+// ===========================================================================================================================================================
+template <typename T, uint8_t N>
+struct RunningMedian {                                                                                           // Median of the last N values, O(N) per update, N values plus N bytes of state
+  static_assert(N > 0 && N < 128, "RunningMedian capacity must be 1 to 127");
+
+  T sorted[N];                                                                                                   // Kept sorted by insertion
+  uint8_t arrival[N];                                                                                            // Sequence number of each sorted value, finds the oldest without a second copy
+  uint8_t next;
+  uint8_t count;
+
+  static constexpr uint8_t capacity(){ return N; }
+
+  void reset(){
+    next = 0;
+    count = 0;
+  }
+
+  void push(T value){
+    if(count == N){                                                                                              // Full: the oldest value leaves first
+      uint8_t oldest = (uint8_t)(next - N);
+      uint8_t i = 0;
+      while(i < count - 1 && arrival[i] != oldest) i++;
+      for(; i < count - 1; i++){
+        sorted[i] = sorted[i + 1];
+        arrival[i] = arrival[i + 1];
+      }
+      count--;
+    }
+
+    uint8_t j = count;
+    while(j > 0 && sorted[j - 1] > value){
+      sorted[j] = sorted[j - 1];
+      arrival[j] = arrival[j - 1];
+      j--;
+    }
+    sorted[j] = value;
+    arrival[j] = next++;
+    count++;
+  }
+
+  bool empty() const { return count == 0; }
+  T median() const { return count ? sorted[count / 2] : T(); }                                                   // Upper median for an even count, like the batch version it replaces
+  T min() const { return count ? sorted[0] : T(); }
+  T max() const { return count ? sorted[count - 1] : T(); }
+
+  T medianAbsoluteDeviation() const {                                                                            // MAD, sorted by insertion like the values (N is small)
+    T deviations[N];
+    T center = median();
+    for(uint8_t i = 0; i < count; i++){
+      T d = sorted[i] > center ? sorted[i] - center : center - sorted[i];
+      uint8_t j = i;
+      while(j > 0 && deviations[j - 1] > d){
+        deviations[j] = deviations[j - 1];
+        j--;
+      }
+      deviations[j] = d;
+    }
+    return count ? deviations[count / 2] : T();
+  }
+};
+// RUNNING MEDIAN END ========================================================================================================================================
+
+// ===========================================================================================================================================================
+// HAMPEL OUTLIER FILTER
+// ===========================================================================================================================================================
+template <typename T, uint8_t N>
+struct HampelFilter {                                                                                            // Rejects values more than k scaled MADs away from the median of the last N accepted ones
+  static_assert(N >= 3, "HampelFilter needs a window of 3 or more");
+
+  RunningMedian<T, N> accepted;
+  uint8_t rejectedRun;                                                                                           // Consecutive rejections, a run of N / 2 + 1 is taken as a real step
+  uint16_t rejected;                                                                                             // Total since the last reset, wraps
+
+  static constexpr float MAD_TO_SIGMA = 1.4826f;                                                                 // MAD of a Gaussian times this is its standard deviation
+
+  void reset(){
+    accepted.reset();
+    rejectedRun = 0;
+    rejected = 0;
+  }
+
+  bool isOutlier(T value, float k, T minSigma) const {
+    if(accepted.count < 3) return false;                                                                         // Too little history to judge
+    T center = accepted.median();
+    T sigma = (T)(MAD_TO_SIGMA * accepted.medianAbsoluteDeviation());
+    if(sigma < minSigma) sigma = minSigma;                                                                       // Quantized, steady signals have a MAD of 0
+    T deviation = value > center ? value - center : center - value;
+    return deviation > (T)(k * sigma);
+  }
+
+  T update(T value, float k, T minSigma, bool* outlier = NULL){                                                  // The value, or the median it is replaced with
+    bool far = isOutlier(value, k, minSigma);
+    bool reject = far && rejectedRun < N / 2;
+    if(outlier != NULL) *outlier = reject;
+    if(reject){
+      rejectedRun++;
+      rejected++;
+      return accepted.median();
+    }
+    if(far) accepted.reset();                                                                                    // A step that persisted: forget the old level instead of fighting it
+    rejectedRun = 0;
+    accepted.push(value);
+    return value;
+  }
+};
+// HAMPEL OUTLIER FILTER END =================================================================================================================================
+
+// ===========================================================================================================================================================
+// EWMA
+// ===========================================================================================================================================================
+template <typename T, uint8_t Divisor>
+struct Ewma {                                                                                                    // value += (x - value) / Divisor, seeded by the first sample
+  static_assert(Divisor > 0, "Ewma divisor must be 1 or more");
+
+  T value;
+  bool seeded;
+
+  void reset(){
+    seeded = false;
+  }
+
+  T update(T sample){
+    value = seeded ? value + (sample - value) / (T)Divisor : sample;
+    seeded = true;
+    return value;
+  }
+
+  T valueOr(T fallback) const { return seeded ? value : fallback; }                                              // e.g. NAN for the reports until the first sample
+};
+// EWMA END ==================================================================================================================================================
\ No newline at end of file
@@ -0,0 +1,166 @@
+#pragma once                                                                                                     // Binary twin of telemetrySerializer.h: same schema tables, varint frames instead of JSON text
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include "telemetrySerializer.h"
+
+// Frame layout (all integers are LEB128 varints, signed ones zigzag encoded first):
+//   version (1 byte) | fields per record (1 byte) | record count | records...
+//   record = timestamp delta in ms (signed, the first one is relative to 0) | one value per schema field
+// Every value is sent as the fixed-point integer round(v * 10^decimals) + 1, so 0 is left free to mean "no value" (NaN/inf).
+#define TELEMETRY_CODEC_VERSION 1
+#define TELEMETRY_VARINT_MAX_LEN 10                                                                              // 64 bits in 7-bit groups
+
+// ===========================================================================================================================================================
+// BINARY WRITER
+// ===========================================================================================================================================================
+class BinaryWriter {
+public:
+  BinaryWriter(uint8_t* out, size_t size) : out(out), size(size), len(0), overflow(false) {}
+
+  void byte(uint8_t b){
+    if(len < size) out[len++] = b;
+    else overflow = true;
+  }
+
+  void varint(uint64_t v){
+    while(v >= 0x80){
+      byte((uint8_t)(v | 0x80));
+      v >>= 7;
+    }
+    byte((uint8_t)v);
+  }
+
+  void zigzag(int64_t v){
+    varint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));                                                            // Small magnitudes stay small whatever the sign
+  }
+
+  void value(const TelemetryValue& v, uint8_t decimals){
+    static const uint32_t pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    int64_t fixedPoint;
+    switch(v.kind){
+      case TelemetryValue::Signed:   fixedPoint = v.i; break;
+      case TelemetryValue::Unsigned: fixedPoint = (int64_t)v.u; break;
+      default:
+        if(!isfinite(v.f)){
+          varint(0);
+          return;
+        }
+        if(decimals > 6) decimals = 6;
+        fixedPoint = (int64_t)llroundf(v.f * pow10[decimals]);
+        break;
+    }
+    uint64_t encoded = ((uint64_t)fixedPoint << 1) ^ (uint64_t)(fixedPoint >> 63);
+    varint(encoded + 1);
+  }
+
+  size_t finish() const { return overflow ? 0 : len; }                                                           // Length written, 0 if the buffer was too small
+  bool failed() const { return overflow; }
+
+private:
+  uint8_t* out;
+  size_t size;
+  size_t len;
+  bool overflow;
+};
+// BINARY WRITER END =========================================================================================================================================
+
+// ===========================================================================================================================================================
+// BINARY READER
+// ===========================================================================================================================================================
+class BinaryReader {
+public:
+  BinaryReader(const uint8_t* in, size_t size) : in(in), size(size), pos(0), error(false) {}
+
+  uint8_t byte(){
+    if(pos < size) return in[pos++];
+    error = true;
+    return 0;
+  }
+
+  uint64_t varint(){
+    uint64_t v = 0;
+    for(uint8_t shift = 0; shift < 7 * TELEMETRY_VARINT_MAX_LEN; shift += 7){
+      uint8_t b = byte();
+      v |= (uint64_t)(b & 0x7F) << shift;
+      if(!(b & 0x80)) return v;
+    }
+    error = true;                                                                                                // Too long or truncated
+    return 0;
+  }
+
+  int64_t zigzag(){
+    uint64_t v = varint();
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+  }
+
+  TelemetryValue value(uint8_t decimals){                                                                        // Integers come back as Signed, scaled fields as Real
+    static const uint32_t pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    uint64_t encoded = varint();
+    if(encoded == 0) return TelemetryValue(NAN);
+
+    encoded -= 1;
+    int64_t fixedPoint = (int64_t)(encoded >> 1) ^ -(int64_t)(encoded & 1);
+    if(decimals == 0) return TelemetryValue((long long)fixedPoint);
+    if(decimals > 6) decimals = 6;
+    return TelemetryValue((double)fixedPoint / pow10[decimals]);
+  }
+
+  bool done() const { return pos == size; }
+  bool failed() const { return error; }
+
+private:
+  const uint8_t* in;
+  size_t size;
+  size_t pos;
+  bool error;
+};
+// BINARY READER END =========================================================================================================================================
+
+// ===========================================================================================================================================================
+// SCHEMA ENCODING
+// ===========================================================================================================================================================
+// Frame header ----------------------------------------------------------------------------------------------------------------------------------------------
+template <size_t N>
+void writeBinaryHeader(BinaryWriter& writer, const TelemetryField (&)[N], uint8_t records){
+  writer.byte(TELEMETRY_CODEC_VERSION);
+  writer.byte((uint8_t)N);                                                                                       // Lets the decoder reject a frame built with another schema
+  writer.varint(records);
+}
+
+// One record, 'previousMs' is updated so the next record only carries the delta -----------------------------------------------------------------------------
+template <size_t N>
+void writeBinaryTelemetry(BinaryWriter& writer, uint64_t timestampMs, uint64_t& previousMs, const TelemetryField (&fields)[N], const TelemetryValue (&values)[N]){
+  writer.zigzag((int64_t)(timestampMs - previousMs));
+  previousMs = timestampMs;
+  for(size_t i = 0; i < N; i++){
+    writer.value(values[i], fields[i].decimals);
+  }
+}
+
+// Whole frame back to the ThingsBoard '[{"ts":..,"values":{..}}]' array, 0 if the frame is malformed or does not fit ----------------------------------------
+template <size_t N>
+size_t binaryFrameToJson(const uint8_t* in, size_t inSize, const TelemetryField (&fields)[N], char* out, size_t outSize){
+  BinaryReader reader(in, inSize);
+  if(reader.byte() != TELEMETRY_CODEC_VERSION || reader.byte() != N) return 0;
+  uint64_t records = reader.varint();
+
+  JsonWriter writer(out, outSize);
+  writer.raw('[');
+  uint64_t timestampMs = 0;
+  for(uint64_t r = 0; r < records && !reader.failed(); r++){
+    timestampMs += (uint64_t)reader.zigzag();
+    TelemetryValue values[N] = {};
+    for(size_t i = 0; i < N; i++){
+      values[i] = reader.value(fields[i].decimals);
+    }
+    if(r) writer.raw(',');
+    writeTimestampedTelemetry(writer, timestampMs, fields, values);
+  }
+  writer.raw(']');
+
+  if(reader.failed() || !reader.done()) return 0;
+  return writer.finish();
+}
+// SCHEMA ENCODING END =======================================================================================================================================
\ No newline at end of file
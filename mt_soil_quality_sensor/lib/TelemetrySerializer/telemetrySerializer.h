@@ -0,0 +1,156 @@
+#pragma once                                                                                                     // Header-only: no heap, no printf, writes straight into the caller's buffer
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+// ===========================================================================================================================================================
+// FIELD TABLE
+// ===========================================================================================================================================================
+struct TelemetryField {                                                                                          // One entry of a constexpr schema, e.g. {"soilTemperature", 2}
+  const char* key;
+  uint8_t decimals;                                                                                              // Fixed-point precision for real values (0 to 6), ignored for integers
+};
+
+struct TelemetryValue {                                                                                          // Integers keep full precision, reals are printed in fixed point
+  enum Kind : uint8_t { Signed, Unsigned, Real };
+
+  Kind kind;
+  union {
+    int64_t i;
+    uint64_t u;
+    float f;
+  };
+
+  constexpr TelemetryValue() : kind(Signed), i(0) {}
+  constexpr TelemetryValue(int v) : kind(Signed), i(v) {}
+  constexpr TelemetryValue(long v) : kind(Signed), i(v) {}
+  constexpr TelemetryValue(long long v) : kind(Signed), i(v) {}
+  constexpr TelemetryValue(unsigned int v) : kind(Unsigned), u(v) {}
+  constexpr TelemetryValue(unsigned long v) : kind(Unsigned), u(v) {}
+  constexpr TelemetryValue(unsigned long long v) : kind(Unsigned), u(v) {}
+  constexpr TelemetryValue(float v) : kind(Real), f(v) {}
+  constexpr TelemetryValue(double v) : kind(Real), f((float)v) {}
+};
+// FIELD TABLE END ===========================================================================================================================================
+
+// ===========================================================================================================================================================
+// JSON WRITER
+// ===========================================================================================================================================================
+class JsonWriter {
+public:
+  JsonWriter(char* out, size_t size) : out(out), size(size), len(0), overflow(size == 0) {}
+
+  void raw(char c){
+    if(len + 1 < size) out[len++] = c;                                                                           // Always keeps room for the null terminator
+    else overflow = true;
+  }
+
+  void raw(const char* s){
+    while(*s) raw(*s++);
+  }
+
+  void key(const char* k){
+    raw('"');
+    raw(k);
+    raw("\":");
+  }
+
+  void number(uint64_t v){
+    char digits[20];
+    uint8_t n = 0;
+    do{
+      digits[n++] = '0' + (v % 10);
+      v /= 10;
+    }while(v);
+    while(n) raw(digits[--n]);
+  }
+
+  void number(int64_t v){
+    if(v < 0){
+      raw('-');
+      number((uint64_t)0 - (uint64_t)v);
+    }else{
+      number((uint64_t)v);
+    }
+  }
+
+  void fixed(float v, uint8_t decimals){
+    static const uint32_t pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    if(!isfinite(v)){                                                                                            // JSON has no NaN/inf
+      raw("null");
+      return;
+    }
+    if(decimals > 6) decimals = 6;
+
+    uint64_t scaled = (uint64_t)(fabsf(v) * pow10[decimals] + 0.5f);                                             // Rounded to the requested precision
+    if(v < 0 && scaled != 0) raw('-');
+    number(scaled / pow10[decimals]);
+
+    if(decimals > 0){
+      raw('.');
+      uint32_t frac = scaled % pow10[decimals];
+      for(uint32_t div = pow10[decimals - 1]; div > 0; div /= 10){                                               // Zero padded fraction
+        raw('0' + (frac / div) % 10);
+      }
+    }
+  }
+
+  void value(const TelemetryValue& v, uint8_t decimals){
+    switch(v.kind){
+      case TelemetryValue::Signed:   number(v.i); break;
+      case TelemetryValue::Unsigned: number(v.u); break;
+      case TelemetryValue::Real:     fixed(v.f, decimals); break;
+    }
+  }
+
+  size_t finish(){                                                                                               // Length written, 0 if the buffer was too small
+    if(size == 0) return 0;
+    out[len] = '\0';
+    return overflow ? 0 : len;
+  }
+
+  size_t length() const { return len; }
+  bool failed() const { return overflow; }
+
+private:
+  char* out;
+  size_t size;
+  size_t len;
+  bool overflow;
+};
+// JSON WRITER END ===========================================================================================================================================
+
+// ===========================================================================================================================================================
+// SCHEMA SERIALIZATION
+// ===========================================================================================================================================================
+// {"key":value,...} (N ties the values to the schema at compile time) ---------------------------------------------------------------------------------------
+template <size_t N>
+void writeTelemetryObject(JsonWriter& writer, const TelemetryField (&fields)[N], const TelemetryValue (&values)[N]){
+  writer.raw('{');
+  for(size_t i = 0; i < N; i++){
+    if(i) writer.raw(',');
+    writer.key(fields[i].key);
+    writer.value(values[i], fields[i].decimals);
+  }
+  writer.raw('}');
+}
+
+// {"ts":...,"values":{...}} (ThingsBoard timestamped record) ------------------------------------------------------------------------------------------------
+template <size_t N>
+void writeTimestampedTelemetry(JsonWriter& writer, uint64_t timestampMs, const TelemetryField (&fields)[N], const TelemetryValue (&values)[N]){
+  writer.raw("{\"ts\":");
+  writer.number(timestampMs);
+  writer.raw(",\"values\":");
+  writeTelemetryObject(writer, fields, values);
+  writer.raw('}');
+}
+
+// Single record into a buffer -------------------------------------------------------------------------------------------------------------------------------
+template <size_t N>
+size_t serializeTelemetry(char* out, size_t size, const TelemetryField (&fields)[N], const TelemetryValue (&values)[N]){
+  JsonWriter writer(out, size);
+  writeTelemetryObject(writer, fields, values);
+  return writer.finish();
+}
+// SCHEMA SERIALIZATION END ==================================================================================================================================
\ No newline at end of file
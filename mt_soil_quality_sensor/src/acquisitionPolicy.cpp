@@ -0,0 +1,88 @@
+#include <math.h>
+#include "acquisitionPolicy.h"
+
+#define MIN_RESOLUTION_BITS 9
+#define MAX_RESOLUTION_BITS 12
+#define POLICY_LEVELS (MAX_RESOLUTION_BITS - MIN_RESOLUTION_BITS)                                                // 0 (quiet) to 3 (noisy or changing)
+
+// HISTORY ---------------------------------------------------------------------------------------------------------------------------------------------------
+static float historyAt(const AcquisitionHistory& history, uint8_t index){                                        // 0 is the oldest
+  return history.values[(history.head + index) % POLICY_HISTORY_LEN];
+}
+
+void recordAcquisition(AcquisitionHistory& history, float value){
+  if(history.head >= POLICY_HISTORY_LEN || history.count > POLICY_HISTORY_LEN){                                  // Indices out of range: start over
+    history.head = 0;
+    history.count = 0;
+  }
+  if(isnan(value) || value <= -127.0f || value == 85.0f) return;                                                 // DS18B20 error codes (disconnected / power-on value) would fake a step
+
+  uint8_t tail = (history.head + history.count) % POLICY_HISTORY_LEN;
+  history.values[tail] = value;
+
+  if(history.count < POLICY_HISTORY_LEN){
+    history.count++;
+  }else{
+    history.head = (history.head + 1) % POLICY_HISTORY_LEN;
+  }
+}
+// HISTORY END -----------------------------------------------------------------------------------------------------------------------------------------------
+
+// STATISTICS ------------------------------------------------------------------------------------------------------------------------------------------------
+float historyStdDev(const AcquisitionHistory& history){
+  if(history.count < 2) return 0.0f;
+
+  float mean = 0.0f;
+  for(uint8_t i = 0; i < history.count; i++) mean += historyAt(history, i);
+  mean /= history.count;
+
+  float sumSq = 0.0f;
+  for(uint8_t i = 0; i < history.count; i++){
+    float d = historyAt(history, i) - mean;
+    sumSq += d * d;
+  }
+  return sqrtf(sumSq / (history.count - 1));
+}
+
+float historyTrend(const AcquisitionHistory& history){                                                           // Least squares slope, units per wake
+  if(history.count < 2) return 0.0f;
+
+  float n = history.count;
+  float meanX = (n - 1) / 2.0f;
+  float meanY = 0.0f;
+  for(uint8_t i = 0; i < history.count; i++) meanY += historyAt(history, i);
+  meanY /= n;
+
+  float num = 0.0f, den = 0.0f;
+  for(uint8_t i = 0; i < history.count; i++){
+    float dx = i - meanX;
+    num += dx * (historyAt(history, i) - meanY);
+    den += dx * dx;
+  }
+  return num / den;
+}
+// STATISTICS END --------------------------------------------------------------------------------------------------------------------------------------------
+
+// PLAN THE NEXT ACQUISITION ---------------------------------------------------------------------------------------------------------------------------------
+static uint8_t activityLevel(float value, float quiet, float noisy){                                             // Linear between the quiet and noisy thresholds
+  if(value <= quiet) return 0;
+  if(value >= noisy) return POLICY_LEVELS;
+  return 1 + (uint8_t)((value - quiet) / (noisy - quiet) * (POLICY_LEVELS - 1));
+}
+
+AcquisitionPlan planAcquisition(const AcquisitionHistory& history, const AcquisitionLimits& limits){
+  uint8_t level = POLICY_LEVELS;                                                                                 // Not enough history (first wakes after power-on): full acquisition
+
+  if(history.count >= 3){
+    uint8_t noiseLevel = activityLevel(historyStdDev(history), limits.quietStdDev, limits.noisyStdDev);
+    uint8_t trendLevel = activityLevel(fabsf(historyTrend(history)), limits.quietTrend, limits.noisyTrend);
+    level = noiseLevel > trendLevel ? noiseLevel : trendLevel;                                                   // Whatever looks more active wins
+  }
+
+  AcquisitionPlan plan;
+  plan.resolutionBits = MIN_RESOLUTION_BITS + level;
+  plan.samples = limits.minSamples + (limits.maxSamples - limits.minSamples) * level / POLICY_LEVELS;
+  if(plan.samples % 2 == 0 && plan.samples < limits.maxSamples) plan.samples++;                                  // Odd counts give a true median
+  return plan;
+}
+// PLAN THE NEXT ACQUISITION END -----------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
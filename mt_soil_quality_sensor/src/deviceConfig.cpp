@@ -0,0 +1,208 @@
+#include <string.h>
+#include "deviceConfig.h"
+#include "hal.h"
+#include "macros.h"
+#include "telemetryReport.h"
+
+struct ConfigField {                                                                                             // One shared attribute, its NVS key is the same name (15 characters at most)
+  const char* key;
+  uint16_t DeviceConfig::* value;
+  uint16_t minValue;
+  uint16_t maxValue;
+  uint16_t defaultValue;
+};
+
+static const ConfigField CONFIG_FIELDS[] = {
+  {"sleepMinS",       &DeviceConfig::sleepMinS,       10, 14400,                            SLEEP_MIN_S},
+  {"sleepMaxS",       &DeviceConfig::sleepMaxS,       10, 14400,                            SLEEP_MAX_S},
+  {"batchDepth",      &DeviceConfig::batchDepth,      1,  TELEMETRY_BUFFER_CAPACITY,        BATCH_DEPTH},
+  {"tempMinSamples",  &DeviceConfig::tempMinSamples,  1,  TEMPERATURE_MAX_SAMPLES,          TEMPERATURE_ADAPTIVE_MIN_SAMPLES},
+  {"tempMaxSamples",  &DeviceConfig::tempMaxSamples,  1,  TEMPERATURE_MAX_SAMPLES,          TEMPERATURE_ADAPTIVE_MAX_SAMPLES},
+  {"tempMaxBits",     &DeviceConfig::tempMaxBits,     9,  12,                               12},
+  {"moistMinSamples", &DeviceConfig::moistMinSamples, 1,  MOISTURE_ADAPTIVE_MAX_SAMPLES,    MOISTURE_ADAPTIVE_MIN_SAMPLES},
+  {"moistMaxSamples", &DeviceConfig::moistMaxSamples, 1,  MOISTURE_ADAPTIVE_MAX_SAMPLES,    MOISTURE_ADAPTIVE_MAX_SAMPLES},
+  {SOIL_MOIST_DRY_KEY, &DeviceConfig::moistDryMv,     1,  3300,                             (uint16_t)SOIL_MOIST_DRY_MV},
+  {SOIL_MOIST_WET_KEY, &DeviceConfig::moistWetMv,     1,  3300,                             (uint16_t)SOIL_MOIST_WET_MV},
+};
+#define CONFIG_FIELD_COUNT (sizeof(CONFIG_FIELDS) / sizeof(CONFIG_FIELDS[0]))
+
+// VALIDATION ------------------------------------------------------------------------------------------------------------------------------------------------
+static const char* inconsistentKey(const DeviceConfig& config){                                                  // Rules between fields, the ranges are checked one by one
+  if(config.sleepMinS > config.sleepMaxS) return "sleepMinS";
+  if(config.tempMinSamples > config.tempMaxSamples) return "tempMinSamples";
+  if(config.moistMinSamples > config.moistMaxSamples) return "moistMinSamples";
+  if(config.moistDryMv == config.moistWetMv) return SOIL_MOIST_WET_KEY;                                          // Would divide by zero in soilMoisturePercent()
+  return NULL;
+}
+
+static void setDefaults(DeviceConfig& config){
+  memset(&config, 0, sizeof(config));
+  for(size_t i = 0; i < CONFIG_FIELD_COUNT; i++) config.*CONFIG_FIELDS[i].value = CONFIG_FIELDS[i].defaultValue;
+  config.magic = DEVICE_CONFIG_MAGIC;
+}
+// VALIDATION END --------------------------------------------------------------------------------------------------------------------------------------------
+
+// LOAD ------------------------------------------------------------------------------------------------------------------------------------------------------
+void deviceConfigBegin(DeviceConfig& config){
+  if(config.magic == DEVICE_CONFIG_MAGIC) return;                                                                // Deep sleep wake: the RTC copy, no flash read
+
+  setDefaults(config);                                                                                           // Power-on: defaults, then what NVS holds
+  for(size_t i = 0; i < CONFIG_FIELD_COUNT; i++){
+    uint32_t stored;
+    if(halSettingsGetU32(CONFIG_FIELDS[i].key, stored) && stored >= CONFIG_FIELDS[i].minValue && stored <= CONFIG_FIELDS[i].maxValue){
+      config.*CONFIG_FIELDS[i].value = stored;
+    }
+  }
+  uint32_t version;
+  if(halSettingsGetU32(DEVICE_CONFIG_VERSION_KEY, version)) config.version = version;
+  if(inconsistentKey(config) != NULL){                                                                           // Only a bench calibration written before the remote settings can get here
+    config.moistDryMv = (uint16_t)SOIL_MOIST_DRY_MV;
+    config.moistWetMv = (uint16_t)SOIL_MOIST_WET_MV;
+  }
+  if(inconsistentKey(config) != NULL) setDefaults(config);
+}
+
+MoistureCalibration deviceMoistureCalibration(const DeviceConfig& config){
+  MoistureCalibration calibration;
+  calibration.dryMv = config.moistDryMv;
+  calibration.wetMv = config.moistWetMv;
+  return calibration;
+}
+// LOAD END --------------------------------------------------------------------------------------------------------------------------------------------------
+
+// SHARED ATTRIBUTES PARSING ---------------------------------------------------------------------------------------------------------------------------------
+const char* findAttribute(const char* json, const char* key){                                                    // Right after "key":, NULL if absent. Flat or nested in {"shared":{...}}
+  size_t keyLen = strlen(key);
+  for(const char* p = strchr(json, '"'); p != NULL; p = strchr(p + 1, '"')){
+    if(strncmp(p + 1, key, keyLen) != 0 || p[1 + keyLen] != '"') continue;
+    const char* value = p + 2 + keyLen;
+    while(*value == ' ') value++;
+    if(*value != ':') continue;                                                                                  // The same text as a string value
+    value++;
+    while(*value == ' ') value++;
+    return value;
+  }
+  return NULL;
+}
+
+bool parseAttributeUnsigned(const char* text, uint32_t& value){                                                  // 30 or "30", the dashboard may store either. No sign, no fraction
+  bool quoted = *text == '"';
+  if(quoted) text++;
+  if(*text < '0' || *text > '9') return false;
+
+  value = 0;
+  while(*text >= '0' && *text <= '9'){
+    if(value > 100000) return false;                                                                             // Far above any range, and no overflow
+    value = value * 10 + (*text++ - '0');
+  }
+  if(quoted && *text++ != '"') return false;
+  return *text == ',' || *text == '}' || *text == ' ';
+}
+
+bool parseAttributeString(const char* text, char* out, size_t outSize){                                          // Backslash escapes kept as the escaped character, no \u
+  if(*text++ != '"') return false;
+  size_t len = 0;
+  while(*text != '"'){
+    if(*text == '\\' && text[1] != '\0') text++;
+    if(*text == '\0' || len + 1 >= outSize) return false;                                                        // Unterminated, or longer than the buffer
+    out[len++] = *text++;
+  }
+  out[len] = '\0';
+  return true;
+}
+
+static ConfigResult applyDeviceConfig(DeviceConfig& config, const char* json, const char** badKey){
+  uint32_t version;
+  const char* text = findAttribute(json, DEVICE_CONFIG_VERSION_KEY);
+  if(text == NULL) return CONFIG_IGNORED;                                                                        // Unversioned set, the server side is half edited
+  if(!parseAttributeUnsigned(text, version)){
+    *badKey = DEVICE_CONFIG_VERSION_KEY;
+    return CONFIG_REJECTED;
+  }
+  if(version <= config.version || version == config.rejectedVersion) return CONFIG_IGNORED;                      // Every connect gets the whole set back, nothing to do almost always
+
+  DeviceConfig candidate = config;
+  for(size_t i = 0; i < CONFIG_FIELD_COUNT && *badKey == NULL; i++){
+    const ConfigField& field = CONFIG_FIELDS[i];
+    uint32_t value;
+    text = findAttribute(json, field.key);
+    if(text == NULL) continue;                                                                                   // Not set on the server, the current value stays
+    if(!parseAttributeUnsigned(text, value) || value < field.minValue || value > field.maxValue) *badKey = field.key;
+    else candidate.*field.value = value;
+  }
+  if(*badKey == NULL) *badKey = inconsistentKey(candidate);
+  if(*badKey != NULL){                                                                                           // All or nothing, a half applied set is a version nobody wrote
+    config.rejectedVersion = version;
+    return CONFIG_REJECTED;
+  }
+
+  bool persisted = true;
+  for(size_t i = 0; i < CONFIG_FIELD_COUNT; i++){
+    const ConfigField& field = CONFIG_FIELDS[i];
+    if(candidate.*field.value != config.*field.value) persisted &= halSettingsSetU32(field.key, candidate.*field.value); // Changed keys only, NVS wear
+  }
+  if(persisted) halSettingsSetU32(DEVICE_CONFIG_VERSION_KEY, version);                                           // Version last: after a failed write the next power-on asks for the set again
+  candidate.version = version;
+  config = candidate;
+  return CONFIG_APPLIED;
+}
+// SHARED ATTRIBUTES PARSING END -----------------------------------------------------------------------------------------------------------------------------
+
+// MQTT ------------------------------------------------------------------------------------------------------------------------------------------------------
+bool requestDeviceConfig(ConfigSync& sync, uint32_t nowMs, const char* extraKeys){
+  char request[DEVICE_CONFIG_MESSAGE_MAX_LEN];
+  JsonWriter writer(request, sizeof(request));
+  writer.raw("{\"sharedKeys\":\"");
+  writer.raw(DEVICE_CONFIG_VERSION_KEY);
+  for(size_t i = 0; i < CONFIG_FIELD_COUNT; i++){
+    writer.raw(',');
+    writer.raw(CONFIG_FIELDS[i].key);
+  }
+  if(extraKeys != NULL){
+    writer.raw(',');
+    writer.raw(extraKeys);
+  }
+  writer.raw("\"}");
+  size_t len = writer.finish();
+
+  sync.requestedMs = nowMs;
+  sync.extraKeys = extraKeys;
+  sync.pending = len > 0 && halMqttSubscribe(MQTT_TOPIC_ATTRIBUTES) && halMqttSubscribe(MQTT_TOPIC_ATTRIBUTES_RESPONSE) &&
+                 halMqttPublish(MQTT_TOPIC_ATTRIBUTES_REQUEST, (const uint8_t*)request, len);
+  return sync.pending;
+}
+
+ConfigResult handleDeviceConfigMessage(DeviceConfig& config, ConfigSync& sync, const char* topic, const uint8_t* payload, size_t len, uint32_t nowMs,
+                                       const char** badKey){
+  *badKey = NULL;
+  if(len >= DEVICE_CONFIG_MESSAGE_MAX_LEN) return CONFIG_IGNORED;
+
+  char json[DEVICE_CONFIG_MESSAGE_MAX_LEN];
+  memcpy(json, payload, len);
+  json[len] = '\0';
+
+  if(strncmp(topic, MQTT_TOPIC_ATTRIBUTES_RESPONSE, sizeof(MQTT_TOPIC_ATTRIBUTES_RESPONSE) - 2) == 0){           // Response prefix, '+' stripped
+    sync.pending = false;
+    ConfigResult result = applyDeviceConfig(config, json, badKey);
+    if(result != CONFIG_IGNORED) sync.reportDue = true;
+    return result;
+  }
+
+  uint32_t version;
+  const char* text = findAttribute(json, DEVICE_CONFIG_VERSION_KEY);
+  if(strcmp(topic, MQTT_TOPIC_ATTRIBUTES) != 0 || text == NULL || !parseAttributeUnsigned(text, version) || version <= config.version) return CONFIG_IGNORED;
+  return requestDeviceConfig(sync, nowMs, sync.extraKeys) ? CONFIG_REQUESTED : CONFIG_IGNORED;                   // A push only carries the keys that changed, the whole set is asked for
+}
+
+bool deviceConfigPending(ConfigSync& sync, uint32_t nowMs){
+  if(sync.pending && nowMs - sync.requestedMs >= CONFIG_RESPONSE_TIMEOUT_MS) sync.pending = false;               // Old ThingsBoard or a lost response: the next flush asks again
+  return sync.pending;
+}
+
+bool publishDeviceConfig(const DeviceConfig& config, ConfigSync& sync){
+  if(!sync.reportDue) return false;
+
+  const TelemetryValue values[] = {config.version, config.rejectedVersion};                                      // Same order as DEVICE_CONFIG_REPORT_FIELDS
+  return publishAttributeReport<DEVICE_CONFIG_REPORT_MAX_LEN>(sync.reportDue, DEVICE_CONFIG_REPORT_FIELDS, values);
+}
+// MQTT END --------------------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
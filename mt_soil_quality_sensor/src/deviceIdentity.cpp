@@ -0,0 +1,24 @@
+#include <string.h>
+#include "deviceIdentity.h"
+#include "hal.h"
+#include "macros.h"
+
+// LOAD THE IDENTITY -----------------------------------------------------------------------------------------------------------------------------------------
+static void loadString(const char* key, char* value, size_t len, const char* fallback){
+  if(halIdentityGetStr(key, value, len) && value[0] != '\0') return;
+  strncpy(value, fallback, len - 1);                                                                             // Longer build defaults are cut rather than overflowing
+  value[len - 1] = '\0';
+}
+
+void loadDeviceIdentity(DeviceIdentity& identity){
+  memset(&identity, 0, sizeof(identity));
+  identity.provisioned = halIdentityGetStr(IDENTITY_TOKEN_KEY, identity.token, sizeof(identity.token)) && identity.token[0] != '\0';
+  if(!identity.provisioned) loadString(IDENTITY_TOKEN_KEY, identity.token, sizeof(identity.token), ACCESS_TOKEN);
+  loadString(IDENTITY_CLIENT_KEY, identity.clientId, sizeof(identity.clientId), MQTT_CLIENT);
+  loadString(IDENTITY_SSID_KEY, identity.wifiSsid, sizeof(identity.wifiSsid), WIFI_SSID);
+  loadString(IDENTITY_PASSWORD_KEY, identity.wifiPassword, sizeof(identity.wifiPassword), WIFI_PASSWORD);
+  if(!halIdentityGetI32(IDENTITY_TREE_KEY, identity.treeId)) identity.treeId = TREE_ID;
+  int32_t uplink;
+  identity.loraUplink = halIdentityGetI32(IDENTITY_UPLINK_KEY, uplink) ? uplink == 1 : UPLINK_LORA;
+}
+// LOAD THE IDENTITY END -------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include <math.h>
+#include "energyAccount.h"
+#include "hal.h"
+#include "macros.h"
+#include "telemetryReport.h"
+
+// COULOMB COUNTER WINDOWS -----------------------------------------------------------------------------------------------------------------------------------
+static void openWindow(EnergyLedger& ledger, float drawnmAh, uint64_t nowMs){
+  ledger.windowStartmAh = drawnmAh;
+  ledger.windowStartMs = nowMs;
+  ledger.windowOpen = true;
+}
+
+void updateEnergyLedger(EnergyLedger& ledger, float drawnmAh, uint64_t nowMs, float batteryVolts){
+  ledger.batteryVolts = batteryVolts;
+  if(!ledger.windowOpen || drawnmAh < ledger.windowStartmAh || nowMs <= ledger.windowStartMs){
+    openWindow(ledger, drawnmAh, nowMs);                                                                         // First wake, charging or counter reset: start over
+    return;
+  }
+
+  uint64_t elapsedMs = nowMs - ledger.windowStartMs;
+  if(elapsedMs > ENERGY_WINDOW_MAX_S * 1000ULL){
+    openWindow(ledger, drawnmAh, nowMs);
+    return;
+  }
+
+  float windowmAh = drawnmAh - ledger.windowStartmAh;
+  if(windowmAh < ENERGY_WINDOW_MAH) return;                                                                      // Too few counter steps yet
+
+  float windowmA = windowmAh * 3600000.0f / elapsedMs;
+  ledger.avgCurrentmA.update(windowmA);
+  openWindow(ledger, drawnmAh, nowMs);
+}
+// COULOMB COUNTER WINDOWS END -------------------------------------------------------------------------------------------------------------------------------
+
+// ESTIMATES -------------------------------------------------------------------------------------------------------------------------------------------------
+float batteryStateOfCharge(float volts){
+  static const float curveV[] = {3.30f, 3.60f, 3.70f, 3.75f, 3.80f, 3.90f, 4.00f, 4.10f, 4.20f};
+  static const float curveSoc[] = {0.00f, 0.08f, 0.20f, 0.35f, 0.45f, 0.60f, 0.75f, 0.90f, 1.00f};
+  const uint8_t points = sizeof(curveV) / sizeof(curveV[0]);
+
+  if(isnan(volts)) return NAN;
+  if(volts <= curveV[0]) return 0.0f;
+  for(uint8_t i = 1; i < points; i++){
+    if(volts < curveV[i]) return curveSoc[i - 1] + (curveSoc[i] - curveSoc[i - 1]) * (volts - curveV[i - 1]) / (curveV[i] - curveV[i - 1]);
+  }
+  return 1.0f;
+}
+
+float remainingRuntimeH(const EnergyLedger& ledger, float capacitymAh){
+  if(!ledger.avgCurrentmA.seeded || ledger.avgCurrentmA.value <= 0.0f) return NAN;                               // No closed window yet, or charging
+  return batteryStateOfCharge(ledger.batteryVolts) * capacitymAh / ledger.avgCurrentmA.value;
+}
+
+float reportChargemAh(const EnergyLedger& ledger, uint32_t reportIntervalS){
+  return ledger.avgCurrentmA.valueOr(NAN) * reportIntervalS / 3600.0f;
+}
+
+float mAhTomJ(float mAh, float volts){
+  return mAh * 3600.0f * volts;                                                                                  // 1 mAh = 3.6 C
+}
+// ESTIMATES END ---------------------------------------------------------------------------------------------------------------------------------------------
+
+// PUBLISHING ------------------------------------------------------------------------------------------------------------------------------------------------
+size_t serializeWakeEnergy(const WakeProfileHistory& history, const EnergyLedger& ledger, uint32_t reportIntervalS, float vbusVolts, char* out,
+                           size_t outSize){
+  const WakeProfile& p = history.lastFlush;
+  float reportmAh = reportChargemAh(ledger, reportIntervalS);
+  const TelemetryValue values[] = {                                                                              // Same order as WAKE_ENERGY_FIELDS
+    p.phasemAh[PHASE_BOOT], p.phasemAh[PHASE_POWER], p.phasemAh[PHASE_SENSORS], p.phasemAh[PHASE_SAMPLING],
+    p.phasemAh[PHASE_WIFI], p.phasemAh[PHASE_OTA], p.phasemAh[PHASE_MQTT], p.phasemAh[PHASE_PUBLISH],
+    p.totalmAh, mAhTomJ(p.totalmAh, ledger.batteryVolts), history.lastQuietmAh,
+    ledger.avgCurrentmA.valueOr(NAN),
+    reportmAh, mAhTomJ(reportmAh, ledger.batteryVolts),
+    vbusVolts > 4.0f ? NAN : remainingRuntimeH(ledger, BATTERY_CAPACITY_MAH),
+    vbusVolts,
+  };
+  return serializeTelemetry(out, outSize, WAKE_ENERGY_FIELDS, values);
+}
+
+bool publishWakeEnergy(const WakeProfileHistory& history, const EnergyLedger& ledger, uint32_t reportIntervalS){
+  char energyStr[ENERGY_MAX_LEN];
+  return publishReport(MQTT_TOPIC_PUB, energyStr,
+                       serializeWakeEnergy(history, ledger, reportIntervalS, halVbusVoltage(), energyStr, sizeof(energyStr)));
+}
+// PUBLISHING END --------------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
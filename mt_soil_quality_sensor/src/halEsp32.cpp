@@ -0,0 +1,638 @@
+#ifdef ARDUINO
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <Arduino.h>
+#include <sys/time.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <esp_partition.h>
+#include <esp_ota_ops.h>
+#include <esp32/rom/miniz.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/sha256.h>
+#include <esp_adc_cal.h>
+#include <driver/adc.h>
+#include <driver/i2s.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+#include <SPI.h>
+#include <Wire.h>
+#include <OneWire.h>
+#include "halEsp32.h"
+#include "macros.h"
+#include "deviceIdentity.h"
+#include "mqttPacket.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// CONSTRUCTORES DE OBJETOS DE CLASE DE LIBRERIA, VARIABLES GLOBALES, CONSTANTES...
+// ===========================================================================================================================================================
+static AXP20X_Class axp;
+static OneWire oneWireBus(ONE_WIRE_PIN);
+static uint8_t probeBits = 12;
+static PubSubClient* mqttClient = NULL;
+static HalMqttHandler mqttHandler = NULL;
+static bool pmuReady = false;
+static const esp_partition_t* logPartition = NULL;
+static esp_adc_cal_characteristics_t adcCalibration;
+static Preferences settings;
+static Preferences identityStore;                                                                                // IDENTITY_PARTITION, never written by the firmware
+static WiFiClientSecure httpTransport;                                                                           // Its own TLS session, opened once MQTT is closed so both never hold heap at once
+static HTTPClient http;
+static WiFiClient* httpStream = NULL;
+static tinfl_decompressor inflater;                                                                              // 11 kB, off the loop task stack
+static SPIClass loraSpi(VSPI);
+// CONSTRUCTORES END =========================================================================================================================================
+
+// CLOCK AND SLEEP -------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t halMillis(){
+  return millis();
+}
+
+uint64_t halMicros(){
+  return esp_timer_get_time();
+}
+
+void halDelayMs(uint32_t ms){
+  delay(ms);                                                                                                     // vTaskDelay underneath, the other tasks keep running
+}
+
+uint64_t halEpochMs(){
+  struct timeval tv;
+  gettimeofday(&tv, NULL);                                                                                       // Backed by the RTC timer on the ESP32, so it keeps counting during deep sleep
+  return (uint64_t)tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+}
+
+void halDeepSleep(uint64_t seconds){
+  esp_sleep_enable_timer_wakeup(seconds * 1000000ULL);
+  esp_deep_sleep_start();
+}
+// CLOCK AND SLEEP END ---------------------------------------------------------------------------------------------------------------------------------------
+
+// PMU -------------------------------------------------------------------------------------------------------------------------------------------------------
+AXP20X_Class& halPmu(){
+  return axp;
+}
+
+bool halPowerBegin(){
+  Wire.begin(SDA_PIN, SCL_PIN);                                                                                  // Initialize I2C bus
+  pmuReady = axp.begin(Wire, AXP192_SLAVE_ADDRESS) == 0;                                                         // "AXP192_SLAVE_ADDRESS" should be "0x34"
+  return pmuReady;
+}
+
+void halSensorPower(bool on){
+  axp.setPowerOutPut(AXP192_DCDC1, on ? AXP202_ON : AXP202_OFF);
+}
+
+void halMoisturePower(bool on){
+  pinMode(MOIST_POWER_PIN, OUTPUT);
+  digitalWrite(MOIST_POWER_PIN, on ? HIGH : LOW);
+}
+
+float halBatteryVoltage(){
+  return axp.getBattVoltage() / 1000.0f;                                                                         // Read battery voltage in mV and convert it to V
+}
+
+float halBatteryCurrentmA(){
+  if(!pmuReady) return NAN;                                                                                      // The profiler starts timing before the I2C bus is up
+  return axp.getBattDischargeCurrent() - axp.getBattChargeCurrent();
+}
+
+float halBatteryDrawnmAh(){
+  return -axp.getCoulombData();                                                                                  // Charge in minus charge out, 0.36 mAh per count at the default 25 Hz ADC rate
+}
+
+float halVbusVoltage(){
+  return axp.isVBUSPlug() ? axp.getVbusVoltage() / 1000.0f : 0.0f;
+}
+// PMU END ---------------------------------------------------------------------------------------------------------------------------------------------------
+
+// ONEWIRE TEMPERATURE PROBES --------------------------------------------------------------------------------------------------------------------------------
+#define DS18B20_FAMILY 0x28
+#define DS18B20_CONVERT 0x44
+#define DS18B20_READ_SCRATCHPAD 0xBE
+#define DS18B20_WRITE_SCRATCHPAD 0x4E
+#define DS18B20_SCRATCHPAD_LEN 9                                                                                 // 8 bytes plus their CRC
+
+void halTemperatureBegin(){
+  probeBits = 12;                                                                                                // EEPROM default of the DS18B20 until halTemperatureResolution()
+}
+
+uint8_t halTemperatureSearch(uint8_t (*roms)[HAL_PROBE_ROM_LEN], uint8_t max){
+  uint8_t count = 0;
+  oneWireBus.reset_search();
+  while(count < max && oneWireBus.search(roms[count])){                                                          // About 13 ms per device on the bus
+    if(roms[count][0] == DS18B20_FAMILY && OneWire::crc8(roms[count], HAL_PROBE_ROM_LEN - 1) == roms[count][HAL_PROBE_ROM_LEN - 1]) count++;
+  }
+  return count;
+}
+
+void halTemperatureResolution(uint8_t bits){
+  probeBits = constrain(bits, 9, 12);
+  if(!oneWireBus.reset()) return;                                                                                // No presence pulse, nothing on the bus
+  oneWireBus.skip();
+  oneWireBus.write(DS18B20_WRITE_SCRATCHPAD);
+  oneWireBus.write(0x4B);                                                                                        // TH and TL back to the factory values, the alarms are not used
+  oneWireBus.write(0x46);
+  oneWireBus.write(((probeBits - 9) << 5) | 0x1F);                                                               // Scratchpad only, the probes are back to 12 bits after a power cycle
+}
+
+uint32_t halTemperatureConversionMs(){
+  return 750 >> (12 - probeBits);                                                                                // 94, 188, 375 or 750 ms
+}
+
+void halTemperatureRequest(){
+  if(!oneWireBus.reset()) return;
+  oneWireBus.skip();
+  oneWireBus.write(DS18B20_CONVERT);                                                                             // Externally powered probes (DCDC1), no strong pull-up needed
+}
+
+bool halTemperatureReady(){
+  return oneWireBus.read_bit() == 1;                                                                             // Wired-AND: a probe still converting holds the line low
+}
+
+float halTemperatureReadC(const uint8_t* rom){
+  uint8_t scratchpad[DS18B20_SCRATCHPAD_LEN];
+  if(!oneWireBus.reset()) return HAL_PROBE_DISCONNECTED_C;
+  oneWireBus.select(rom);
+  oneWireBus.write(DS18B20_READ_SCRATCHPAD);
+  oneWireBus.read_bytes(scratchpad, sizeof(scratchpad));
+
+  bool allZeros = true;
+  for(uint8_t i = 0; i < sizeof(scratchpad); i++) allZeros &= scratchpad[i] == 0;
+  if(allZeros || OneWire::crc8(scratchpad, DS18B20_SCRATCHPAD_LEN - 1) != scratchpad[DS18B20_SCRATCHPAD_LEN - 1]){
+    return HAL_PROBE_DISCONNECTED_C;                                                                             // Probe gone (bus held low) or a corrupted read
+  }
+
+  int16_t raw = (scratchpad[1] << 8) | scratchpad[0];
+  raw &= ~((1 << (12 - probeBits)) - 1);                                                                         // Undefined low bits below 12 bits
+  return raw / 16.0f;
+}
+// ONEWIRE TEMPERATURE PROBES END ----------------------------------------------------------------------------------------------------------------------------
+
+// ADC -------------------------------------------------------------------------------------------------------------------------------------------------------
+#define ADC_DEFAULT_VREF_MV 1100                                                                                 // Only used by chips without any calibration burnt in eFuse
+#define ADC_BURST_DMA_LEN 256                                                                                    // Samples per DMA buffer
+
+void halAnalogBegin(){
+  adc1_config_width(ADC_WIDTH_BIT_12);
+  esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, ADC_DEFAULT_VREF_MV, &adcCalibration); // Two-point or Vref from eFuse, 0 to about 3V1 at 11 dB
+}
+
+size_t halAnalogBurst(uint8_t pin, uint16_t* raw, size_t count){
+  int8_t channel = digitalPinToAnalogChannel(pin);
+  if(channel < 0 || channel >= ADC1_CHANNEL_MAX) return 0;                                                       // The I2S DMA only samples ADC1, ADC2 belongs to Wi-Fi anyway
+  adc1_config_channel_atten((adc1_channel_t)channel, ADC_ATTEN_DB_11);
+
+  i2s_config_t config = {};
+  config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+  config.sample_rate = ADC_BURST_RATE_HZ;
+  config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+  config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+  config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+  config.dma_buf_count = 2;
+  config.dma_buf_len = ADC_BURST_DMA_LEN;
+  if(i2s_driver_install(I2S_NUM_0, &config, 0, NULL) != ESP_OK) return 0;
+  i2s_set_adc_mode(ADC_UNIT_1, (adc1_channel_t)channel);
+  i2s_adc_enable(I2S_NUM_0);
+
+  size_t received = 0;
+  size_t bytes = 0;
+  uint16_t settling[ADC_BURST_DMA_LEN];
+  i2s_read(I2S_NUM_0, settling, sizeof(settling), &bytes, pdMS_TO_TICKS(100));                                   // The first buffer still holds conversions from before the channel switch
+  while(received < count){
+    if(i2s_read(I2S_NUM_0, raw + received, (count - received) * sizeof(uint16_t), &bytes, pdMS_TO_TICKS(100)) != ESP_OK || bytes == 0) break;
+    received += bytes / sizeof(uint16_t);
+  }
+  i2s_adc_disable(I2S_NUM_0);
+  i2s_driver_uninstall(I2S_NUM_0);                                                                               // ADC1 back to the one-shot driver
+
+  for(size_t i = 0; i < received; i++) raw[i] &= 0x0FFF;                                                         // The upper nibble carries the channel number
+  return received;
+}
+
+uint32_t halAnalogMillivolts(uint16_t raw){
+  return esp_adc_cal_raw_to_voltage(raw, &adcCalibration);
+}
+// ADC END ---------------------------------------------------------------------------------------------------------------------------------------------------
+
+// NETWORK LINK ----------------------------------------------------------------------------------------------------------------------------------------------
+bool halNetworkUp(uint32_t timeoutMs){                                                                           // The join itself is started by connectToWiFi() with the rejoin cache
+  uint32_t start = millis();
+  while(WiFi.status() != WL_CONNECTED && (millis() - start) < timeoutMs){
+    delay(10);
+  }
+  return WiFi.status() == WL_CONNECTED;
+}
+
+void halNetworkDown(){
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+}
+
+bool halNetworkConnected(){
+  return WiFi.status() == WL_CONNECTED;
+}
+// NETWORK LINK END ------------------------------------------------------------------------------------------------------------------------------------------
+
+// MQTT TRANSPORT --------------------------------------------------------------------------------------------------------------------------------------------
+// PubSubClient owns the socket: every byte in and out goes through it, so its keepalive (PINGREQ when due, pingOutstanding cleared by the PINGRESP,
+// timeout after 1.5 periods of silence) sees the QoS 1 traffic too. The QoS 1 PUBLISH is written with mqttClient->write(), which counts as
+// outbound activity. PubSubClient drops the PUBACKs it reads, so AckTap, between it and the TLS client, scans the incoming stream for them.
+class AckTap : public Client {
+public:
+  Client* transport = NULL;
+  MqttAckScanner scanner = {};
+
+  int connect(IPAddress ip, uint16_t port) override { scanner.reset(); return transport->connect(ip, port); }
+  int connect(const char* host, uint16_t port) override { scanner.reset(); return transport->connect(host, port); }
+  size_t write(uint8_t b) override { return transport->write(b); }
+  size_t write(const uint8_t* buf, size_t size) override { return transport->write(buf, size); }
+  int available() override { return transport->available(); }
+  int peek() override { return transport->peek(); }
+  void flush() override { transport->flush(); }
+  void stop() override { transport->stop(); }
+  uint8_t connected() override { return transport->connected(); }
+  operator bool() override { return transport->connected(); }
+
+  int read() override {
+    int b = transport->read();
+    if(b >= 0) scanner.feed(b);
+    return b;
+  }
+
+  int read(uint8_t* buf, size_t size) override {
+    int n = transport->read(buf, size);
+    for(int i = 0; i < n; i++) scanner.feed(buf[i]);
+    return n;
+  }
+};
+
+static AckTap ackTap;
+
+void halBindMqtt(PubSubClient& client, Client& transport){
+  ackTap.transport = &transport;
+  client.setClient(ackTap);
+  mqttClient = &client;
+}
+
+bool halMqttConnect(const char* host, uint16_t port, const char* clientId, const char* user){
+  if(mqttClient == NULL) return false;
+  if(mqttClient->connected()) return true;                                                                       // Keeps the resolved address and TLS hostname set by connectToMQTT()
+  mqttClient->setServer(host, port);
+  return mqttClient->connect(clientId, user, NULL);
+}
+
+bool halMqttPublish(const char* topic, const uint8_t* payload, size_t len){
+  return mqttClient != NULL && mqttClient->publish(topic, payload, len, false);
+}
+
+#define QOS1_TOPIC_MAX_LEN 64                                                                                    // The PUBLISH header is built on the stack
+
+bool halMqttPublishQos1(const char* topic, const uint8_t* payload, size_t len, uint16_t packetId){
+  if(mqttClient == NULL || !mqttClient->connected()) return false;
+
+  uint8_t header[MQTT_PUBLISH_HEADER_MAX_LEN(QOS1_TOPIC_MAX_LEN)];
+  size_t n = mqttPublishHeader(header, sizeof(header), topic, len, packetId);
+  return n > 0 && mqttClient->write(header, n) == n && mqttClient->write(payload, len) == len;                   // PubSubClient only builds QoS 0 publishes
+}
+
+bool halMqttConnected(){
+  return mqttClient != NULL && mqttClient->connected();
+}
+
+bool halMqttLoop(){
+  return mqttClient != NULL && mqttClient->loop();                                                               // PINGREQ when due, one incoming packet: PINGRESP, PUBACK or a subscribed publish
+}
+
+int32_t halMqttPollAck(uint32_t waitMs){
+  uint32_t startMs = millis();
+  uint16_t packetId;
+  while(true){
+    if(ackTap.scanner.take(packetId)) return packetId;
+    if(!halMqttLoop()) return HAL_MQTT_LOST;                                                                     // Keepalive expired or the socket closed
+    if(ackTap.scanner.take(packetId)) return packetId;
+    if(millis() - startMs >= waitMs) return HAL_MQTT_NO_ACK;
+    if(ackTap.available() <= 0) delay(1);
+  }
+}
+
+static void mqttCallback(char* topic, uint8_t* payload, unsigned int length){
+  if(mqttHandler != NULL) mqttHandler(topic, payload, length);
+}
+
+bool halMqttSubscribe(const char* topic){
+  return mqttClient != NULL && mqttClient->subscribe(topic);
+}
+
+void halMqttOnMessage(HalMqttHandler handler){
+  mqttHandler = handler;
+  if(mqttClient != NULL) mqttClient->setCallback(mqttCallback);                                                  // Called from mqttClient.loop(), in halMqttLoop() and halMqttPollAck()
+}
+
+void halMqttDisconnect(){
+  if(mqttClient != NULL) mqttClient->disconnect();
+}
+// MQTT TRANSPORT END ----------------------------------------------------------------------------------------------------------------------------------------
+
+// SETTINGS (NVS) --------------------------------------------------------------------------------------------------------------------------------------------
+bool halSettingsGetU32(const char* key, uint32_t& value){
+  if(!settings.begin(SETTINGS_NAMESPACE, true)) return false;                                                    // Read-only open fails until something was written
+  bool found = settings.isKey(key);
+  if(found) value = settings.getULong(key);
+  settings.end();
+  return found;
+}
+
+bool halSettingsSetU32(const char* key, uint32_t value){
+  if(!settings.begin(SETTINGS_NAMESPACE, false)) return false;
+  bool ok = settings.putULong(key, value) == sizeof(value);
+  settings.end();
+  return ok;
+}
+// SETTINGS END ----------------------------------------------------------------------------------------------------------------------------------------------
+
+// DEVICE IDENTITY (READ-ONLY NVS PARTITION) -----------------------------------------------------------------------------------------------------------------
+bool halIdentityGetStr(const char* key, char* value, size_t len){
+  if(!identityStore.begin(IDENTITY_NAMESPACE, true, IDENTITY_PARTITION)) return false;                           // Also initialises the partition, fails on a board never provisioned
+  bool found = identityStore.isKey(key) && identityStore.getString(key, value, len) > 0;
+  identityStore.end();
+  return found;
+}
+
+bool halIdentityGetI32(const char* key, int32_t& value){
+  if(!identityStore.begin(IDENTITY_NAMESPACE, true, IDENTITY_PARTITION)) return false;
+  bool found = identityStore.isKey(key);
+  if(found) value = identityStore.getInt(key);
+  identityStore.end();
+  return found;
+}
+// DEVICE IDENTITY END ---------------------------------------------------------------------------------------------------------------------------------------
+
+// LORA RADIO (SX1276, REGISTER LEVEL) -----------------------------------------------------------------------------------------------------------------------
+#define SX127X_REG_FIFO 0x00
+#define SX127X_REG_OP_MODE 0x01
+#define SX127X_REG_FRF_MSB 0x06
+#define SX127X_REG_FRF_MID 0x07
+#define SX127X_REG_FRF_LSB 0x08
+#define SX127X_REG_PA_CONFIG 0x09
+#define SX127X_REG_FIFO_ADDR_PTR 0x0D
+#define SX127X_REG_FIFO_TX_BASE 0x0E
+#define SX127X_REG_IRQ_FLAGS 0x12
+#define SX127X_REG_MODEM_CONFIG1 0x1D
+#define SX127X_REG_MODEM_CONFIG2 0x1E
+#define SX127X_REG_PREAMBLE_MSB 0x20
+#define SX127X_REG_PREAMBLE_LSB 0x21
+#define SX127X_REG_PAYLOAD_LEN 0x22
+#define SX127X_REG_MODEM_CONFIG3 0x26
+#define SX127X_REG_SYNC_WORD 0x39
+#define SX127X_REG_DIO_MAPPING1 0x40
+#define SX127X_REG_VERSION 0x42
+#define SX127X_MODE_LORA 0x80                                                                                    // LongRangeMode, only changes in sleep
+#define SX127X_MODE_SLEEP 0x00
+#define SX127X_MODE_STDBY 0x01
+#define SX127X_MODE_TX 0x03
+#define SX127X_IRQ_TX_DONE 0x08
+#define SX127X_SILICON_VERSION 0x12
+#define SX127X_XTAL_HZ 32000000ULL
+
+static void loraWrite(uint8_t reg, uint8_t value){
+  digitalWrite(LORA_CS_PIN, LOW);
+  loraSpi.transfer(reg | 0x80);                                                                                  // MSB set: write access
+  loraSpi.transfer(value);
+  digitalWrite(LORA_CS_PIN, HIGH);
+}
+
+static uint8_t loraRead(uint8_t reg){
+  digitalWrite(LORA_CS_PIN, LOW);
+  loraSpi.transfer(reg & 0x7F);
+  uint8_t value = loraSpi.transfer(0x00);
+  digitalWrite(LORA_CS_PIN, HIGH);
+  return value;
+}
+
+static uint8_t loraBandwidthCode(){
+  static const uint32_t bandwidthsHz[] = {7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000};
+  for(uint8_t code = 0; code < sizeof(bandwidthsHz) / sizeof(bandwidthsHz[0]); code++){
+    if(LORA_BANDWIDTH_HZ <= bandwidthsHz[code]) return code;
+  }
+  return 9;
+}
+
+static void loraPowerOff(){
+  loraWrite(SX127X_REG_OP_MODE, SX127X_MODE_LORA | SX127X_MODE_SLEEP);
+  loraSpi.endTransaction();
+  loraSpi.end();
+  axp.setPowerOutPut(AXP192_LDO2, AXP202_OFF);                                                                   // As setupPower() leaves it, the radio draws nothing between frames
+}
+
+bool halLoraTransmit(const uint8_t* frame, size_t len){
+  if(len == 0 || len > HAL_LORA_MAX_LEN) return false;
+  axp.setLDO2Voltage(3300);
+  axp.setPowerOutPut(AXP192_LDO2, AXP202_ON);
+  pinMode(LORA_CS_PIN, OUTPUT);
+  digitalWrite(LORA_CS_PIN, HIGH);
+  pinMode(LORA_DIO0_PIN, INPUT);
+  pinMode(LORA_RST_PIN, OUTPUT);
+  digitalWrite(LORA_RST_PIN, LOW);                                                                               // Manual reset once the supply is up, the chip is ready 5 ms after it
+  delay(1);
+  digitalWrite(LORA_RST_PIN, HIGH);
+  delay(6);
+  loraSpi.begin(LORA_SCK_PIN, LORA_MISO_PIN, LORA_MOSI_PIN, LORA_CS_PIN);
+  loraSpi.beginTransaction(SPISettings(8000000, MSBFIRST, SPI_MODE0));
+  if(loraRead(SX127X_REG_VERSION) != SX127X_SILICON_VERSION){                                                    // No SX1276 answering: unpowered, missing or a different board
+    loraPowerOff();
+    return false;
+  }
+
+  bool lowDataRate = (1UL << LORA_SPREADING_FACTOR) * 1000UL / LORA_BANDWIDTH_HZ >= 16;                          // Symbols of 16 ms or longer, same rule as loraAirtimeMs()
+  uint64_t frf = ((uint64_t)LORA_FREQUENCY_HZ << 19) / SX127X_XTAL_HZ;                                           // 61 Hz steps
+  loraWrite(SX127X_REG_OP_MODE, SX127X_MODE_SLEEP);
+  loraWrite(SX127X_REG_OP_MODE, SX127X_MODE_LORA | SX127X_MODE_SLEEP);
+  loraWrite(SX127X_REG_FRF_MSB, (uint8_t)(frf >> 16));
+  loraWrite(SX127X_REG_FRF_MID, (uint8_t)(frf >> 8));
+  loraWrite(SX127X_REG_FRF_LSB, (uint8_t)frf);
+  loraWrite(SX127X_REG_PA_CONFIG, 0x80 | (LORA_TX_POWER_DBM - 2));                                               // PA_BOOST (the only PA wired on the T-Beam), 2 to 17 dBm
+  loraWrite(SX127X_REG_MODEM_CONFIG1, (loraBandwidthCode() << 4) | ((LORA_CODING_RATE - 4) << 1));               // Explicit header
+  loraWrite(SX127X_REG_MODEM_CONFIG2, (LORA_SPREADING_FACTOR << 4) | 0x04);                                      // Payload CRC on
+  loraWrite(SX127X_REG_MODEM_CONFIG3, (lowDataRate ? 0x08 : 0x00) | 0x04);                                       // AGC on
+  loraWrite(SX127X_REG_PREAMBLE_MSB, 0);
+  loraWrite(SX127X_REG_PREAMBLE_LSB, LORA_PREAMBLE_LEN);
+  loraWrite(SX127X_REG_SYNC_WORD, LORA_SYNC_WORD);
+  loraWrite(SX127X_REG_OP_MODE, SX127X_MODE_LORA | SX127X_MODE_STDBY);                                           // FIFO only accessible out of sleep
+
+  loraWrite(SX127X_REG_FIFO_TX_BASE, 0);
+  loraWrite(SX127X_REG_FIFO_ADDR_PTR, 0);
+  digitalWrite(LORA_CS_PIN, LOW);
+  loraSpi.transfer(SX127X_REG_FIFO | 0x80);                                                                      // Burst write, the address pointer advances on its own
+  for(size_t i = 0; i < len; i++) loraSpi.transfer(frame[i]);
+  digitalWrite(LORA_CS_PIN, HIGH);
+  loraWrite(SX127X_REG_PAYLOAD_LEN, (uint8_t)len);
+  loraWrite(SX127X_REG_DIO_MAPPING1, 0x40);                                                                      // DIO0 = TxDone
+  loraWrite(SX127X_REG_IRQ_FLAGS, 0xFF);
+  loraWrite(SX127X_REG_OP_MODE, SX127X_MODE_LORA | SX127X_MODE_TX);
+
+  uint32_t startMs = millis();
+  while(digitalRead(LORA_DIO0_PIN) == LOW && millis() - startMs < LORA_TX_TIMEOUT_MS) delay(1);                  // The airtime, other tasks keep running
+  bool sent = loraRead(SX127X_REG_IRQ_FLAGS) & SX127X_IRQ_TX_DONE;
+  loraWrite(SX127X_REG_IRQ_FLAGS, 0xFF);
+  loraPowerOff();
+  return sent;
+}
+// LORA RADIO END --------------------------------------------------------------------------------------------------------------------------------------------
+
+// FRAME AUTHENTICATION --------------------------------------------------------------------------------------------------------------------------------------
+void halHmacSha256(const uint8_t* key, size_t keyLen, const uint8_t* data, size_t len, uint8_t* mac){
+  mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), key, keyLen, data, len, mac);                    // SHA accelerator underneath
+}
+
+uint32_t halRandom(){                                                                                            // Seeded by the bootloader, true random once the radio has been on
+  return esp_random();
+}
+// FRAME AUTHENTICATION END ----------------------------------------------------------------------------------------------------------------------------------
+
+// TELEMETRY LOG FLASH ---------------------------------------------------------------------------------------------------------------------------------------
+static const esp_partition_t* findLogPartition(){
+  if(logPartition == NULL){
+    logPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)TELEMETRY_LOG_SUBTYPE, TELEMETRY_LOG_PARTITION);
+  }
+  return logPartition;
+}
+
+uint32_t halLogSize(){
+  return findLogPartition() != NULL ? logPartition->size : 0;                                                    // Older images were flashed with the default table, no log then
+}
+
+bool halLogRead(uint32_t offset, void* data, size_t len){
+  return findLogPartition() != NULL && esp_partition_read(logPartition, offset, data, len) == ESP_OK;
+}
+
+bool halLogWrite(uint32_t offset, const void* data, size_t len){
+  return findLogPartition() != NULL && esp_partition_write(logPartition, offset, data, len) == ESP_OK;
+}
+
+bool halLogErase(uint32_t offset){
+  offset -= offset % HAL_LOG_SECTOR_SIZE;
+  return findLogPartition() != NULL && esp_partition_erase_range(logPartition, offset, HAL_LOG_SECTOR_SIZE) == ESP_OK;
+}
+// TELEMETRY LOG FLASH END -----------------------------------------------------------------------------------------------------------------------------------
+
+// HTTP DOWNLOAD ---------------------------------------------------------------------------------------------------------------------------------------------
+bool halHttpOpen(const char* url, uint32_t offset){
+  halHttpClose();
+  httpTransport.setCACert(OTA_ROOT_CA);
+  http.setReuse(false);
+  http.setTimeout(OTA_HTTP_TIMEOUT_S * 1000);
+  if(!http.begin(httpTransport, url)) return false;                                                              // https:// only: the signature vouches for the image, TLS for the server
+
+  char range[24];
+  snprintf(range, sizeof(range), "bytes=%lu-", (unsigned long)offset);
+  http.addHeader("Range", range);
+  int code = http.GET();
+  if(code != HTTP_CODE_PARTIAL_CONTENT && code != HTTP_CODE_OK){
+    http.end();
+    return false;
+  }
+  httpStream = http.getStreamPtr();
+  httpStream->setTimeout(OTA_HTTP_TIMEOUT_S);                                                                    // Seconds on WiFiClient
+  for(uint32_t skip = code == HTTP_CODE_OK ? offset : 0; skip > 0; ){                                            // Range ignored by the server: read up to offset
+    uint8_t discard[256];
+    size_t chunk = skip < sizeof(discard) ? skip : sizeof(discard);
+    if(httpStream->readBytes(discard, chunk) != chunk){
+      halHttpClose();
+      return false;
+    }
+    skip -= chunk;
+  }
+  return true;
+}
+
+bool halHttpRead(uint8_t* data, size_t len){
+  return httpStream != NULL && httpStream->readBytes(data, len) == len;
+}
+
+void halHttpClose(){
+  if(httpStream == NULL) return;
+  http.end();
+  httpStream = NULL;
+}
+// HTTP DOWNLOAD END -----------------------------------------------------------------------------------------------------------------------------------------
+
+// FIRMWARE UPDATE SLOT --------------------------------------------------------------------------------------------------------------------------------------
+extern "C" bool verifyRollbackLater(){                                                                           // The core would confirm every image in initArduino(), halOtaConfirm() does it after the first acked flush
+  return true;
+}
+
+uint32_t halOtaSlotSize(){
+  const esp_partition_t* slot = esp_ota_get_next_update_partition(NULL);
+  return slot != NULL ? slot->size : 0;
+}
+
+bool halOtaWrite(uint32_t offset, const void* data, size_t len){
+  const esp_partition_t* slot = esp_ota_get_next_update_partition(NULL);
+  if(slot == NULL || offset + len > slot->size) return false;
+  uint32_t eraseFrom = (offset + HAL_LOG_SECTOR_SIZE - 1) / HAL_LOG_SECTOR_SIZE * HAL_LOG_SECTOR_SIZE;           // Sectors this write is the first to reach
+  uint32_t eraseTo = (offset + len + HAL_LOG_SECTOR_SIZE - 1) / HAL_LOG_SECTOR_SIZE * HAL_LOG_SECTOR_SIZE;
+  if(eraseTo > eraseFrom && esp_partition_erase_range(slot, eraseFrom, eraseTo - eraseFrom) != ESP_OK) return false;
+  return esp_partition_write(slot, offset, data, len) == ESP_OK;
+}
+
+bool halOtaDigest(uint32_t len, uint8_t* sha256){
+  const esp_partition_t* slot = esp_ota_get_next_update_partition(NULL);
+  if(slot == NULL || len > slot->size) return false;
+
+  uint8_t chunk[512];
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts_ret(&ctx, 0);
+  bool ok = true;
+  for(uint32_t offset = 0; offset < len && ok; offset += sizeof(chunk)){
+    size_t n = len - offset < sizeof(chunk) ? len - offset : sizeof(chunk);
+    ok = esp_partition_read(slot, offset, chunk, n) == ESP_OK && mbedtls_sha256_update_ret(&ctx, chunk, n) == 0;
+  }
+  ok = ok && mbedtls_sha256_finish_ret(&ctx, sha256) == 0;
+  mbedtls_sha256_free(&ctx);
+  return ok;
+}
+
+bool halOtaActivate(){
+  const esp_partition_t* slot = esp_ota_get_next_update_partition(NULL);
+  return slot != NULL && esp_ota_set_boot_partition(slot) == ESP_OK;                                             // Also checks the app image header and its own checksum
+}
+
+bool halOtaTrialBoot(){
+  esp_ota_img_states_t state;
+  return esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY;
+}
+
+void halOtaConfirm(){
+  esp_ota_mark_app_valid_cancel_rollback();
+}
+// FIRMWARE UPDATE SLOT END ----------------------------------------------------------------------------------------------------------------------------------
+
+// IMAGE CHECKS ----------------------------------------------------------------------------------------------------------------------------------------------
+size_t halInflate(const uint8_t* in, size_t inLen, uint8_t* out, size_t outSize){
+  size_t inBytes = inLen;
+  size_t outBytes = outSize;
+  tinfl_init(&inflater);                                                                                         // ROM copy of miniz, no flash spent on an inflater
+  tinfl_status status = tinfl_decompress(&inflater, in, &inBytes, out, out, &outBytes,
+                                         TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+  return status == TINFL_STATUS_DONE ? outBytes : 0;
+}
+
+bool halVerifySignature(const uint8_t* data, size_t len, const uint8_t* signature, size_t signatureLen){
+  uint8_t hash[32];
+  mbedtls_pk_context key;
+  mbedtls_pk_init(&key);
+  bool ok = mbedtls_sha256_ret(data, len, hash, 0) == 0 &&
+            mbedtls_pk_parse_public_key(&key, (const uint8_t*)OTA_PUBLIC_KEY, sizeof(OTA_PUBLIC_KEY)) == 0 &&    // PEM: the length counts the terminating NUL
+            mbedtls_pk_verify(&key, MBEDTLS_MD_SHA256, hash, sizeof(hash), signature, signatureLen) == 0;
+  mbedtls_pk_free(&key);
+  return ok;
+}
+// IMAGE CHECKS END ------------------------------------------------------------------------------------------------------------------------------------------
+#endif
\ No newline at end of file
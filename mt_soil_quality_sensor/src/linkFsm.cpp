@@ -0,0 +1,137 @@
+#include "linkFsm.h"
+#include "hal.h"
+#include "macros.h"
+#include "telemetryReport.h"
+
+// HELPERS ---------------------------------------------------------------------------------------------------------------------------------------------------
+static bool reached(uint32_t nowMs, uint32_t targetMs){
+  return (int32_t)(nowMs - targetMs) >= 0;                                                                       // Safe across the millis() wrap
+}
+
+static uint32_t nextRandom(LinkFsm& fsm){
+  fsm.rng ^= fsm.rng << 13;
+  fsm.rng ^= fsm.rng >> 17;
+  fsm.rng ^= fsm.rng << 5;
+  return fsm.rng;
+}
+
+static void expire(LinkFsm& fsm, LinkStats& stats){
+  fsm.state = LINK_EXPIRED;
+  stats.expiredWakes++;
+  if(stats.consecutiveExpired < 8) stats.consecutiveExpired++;
+  uint32_t skip = (1UL << stats.consecutiveExpired) - 1;                                                         // 1, 3, 7... wakes without radio after each expired one
+  stats.skipWakes = skip < LINK_MAX_SKIP_WAKES ? skip : LINK_MAX_SKIP_WAKES;
+}
+
+static void backOff(LinkFsm& fsm, LinkStats& stats, LinkState retryState, uint32_t nowMs){
+  uint8_t shift = fsm.failures < 16 ? fsm.failures : 16;
+  uint32_t delayMs = LINK_BACKOFF_BASE_MS << shift;
+  if(delayMs > LINK_BACKOFF_MAX_MS) delayMs = LINK_BACKOFF_MAX_MS;
+  delayMs = delayMs / 2 + nextRandom(fsm) % (delayMs / 2 + 1);                                                   // Equal jitter, a fleet that lost the same AP does not retry in lockstep
+  if(fsm.failures < 255) fsm.failures++;
+
+  fsm.retryState = retryState;
+  fsm.resumeMs = nowMs + delayMs;
+  fsm.state = LINK_BACKOFF;
+  if(reached(fsm.resumeMs, fsm.deadlineMs)) expire(fsm, stats);                                                  // No attempt would fit before the deadline
+}
+// HELPERS END -----------------------------------------------------------------------------------------------------------------------------------------------
+
+// STATE MACHINE ---------------------------------------------------------------------------------------------------------------------------------------------
+void linkBegin(LinkFsm& fsm, uint32_t nowMs, uint32_t budgetMs, uint32_t seed){
+  fsm.state = LINK_JOIN;
+  fsm.retryState = LINK_JOIN;
+  fsm.deadlineMs = nowMs + budgetMs;
+  fsm.resumeMs = nowMs;
+  fsm.failures = 0;
+  fsm.attempts = 0;
+  fsm.rng = seed ? seed : 0x9E3779B9UL;                                                                          // xorshift never leaves 0
+}
+
+LinkAction linkStep(LinkFsm& fsm, LinkStats& stats, LinkEvent event, uint32_t nowMs){
+  switch(event){
+    case LINK_WIFI_UP:
+      if(fsm.state == LINK_JOIN) fsm.state = LINK_CONNECT;
+      break;
+    case LINK_WIFI_FAILED:
+      stats.wifiFailures++;
+      backOff(fsm, stats, LINK_JOIN, nowMs);
+      break;
+    case LINK_MQTT_UP:
+      fsm.state = LINK_UP;
+      fsm.failures = 0;
+      stats.lastAttempts = fsm.attempts;
+      stats.lastUpMs = nowMs;
+      stats.consecutiveExpired = 0;
+      stats.skipWakes = 0;
+      break;
+    case LINK_MQTT_FAILED:
+      stats.mqttFailures++;
+      backOff(fsm, stats, LINK_CONNECT, nowMs);
+      break;
+    case LINK_WIFI_LOST:
+    case LINK_MQTT_LOST:
+      stats.linkLosses++;
+      backOff(fsm, stats, event == LINK_WIFI_LOST ? LINK_JOIN : LINK_CONNECT, nowMs);
+      break;
+    case LINK_TICK:
+      break;
+  }
+
+  if(fsm.state != LINK_UP && fsm.state != LINK_EXPIRED && reached(nowMs, fsm.deadlineMs)) expire(fsm, stats);
+  if(fsm.state == LINK_BACKOFF && reached(nowMs, fsm.resumeMs)) fsm.state = fsm.retryState;
+
+  switch(fsm.state){
+    case LINK_JOIN:
+      fsm.attempts++;
+      return LINK_DO_JOIN;
+    case LINK_CONNECT:
+      fsm.attempts++;
+      return LINK_DO_CONNECT;
+    case LINK_BACKOFF:
+      return LINK_DO_WAIT;
+    case LINK_UP:
+      return LINK_DO_SERVE;
+    default:
+      return LINK_DO_SLEEP;
+  }
+}
+
+uint32_t linkWaitMs(const LinkFsm& fsm, uint32_t nowMs){
+  if(fsm.state != LINK_BACKOFF || reached(nowMs, fsm.resumeMs)) return 0;
+  return fsm.resumeMs - nowMs;
+}
+
+uint32_t linkAttemptMs(const LinkFsm& fsm, uint32_t nowMs, uint32_t maxMs){
+  uint32_t remainingMs = reached(nowMs, fsm.deadlineMs) ? 0 : fsm.deadlineMs - nowMs;
+  return remainingMs < maxMs ? remainingMs : maxMs;
+}
+// STATE MACHINE END -----------------------------------------------------------------------------------------------------------------------------------------
+
+// BACKOFF ACROSS WAKES --------------------------------------------------------------------------------------------------------------------------------------
+bool linkRadioDue(LinkStats& stats){
+  if(stats.skipWakes == 0) return true;
+  stats.skipWakes--;                                                                                             // The readings keep piling up in RTC memory meanwhile
+  return false;
+}
+// BACKOFF ACROSS WAKES END ----------------------------------------------------------------------------------------------------------------------------------
+
+// FAILURE REPORT --------------------------------------------------------------------------------------------------------------------------------------------
+size_t serializeLinkStats(const LinkStats& stats, char* out, size_t outSize){
+  const TelemetryValue values[] = {                                                                              // Same order as LINK_STATS_FIELDS
+    stats.wifiFailures, stats.mqttFailures, stats.linkLosses, stats.expiredWakes, stats.lastAttempts, stats.lastUpMs,
+  };
+  return serializeTelemetry(out, outSize, LINK_STATS_FIELDS, values);
+}
+
+bool publishLinkFailures(LinkStats& stats){
+  char statsStr[LINK_STATS_MAX_LEN];
+  if(!publishReport(MQTT_TOPIC_PUB, statsStr, serializeLinkStats(stats, statsStr, sizeof(statsStr)))) return false;
+
+  stats.wifiFailures = 0;
+  stats.mqttFailures = 0;
+  stats.linkLosses = 0;
+  stats.expiredWakes = 0;
+  return true;
+}
+// FAILURE REPORT END ----------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
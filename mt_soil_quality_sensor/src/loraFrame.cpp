@@ -0,0 +1,94 @@
+#include "loraFrame.h"
+#include "telemetryCodec.h"
+
+// DEVICE ADDRESS --------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t loraDeviceAddress(const char* clientId){
+  uint32_t hash = 2166136261UL;
+  while(*clientId){
+    hash ^= (uint8_t)*clientId++;
+    hash *= 16777619UL;
+  }
+  return hash;                                                                                                   // A collision within a fleet is unlikely, ThingsBoard/loraGateway refuses a device list with one
+}
+// DEVICE ADDRESS END ----------------------------------------------------------------------------------------------------------------------------------------
+
+// AIRTIME AND PAYLOAD LIMITS --------------------------------------------------------------------------------------------------------------------------------
+uint32_t loraAirtimeMs(size_t len, uint8_t spreadingFactor, uint32_t bandwidthHz, uint8_t codingRate){
+  float symbolMs = (float)(1UL << spreadingFactor) * 1000.0f / bandwidthHz;
+  int lowRate = symbolMs >= 16.0f ? 1 : 0;                                                                       // Low data rate optimization, mandatory above 16 ms per symbol (SF11 and SF12 at 125 kHz)
+  int bits = 8 * (int)len - 4 * spreadingFactor + 28 + 16;                                                       // Explicit header, payload CRC on
+  int divisor = 4 * (spreadingFactor - 2 * lowRate);
+  int blocks = bits > 0 ? (bits + divisor - 1) / divisor : 0;
+  float symbols = (LORA_PREAMBLE_LEN + 4.25f) + 8 + blocks * codingRate;
+  return (uint32_t)(symbols * symbolMs + 0.999f);
+}
+
+size_t loraMaxPayload(uint8_t spreadingFactor){
+  if(spreadingFactor >= 10) return 51;
+  if(spreadingFactor == 9) return 115;
+  return LORA_FRAME_MAX_LEN;
+}
+// AIRTIME AND PAYLOAD LIMITS END ----------------------------------------------------------------------------------------------------------------------------
+
+// ENCODE ----------------------------------------------------------------------------------------------------------------------------------------------------
+size_t encodeLoraFrame(const TelemetryBuffer& buffer, uint32_t address, uint16_t session, uint16_t counter, uint64_t nowMs, uint8_t* out, size_t outSize,
+                       uint8_t& records){
+  records = 0;
+  if(outSize < LORA_FRAME_HEADER_LEN) return 0;
+  out[0] = LORA_FRAME_VERSION;
+  for(uint8_t i = 0; i < 4; i++) out[1 + i] = (uint8_t)(address >> (8 * i));
+  out[5] = (uint8_t)session;
+  out[6] = (uint8_t)(session >> 8);
+  out[7] = (uint8_t)counter;
+  out[8] = (uint8_t)(counter >> 8);
+
+  size_t len = LORA_FRAME_HEADER_LEN;
+  int64_t previousAgeS = 0;
+  int64_t previousBoot = 0;
+  while(records < buffer.count && records < LORA_FRAME_MAX_RECORDS){
+    const TelemetryRecord& record = telemetryRecordAt(buffer, records);
+    int64_t ageS = nowMs > record.timestampMs ? (int64_t)((nowMs - record.timestampMs + 500) / 1000) : 0;        // Each age rounded on its own, no drift along the frame
+    const TelemetryValue values[] = {record.soilTemp[0], record.soilTemp[1], record.soilTemp[2], record.soilTemp[3], record.soilMoist, record.batVolt,
+                                     record.sleepS};                                                             // Same order as LORA_FIELDS
+
+    BinaryWriter writer(out + len, outSize - len);
+    writer.zigzag(ageS - previousAgeS);
+    writer.zigzag((int64_t)record.bootCnt - previousBoot);
+    for(size_t i = 0; i < LORA_FIELD_COUNT; i++) writer.value(values[i], LORA_FIELDS[i].decimals);
+    if(writer.failed()) break;                                                                                   // This one does not fit, the frame ends with the previous one
+
+    len += writer.finish();
+    previousAgeS = ageS;
+    previousBoot = record.bootCnt;
+    records++;
+  }
+
+  out[9] = records;
+  return records > 0 ? len : 0;
+}
+// ENCODE END ------------------------------------------------------------------------------------------------------------------------------------------------
+
+// DECODE ----------------------------------------------------------------------------------------------------------------------------------------------------
+bool decodeLoraFrame(const uint8_t* frame, size_t len, LoraFrameHeader& header, LoraReading* readings, uint8_t maxReadings){
+  if(len < LORA_FRAME_HEADER_LEN || frame[0] != LORA_FRAME_VERSION) return false;
+  header.version = frame[0];
+  header.address = (uint32_t)frame[1] | (uint32_t)frame[2] << 8 | (uint32_t)frame[3] << 16 | (uint32_t)frame[4] << 24;
+  header.session = (uint16_t)(frame[5] | frame[6] << 8);
+  header.counter = (uint16_t)(frame[7] | frame[8] << 8);
+  header.records = frame[9];
+  if(header.records == 0 || header.records > maxReadings) return false;
+
+  BinaryReader reader(frame + LORA_FRAME_HEADER_LEN, len - LORA_FRAME_HEADER_LEN);
+  int64_t ageS = 0;
+  int64_t bootCnt = 0;
+  for(uint8_t r = 0; r < header.records; r++){
+    ageS += reader.zigzag();
+    bootCnt += reader.zigzag();
+    if(ageS < 0 || bootCnt < 0) return false;
+    readings[r].ageS = (uint32_t)ageS;
+    readings[r].bootCnt = (uint32_t)bootCnt;
+    for(size_t i = 0; i < LORA_FIELD_COUNT; i++) readings[r].values[i] = reader.value(LORA_FIELDS[i].decimals);
+  }
+  return !reader.failed() && reader.done();                                                                      // Trailing bytes mean another layout
+}
+// DECODE END ------------------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include <string.h>
+#include "loraUplink.h"
+#include "hal.h"
+#include "macros.h"
+
+// STATE -----------------------------------------------------------------------------------------------------------------------------------------------------
+void loraUplinkBegin(LoraUplink& lora){
+  if(lora.magic == LORA_UPLINK_MAGIC) return;
+  memset(&lora, 0, sizeof(lora));                                                                                // The RTC clock starts over as well, so does the duty cycle
+  lora.magic = LORA_UPLINK_MAGIC;
+  lora.session = (uint16_t)halRandom();                                                                          // The counter is back at 0: a new window at the gateway
+}
+
+static uint32_t airtimeToday(const LoraUplink& lora, uint64_t nowMs){
+  return lora.day == (uint32_t)(nowMs / LORA_DAY_MS) ? lora.airtimeTodayMs : 0;
+}
+// STATE END -------------------------------------------------------------------------------------------------------------------------------------------------
+
+// CHECK IF THE RADIO HAS TO BE POWERED ----------------------------------------------------------------------------------------------------------------------
+bool loraFlushDue(const LoraUplink& lora, const WakeState& state, const TelemetryLog& log, uint8_t depth, uint64_t nowMs, uint8_t pending){
+  if(nowMs < lora.channelFreeMs || airtimeToday(lora, nowMs) >= LORA_DAILY_AIRTIME_MS) return false;             // No reason to wake the radio, nothing could go out
+  return telemetryFlushDue(state.buffer, nowMs, depth, BATCH_MAX_AGE_S, pending) || telemetryLogPending(log) > 0; // A backlog drains one frame per free wake
+}
+// CHECK IF THE RADIO HAS TO BE POWERED END ------------------------------------------------------------------------------------------------------------------
+
+// SEND ONE FRAME --------------------------------------------------------------------------------------------------------------------------------------------
+LoraStatus loraUplinkSend(LoraUplink& lora, WakeState& state, TelemetryLog& log, TelemetryBuffer& batch, const DeviceIdentity& identity,
+                          uint8_t depth, uint64_t nowMs){
+  uint32_t day = (uint32_t)(nowMs / LORA_DAY_MS);
+  if(day != lora.day){
+    lora.day = day;
+    lora.airtimeTodayMs = 0;
+  }
+
+  uint32_t backlog = telemetryLogPending(log);
+  if(state.buffer.count == 0 && backlog == 0) return LORA_IDLE;
+  bool live = state.buffer.count > 0 && (backlog == 0 || telemetryFlushDue(state.buffer, nowMs, depth, BATCH_MAX_AGE_S)); // The backlog first, unless the RTC batch is due itself
+  if(nowMs < lora.channelFreeMs || lora.airtimeTodayMs >= LORA_DAILY_AIRTIME_MS){
+    lora.deferred++;
+    return LORA_DEFERRED;
+  }
+
+  uint8_t skipped = 0;
+  uint32_t endSlot = 0;
+  if(!live){
+    endSlot = loadTelemetryLog(log, log.readSlot, batch, skipped);
+    if(batch.count == 0){                                                                                        // Only torn slots or readings that cannot be placed in time
+      consumeTelemetryLog(log, endSlot, skipped);
+      return LORA_IDLE;
+    }
+  }
+
+  uint8_t frame[LORA_FRAME_MAX_LEN];
+  uint8_t records;
+  size_t len = encodeLoraFrame(live ? state.buffer : batch, loraDeviceAddress(identity.clientId), lora.session, lora.frameCounter, nowMs,
+                               frame, loraMaxPayload(LORA_SPREADING_FACTOR) - LORA_MIC_LEN, records);
+  uint32_t airtimeMs = loraAirtimeMs(len + LORA_MIC_LEN, LORA_SPREADING_FACTOR, LORA_BANDWIDTH_HZ, LORA_CODING_RATE);
+  if(len == 0 || lora.airtimeTodayMs + airtimeMs > LORA_DAILY_AIRTIME_MS){
+    lora.deferred++;
+    return LORA_DEFERRED;
+  }
+
+  uint8_t mac[32];
+  halHmacSha256((const uint8_t*)identity.token, strlen(identity.token), frame, len, mac);
+  memcpy(frame + len, mac, LORA_MIC_LEN);
+  len += LORA_MIC_LEN;
+  if(!halLoraTransmit(frame, len)){
+    lora.failures++;
+    return LORA_FAILED;
+  }
+
+  lora.frameCounter++;
+  lora.channelFreeMs = nowMs + (uint64_t)(airtimeMs * 100.0f / LORA_DUTY_CYCLE_PCT);                             // The frame itself, then 99 times its airtime off at 1 %
+  lora.airtimeTodayMs += airtimeMs;
+  lora.lastAirtimeMs = airtimeMs;
+  lora.lastReadings = records;
+  lora.frames++;
+  lora.readings += records;
+
+  if(live){
+    popTelemetryRecords(state.buffer, records);
+  }else{
+    if(records < batch.count) endSlot = loadTelemetryLog(log, log.readSlot, batch, skipped, records);            // Reloaded up to the last reading sent, for its slot
+    consumeTelemetryLog(log, endSlot, skipped);
+  }
+  return LORA_SENT;
+}
+// SEND ONE FRAME END ----------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -3,24 +3,20 @@ SOIL QUALITY SENSOR: this file includes the main code for the soil quality senso
 via MQTT at a fixed frequency, measuring soil temperature and moisture using a DS18B20 and a FC-38, respectively.
 *********************************************************************************************************************************************************** */
 
-// ajsdhakshd
-//ahsdjksahd
-
 // ===========================================================================================================================================================
 // LIBRARY INCLUSION
 // ===========================================================================================================================================================
 #include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
 // Wi-Fi and MQTT libs ---------------------------------------------------------------------------------------------------------------------------------------
 #include <WiFi.h>                                                                                                // Library to connect to Wi-Fi
-#include <WiFiClientSecure.h>                                                                                    // Library to add TLS certificates to MQTT connection
+#include "tlsSessionClient.h"                                                                                    // TLS client that resumes the previous session across deep sleep
 #include <PubSubClient.h>                                                                                        // Library to connect to a MQTT broker
 // ArduinoOTA libs -------------------------------------------------------------------------------------------------------------------------------------------
 #include <ESPmDNS.h>
 #include <WiFiUdp.h>
 #include <ArduinoOTA.h>
-// I2C libs --------------------------------------------------------------------------------------------------------------------------------------------------
-#include <Wire.h>
-#include <axp20x.h>                                                                                              // Library for the PMU AXP192
+// Hardware libs ---------------------------------------------------------------------------------------------------------------------------------------------
+#include "halEsp32.h"                                                                                            // AXP192, probes, ADC and MQTT transport behind hal.h
 // Config libs -----------------------------------------------------------------------------------------------------------------------------------------------
 #include "macros.h"
 #include "mqttUtils.h"
@@ -28,16 +24,36 @@ via MQTT at a fixed frequency, measuring soil temperature and moisture using a D
 #include "wifiUtils.h"
 #include "sleepUtils.h"
 #include "powerUtils.h"
+#include "timeUtils.h"
+#include "telemetryBuffer.h"
+#include "telemetryLog.h"
+#include "uplink.h"
+#include "wakeCycle.h"
+#include "wakeProfiler.h"
+#include "energyAccount.h"
+#include "linkFsm.h"
+#include "deviceConfig.h"
+#include "otaPull.h"
+#include "maintenanceWindow.h"
+#include "deviceIdentity.h"
+#include "loraUplink.h"
+#include "wakeRunner.h"
 // Sensors libs ----------------------------------------------------------------------------------------------------------------------------------------------
 #include "sensors.h"
+#include "sampling.h"
+#include "probeBus.h"
+#include "moisturePower.h"
 // LIBRARIES INCLUSION END ===================================================================================================================================
 
 // ===========================================================================================================================================================
 // CONSTRUCTORES DE OBJETOS DE CLASE DE LIBRERIA, VARIABLES GLOBALES, CONSTANTES...
 // ===========================================================================================================================================================
-static WiFiClientSecure secureClient;                                                                            // Object of the Wi-Fi library
+static RTC_DATA_ATTR TlsSessionCache tlsSession;                                                                 // TLS session ticket/ID from the previous wake
+static RTC_DATA_ATTR TlsSessionStats tlsStats;
+static RTC_DATA_ATTR RejoinCache rejoinCache;                                                                    // Last AP, channel, lease and broker address for the fast rejoin
+static WiFiClient tcpClient;                                                                                     // Object of the Wi-Fi library
+static SessionTLSClient secureClient(tcpClient, tlsSession, tlsStats);                                           // TLS on top of the TCP client, resumes the cached session when possible
 static PubSubClient mqttClient(secureClient);                                                                    // Object of the MQTT library
-static AXP20X_Class axp;
 // CONSTRUCTORES END =========================================================================================================================================
 
 // ===========================================================================================================================================================
@@ -45,17 +61,25 @@ static AXP20X_Class axp;
 // ===========================================================================================================================================================
 // Variables -------------------------------------------------------------------------------------------------------------------------------------------------
 static bool ledState = LOW;
-static volatile bool pekPressed = false;
-static RTC_DATA_ATTR uint32_t bootCount = 1;                                                                     // Boot counter must be stored in the RTC memory so it survives deep sleep, but not power-off
+static RTC_DATA_ATTR WakeRetained kept = WAKE_RETAINED_INIT;                                                     // Boot counter, pending readings, acquisition history, settings, link and energy stats survive deep sleep, but not power-off
+static DeviceIdentity identity;                                                                                  // Token, tree, client ID and Wi-Fi of this node, from the ident partition
+static WakeRunner run;                                                                                           // This wake: link, uplink window, profiler, settings request and payload buffers
+static bool brokerReady = false;
 // GLOBAL VARIABLES END ======================================================================================================================================
 
 // ===========================================================================================================================================================
-// ISR
+// FUNCTION PROTOTYPES
 // ===========================================================================================================================================================
-static void IRAM_ATTR handlePMUIRQ() {
-  pekPressed = true;
-}
-// ISR END ===================================================================================================================================================
+static void acquire(WakeRunner& run, float* temperaturesC, float& moisturePercent);
+static bool joinWiFi(WakeRunner& run, uint32_t timeoutMs);
+static bool connectBroker(WakeRunner& run);
+static void publishConnectionStats(WakeRunner& run);
+static void openOTA();
+static void handleOTA();
+static void reportWake(WakeRunner& run, WakeNote note, uint32_t detail);
+static void handleAttributes(const char* topic, const uint8_t* payload, size_t len);
+static const WakeHooks hooks = {acquire, joinWiFi, connectBroker, publishConnectionStats, openOTA, handleOTA, stopOTA, reportWake, esp_restart};
+// FUNCTION PROTOTYPES END ===================================================================================================================================
 
 // ===========================================================================================================================================================
 // FREERTOS ELEMENTS
@@ -69,65 +93,39 @@ static void MQTTTask(void*);
 static void PEKTask(void*);
 // FREERTOS ELEMENTS END =====================================================================================================================================
 
+// ===========================================================================================================================================================
+// ISR
+// ===========================================================================================================================================================
+static void IRAM_ATTR handlePMUIRQ() {
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+  if(PEKTaskHandle != NULL) vTaskNotifyGiveFromISR(PEKTaskHandle, &higherPriorityTaskWoken);                     // Before the task exists the IRQ line just stays low, see PEKTask
+  if(higherPriorityTaskWoken) portYIELD_FROM_ISR();
+}
+// ISR END ===================================================================================================================================================
+
 // ===========================================================================================================================================================
 // THREADS
 // ===========================================================================================================================================================
 // MQTT thread -----------------------------------------------------------------------------------------------------------------------------------------------
 static void MQTTTask(void *pvParameters){
-  while(true) {
-    ArduinoOTA.handle();                                                                                           // If a new version is available, download and install it
-
-    if(!mqttClient.connected()){                                                                                   // If no connection
-      reconnectToMQTT(mqttClient, MQTT_CLIENT, ACCESS_TOKEN, semaphoreSerial);                                     // Call reconnect function
-    }
-    mqttClient.loop();                                                                                             // Main MQTT function. It must run at the highest frequency and never be blocked
-
-    if(WiFi.status() != WL_CONNECTED){
-      reconnectToWiFi(ledState, WIFI_SSID, WIFI_PASSWORD, LED_PIN, semaphoreSerial);                               // Connect to Wi-Fi during the execution of the thread
-    }else{                                                                                                         // Check WiFi connection status
-      // MQTT Pub ----------------------------------------------------------------------------------------------------------------------------------------------
-      char dataStr[256];                                                                                           // A string is created to save a JSON containing the variables and values to be published with a size of 256 characters
-      // Sensor readings ---------------------------------------------------------------------------------------------------------------------------------------
-      // float soilTemp = random(1000, 4500) / 100.0f;                                                                // Simulated measurements
-      float soilMoist = 94.47;
-      float soilTemp = getMedianTemperatureC(TEMPERATURE_SAMPLES);                                                 // Real measurements, iterated 5 times to get the median and so more robust data
-      // float soilMoist = getMedianSoilMoisture(MOISTURE_SAMPLES);
-      // Sensor readings END -----------------------------------------------------------------------------------------------------------------------------------
-      axp.setPowerOutPut(AXP192_DCDC1, AXP202_OFF);                                                                // Turn off the sensors after measurements have been taken
-
-      float batVolt = (axp.getBattVoltage()) / 1000.0f;                                                            // Read battery voltage in mV and convert it to V
-
-      sprintf(dataStr, "{\"treeId\":%u,\"bootCnt\":%lu,\"soilTemperature\":%4.2f,\"soilMoisture\":%5.2f,\"batVoltage\":%4.3f}",
-              TREE_ID, (unsigned long)bootCount, soilTemp, soilMoist, batVolt);                                    // 'sprintf' C++ function is used to introduce the values of the sensor variables with the optimal formatting
-      
-      if(mqttClient.publish(MQTT_TOPIC_PUB, dataStr)){                                                             // The string is published on ThingsBoard topic
-        if(xSemaphoreTake(semaphoreSerial, portMAX_DELAY)){
-          Debugln(dataStr);                                                                                        // Display the string in the serial monitor
-          Debugln(F("Going to sleep until next TX..."));
-          xSemaphoreGive(semaphoreSerial);
-        }
-        bootCount++;
-
-        sleep_seconds(SLEEP_DURATION_S);                                                                           // Schedule deep sleep for the specified duration (30 seconds)
-      }else{
-        if(xSemaphoreTake(semaphoreSerial, portMAX_DELAY)){
-          Debugln(F("Failed to publish data"));
-          xSemaphoreGive(semaphoreSerial);
-        }
-      }
-      // MQTT Pub END ----------------------------------------------------------------------------------------------------------------------------------------
-    }
-
-    vTaskDelay(pdMS_TO_TICKS(100));
-  }
+  runRadioWake(run, esp_random());                                                                               // Join, flush, backlog, settings, firmware and maintenance, then deep sleep. Never returns
 }
 
 // PEK THREAD ------------------------------------------------------------------------------------------------------------------------------------------------
 static void PEKTask(void *pvParameters){
+  bool pending = digitalRead(PMU_IRQ_PIN) == LOW;                                                                // Pressed between setup() and the task creation, that edge is gone
+
   while(true) {
-    pekThreadRoutine(&pekPressed, axp, semaphoreSerial);
+    if(!pending) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);                                                        // Blocked until handlePMUIRQ(), no wakeups while nothing happens
+    pending = false;
 
-    vTaskDelay(pdMS_TO_TICKS(100));
+    if(pekThreadRoutine(halPmu(), semaphoreSerial) == PEK_SHORT){                                                // Long press never returns
+      requestMaintenance(kept.maintenance, MAINTENANCE_PEK);
+      if(xSemaphoreTake(semaphoreSerial, portMAX_DELAY)){
+        Debugln(F("Short press detected: maintenance window requested"));
+        xSemaphoreGive(semaphoreSerial);
+      }
+    }
   }
 }
 // THREADS END ===============================================================================================================================================
@@ -136,6 +134,8 @@ static void PEKTask(void *pvParameters){
 // SETUP FUNCTION
 // ===========================================================================================================================================================
 void setup() {
+  wakeBegin(run, kept, identity, hooks);                                                                         // Boot time so far, every phase below is timed against the same reset-based clock
+
   #if ENABLE_SERIAL
     Serial.begin(115200);
   #endif
@@ -143,27 +143,74 @@ void setup() {
   Debugln(F("Soil Quality Sensor Beta"));
 
   // AXP192 setup --------------------------------------------------------------------------------------------------------------------------------------------
-  Wire.begin(SDA_PIN, SCL_PIN);                                                                                  // Initialize I2C bus
-  
-  if(axp.begin(Wire, AXP192_SLAVE_ADDRESS) != 0){                                                                // "AXP192_SLAVE_ADDRESS" should be "0x34"
+  profileStart(run.profiler, PHASE_POWER);
+  moisturePowerOn(run.moisturePower, kept.moisturePowerStats);                                                   // First thing: the FC-38 settles while the PMU, the probes and the log come up
+  if(!halPowerBegin()){                                                                                          // I2C bus and AXP192 ("AXP192_SLAVE_ADDRESS" should be "0x34")
     Debugln(F("AXP192 not detected!"));
     while(1);
   }else{
     Debugln(F("AXP192 detected"));
   }
 
-  setupPower(axp, PMU_IRQ_PIN, handlePMUIRQ);                                                                                  // AXP192 setup
-  initSensors();                                                                                                 // Function from the custom library to setup the sensors
+  setupPower(halPmu(), PMU_IRQ_PIN, handlePMUIRQ);                                                               // AXP192 setup
+  maintenanceBegin(kept.maintenance);                                                                            // Before the PEK check below, which may set its flag
+  if(digitalRead(PMU_IRQ_PIN) == LOW){                                                                           // Woken by the PEK (EXT1) or pressed while booting: no edge left for the ISR
+    run.forceFlush = pekThreadRoutine(halPmu(), NULL) == PEK_SHORT;
+    if(run.forceFlush){
+      requestMaintenance(kept.maintenance, MAINTENANCE_PEK);                                                     // Someone is at the node: the window opens once the link is up
+      Debugln(F("Short press detected: measuring, publishing and opening a maintenance window"));
+    }
+  }
+  run.trialBoot = halOtaTrialBoot();                                                                             // Pending verify: this wake has to reach the broker whatever the batch says
+  if(run.trialBoot){
+    run.forceFlush = true;
+    Debugf("Firmware %u on trial, kept once this flush is acknowledged\n", FIRMWARE_VERSION);
+  }
+  profileEnd(run.profiler, PHASE_POWER);
+
+  profileStart(run.profiler, PHASE_SENSORS);
+  loadDeviceIdentity(identity);                                                                                  // Before the MQTT task starts, every node runs the same image
+  if(identity.provisioned) Debugf("%s, tree %d\n", identity.clientId, (int)identity.treeId);
+  else Debugf("No identity partition: build defaults (%s, tree %d)\n", identity.clientId, (int)identity.treeId);
+  deviceConfigBegin(kept.config);                                                                                // RTC copy, or NVS after a power-on
+  otaPullBegin(kept.otaPull, FIRMWARE_VERSION);                                                                  // Download progress survives deep sleep, not a power-on
+  initSensors(deviceMoistureCalibration(kept.config));                                                           // Function from the custom library to setup the sensors
+  uint8_t probes = probeBusBegin(kept.probeBus);                                                                 // Cached ROM codes, no search on a deep sleep wake
+  AcquisitionPlan temperaturePlan = wakePlanAcquisition(run);                                                    // Cheap acquisition while the soil is stable, full one when it is noisy or changing
+  profileEnd(run.profiler, PHASE_SENSORS);
+  profileStart(run.profiler, PHASE_SAMPLING);
+  startTemperatureAcquisition(kept.probeBus, temperaturePlan.samples);                                           // Conversions start right away and overlap with whatever comes next
+  WakeKind kind = wakeDecide(run);                                                                               // Every wake takes a reading, the radio is only brought up to flush a full batch
+  startMoistureAcquisition(run.moisturePower, kept.moisturePowerStats, run.moistureSamples, kind != WAKE_RADIO); // Burst once settled, then the probe is cut off. Its current is only measured on quiet wakes
+  Debugf("Temperature acquisition: %u probes, %u bits, %u samples\n", probes, temperaturePlan.resolutionBits, temperaturePlan.samples);
   sleep_interrupt(BUTTON_PIN, 0);                                                                                // Enable deep sleep interrupt using builtin button
-  connectToWiFi(ledState, axp, WIFI_SSID, WIFI_PASSWORD, LED_PIN, PMU_IRQ_PIN);                                  // Connect to Wi-Fi during setup
-  setupOTA();                                                                                                    // Function that contains all the OTA parameters setup
-  connectToMQTT(mqttClient, secureClient, ROOT_CA, MQTT_SERVER, MQTT_PORT);                                      // Connectarse al broker MQTT y establecer TLS
+  sleep_interrupt_low(PMU_IRQ_PIN_MASK);                                                                         // And from the PEK, through the AXP192 IRQ line
+
+  telemetryLogBegin(kept.log);                                                                                   // Flash scan after a power-on only, the cursor is in RTC memory afterwards
+
+  if(kind == WAKE_LORA) runLoraWake(run);                                                                        // Radio powered for one frame at most, a few hundred ms
+  if(kind == WAKE_QUIET) runQuietWake(run);                                                                      // Both end in deep sleep
 
   // FreeRTOS setup ------------------------------------------------------------------------------------------------------------------------------------------
   // Create the semaphore
   semaphoreSerial = xSemaphoreCreateMutex();
 
   // Initialize Tasks
+  xTaskCreatePinnedToCore(                                                                                       // PEK task first so a long press still shuts the device down while joining
+    PEKTask,                                                                                                     /* Function to implement the task */
+    "PEKTask",                                                                                                   /* Name of the task */
+    3072,                                                                                                        /* Stack size in bytes */
+    NULL,                                                                                                        /* Task input parameter */
+    1,                                                                                                           /* Priority of the task */
+    &PEKTaskHandle,                                                                                              /* Task handle. */
+    0                                                                                                            /* Core where the task should run */
+  );
+
+  mqttClient.setSocketTimeout(LINK_MQTT_TIMEOUT_S);                                                              // A stalled broker costs one timeout, not the whole wake
+  halBindMqtt(mqttClient, secureClient);                                                                         // The wake cycle publishes through hal.h
+  halMqttOnMessage(handleAttributes);                                                                            // Shared attributes, subscribed on every connect
+  mqttClient.setBufferSize(TELEMETRY_BATCH_MAX_LEN + sizeof(MQTT_TOPIC_PUB) + 8);                                // Room for a full batch plus the MQTT fixed header and topic
+
   xTaskCreatePinnedToCore(
     MQTTTask,                                                                                                    /* Function to implement the task */
     "MQTTTask",                                                                                                  /* Name of the task */
@@ -173,16 +220,6 @@ void setup() {
     &MQTTTaskHandle,                                                                                             /* Task handle. */
     1                                                                                                            /* Core where the task should run */
   );
-
-  xTaskCreatePinnedToCore(
-    PEKTask,                                                                                                     /* Function to implement the task */
-    "PEKTask",                                                                                                   /* Name of the task */
-    5000,                                                                                                        /* Stack size in bytes */
-    NULL,                                                                                                        /* Task input parameter */
-    1,                                                                                                           /* Priority of the task */
-    &PEKTaskHandle,                                                                                              /* Task handle. */
-    0                                                                                                            /* Core where the task should run */
-  );
   // FreeRTOS setup END --------------------------------------------------------------------------------------------------------------------------------------
 }
 // SETUP FUNCTION END ========================================================================================================================================
@@ -193,4 +230,126 @@ void setup() {
 void loop() {
   delay(10000);                                                                                                  // Empty loop as FreeRTOS is doing the tasks' job
 }
-// LOOP FUNCTION END =========================================================================================================================================
\ No newline at end of file
+// LOOP FUNCTION END =========================================================================================================================================
+
+// ===========================================================================================================================================================
+// AUXILIARY FUNCTIONS
+// ===========================================================================================================================================================
+// READINGS OF THE BACKGROUND ACQUISITION --------------------------------------------------------------------------------------------------------------------
+static void acquire(WakeRunner& run, float* temperaturesC, float& moisturePercent){
+  waitMedianTemperaturesC(temperaturesC, TEMPERATURE_TIMEOUT_MS);                                                // One median per probe from the background acquisition started in setup()
+  moisturePercent = waitMoisturePercent(MOISTURE_TIMEOUT_MS);                                                    // Also makes sure the FC-38 is off by now
+  Debugf("FC-38: %.2f %%, powered for %u ms\n", moisturePercent, (unsigned)kept.moisturePowerStats.lastOnMs);
+}
+// READINGS OF THE BACKGROUND ACQUISITION END ----------------------------------------------------------------------------------------------------------------
+
+// WI-FI AND BROKER ------------------------------------------------------------------------------------------------------------------------------------------
+static bool joinWiFi(WakeRunner& run, uint32_t timeoutMs){
+  return connectToWiFi(ledState, run.identity->wifiSsid, run.identity->wifiPassword, LED_PIN, rejoinCache, timeoutMs);
+}
+
+static bool connectBroker(WakeRunner& run){
+  if(!brokerReady){                                                                                              // The broker address needs the network, done once per wake
+    IPAddress brokerIp = resolveBroker(rejoinCache, MQTT_SERVER);                                                // Cached address when still fresh, DNS lookup otherwise
+    if(brokerIp != INADDR_NONE){
+      connectToMQTT(mqttClient, secureClient, ROOT_CA, MQTT_SERVER, brokerIp, MQTT_PORT);                        // Connectarse al broker MQTT y establecer TLS
+    }else{
+      connectToMQTT(mqttClient, secureClient, ROOT_CA, MQTT_SERVER, MQTT_PORT);
+    }
+    brokerReady = true;
+  }
+  if(!reconnectToMQTT(mqttClient, run.identity->clientId, run.identity->token, MQTT_SERVER, MQTT_PORT, semaphoreSerial)) return false;
+  rememberBrokerAddress(rejoinCache, tcpClient.remoteIP());                                                      // Keep the address that answered for the next wakes
+  tcpClient.setNoDelay(true);                                                                                    // A QoS 1 header and its payload are separate writes, Nagle would hold the second back
+  return true;
+}
+// WI-FI AND BROKER END --------------------------------------------------------------------------------------------------------------------------------------
+
+// PUBLISH CONNECTION STATS ----------------------------------------------------------------------------------------------------------------------------------
+static void publishConnectionStats(WakeRunner& run){
+  static constexpr TelemetryField CONNECTION_STATS_FIELDS[] = {
+    {"wifiMs", 0}, {"wifiFast", 0}, {"dnsCached", 0},
+    {"tlsFull", 0}, {"tlsResumed", 0}, {"tlsFailed", 0}, {"tlsHitRate", 0}, {"tlsHsMs", 0}, {"tlsSavedMs", 0},
+    {"logPending", 0}, {"logDropped", 0}, {"tempOutliers", 0},
+  };
+  const TelemetryValue values[] = {
+    rejoinCache.lastRejoinMs, rejoinCache.lastRejoinFast, rejoinCache.lastBrokerCached,
+    tlsStats.fullHandshakes, tlsStats.resumedHandshakes, tlsStats.failedHandshakes, tlsResumptionRate(tlsStats), tlsStats.lastHandshakeMs, tlsStats.savedMs,
+    telemetryLogPending(kept.log), kept.log.dropped, temperatureOutliers(kept.wake),
+  };
+
+  char statsStr[256];
+  if(serializeTelemetry(statsStr, sizeof(statsStr), CONNECTION_STATS_FIELDS, values) > 0){
+    mqttClient.publish(MQTT_TOPIC_PUB, statsStr);                                                                // Best effort, the readings have already been delivered
+  }
+}
+// PUBLISH CONNECTION STATS END ------------------------------------------------------------------------------------------------------------------------------
+
+// MAINTENANCE WINDOW (ARDUINOOTA AND MDNS ON REQUEST) -------------------------------------------------------------------------------------------------------
+static void openOTA(){
+  setupOTA();                                                                                                    // Hostname, password and callbacks, only for the wakes that need them
+  WiFi.setSleep(false);                                                                                          // Modem sleep would drop mDNS queries and slow the upload, the window is short anyway
+}
+
+static void handleOTA(){
+  ArduinoOTA.handle();
+}
+// MAINTENANCE WINDOW END ------------------------------------------------------------------------------------------------------------------------------------
+
+// SERIAL LOG OF THE WAKE ------------------------------------------------------------------------------------------------------------------------------------
+static void reportWake(WakeRunner& run, WakeNote note, uint32_t detail){
+  if(semaphoreSerial != NULL && !xSemaphoreTake(semaphoreSerial, portMAX_DELAY)) return;                         // No mutex yet on the wakes that end in setup()
+  switch(note){
+    case WAKE_READING:               Debugf("Reading stored (%u/%u)\n", kept.wake.buffer.count, kept.config.batchDepth); break;
+    case WAKE_SPILLED:               Debugf("RTC buffer full, %u readings moved to flash\n", (unsigned)detail); break;
+    case WAKE_LORA_SENT:
+      switch((LoraStatus)detail){
+        case LORA_SENT:     Debugf("LoRa frame %u: %u readings, %u ms on air\n", (unsigned)(uint16_t)(kept.lora.frameCounter - 1), kept.lora.lastReadings,
+                                   (unsigned)kept.lora.lastAirtimeMs); break;
+        case LORA_DEFERRED: Debugf("LoRa frame deferred, %u ms on air today\n", (unsigned)kept.lora.airtimeTodayMs); break;
+        case LORA_FAILED:   Debugln(F("SX1276 not answering, readings kept")); break;
+        case LORA_IDLE:     Debugln(F("Radio stays off")); break;
+      }
+      break;
+    case WAKE_PUBLISH_FAILED:        Debugln(F("Failed to publish data")); break;
+    case WAKE_ACKED:                 Debugln(F("Readings acknowledged by the broker")); break;
+    case WAKE_TRIAL_CONFIRMED:       Debugf("Firmware %u confirmed\n", (unsigned)detail); break;
+    case WAKE_CONFIG:
+      switch((ConfigResult)detail){
+        case CONFIG_APPLIED:   Debugf("Settings version %u applied, from the next wake on\n", (unsigned)kept.config.version); break;
+        case CONFIG_REJECTED:  Debugf("Settings rejected, bad %s\n", run.badKey); break;
+        case CONFIG_REQUESTED: Debugln(F("Settings changed on the server, requesting them")); break;
+        case CONFIG_IGNORED:   break;
+      }
+      break;
+    case WAKE_FIRMWARE_OFFERED:      Debugf("Firmware %u offered at %s\n", (unsigned)detail, kept.otaPull.url); break;
+    case WAKE_MAINTENANCE_REQUESTED: Debugf("Maintenance window %u requested from the server\n", (unsigned)kept.maintenance.handledRequest); break;
+    case WAKE_MAINTENANCE_OPENED:    Debugf("Maintenance window open for %u s\n", MAINTENANCE_WINDOW_S); break;
+    case WAKE_MAINTENANCE_CLOSED:    Debugf("Maintenance window closed after %u s\n", (unsigned)detail); break;
+    case WAKE_MAINTENANCE_REFUSED:   Debugln(F("Maintenance window refused: battery too low")); break;
+    case WAKE_FIRMWARE:
+      switch((OtaStatus)detail){
+        case OTA_PARTIAL:  Debugf("Firmware %u: %u of %u bytes in the slot\n", (unsigned)kept.otaPull.offeredVersion, (unsigned)kept.otaPull.written,
+                                  (unsigned)kept.otaPull.header.imageSize); break;
+        case OTA_READY:    Debugf("Firmware %u verified, restarting into it\n", (unsigned)kept.otaPull.header.version); break;
+        case OTA_RETRY:    Debugln(F("Firmware download interrupted, resumed on the next flush")); break;
+        case OTA_REJECTED: Debugf("Firmware %u rejected: bad signature, size or digest\n", (unsigned)kept.otaPull.failedVersion); break;
+        case OTA_IDLE:     break;
+      }
+      break;
+    case WAKE_FLUSHED:
+      Debugf("%u readings in %u messages, %u left in flash. Going to sleep until next TX...\n", (unsigned)run.uplink.readingsAcked,
+             (unsigned)run.uplink.messagesAcked, (unsigned)telemetryLogPending(kept.log));
+      break;
+    case WAKE_BUDGET_SPENT:          Debugf("Wake budget spent, %u readings moved to flash\n", (unsigned)detail); break;
+  }
+  if(semaphoreSerial != NULL) xSemaphoreGive(semaphoreSerial);
+}
+// SERIAL LOG OF THE WAKE END --------------------------------------------------------------------------------------------------------------------------------
+
+// APPLY SHARED ATTRIBUTES -----------------------------------------------------------------------------------------------------------------------------------
+static void handleAttributes(const char* topic, const uint8_t* payload, size_t len){                             // MQTT task, from mqttClient.loop() or while waiting for PUBACKs
+  wakeHandleAttributes(run, topic, payload, len);
+}
+// APPLY SHARED ATTRIBUTES END -------------------------------------------------------------------------------------------------------------------------------
+// AUXILIARY FUNCTIONS END ===================================================================================================================================
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include <string.h>
+#include "maintenanceWindow.h"
+#include "deviceConfig.h"
+#include "energyAccount.h"
+#include "hal.h"
+#include "macros.h"
+#include "telemetryReport.h"
+
+// REQUESTS --------------------------------------------------------------------------------------------------------------------------------------------------
+void maintenanceBegin(MaintenanceState& state){
+  if(state.magic == MAINTENANCE_MAGIC) return;
+
+  memset(&state, 0, sizeof(state));                                                                              // Power-on: no window pending, a power cycle is not a request
+  halSettingsGetU32(MAINTENANCE_ATTRIBUTE_KEY, state.handledRequest);                                            // So the value still set on the server does not open a window after every power-on
+  state.magic = MAINTENANCE_MAGIC;
+}
+
+void requestMaintenance(MaintenanceState& state, MaintenanceReason reason){
+  state.requested = reason;
+}
+
+bool handleMaintenanceAttributes(MaintenanceState& state, const uint8_t* payload, size_t len){
+  char json[DEVICE_CONFIG_MESSAGE_MAX_LEN];
+  if(len >= sizeof(json)) return false;
+  memcpy(json, payload, len);
+  json[len] = '\0';
+
+  uint32_t request;
+  const char* text = findAttribute(json, MAINTENANCE_ATTRIBUTE_KEY);
+  if(text == NULL || !parseAttributeUnsigned(text, request) || request <= state.handledRequest) return false;
+  state.handledRequest = request;
+  halSettingsSetU32(MAINTENANCE_ATTRIBUTE_KEY, request);                                                         // One write per request, served or refused
+  requestMaintenance(state, MAINTENANCE_ATTRIBUTE);
+  return true;
+}
+
+bool maintenanceRadioDue(const MaintenanceState& state){
+  return state.requested != MAINTENANCE_NONE;
+}
+// REQUESTS END ----------------------------------------------------------------------------------------------------------------------------------------------
+
+// WINDOW ----------------------------------------------------------------------------------------------------------------------------------------------------
+static bool powerAllows(float batteryVolts, float vbusVolts){
+  return vbusVolts >= MAINTENANCE_USB_VOLTS || batteryStateOfCharge(batteryVolts) >= MAINTENANCE_MIN_SOC;        // USB connected: charging, not draining
+}
+
+bool openMaintenance(MaintenanceState& state, MaintenanceWindow& window, float batteryVolts, float vbusVolts, uint32_t nowMs){
+  if(state.requested == MAINTENANCE_NONE) return false;
+  uint8_t reason = state.requested;
+  state.requested = MAINTENANCE_NONE;                                                                            // Served or refused, never carried over a second time
+
+  if(window.open){                                                                                               // Another request while open: the timeout starts again
+    window.endMs = nowMs + MAINTENANCE_WINDOW_S * 1000UL;
+    return false;
+  }
+  if(!powerAllows(batteryVolts, vbusVolts)){
+    if(state.refused < 0xFFFF) state.refused++;
+    state.reportDue = true;
+    return false;
+  }
+  window.openedMs = nowMs;
+  window.endMs = nowMs + MAINTENANCE_WINDOW_S * 1000UL;
+  window.reason = reason;
+  window.open = true;
+  return true;
+}
+
+bool maintenanceActive(MaintenanceState& state, MaintenanceWindow& window, float batteryVolts, float vbusVolts, uint32_t nowMs){
+  if(!window.open) return false;
+  if((int32_t)(nowMs - window.endMs) < 0 && powerAllows(batteryVolts, vbusVolts)) return true;
+
+  window.open = false;
+  state.lastReason = window.reason;
+  state.lastOpenS = (nowMs - window.openedMs) / 1000;
+  state.reportDue = true;
+  return false;
+}
+// WINDOW END ------------------------------------------------------------------------------------------------------------------------------------------------
+
+// MQTT ------------------------------------------------------------------------------------------------------------------------------------------------------
+bool publishMaintenance(MaintenanceState& state){
+  if(!state.reportDue) return false;
+
+  const TelemetryValue values[] = {state.handledRequest, state.lastReason, state.lastOpenS, state.refused};      // Same order as MAINTENANCE_REPORT_FIELDS
+  return publishAttributeReport<MAINTENANCE_REPORT_MAX_LEN>(state.reportDue, MAINTENANCE_REPORT_FIELDS, values);
+}
+// MQTT END --------------------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
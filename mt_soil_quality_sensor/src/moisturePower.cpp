@@ -0,0 +1,78 @@
+#include <math.h>
+#include <string.h>
+#include "moisturePower.h"
+#include "hal.h"
+#include "macros.h"
+#include "telemetryReport.h"
+
+// SETTLE SCHEDULE -------------------------------------------------------------------------------------------------------------------------------------------
+void moisturePowerOn(MoisturePower& power, MoisturePowerStats& stats){
+  if(stats.magic != MOISTURE_POWER_MAGIC){                                                                       // No magic after a power-on: start from zero
+    memset(&stats, 0, sizeof(stats));
+    stats.magic = MOISTURE_POWER_MAGIC;
+  }
+  if(power.on) return;
+
+  halMoisturePower(true);
+  power.onAtMs = halMillis();
+  power.waitedMs = 0;
+  power.on = true;
+}
+
+uint32_t moistureSettleLeftMs(const MoisturePower& power){
+  if(!power.on) return MOISTURE_SETTLE_MS;                                                                       // Not even switched on
+  uint32_t elapsedMs = halMillis() - power.onAtMs;
+  return elapsedMs >= MOISTURE_SETTLE_MS ? 0 : MOISTURE_SETTLE_MS - elapsedMs;
+}
+
+void moisturePowerWait(MoisturePower& power){
+  uint32_t leftMs = moistureSettleLeftMs(power);
+  if(leftMs == 0) return;                                                                                        // Fully hidden behind the boot, the PMU and the probe setup
+  halDelayMs(leftMs);
+  power.waitedMs += leftMs;
+}
+// SETTLE SCHEDULE END ---------------------------------------------------------------------------------------------------------------------------------------
+
+// POWER OFF AND CURRENT -------------------------------------------------------------------------------------------------------------------------------------
+void moisturePowerOff(MoisturePower& power, MoisturePowerStats& stats, bool radioOff){
+  if(!power.on) return;
+
+  bool measure = radioOff && stats.wakesToMeasure == 0;                                                          // The radio draws bursts of 100+ mA, the difference would be noise
+  float onmA = measure ? halBatteryCurrentmA() : NAN;
+  halMoisturePower(false);
+  power.on = false;
+  stats.lastOnMs = halMillis() - power.onAtMs;
+  stats.lastWaitMs = power.waitedMs;
+  if(stats.wakesToMeasure > 0) stats.wakesToMeasure--;
+  if(!measure) return;
+
+  halDelayMs(PMU_ADC_PERIOD_MS);                                                                                 // Next PMU conversion, the first one after the edge
+  float probemA = onmA - halBatteryCurrentmA();
+  stats.wakesToMeasure = MOISTURE_MEASURE_EVERY;
+  if(isnan(probemA) || probemA <= 0.0f) return;                                                                  // Another load switched meanwhile
+  stats.probemA.update(probemA);
+}
+
+float moisturePowerDuty(const MoisturePowerStats& stats, uint32_t sleepS){
+  float periodMs = sleepS * 1000.0f + stats.lastOnMs;
+  return periodMs > 0.0f ? stats.lastOnMs / periodMs : 0.0f;
+}
+// POWER OFF AND CURRENT END ---------------------------------------------------------------------------------------------------------------------------------
+
+// PUBLISHING ------------------------------------------------------------------------------------------------------------------------------------------------
+size_t serializeMoisturePower(const MoisturePowerStats& stats, uint32_t sleepS, char* out, size_t outSize){
+  float duty = moisturePowerDuty(stats, sleepS);
+  const TelemetryValue values[] = {                                                                              // Same order as MOISTURE_POWER_FIELDS
+    stats.lastOnMs, stats.lastWaitMs,
+    stats.probemA.valueOr(NAN),
+    (uint32_t)(duty * 1000000.0f + 0.5f),
+    stats.probemA.valueOr(NAN) * duty * 1000.0f,
+  };
+  return serializeTelemetry(out, outSize, MOISTURE_POWER_FIELDS, values);
+}
+
+bool publishMoisturePower(const MoisturePowerStats& stats, uint32_t sleepS){
+  char powerStr[MOISTURE_POWER_MAX_LEN];
+  return publishReport(MQTT_TOPIC_PUB, powerStr, serializeMoisturePower(stats, sleepS, powerStr, sizeof(powerStr)));
+}
+// PUBLISHING END --------------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -3,35 +3,39 @@
 #include "mqttUtils.h"
 
 // CONNECT TO MQTT -------------------------------------------------------------------------------------------------------------------------------------------
-void connectToMQTT(PubSubClient& client, WiFiClientSecure &clientSecure, const char* rootCa, const char* mqttServer, const uint16_t mqttPort) {
+void connectToMQTT(PubSubClient& client, SessionTLSClient& clientSecure, const char* rootCa, const char* mqttServer, const uint16_t mqttPort) {
   clientSecure.setCACert(rootCa);                                                                               // Initialization of the ciphered connection
   client.setServer(mqttServer, mqttPort);                                                                  // Function of the MQTT library to establish connection with the broker
 }
+
+void connectToMQTT(PubSubClient& client, SessionTLSClient& clientSecure, const char* rootCa, const char* mqttServer, IPAddress mqttServerIp, const uint16_t mqttPort) {
+  clientSecure.setCACert(rootCa);
+  clientSecure.setHostname(mqttServer);                                                                          // The certificate is still checked against the name
+  client.setServer(mqttServerIp, mqttPort);                                                                      // Cached address, skips the DNS lookup
+}
 // CONNECT TO MQTT END ---------------------------------------------------------------------------------------------------------------------------------------
 
 // RECONNECT TO MQTT -----------------------------------------------------------------------------------------------------------------------------------------
-void reconnectToMQTT(PubSubClient& client, const char* clientId, const char* token, SemaphoreHandle_t serialSemaphore) {
-  while(!client.connected()){                                                                                // Loop until we're reconnected
+bool reconnectToMQTT(PubSubClient& client, const char* clientId, const char* token, const char* mqttServer, const uint16_t mqttPort, SemaphoreHandle_t serialSemaphore) {
+  if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){                                                            // One attempt, the retries and their backoff belong to linkFsm
+    Debug(F("Attempting MQTT connection..."));
+    xSemaphoreGive(serialSemaphore);
+  }
+
+  if(client.connect(clientId, token, NULL)){                                                                     // Attempt to connect, the client ID of the ident partition
     if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
-      Debug(F("Attempting MQTT connection..."));
+      Debugln(F("connected"));
       xSemaphoreGive(serialSemaphore);
     }
+    return true;
+  }
 
-    if(client.connect("soil_quaity_sensor", token, NULL)){                                            // Attempt to connect
-      if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
-        Debugln(F("connected"));
-        xSemaphoreGive(serialSemaphore);
-      }
-    }else{
-      if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
-        Debug(F("failed, rc="));
-        Debug(client.state());
-        Debugln(F(" try again in 5 seconds"));
-        xSemaphoreGive(serialSemaphore);
-      }
-
-      vTaskDelay(pdMS_TO_TICKS(5000));                                                                           // Wait 5 seconds before retrying
-    }
+  if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+    Debug(F("failed, rc="));
+    Debugln(client.state());
+    xSemaphoreGive(serialSemaphore);
   }
+  client.setServer(mqttServer, mqttPort);                                                                        // A cached address may be stale, retry resolving the name
+  return false;
 }
 // RECONNECT TO MQTT END -------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1 @@
+#pragma once                                                                                                     // QuickMedianLib includes WProgram.h when ARDUINO is not defined, nothing of it is used on the host
\ No newline at end of file
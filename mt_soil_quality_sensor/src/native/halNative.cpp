@@ -0,0 +1,919 @@
+#ifndef ARDUINO
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+#include <zlib.h>
+#include "hal.h"
+#include "halNative.h"
+#include "macros.h"
+#include "deviceIdentity.h"
+#include "loraFrame.h"
+#include "mqttPacket.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// SIMULATION MODELS
+// ===========================================================================================================================================================
+// Currents (mA) ---------------------------------------------------------------------------------------------------------------------------------------------
+#define SIM_CPU_MA 45.0f                                                                                         // ESP32 awake, radio off
+#define SIM_RADIO_MA 95.0f                                                                                       // Extra while the Wi-Fi link is up
+#define SIM_SENSORS_MA 2.0f                                                                                      // DS18B20s on DCDC1
+#define SIM_MOIST_PROBE_MA 5.0f                                                                                  // FC-38 board: power LED, LM393 and the probe itself
+#define SIM_SLEEP_MA 0.2f                                                                                        // ESP32 deep sleep + AXP192 quiescent
+#define SIM_BATTERY_MAH 3000.0f                                                                                  // 18650 cell in the T-Beam holder
+#define SIM_COULOMB_LSB_MAH 0.364f                                                                               // 65536 * 0.5 mA / 3600 / 25 Hz
+// Link timings (ms) -----------------------------------------------------------------------------------------------------------------------------------------
+#define SIM_JOIN_MS 1500                                                                                         // Full scan + DHCP
+#define SIM_TLS_HANDSHAKE_MS 900                                                                                 // The local broker is plain MQTT, the handshake cost is added on top
+#define SIM_BOOT_MS 250                                                                                          // ROM + second stage bootloader + image load after a deep sleep wake
+#define SIM_TCP_REFUSED_MS 50                                                                                    // RST from a host with nothing listening
+#define SIM_MQTT_LOOP_WAIT_MS 5                                                                                  // Real time halMqttLoop() gives the local broker, the simulated clock only moves in halDelayMs()
+// LoRa radio ------------------------------------------------------------------------------------------------------------------------------------------------
+#define SIM_LORA_SETUP_MS 10                                                                                     // LDO2 ramp, reset pulse, 5 ms until the SX1276 answers and its configuration
+#define SIM_LORA_TX_MA 90.0f                                                                                     // SX1276 on PA_BOOST at 14 dBm, on top of the CPU
+#define SIM_LORA_RSSI_DBM -105.0f                                                                                // Typical plot a couple of km from the gateway...
+#define SIM_LORA_SNR_DB 2.0f                                                                                     // ...well above the SF9 demodulation floor (-12.5 dB)
+// OneWire timings (ms, standard speed) ----------------------------------------------------------------------------------------------------------------------
+#define SIM_ONEWIRE_SEARCH_MS 13                                                                                 // Per device found: reset plus 64 triplets of time slots
+#define SIM_ONEWIRE_BROADCAST_MS 2                                                                               // Reset, skip ROM and one command byte
+#define SIM_ONEWIRE_READ_MS 11                                                                                   // Reset, match ROM, read scratchpad and its 9 bytes
+// Flash -----------------------------------------------------------------------------------------------------------------------------------------------------
+#define SIM_LOG_SIZE (16 * HAL_LOG_SECTOR_SIZE)                                                                  // Small on purpose, a few days of outage wrap the ring
+#define SIM_FLASH_ERASE_MS 45                                                                                    // 4 kB sector erase, typical for the T-Beam's SPI NOR
+#define SIM_FLASH_WRITE_MS 1                                                                                     // One page program plus the SPI overhead
+#define SIM_OTA_SLOT_SIZE 0x140000                                                                               // app1 in partitions.csv
+#define SIM_NVS_PAGE_SIZE 4096                                                                                   // ESP-IDF NVS layout: 32 byte page header, 32 byte entry state bitmap...
+#define SIM_NVS_ENTRIES 126                                                                                      // ...and this many 32 byte entries per page
+#define SIM_NVS_TYPE_U8 0x01
+#define SIM_NVS_TYPE_I32 0x14
+#define SIM_NVS_TYPE_STR 0x21
+// Image download --------------------------------------------------------------------------------------------------------------------------------------------
+#define SIM_HTTP_KBPS 60                                                                                         // HTTPS throughput of the T-Beam over a weak AP, the local server is far faster
+#define SIM_INFLATE_KBPS 2000                                                                                    // ROM tinfl on the 240 MHz core, output side
+#define SIM_VERIFY_MS 60                                                                                         // mbedTLS ECDSA P-256 verify in software
+// Soil models -----------------------------------------------------------------------------------------------------------------------------------------------
+#define SIM_SOIL_MEAN_C 16.0f
+#define SIM_SOIL_SWING_C 3.0f                                                                                    // Daily amplitude a few cm deep
+#define SIM_PROBE_NOISE_C 0.06f
+#define SIM_PROBE_DEPTH_CM 5.0f                                                                                  // First probe, the others SIM_PROBE_SPACING_CM apart below it
+#define SIM_PROBE_SPACING_CM 15.0f
+#define SIM_DAMPING_DEPTH_CM 12.0f                                                                               // The daily wave loses 1/e of its swing and lags 1 rad every 12 cm
+#define SIM_DRYING_PERIOD_S 21600.0f                                                                             // Irrigated every 6 h
+#define SIM_ADC_NOISE 3.0f                                                                                       // Per conversion, in LSB
+#define SIM_ADC_SPIKE_PCT 2                                                                                      // Conversions hit by a Wi-Fi TX burst while the radio is on...
+#define SIM_ADC_SPIKE 150.0f                                                                                     // ...and how far they jump
+#define SIM_ADC_GAIN_MV 0.8f                                                                                     // Typical 11 dB curve of an ESP32 with two-point eFuse calibration
+#define SIM_ADC_OFFSET_MV 142.0f
+#define SIM_ADC_SETUP_MS 1                                                                                       // I2S driver install, settling buffer and uninstall
+#define SIM_MOIST_SETTLE_TAU_MS 12.0f                                                                            // FC-38 output rising after power-up, 1 LSB off after about 7 time constants
+#define SIM_SETTINGS_MAX 16                                                                                      // NVS keys the simulation can hold
+
+static uint64_t simEpochMs = 0;                                                                                  // Simulated wall clock, starts at the host time
+static uint64_t wakeStartMs = 0;
+static uint64_t requestedSleepS = 0;
+static bool sensorsOn = false;
+static bool moistureOn = false;
+static uint64_t moistureOnMs = 0;
+static bool radioOn = false;
+static bool linkUp = false;
+static uint8_t wifiFailurePercent = 0;
+static uint64_t radioSinceMs = 0;
+static uint8_t probeBits = 12;
+static uint8_t probeCount = 1;
+static uint8_t probeGlitchPercent = 0;
+static uint64_t conversionDoneMs = 0;
+static uint32_t rngState = 12345;
+static uint8_t logFlash[SIM_LOG_SIZE];
+static FILE* logFile = NULL;                                                                                     // Keeps the log across runs, a new run is a power cycle
+static bool logReady = false;
+static int mqttSocket = -1;
+static int httpSocket = -1;
+static uint32_t mqttLatencyMs = 0;
+static HalMqttHandler mqttHandler = NULL;
+static uint64_t ackDueUs[256];                                                                                   // Host time at which each in-flight PUBACK may be seen, by packet id
+static SimStats stats;
+static FILE* loraFile = NULL;                                                                                    // What the gateway receives, one line per frame
+static uint8_t loraLossPercent = 0;
+static SimPmuReading pmuReading;
+static bool pmuScripted = false;                                                                                 // simSetPmuReading(): a test feeds the AXP192 registers
+static const char* otaPublicKey = OTA_PUBLIC_KEY;                                                                // simSetOtaPublicKey(): tests sign their own images
+static struct { char key[16]; uint32_t value; } settings[SIM_SETTINGS_MAX];                                      // NVS, in memory: a new run starts from blank settings
+static uint8_t settingsCount = 0;
+static uint8_t identityImage[IDENTITY_PARTITION_SIZE];                                                           // No valid page unless SIM_IDENTITY loads an image, the build defaults are used then
+static uint8_t otaSlot[SIM_OTA_SLOT_SIZE];
+static enum { OTA_SLOT_IDLE, OTA_SLOT_ACTIVATED, OTA_SLOT_TRIAL } otaSlotState = OTA_SLOT_IDLE;                  // ACTIVATED: boots on the next wake, TRIAL: that wake, until confirmed
+
+static float randomUniform(){                                                                                    // xorshift32, repeatable runs
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return (rngState >> 8) / 16777216.0f;
+}
+
+static float randomGaussian(){
+  float u1 = randomUniform() + 1e-7f;
+  float u2 = randomUniform();
+  return sqrtf(-2.0f * logf(u1)) * cosf(6.2831853f * u2);
+}
+
+static void advance(uint64_t ms, float currentmA){
+  simEpochMs += ms;
+  stats.consumedmAh += currentmA * ms / 3600000.0f;
+}
+
+static float awakeCurrent(){
+  return SIM_CPU_MA + (radioOn ? SIM_RADIO_MA : 0.0f) + (sensorsOn ? SIM_SENSORS_MA : 0.0f) + (moistureOn ? SIM_MOIST_PROBE_MA : 0.0f);
+}
+
+static float soilTemperatureC(float depthCm){
+  float dayS = fmodf((float)((simEpochMs / 1000) % 86400), 86400.0f);
+  float damping = (depthCm - SIM_PROBE_DEPTH_CM) / SIM_DAMPING_DEPTH_CM;
+  return SIM_SOIL_MEAN_C + SIM_SOIL_SWING_C * expf(-damping) * sinf(6.2831853f * (dayS - 36000.0f) / 86400.0f - damping); // Peaks mid-afternoon near the surface
+}
+
+static float soilMoistureRaw(){
+  float phase = fmodf((float)(simEpochMs / 1000), SIM_DRYING_PERIOD_S) / SIM_DRYING_PERIOD_S;
+  return 515.0f + 80.0f * phase;                                                                                 // Wet right after irrigation, drying towards SOIL_MOIST_DRY_MV
+}
+// SIMULATION MODELS END =====================================================================================================================================
+
+// WAKE BOOKKEEPING ------------------------------------------------------------------------------------------------------------------------------------------
+void simBeginWake(){
+  if(simEpochMs == 0){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    simEpochMs = (uint64_t)tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+  }
+  wakeStartMs = simEpochMs;
+  requestedSleepS = 0;
+  stats.wakes++;
+  if(otaSlotState == OTA_SLOT_TRIAL){                                                                            // Reset before halOtaConfirm(): the bootloader goes back to the old image
+    otaSlotState = OTA_SLOT_IDLE;
+    stats.otaRollbacks++;
+  }
+  if(otaSlotState == OTA_SLOT_ACTIVATED) otaSlotState = OTA_SLOT_TRIAL;
+  advance(SIM_BOOT_MS, SIM_CPU_MA);
+}
+
+uint64_t simEndWake(){
+  halHttpClose();
+  halMqttDisconnect();
+  halNetworkDown();
+  sensorsOn = false;
+  halMoisturePower(false);                                                                                       // GPIOs float in deep sleep
+  stats.awakeMs += simEpochMs - wakeStartMs;
+
+  uint64_t sleepS = requestedSleepS ? requestedSleepS : SLEEP_DURATION_S;
+  advance(sleepS * 1000ULL, SIM_SLEEP_MA);
+  return sleepS;
+}
+
+float simBatteryVoltage(){
+  float charge = 1.0f - stats.consumedmAh / SIM_BATTERY_MAH;
+  if(charge < 0.0f) charge = 0.0f;
+  return 3.3f + 0.9f * charge - 0.15f * (1.0f - charge) * (1.0f - charge);                                       // Rough LiPo discharge curve, 4.2 V full to 3.15 V empty
+}
+
+void simSetWifiFailurePercent(uint8_t percent){
+  wifiFailurePercent = percent;
+}
+
+void simSetProbeCount(uint8_t count){
+  probeCount = count;
+}
+
+void simSetProbeGlitchPercent(uint8_t percent){
+  probeGlitchPercent = percent;
+}
+
+void simSetMqttLatencyMs(uint32_t ms){
+  mqttLatencyMs = ms;
+}
+
+uint64_t simHostMicros(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+bool simSetLogFile(const char* path){
+  logFile = fopen(path, "r+b");
+  if(logFile == NULL) logFile = fopen(path, "w+b");
+  if(logFile == NULL) return false;
+
+  memset(logFlash, 0xFF, sizeof(logFlash));
+  size_t stored = fread(logFlash, 1, sizeof(logFlash), logFile);
+  if(stored < sizeof(logFlash)){                                                                                 // New file: a blank partition
+    fseek(logFile, 0, SEEK_SET);
+    fwrite(logFlash, 1, sizeof(logFlash), logFile);
+    fflush(logFile);
+  }
+  logReady = true;
+  return true;
+}
+
+bool simSetIdentityFile(const char* path){
+  FILE* file = fopen(path, "rb");
+  if(file == NULL) return false;
+  memset(identityImage, 0xFF, sizeof(identityImage));
+  size_t n = fread(identityImage, 1, sizeof(identityImage), file);
+  fclose(file);
+  return n > 0;
+}
+
+bool simSetLoraFile(const char* path){
+  loraFile = fopen(path, "a");
+  return loraFile != NULL;
+}
+
+void simSetLoraLossPercent(uint8_t percent){
+  loraLossPercent = percent;
+}
+
+void simSetPmuReading(const SimPmuReading* reading){
+  pmuScripted = reading != NULL;
+  if(reading) pmuReading = *reading;
+}
+
+void simSetOtaPublicKey(const char* pem){
+  otaPublicKey = pem ? pem : OTA_PUBLIC_KEY;
+}
+
+const SimStats& simStats(){
+  return stats;
+}
+// WAKE BOOKKEEPING END --------------------------------------------------------------------------------------------------------------------------------------
+
+// CLOCK AND SLEEP -------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t halMillis(){
+  return (uint32_t)(simEpochMs - wakeStartMs);
+}
+
+uint64_t halMicros(){
+  return (simEpochMs - wakeStartMs) * 1000ULL;
+}
+
+void halDelayMs(uint32_t ms){
+  advance(ms, awakeCurrent());                                                                                   // Simulated time only, a whole day runs in milliseconds
+}
+
+uint64_t halEpochMs(){
+  return simEpochMs;
+}
+
+void halDeepSleep(uint64_t seconds){
+  requestedSleepS = seconds;                                                                                     // The simulated wake has to return on its own, see simEndWake()
+}
+// CLOCK AND SLEEP END ---------------------------------------------------------------------------------------------------------------------------------------
+
+// PMU -------------------------------------------------------------------------------------------------------------------------------------------------------
+bool halPowerBegin(){
+  return true;
+}
+
+void halSensorPower(bool on){
+  sensorsOn = on;
+}
+
+void halMoisturePower(bool on){
+  if(on == moistureOn) return;
+  if(on) moistureOnMs = simEpochMs;                                                                              // The settle model starts from here
+  else stats.moistureOnMs += simEpochMs - moistureOnMs;
+  moistureOn = on;
+}
+
+float halBatteryVoltage(){
+  if(pmuScripted) return pmuReading.batteryVolts;
+  return simBatteryVoltage() - (radioOn ? 0.08f : 0.0f);                                                         // Sag under the radio load
+}
+
+float halBatteryCurrentmA(){
+  return awakeCurrent();
+}
+
+float halBatteryDrawnmAh(){
+  if(pmuScripted) return pmuReading.drawnmAh;
+  return floorf(stats.consumedmAh / SIM_COULOMB_LSB_MAH) * SIM_COULOMB_LSB_MAH;                                  // Same resolution as the AXP192 counter
+}
+
+float halVbusVoltage(){
+  return pmuScripted ? pmuReading.vbusVolts : 0.0f;
+}
+// PMU END ---------------------------------------------------------------------------------------------------------------------------------------------------
+
+// ONEWIRE TEMPERATURE PROBES --------------------------------------------------------------------------------------------------------------------------------
+static void probeRom(uint8_t index, uint8_t* rom){
+  static const uint8_t serial[HAL_PROBE_ROM_LEN - 1] = {0x28, 0x6E, 0x3A, 0x57, 0x04, 0x00, 0x00};               // DS18B20 family code, then the serial number
+  memcpy(rom, serial, sizeof(serial));
+  rom[1] += index;
+  rom[HAL_PROBE_ROM_LEN - 1] = index;                                                                            // Stands in for the CRC, never checked here
+}
+
+void halTemperatureBegin(){
+  probeBits = 12;
+}
+
+uint8_t halTemperatureSearch(uint8_t (*roms)[HAL_PROBE_ROM_LEN], uint8_t max){
+  uint8_t count = probeCount < max ? probeCount : max;
+  for(uint8_t i = 0; i < count; i++) probeRom(i, roms[i]);
+  advance(SIM_ONEWIRE_SEARCH_MS * (probeCount + 1), awakeCurrent());                                             // The last pass finds nothing new
+  stats.probeSearches++;
+  return count;
+}
+
+void halTemperatureResolution(uint8_t bits){
+  if(bits >= 9 && bits <= 12) probeBits = bits;
+  advance(SIM_ONEWIRE_BROADCAST_MS, awakeCurrent());
+}
+
+uint32_t halTemperatureConversionMs(){
+  return 750 >> (12 - probeBits);                                                                                // DS18B20: 94, 188, 375 or 750 ms
+}
+
+void halTemperatureRequest(){
+  advance(SIM_ONEWIRE_BROADCAST_MS, awakeCurrent());
+  conversionDoneMs = simEpochMs + halTemperatureConversionMs();                                                  // Every probe converts in parallel
+}
+
+bool halTemperatureReady(){
+  return simEpochMs >= conversionDoneMs;
+}
+
+float halTemperatureReadC(const uint8_t* rom){
+  advance(SIM_ONEWIRE_READ_MS, awakeCurrent());
+  stats.probeReads++;
+  uint8_t index = rom[HAL_PROBE_ROM_LEN - 1];
+  uint8_t expected[HAL_PROBE_ROM_LEN];
+  probeRom(index, expected);
+  if(!sensorsOn || index >= probeCount || memcmp(rom, expected, sizeof(expected)) != 0){
+    return HAL_PROBE_DISCONNECTED_C;                                                                             // Rail off (reading after the sensors were switched off) or probe unplugged
+  }
+
+  float step = 0.5f / (1 << (probeBits - 9));
+  float value = soilTemperatureC(SIM_PROBE_DEPTH_CM + index * SIM_PROBE_SPACING_CM) + SIM_PROBE_NOISE_C * randomGaussian();
+  if(randomUniform() * 100.0f < probeGlitchPercent){
+    if(randomUniform() < 0.5f) return HAL_PROBE_RESET_C;                                                         // Browned out before the conversion
+    value += 16.0f;                                                                                              // Bit 8 of the raw count flipped inside the probe, the CRC covers it as read
+  }
+  return roundf(value / step) * step;                                                                            // Quantized like the real scratchpad
+}
+// ONEWIRE TEMPERATURE PROBES END ----------------------------------------------------------------------------------------------------------------------------
+
+// ADC -------------------------------------------------------------------------------------------------------------------------------------------------------
+void halAnalogBegin(){
+}
+
+size_t halAnalogBurst(uint8_t pin, uint16_t* raw, size_t count){
+  advance(SIM_ADC_SETUP_MS + count * 1000ULL / ADC_BURST_RATE_HZ, awakeCurrent());
+  float level = soilMoistureRaw() * (1.0f - expf(-(float)(simEpochMs - moistureOnMs) / SIM_MOIST_SETTLE_TAU_MS)); // Still rising if sampled too early
+  for(size_t i = 0; i < count; i++){
+    float value = moistureOn && pin == SOIL_MOIST_PIN ? level + SIM_ADC_NOISE * randomGaussian() : 0.0f;
+    if(radioOn && randomUniform() * 100.0f < SIM_ADC_SPIKE_PCT) value += SIM_ADC_SPIKE;
+    raw[i] = value < 0.0f ? 0 : (value > 4095.0f ? 4095 : (uint16_t)value);
+  }
+  return count;
+}
+
+uint32_t halAnalogMillivolts(uint16_t raw){
+  return (uint32_t)(SIM_ADC_OFFSET_MV + SIM_ADC_GAIN_MV * raw + 0.5f);
+}
+// ADC END ---------------------------------------------------------------------------------------------------------------------------------------------------
+
+// NETWORK LINK ----------------------------------------------------------------------------------------------------------------------------------------------
+bool halNetworkUp(uint32_t timeoutMs){
+  if(linkUp) return true;
+  if(!radioOn){
+    radioOn = true;
+    radioSinceMs = simEpochMs;
+    stats.radioWakes++;
+  }
+  if(randomUniform() * 100.0f < wifiFailurePercent || timeoutMs < SIM_JOIN_MS){                                  // AP down, the whole attempt is spent scanning
+    advance(timeoutMs, awakeCurrent());
+    return false;
+  }
+  advance(SIM_JOIN_MS, awakeCurrent());
+  linkUp = true;
+  return true;
+}
+
+void halNetworkDown(){
+  linkUp = false;
+  if(!radioOn) return;
+  radioOn = false;
+  stats.radioMs += simEpochMs - radioSinceMs;
+}
+
+bool halNetworkConnected(){
+  return linkUp;
+}
+// NETWORK LINK END ------------------------------------------------------------------------------------------------------------------------------------------
+
+// MQTT TRANSPORT (PLAIN MQTT 3.1.1, QOS 0 AND 1, AGAINST A LOCAL BROKER) ------------------------------------------------------------------------------------
+static bool sendAll(const uint8_t* data, size_t len){
+  while(len){
+    ssize_t sent = send(mqttSocket, data, len, MSG_NOSIGNAL);
+    if(sent <= 0) return false;
+    data += sent;
+    len -= sent;
+  }
+  return true;
+}
+
+bool halMqttConnect(const char* host, uint16_t port, const char* clientId, const char* user){
+  if(mqttSocket >= 0) return true;
+  if(!radioOn) return false;
+
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  struct addrinfo hints = {};
+  struct addrinfo* result = NULL;
+  hints.ai_socktype = SOCK_STREAM;
+  if(getaddrinfo(host, service, &hints, &result) != 0) return false;
+
+  for(struct addrinfo* ai = result; ai != NULL && mqttSocket < 0; ai = ai->ai_next){
+    mqttSocket = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if(mqttSocket < 0) continue;
+    struct timeval timeout = {2, 0};
+    setsockopt(mqttSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(mqttSocket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    int noDelay = 1;
+    setsockopt(mqttSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));                                 // Nagle is off on the device too (main.cpp)
+    if(connect(mqttSocket, ai->ai_addr, ai->ai_addrlen) != 0){                                                   // Refused: nothing listening on the port
+      close(mqttSocket);
+      mqttSocket = -1;
+    }
+  }
+  freeaddrinfo(result);
+  if(mqttSocket < 0){
+    advance(SIM_TCP_REFUSED_MS, awakeCurrent());
+    return false;
+  }
+
+  uint8_t packet[512];
+  size_t len = mqttConnectPacket(packet, sizeof(packet), clientId, user, 60);                                    // Keep alive (s)
+
+  uint8_t connack[4];
+  advance(SIM_TLS_HANDSHAKE_MS, awakeCurrent());
+  if(len == 0 || !sendAll(packet, len) || recv(mqttSocket, connack, sizeof(connack), MSG_WAITALL) != 4){
+    advance(LINK_MQTT_TIMEOUT_S * 1000UL, awakeCurrent());                                                       // Stalled broker ('sleep 1d | nc -lk 1883'): the firmware waits for its socket timeout
+    halMqttDisconnect();
+    return false;
+  }
+  if(connack[1] != 2 || !mqttConnackAccepted(connack[0], connack + 2, connack[1])){
+    halMqttDisconnect();
+    return false;
+  }
+  return true;
+}
+
+bool halMqttPublish(const char* topic, const uint8_t* payload, size_t len){
+  if(mqttSocket < 0){
+    stats.publishFailures++;
+    return false;
+  }
+
+  uint8_t header[MQTT_PUBLISH_HEADER_MAX_LEN(256)];
+  size_t n = mqttPublishHeader(header, sizeof(header), topic, len, -1);
+  bool ok = n > 0 && sendAll(header, n) && sendAll(payload, len);
+  if(ok) stats.publishes++;
+  else stats.publishFailures++;
+  return ok;
+}
+
+bool halMqttPublishQos1(const char* topic, const uint8_t* payload, size_t len, uint16_t packetId){
+  if(mqttSocket < 0){
+    stats.publishFailures++;
+    return false;
+  }
+
+  uint8_t header[MQTT_PUBLISH_HEADER_MAX_LEN(256)];
+  size_t n = mqttPublishHeader(header, sizeof(header), topic, len, packetId);
+  bool ok = n > 0 && sendAll(header, n) && sendAll(payload, len);
+  ackDueUs[packetId & 0xFF] = simHostMicros() + mqttLatencyMs * 1000ULL;                                         // Round trip injected by SIM_MQTT_LATENCY_MS
+  if(ok) stats.publishes++;
+  else stats.publishFailures++;
+  return ok;
+}
+
+static bool recvAll(uint8_t* data, size_t len){
+  return len == 0 || recv(mqttSocket, data, len, MSG_WAITALL) == (ssize_t)len;
+}
+
+bool halMqttSubscribe(const char* topic){
+  if(mqttSocket < 0) return false;
+
+  static uint16_t packetId = 0;
+  uint8_t packet[5 + 2 + 2 + 256 + 1];
+  packetId = packetId == 0xFFFF ? 1 : packetId + 1;
+  size_t n = mqttSubscribePacket(packet, sizeof(packet), topic, packetId);
+  return n > 0 && sendAll(packet, n);
+}
+
+void halMqttOnMessage(HalMqttHandler handler){
+  mqttHandler = handler;
+}
+
+static void dispatchPublish(const uint8_t* body, size_t length){
+  char topic[257];
+  const uint8_t* payload;
+  size_t payloadLen;
+  if(mqttHandler != NULL && mqttSplitPublish(body, length, topic, sizeof(topic), payload, payloadLen)) mqttHandler(topic, payload, payloadLen);
+}
+
+static int readPacket(uint32_t waitMs, uint8_t& type, uint8_t* body, size_t& length){                            // 1 with a packet, 0 if none started within waitMs, HAL_MQTT_LOST
+  struct pollfd ready = {mqttSocket, POLLIN, 0};
+  if(poll(&ready, 1, waitMs) <= 0) return 0;
+
+  uint8_t digit;
+  uint32_t remaining = 0;
+  int more = 1;
+  if(!recvAll(&type, 1)) return HAL_MQTT_LOST;
+  for(uint8_t i = 0; more > 0; i++){
+    if(!recvAll(&digit, 1) || (more = mqttLengthDigit(remaining, i, digit)) < 0) return HAL_MQTT_LOST;
+  }
+  length = remaining;
+  if(!recvAll(body, length < HAL_MQTT_RX_MAX_LEN ? length : HAL_MQTT_RX_MAX_LEN)) return HAL_MQTT_LOST;
+  for(size_t left = length; left > HAL_MQTT_RX_MAX_LEN; left--){                                                 // Too long for the handler: skipped, as PubSubClient does
+    uint8_t skipped;
+    if(!recvAll(&skipped, 1)) return HAL_MQTT_LOST;
+  }
+  if(length > HAL_MQTT_RX_MAX_LEN) type = 0;
+  if(mqttIsQos0Publish(type)) dispatchPublish(body, length);                                                     // Subscribed at QoS 0, as on the ESP32
+  return 1;
+}
+
+bool halMqttConnected(){
+  return mqttSocket >= 0;
+}
+
+bool halMqttLoop(){
+  if(mqttSocket < 0) return false;
+  uint8_t type, body[HAL_MQTT_RX_MAX_LEN];
+  size_t length;
+  int got;
+  for(uint32_t waitMs = SIM_MQTT_LOOP_WAIT_MS; (got = readPacket(waitMs, type, body, length)) > 0; waitMs = 0){} // Whatever is queued, PINGRESP and SUBACK dropped
+  if(got == HAL_MQTT_LOST){
+    close(mqttSocket);
+    mqttSocket = -1;
+    return false;
+  }
+  return true;
+}
+
+int32_t halMqttPollAck(uint32_t waitMs){
+  if(mqttSocket < 0) return HAL_MQTT_LOST;
+  uint64_t startUs = simHostMicros();
+  int32_t result = HAL_MQTT_NO_ACK;
+
+  while(result == HAL_MQTT_NO_ACK){
+    uint64_t elapsedMs = (simHostMicros() - startUs) / 1000;
+    uint8_t type, body[HAL_MQTT_RX_MAX_LEN];
+    size_t length;
+    int got = readPacket(elapsedMs < waitMs ? waitMs - elapsedMs : 0, type, body, length);
+    if(got == 0) break;
+    if(got == HAL_MQTT_LOST) return HAL_MQTT_LOST;
+    if(!mqttIsPuback(type, length)) continue;
+
+    result = (body[0] << 8) | body[1];
+    uint64_t dueUs = ackDueUs[result & 0xFF];
+    uint64_t nowUs = simHostMicros();
+    if(dueUs > nowUs) usleep(dueUs - nowUs);
+  }
+  advance((simHostMicros() - startUs) / 1000, awakeCurrent());                                                   // Waiting for the broker is awake time
+  return result;
+}
+
+void halMqttDisconnect(){
+  if(mqttSocket < 0) return;
+  static const uint8_t disconnect[] = {MQTT_DISCONNECT, 0x00};
+  sendAll(disconnect, sizeof(disconnect));
+  close(mqttSocket);
+  mqttSocket = -1;
+}
+// MQTT TRANSPORT END ----------------------------------------------------------------------------------------------------------------------------------------
+
+// SETTINGS (NVS) --------------------------------------------------------------------------------------------------------------------------------------------
+bool halSettingsGetU32(const char* key, uint32_t& value){
+  for(uint8_t i = 0; i < settingsCount; i++){
+    if(strcmp(settings[i].key, key) == 0){
+      value = settings[i].value;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool halSettingsSetU32(const char* key, uint32_t value){
+  if(strlen(key) >= sizeof(settings[0].key)) return false;                                                       // NVS keys are 15 characters at most
+  uint8_t i = 0;
+  while(i < settingsCount && strcmp(settings[i].key, key) != 0) i++;
+  if(i == SIM_SETTINGS_MAX) return false;
+  if(i == settingsCount) settingsCount++;
+  strcpy(settings[i].key, key);
+  settings[i].value = value;
+  return true;
+}
+// SETTINGS END ----------------------------------------------------------------------------------------------------------------------------------------------
+
+// DEVICE IDENTITY (READ-ONLY NVS PARTITION) -----------------------------------------------------------------------------------------------------------------
+static uint32_t nvsCrc(const uint8_t* data, size_t len){
+  return crc32(0xFFFFFFFF, data, len);                                                                           // What esp_rom_crc32_le(0xFFFFFFFF, ...) returns on the device
+}
+
+static const uint8_t* findNvsEntry(uint8_t ns, uint8_t type, const char* key){                                   // Header entry of a written item with a good CRC, NULL otherwise
+  for(uint32_t offset = 0; offset < sizeof(identityImage); offset += SIM_NVS_PAGE_SIZE){
+    const uint8_t* page = identityImage + offset;
+    uint32_t state;
+    memcpy(&state, page, sizeof(state));
+    if(state == 0xFFFFFFFF || nvsCrc(page + 4, 24) != *(const uint32_t*)(page + 28)) continue;                   // Erased, or a header the library would not trust either
+    for(uint8_t i = 0; i < SIM_NVS_ENTRIES; i++){
+      const uint8_t* entry = page + 64 + i * 32;
+      if(((page[32 + i / 4] >> (i % 4 * 2)) & 0x3) != 0x2) continue;                                             // 2 bits per entry: 11 empty, 10 written, 00 erased
+      uint8_t crcInput[28];
+      memcpy(crcInput, entry, 4);
+      memcpy(crcInput + 4, entry + 8, 24);                                                                       // The CRC covers everything but itself
+      if(entry[0] == ns && entry[1] == type && strncmp((const char*)entry + 8, key, 16) == 0 &&
+         nvsCrc(crcInput, sizeof(crcInput)) == *(const uint32_t*)(entry + 4)) return entry;
+      if(entry[2] > 1) i += entry[2] - 1;                                                                        // Data entries of a string are not item headers
+    }
+  }
+  return NULL;
+}
+
+static const uint8_t* findIdentityEntry(uint8_t type, const char* key){
+  const uint8_t* ns = findNvsEntry(0, SIM_NVS_TYPE_U8, IDENTITY_NAMESPACE);
+  return ns == NULL ? NULL : findNvsEntry(ns[24], type, key);                                                    // Namespaces are u8 entries of namespace 0 holding their index
+}
+
+bool halIdentityGetStr(const char* key, char* value, size_t len){
+  const uint8_t* entry = findIdentityEntry(SIM_NVS_TYPE_STR, key);
+  if(entry == NULL) return false;
+  uint16_t size = entry[24] | entry[25] << 8;
+  if(size == 0 || size > len || size > (entry[2] - 1) * 32u) return false;                                       // Terminator included in size
+  if(nvsCrc(entry + 32, size) != *(const uint32_t*)(entry + 28)) return false;
+  memcpy(value, entry + 32, size);
+  value[size - 1] = '\0';
+  return true;
+}
+
+bool halIdentityGetI32(const char* key, int32_t& value){
+  const uint8_t* entry = findIdentityEntry(SIM_NVS_TYPE_I32, key);
+  if(entry == NULL) return false;
+  memcpy(&value, entry + 24, sizeof(value));
+  return true;
+}
+// DEVICE IDENTITY END ---------------------------------------------------------------------------------------------------------------------------------------
+
+// LORA RADIO ------------------------------------------------------------------------------------------------------------------------------------------------
+bool halLoraTransmit(const uint8_t* frame, size_t len){
+  if(len == 0 || len > HAL_LORA_MAX_LEN) return false;
+  uint32_t airtimeMs = loraAirtimeMs(len, LORA_SPREADING_FACTOR, LORA_BANDWIDTH_HZ, LORA_CODING_RATE);
+  advance(SIM_LORA_SETUP_MS, awakeCurrent());
+  advance(airtimeMs, awakeCurrent() + SIM_LORA_TX_MA);
+  stats.loraFrames++;
+  stats.loraAirtimeMs += airtimeMs;
+  if(randomUniform() * 100.0f < loraLossPercent){                                                                // Collision or fade: the node cannot tell, nothing comes back
+    stats.loraLost++;
+    return true;
+  }
+  if(loraFile != NULL){
+    fprintf(loraFile, "%llu %.0f %.1f ", (unsigned long long)simEpochMs, SIM_LORA_RSSI_DBM + 3.0f * randomGaussian(), SIM_LORA_SNR_DB + randomGaussian());
+    for(size_t i = 0; i < len; i++) fprintf(loraFile, "%02x", frame[i]);
+    fprintf(loraFile, "\n");
+    fflush(loraFile);
+  }
+  return true;
+}
+// LORA RADIO END --------------------------------------------------------------------------------------------------------------------------------------------
+
+// FRAME AUTHENTICATION --------------------------------------------------------------------------------------------------------------------------------------
+void halHmacSha256(const uint8_t* key, size_t keyLen, const uint8_t* data, size_t len, uint8_t* mac){
+  HMAC(EVP_sha256(), key, (int)keyLen, data, len, mac, NULL);
+}
+
+uint32_t halRandom(){                                                                                            // Not from rngState: every run is a power-on, the simulated world stays repeatable
+  uint32_t value = 0;
+  RAND_bytes((uint8_t*)&value, sizeof(value));
+  return value;
+}
+// FRAME AUTHENTICATION END ----------------------------------------------------------------------------------------------------------------------------------
+
+// TELEMETRY LOG FLASH ---------------------------------------------------------------------------------------------------------------------------------------
+static void persistLog(uint32_t offset, size_t len){
+  if(logFile == NULL) return;
+  fseek(logFile, offset, SEEK_SET);
+  fwrite(logFlash + offset, 1, len, logFile);
+  fflush(logFile);
+}
+
+uint32_t halLogSize(){
+  if(!logReady){
+    memset(logFlash, 0xFF, sizeof(logFlash));                                                                    // No SIM_LOG_FILE: blank on every run
+    logReady = true;
+  }
+  return sizeof(logFlash);
+}
+
+bool halLogRead(uint32_t offset, void* data, size_t len){
+  if(offset + len > sizeof(logFlash)) return false;
+  memcpy(data, logFlash + offset, len);
+  return true;
+}
+
+bool halLogWrite(uint32_t offset, const void* data, size_t len){
+  if(offset + len > sizeof(logFlash)) return false;
+  const uint8_t* bytes = (const uint8_t*)data;
+  for(size_t i = 0; i < len; i++) logFlash[offset + i] &= bytes[i];                                              // NOR program: a 1 bit can only become 0
+  persistLog(offset, len);
+  advance(SIM_FLASH_WRITE_MS, awakeCurrent());
+  stats.flashWrites++;
+  return true;
+}
+
+bool halLogErase(uint32_t offset){
+  if(offset >= sizeof(logFlash)) return false;
+  offset -= offset % HAL_LOG_SECTOR_SIZE;
+  memset(logFlash + offset, 0xFF, HAL_LOG_SECTOR_SIZE);
+  persistLog(offset, HAL_LOG_SECTOR_SIZE);
+  advance(SIM_FLASH_ERASE_MS, awakeCurrent());
+  stats.flashErases++;
+  return true;
+}
+// TELEMETRY LOG FLASH END -----------------------------------------------------------------------------------------------------------------------------------
+
+// HTTP DOWNLOAD (PLAIN HTTP/1.1 AGAINST A LOCAL SERVER) -----------------------------------------------------------------------------------------------------
+static int connectTo(const char* host, const char* service){
+  struct addrinfo hints = {};
+  struct addrinfo* result = NULL;
+  hints.ai_socktype = SOCK_STREAM;
+  if(getaddrinfo(host, service, &hints, &result) != 0) return -1;
+
+  int fd = -1;
+  for(struct addrinfo* ai = result; ai != NULL && fd < 0; ai = ai->ai_next){
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if(fd < 0) continue;
+    struct timeval timeout = {OTA_HTTP_TIMEOUT_S, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if(connect(fd, ai->ai_addr, ai->ai_addrlen) != 0){
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(result);
+  return fd;
+}
+
+static bool httpRecv(uint8_t* data, size_t len){
+  if(httpSocket < 0 || (len && recv(httpSocket, data, len, MSG_WAITALL) != (ssize_t)len)) return false;
+  advance(len * 1000ULL / (SIM_HTTP_KBPS * 1024), awakeCurrent());
+  stats.otaBytes += len;
+  return true;
+}
+
+bool halHttpOpen(const char* url, uint32_t offset){
+  char host[128], service[8] = "80";
+  const char* path;
+  if(!radioOn || strncmp(url, "http://", 7) != 0) return false;                                                  // https:// needs the device, the simulation has no TLS
+  url += 7;
+  path = strchr(url, '/');
+  size_t hostLen = path ? (size_t)(path - url) : strlen(url);
+  if(hostLen >= sizeof(host)) return false;
+  memcpy(host, url, hostLen);
+  host[hostLen] = '\0';
+  char* port = strchr(host, ':');
+  if(port){
+    *port = '\0';
+    snprintf(service, sizeof(service), "%s", port + 1);
+  }
+
+  halHttpClose();
+  httpSocket = connectTo(host, service);
+  advance(SIM_TLS_HANDSHAKE_MS, awakeCurrent());
+  if(httpSocket < 0) return false;
+
+  char request[512];
+  int len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nRange: bytes=%lu-\r\nConnection: close\r\n\r\n", path ? path : "/", host,
+                     (unsigned long)offset);
+  if(len >= (int)sizeof(request) || send(httpSocket, request, len, MSG_NOSIGNAL) != len){
+    halHttpClose();
+    return false;
+  }
+
+  char headers[2048];
+  size_t n = 0;
+  while(n < 4 || memcmp(headers + n - 4, "\r\n\r\n", 4) != 0){                                                   // Up to the end of the headers, the body stays in the socket
+    if(n == sizeof(headers) - 1 || !httpRecv((uint8_t*)headers + n, 1)){
+      halHttpClose();
+      return false;
+    }
+    n++;
+  }
+  headers[n] = '\0';
+  int code = 0;
+  sscanf(headers, "HTTP/%*s %d", &code);
+  if(code != 206 && code != 200){
+    halHttpClose();
+    return false;
+  }
+  for(uint32_t skip = code == 200 ? offset : 0; skip > 0; ){                                                     // Range ignored ('python3 -m http.server'): read up to offset
+    uint8_t discard[1024];
+    size_t chunk = skip < sizeof(discard) ? skip : sizeof(discard);
+    if(!httpRecv(discard, chunk)){
+      halHttpClose();
+      return false;
+    }
+    skip -= chunk;
+  }
+  return true;
+}
+
+bool halHttpRead(uint8_t* data, size_t len){
+  return httpRecv(data, len);
+}
+
+void halHttpClose(){
+  if(httpSocket < 0) return;
+  close(httpSocket);
+  httpSocket = -1;
+}
+// HTTP DOWNLOAD END -----------------------------------------------------------------------------------------------------------------------------------------
+
+// FIRMWARE UPDATE SLOT --------------------------------------------------------------------------------------------------------------------------------------
+uint32_t halOtaSlotSize(){
+  return sizeof(otaSlot);
+}
+
+bool halOtaWrite(uint32_t offset, const void* data, size_t len){
+  if(offset + len > sizeof(otaSlot)) return false;
+  uint32_t eraseFrom = (offset + HAL_LOG_SECTOR_SIZE - 1) / HAL_LOG_SECTOR_SIZE * HAL_LOG_SECTOR_SIZE;
+  uint32_t eraseTo = (offset + len + HAL_LOG_SECTOR_SIZE - 1) / HAL_LOG_SECTOR_SIZE * HAL_LOG_SECTOR_SIZE;
+  for(uint32_t sector = eraseFrom; sector < eraseTo; sector += HAL_LOG_SECTOR_SIZE){
+    memset(otaSlot + sector, 0xFF, HAL_LOG_SECTOR_SIZE);
+    advance(SIM_FLASH_ERASE_MS, awakeCurrent());
+  }
+  const uint8_t* bytes = (const uint8_t*)data;
+  for(size_t i = 0; i < len; i++) otaSlot[offset + i] &= bytes[i];
+  advance(SIM_FLASH_WRITE_MS * ((len + 255) / 256), awakeCurrent());                                             // One page program per 256 bytes
+  return true;
+}
+
+bool halOtaDigest(uint32_t len, uint8_t* sha256){
+  if(len > sizeof(otaSlot)) return false;
+  SHA256(otaSlot, len, sha256);
+  return true;
+}
+
+bool halOtaActivate(){
+  otaSlotState = OTA_SLOT_ACTIVATED;
+  stats.otaActivations++;
+  return true;
+}
+
+bool halOtaTrialBoot(){
+  return otaSlotState == OTA_SLOT_TRIAL;
+}
+
+void halOtaConfirm(){
+  if(otaSlotState == OTA_SLOT_TRIAL) otaSlotState = OTA_SLOT_IDLE;
+}
+// FIRMWARE UPDATE SLOT END ----------------------------------------------------------------------------------------------------------------------------------
+
+// IMAGE CHECKS ----------------------------------------------------------------------------------------------------------------------------------------------
+size_t halInflate(const uint8_t* in, size_t inLen, uint8_t* out, size_t outSize){
+  uLongf outLen = outSize;
+  if(uncompress(out, &outLen, in, inLen) != Z_OK) return 0;
+  advance(outLen / SIM_INFLATE_KBPS, awakeCurrent());
+  return outLen;
+}
+
+bool halVerifySignature(const uint8_t* data, size_t len, const uint8_t* signature, size_t signatureLen){
+  BIO* pem = BIO_new_mem_buf(otaPublicKey, -1);
+  EVP_PKEY* key = PEM_read_bio_PUBKEY(pem, NULL, NULL, NULL);
+  EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+  bool ok = key != NULL && ctx != NULL && EVP_DigestVerifyInit(ctx, NULL, EVP_sha256(), NULL, key) == 1 &&
+            EVP_DigestVerify(ctx, signature, signatureLen, data, len) == 1;
+  EVP_MD_CTX_free(ctx);
+  EVP_PKEY_free(key);
+  BIO_free(pem);
+  advance(SIM_VERIFY_MS, awakeCurrent());
+  return ok;
+}
+// IMAGE CHECKS END ------------------------------------------------------------------------------------------------------------------------------------------
+#endif
\ No newline at end of file
@@ -0,0 +1,377 @@
+/* ***********************************************************************************************************************************************************
+SOIL QUALITY SENSOR (HOST SIMULATION): runs the wake cycle of main.cpp (wakeRunner.h) on Linux against the simulated probes, battery and clock of halNative.cpp. Readings
+are published to a local MQTT broker (plain MQTT, SIM_MQTT_HOST and SIM_MQTT_PORT environment variables, localhost:1883 by default).
+Connection faults: SIM_WIFI_FAIL_PCT makes that share of joins fail, a port nothing listens on refuses the broker and 'sleep 1d | nc -lk <port>' stalls it.
+SIM_LOG_FILE keeps the flash log in a file, so the readings spilled during an outage are replayed by the next run as after a power cycle.
+SIM_PROBES sets how many DS18B20s share the bus (1 to PROBE_MAX_COUNT, 15 cm apart), SIM_PROBE_GLITCH_PCT makes that share of reads bad (85 C or 16 C off).
+SIM_MOIST_CAL=<dry mV>,<wet mV> stores calibration points in NVS. SIM_MQTT_LATENCY_MS holds every PUBACK back by that round trip.
+Shared attributes (deviceConfig.h) are asked for on every connect, a broker that answers v1/devices/me/attributes/request/+ retunes the run.
+fwVersion/fwUrl among them offer an image packed by ThingsBoard/otaImage (otaPull.h): http:// only here, 'python3 -m http.server' serves it.
+A new maintenanceReq, or SIM_PEK_WAKE=<n> pressing the PEK on wake n, holds the link up for a maintenance window (maintenanceWindow.h).
+SIM_IDENTITY=<file> boots with an ident partition image from ThingsBoard/nvsProvision (token, client ID, tree), the -D build defaults otherwise.
+SIM_LORA=<file> turns the node into a LoRa one (loraUplink.h, as uplink=lora in the ident partition) and appends every frame the gateway hears to the file,
+SIM_LORA_LOSS_PCT loses that share on air. 'ThingsBoard/loraGateway devices.csv < file' checks and decodes them, no broker needed.
+'filters' times the streaming filters against the batch medians (QuickMedianLib from lib_deps, the old insertion sort). Drain rates by QoS 1 window and latency: test/test_uplink_throughput.
+
+  pio run -e native && .pio/build/native/program [wakes | filters]
+  pio test -e native
+*********************************************************************************************************************************************************** */
+#if !defined(ARDUINO) && !defined(PIO_UNIT_TESTING)                                                              // pio test -e native brings its own main() per test (test/)
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <QuickMedianLib.h>
+#include "macros.h"
+#include "hal.h"
+#include "halNative.h"
+#include "timeUtils.h"
+#include "sampling.h"
+#include "probeBus.h"
+#include "moisturePower.h"
+#include "wakeCycle.h"
+#include "wakeProfiler.h"
+#include "energyAccount.h"
+#include "linkFsm.h"
+#include "telemetryLog.h"
+#include "uplink.h"
+#include "signalFilters.h"
+#include "deviceConfig.h"
+#include "otaPull.h"
+#include "maintenanceWindow.h"
+#include "deviceIdentity.h"
+#include "loraUplink.h"
+#include "wakeRunner.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// GLOBAL VARIABLES
+// ===========================================================================================================================================================
+static WakeRetained kept = WAKE_RETAINED_INIT;                                                                   // Plain memory survives the simulated deep sleep like RTC memory does
+static WakeRunner run;
+static DeviceIdentity identity;
+static uint32_t confirmedFirmware = FIRMWARE_VERSION;                                                            // Stands in for the image in each app slot: the one that boots after a rollback...
+static uint32_t trialFirmware = 0;                                                                               // ...and the one activated last
+static uint32_t pekWake = 0;                                                                                     // 0: nobody presses the button
+static const char* brokerHost = "localhost";
+static uint16_t brokerPort = 1883;
+// GLOBAL VARIABLES END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// WAKE CYCLE
+// ===========================================================================================================================================================
+// Host side of the wake: synchronous sampling, plain MQTT and one line per wake ----------------------------------------------------------------------------
+static void acquire(WakeRunner& run, float* temperaturesC, float& moisturePercent){
+  moisturePowerWait(run.moisturePower);                                                                          // On the device this wait overlaps with the DS18B20 conversions
+  moisturePercent = sampleMoisturePercent(deviceMoistureCalibration(kept.config), run.moistureSamples);
+  moisturePowerOff(run.moisturePower, kept.moisturePowerStats, run.kind != WAKE_RADIO);
+  sampleTemperatureMediansC(kept.probeBus, run.temperaturePlan.samples, temperaturesC);
+}
+
+static bool join(WakeRunner&, uint32_t timeoutMs){
+  return halNetworkUp(timeoutMs);
+}
+
+static bool connect(WakeRunner& run){
+  return halMqttConnect(brokerHost, brokerPort, run.identity->clientId, run.identity->token);
+}
+
+static void report(WakeRunner& run, WakeNote note, uint32_t detail){
+  switch(note){
+    case WAKE_READING:
+      printf("wake %5u: %6.2f", (unsigned)kept.wake.bootCount - 1, run.lastTemperaturesC[0]);
+      for(uint8_t slot = 1; slot < kept.probeBus.count; slot++) printf("/%.2f", run.lastTemperaturesC[slot]);
+      printf(" C (%2u bits, %u samples), %6.2f %%, stored %2u/%u", run.temperaturePlan.resolutionBits, run.temperaturePlan.samples, run.lastMoisturePercent,
+             kept.wake.buffer.count, kept.config.batchDepth);
+      break;
+    case WAKE_SPILLED: printf(", %u spilled to flash", (unsigned)detail); break;
+    case WAKE_LORA_SENT:
+      switch((LoraStatus)detail){
+        case LORA_SENT:     printf(", LoRa frame %u: %u readings, %u ms on air", (unsigned)(uint16_t)(kept.lora.frameCounter - 1), kept.lora.lastReadings,
+                                   (unsigned)kept.lora.lastAirtimeMs); break;
+        case LORA_DEFERRED: printf(", LoRa frame deferred (%u ms on air today)", (unsigned)kept.lora.airtimeTodayMs); break;
+        case LORA_FAILED:   printf(", LoRa radio failed"); break;
+        case LORA_IDLE:     break;
+      }
+      break;
+    case WAKE_CONFIG:
+      switch((ConfigResult)detail){
+        case CONFIG_APPLIED:   printf(", settings version %u applied", (unsigned)kept.config.version); break;
+        case CONFIG_REJECTED:  printf(", settings rejected (bad %s)", run.badKey); break;
+        case CONFIG_REQUESTED: printf(", settings changed on the server"); break;
+        case CONFIG_IGNORED:   break;
+      }
+      break;
+    case WAKE_FIRMWARE_OFFERED:      printf(", firmware %u offered", (unsigned)detail); break;
+    case WAKE_MAINTENANCE_REQUESTED: printf(", maintenance window requested"); break;
+    case WAKE_MAINTENANCE_CLOSED:    printf(", maintenance window %u s", (unsigned)detail); break;               // Nobody uploads here, the window only keeps the radio up
+    case WAKE_MAINTENANCE_REFUSED:   printf(", maintenance window refused"); break;
+    case WAKE_TRIAL_CONFIRMED:
+      confirmedFirmware = trialFirmware;
+      printf(", firmware %u confirmed", (unsigned)confirmedFirmware);
+      break;
+    case WAKE_FIRMWARE:
+      switch((OtaStatus)detail){
+        case OTA_PARTIAL:  printf(", firmware %u: %u of %u bytes", (unsigned)kept.otaPull.offeredVersion, (unsigned)kept.otaPull.written,
+                                  (unsigned)kept.otaPull.header.imageSize); break;
+        case OTA_RETRY:    printf(", firmware download interrupted"); break;
+        case OTA_REJECTED: printf(", firmware %u rejected", (unsigned)kept.otaPull.failedVersion); break;
+        case OTA_IDLE:     break;
+        case OTA_READY:                                                                                          // No restart here, the next simulated wake boots it
+          printf(", firmware %u verified and activated", (unsigned)kept.otaPull.header.version);
+          trialFirmware = kept.otaPull.header.version;
+          break;
+      }
+      break;
+    case WAKE_FLUSHED:
+      printf(", %u readings acknowledged in %u messages after %u attempts", (unsigned)run.uplink.readingsAcked, (unsigned)run.uplink.messagesAcked,
+             run.link.attempts);
+      if(run.uplink.rewinds > 0) printf(", %u rewinds", run.uplink.rewinds);
+      break;
+    case WAKE_BUDGET_SPENT: printf(", wake budget spent after %u attempts (%u readings spilled to flash)", run.link.attempts, (unsigned)detail); break;
+    case WAKE_PUBLISH_FAILED:
+    case WAKE_ACKED:
+    case WAKE_MAINTENANCE_OPENED:
+      break;
+  }
+}
+
+static const WakeHooks hooks = {acquire, join, connect, NULL, NULL, NULL, NULL, report, NULL};
+
+static void handleAttributes(const char* topic, const uint8_t* payload, size_t len){
+  wakeHandleAttributes(run, topic, payload, len);
+}
+
+// Same steps as setup() in main.cpp, the acquisition runs in place instead of in the background -------------------------------------------------------------
+static void runWake(){
+  wakeBegin(run, kept, identity, hooks);
+  run.trialBoot = halOtaTrialBoot();
+  run.forceFlush = run.trialBoot;
+  otaPullBegin(kept.otaPull, run.trialBoot ? trialFirmware : confirmedFirmware);
+  maintenanceBegin(kept.maintenance);
+  if(kept.wake.bootCount == pekWake){
+    requestMaintenance(kept.maintenance, MAINTENANCE_PEK);
+    run.forceFlush = true;
+  }
+  profileStart(run.profiler, PHASE_POWER);
+  moisturePowerOn(run.moisturePower, kept.moisturePowerStats);
+  halPowerBegin();
+  halSensorPower(true);
+  profileEnd(run.profiler, PHASE_POWER);
+
+  profileStart(run.profiler, PHASE_SENSORS);
+  halAnalogBegin();
+  halTemperatureBegin();
+  probeBusBegin(kept.probeBus);
+  wakePlanAcquisition(run);
+  profileEnd(run.profiler, PHASE_SENSORS);
+
+  profileStart(run.profiler, PHASE_SAMPLING);
+  switch(wakeDecide(run)){
+    case WAKE_QUIET: runQuietWake(run); break;
+    case WAKE_LORA:  runLoraWake(run); break;
+    case WAKE_RADIO: runRadioWake(run, kept.wake.bootCount); break;
+  }
+}
+// WAKE CYCLE END ============================================================================================================================================
+
+// ===========================================================================================================================================================
+// FILTER BENCHMARK
+// ===========================================================================================================================================================
+#define FILTER_BENCH_RUNS 200000
+#define FILTER_BENCH_STACK 4096                                                                                  // Painted below the caller, more than any of the workloads touches
+#define FILTER_BENCH_PAINT 0xA5
+
+static volatile float filterSink;                                                                                // Keeps the optimizer from dropping the work
+static uint8_t* paintedStack = NULL;
+static uint32_t filterRng = 1;
+
+static float benchSample(){                                                                                      // Soil temperature around 16 C with some noise
+  filterRng = filterRng * 1664525UL + 1013904223UL;
+  return 16.0f + (filterRng >> 8) / 16777216.0f;
+}
+
+static uint64_t benchCycles(){
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return simHostMicros();                                                                                        // No cycle counter, the column is then in us
+#endif
+}
+
+// Batch medians the streaming filter replaced ---------------------------------------------------------------------------------------------------------------
+static float insertionMedian(float* values, uint8_t count){                                                      // medianOf() of sampling.cpp before the streaming filters
+  for(uint8_t i = 1; i < count; i++){
+    float v = values[i];
+    uint8_t j = i;
+    while(j > 0 && values[j - 1] > v){
+      values[j] = values[j - 1];
+      j--;
+    }
+    values[j] = v;
+  }
+  return values[count / 2];
+}
+
+// Workloads: one acquisition of 'samples' conversions, as the sampling code runs them -----------------------------------------------------------------------
+__attribute__((noinline)) static void benchEmpty(uint8_t samples){
+  filterSink = samples;
+}
+
+__attribute__((noinline)) static void benchQuickMedian(uint8_t samples){
+  float measurements[samples];                                                                                   // The VLA of the original getMedianTemperatureC()
+  for(uint8_t i = 0; i < samples; i++) measurements[i] = benchSample();
+  filterSink = QuickMedian<float>::GetMedian(measurements, samples);
+}
+
+__attribute__((noinline)) static void benchInsertionMedian(uint8_t samples){
+  float measurements[TEMPERATURE_MAX_SAMPLES];
+  for(uint8_t i = 0; i < samples; i++) measurements[i] = benchSample();
+  filterSink = insertionMedian(measurements, samples);
+}
+
+__attribute__((noinline)) static void benchRunningMedian(uint8_t samples){
+  RunningMedian<float, TEMPERATURE_MAX_SAMPLES> median = {};
+  for(uint8_t i = 0; i < samples; i++) median.push(benchSample());                                               // As each conversion is read
+  filterSink = median.median();
+}
+
+__attribute__((noinline)) static void benchHampel(uint8_t samples){                                              // 'samples' wakes through the RTC filter instead
+  static HampelFilter<float, OUTLIER_WINDOW> filter;
+  for(uint8_t i = 0; i < samples; i++) filterSink = filter.update(benchSample(), OUTLIER_K, TEMPERATURE_OUTLIER_MIN_SIGMA_C);
+}
+
+__attribute__((noinline)) static void benchEwma(uint8_t samples){
+  static Ewma<float, 4> average;
+  for(uint8_t i = 0; i < samples; i++) filterSink = average.update(benchSample());
+}
+
+// Stack high-water mark: paint the area below the caller, run the workload at the same depth, find the deepest byte it changed ------------------------------
+__attribute__((noinline)) static void paintStack(){
+  volatile uint8_t area[FILTER_BENCH_STACK];
+  for(size_t i = 0; i < sizeof(area); i++) area[i] = FILTER_BENCH_PAINT;
+  uint8_t* lowest = (uint8_t*)area;
+  __asm__ volatile("" : "+r"(lowest));                                                                           // Read back once the frame is gone, on purpose: hidden from -Wdangling-pointer
+  paintedStack = lowest;
+}
+
+__attribute__((noinline)) static size_t stackUsed(void (*workload)(uint8_t), uint8_t samples){
+  paintStack();
+  workload(samples);
+  size_t untouched = 0;
+  while(untouched < FILTER_BENCH_STACK && ((volatile uint8_t*)paintedStack)[untouched] == FILTER_BENCH_PAINT) untouched++;
+  return FILTER_BENCH_STACK - untouched;
+}
+
+static void runFilterBench(){
+  static const struct { const char* name; void (*run)(uint8_t); } workloads[] = {
+    {"QuickMedianLib", benchQuickMedian}, {"insertion median", benchInsertionMedian}, {"RunningMedian", benchRunningMedian},
+    {"Hampel (per wake)", benchHampel}, {"Ewma", benchEwma},
+  };
+  static const uint8_t sampleCounts[] = {1, 5, 9, TEMPERATURE_MAX_SAMPLES};
+
+  size_t baseline = stackUsed(benchEmpty, 1);                                                                    // Call overhead, subtracted from every row
+  printf("%u runs each, cycles per sample%s\n", FILTER_BENCH_RUNS, benchCycles() == simHostMicros() ? " (us, no cycle counter)" : "");
+  printf("%-18s %7s %8s %8s %12s\n", "filter", "samples", "cycles", "stack B", "state B");
+  for(const auto& workload : workloads){
+    for(uint8_t samples : sampleCounts){
+      uint64_t start = benchCycles();
+      for(uint32_t run = 0; run < FILTER_BENCH_RUNS; run++) workload.run(samples);
+      double cycles = (double)(benchCycles() - start) / FILTER_BENCH_RUNS / samples;
+      size_t used = stackUsed(workload.run, samples);
+      size_t state = workload.run == benchHampel ? sizeof(HampelFilter<float, OUTLIER_WINDOW>) :
+                     workload.run == benchEwma ? sizeof(Ewma<float, 4>) : 0;                                     // Kept in RTC memory between wakes
+      printf("%-18s %7u %8.1f %8u %12u\n", workload.name, samples, cycles, (unsigned)(used > baseline ? used - baseline : 0), (unsigned)state);
+    }
+  }
+}
+// FILTER BENCHMARK END ======================================================================================================================================
+
+// ===========================================================================================================================================================
+// MAIN
+// ===========================================================================================================================================================
+int main(int argc, char** argv){
+  if(argc > 1 && strcmp(argv[1], "filters") == 0){
+    runFilterBench();
+    return 0;
+  }
+  uint32_t wakes = argc > 1 ? strtoul(argv[1], NULL, 10) : 100;
+  if(getenv("SIM_MQTT_HOST")) brokerHost = getenv("SIM_MQTT_HOST");
+  if(getenv("SIM_MQTT_PORT")) brokerPort = atoi(getenv("SIM_MQTT_PORT"));
+  if(getenv("SIM_PROBES")) simSetProbeCount(atoi(getenv("SIM_PROBES")));
+  if(getenv("SIM_PROBE_GLITCH_PCT")) simSetProbeGlitchPercent(atoi(getenv("SIM_PROBE_GLITCH_PCT")));
+  if(getenv("SIM_MQTT_LATENCY_MS")) simSetMqttLatencyMs(atoi(getenv("SIM_MQTT_LATENCY_MS")));
+  if(getenv("SIM_WIFI_FAIL_PCT")) simSetWifiFailurePercent(atoi(getenv("SIM_WIFI_FAIL_PCT")));
+  if(getenv("SIM_LOG_FILE") && !simSetLogFile(getenv("SIM_LOG_FILE"))) printf("cannot open %s, the log starts blank\n", getenv("SIM_LOG_FILE"));
+  if(getenv("SIM_PEK_WAKE")) pekWake = strtoul(getenv("SIM_PEK_WAKE"), NULL, 10);
+  if(getenv("SIM_MOIST_CAL")){
+    unsigned dryMv = 0, wetMv = 0;
+    sscanf(getenv("SIM_MOIST_CAL"), "%u,%u", &dryMv, &wetMv);
+    halSettingsSetU32(SOIL_MOIST_DRY_KEY, dryMv);
+    halSettingsSetU32(SOIL_MOIST_WET_KEY, wetMv);
+  }
+  if(getenv("SIM_IDENTITY") && !simSetIdentityFile(getenv("SIM_IDENTITY"))) printf("cannot read %s, build defaults used\n", getenv("SIM_IDENTITY"));
+  loadDeviceIdentity(identity);
+  if(getenv("SIM_LORA")){
+    if(simSetLoraFile(getenv("SIM_LORA"))) identity.loraUplink = true;
+    else printf("cannot open %s, Wi-Fi uplink\n", getenv("SIM_LORA"));
+  }
+  if(getenv("SIM_LORA_LOSS_PCT")) simSetLoraLossPercent(atoi(getenv("SIM_LORA_LOSS_PCT")));
+  printf("identity: %s, tree %d, token %s%s, %s uplink\n", identity.clientId, (int)identity.treeId, identity.token, identity.provisioned ? "" : " (build defaults)",
+         identity.loraUplink ? "LoRa" : "Wi-Fi");
+  deviceConfigBegin(kept.config);
+  halMqttOnMessage(handleAttributes);
+  printf("settings version %u: sleep %u-%u s, batch %u, temperature %u-%u samples up to %u bits, moisture %u-%u blocks, dry %u mV, wet %u mV\n",
+         (unsigned)kept.config.version, kept.config.sleepMinS, kept.config.sleepMaxS, kept.config.batchDepth, kept.config.tempMinSamples,
+         kept.config.tempMaxSamples, kept.config.tempMaxBits, kept.config.moistMinSamples, kept.config.moistMaxSamples, kept.config.moistDryMv,
+         kept.config.moistWetMv);
+  telemetryLogBegin(kept.log);
+  printf("flash log: %u slots, %u readings pending from the previous run\n", kept.log.slots, telemetryLogPending(kept.log));
+
+  for(uint32_t i = 0; i < wakes; i++){
+    simBeginWake();
+    runWake();
+    uint32_t awakeMs = halMillis();
+    uint64_t sleepS = simEndWake();
+    printf(", awake %5u ms, sleep %4u s, battery %.3f V\n", awakeMs, (unsigned)sleepS, simBatteryVoltage());
+  }
+
+  const SimStats& stats = simStats();
+  printf("\n%u wakes (%u with radio), %u publishes, %u failures\n", stats.wakes, stats.radioWakes, stats.publishes, stats.publishFailures);
+  char profileStr[WAKE_PROFILE_MAX_LEN];
+  if(kept.profileHistory.valid && serializeWakeProfile(kept.profileHistory, profileStr, sizeof(profileStr)) > 0){
+    printf("last flush profile: %s\n", profileStr);
+  }
+  char energyStr[ENERGY_MAX_LEN];
+  if(kept.profileHistory.valid &&
+     serializeWakeEnergy(kept.profileHistory, kept.energyLedger, kept.config.batchDepth * kept.wake.sleepS, halVbusVoltage(), energyStr, sizeof(energyStr)) > 0){
+    printf("last flush energy: %s\n", energyStr);
+  }
+  char linkStr[LINK_STATS_MAX_LEN];
+  if(serializeLinkStats(kept.linkStats, linkStr, sizeof(linkStr)) > 0){
+    printf("unreported link failures: %s\n", linkStr);
+  }
+  printf("flash log: %u readings pending, %u dropped, %u writes, %u sector erases\n", telemetryLogPending(kept.log), kept.log.dropped,
+         stats.flashWrites, stats.flashErases);
+  printf("%u probes, %u bus searches, %u scratchpad reads, %u outliers rejected\n", kept.probeBus.count, stats.probeSearches, stats.probeReads,
+         (unsigned)temperatureOutliers(kept.wake));
+  char moistStr[MOISTURE_POWER_MAX_LEN];
+  if(serializeMoisturePower(kept.moisturePowerStats, kept.wake.sleepS, moistStr, sizeof(moistStr)) > 0){
+    printf("FC-38 supply: %s, powered %.1f s in total\n", moistStr, stats.moistureOnMs / 1000.0);
+  }
+  if(stats.otaBytes > 0){
+    printf("firmware: running %u, %.1f kB downloaded, %u activated, %u rolled back\n", (unsigned)confirmedFirmware, stats.otaBytes / 1024.0,
+           stats.otaActivations, stats.otaRollbacks);
+  }
+  if(stats.loraFrames > 0){
+    printf("LoRa: %u frames (%u lost on air), %u readings, %.1f s on air, %u deferred, address %08x\n", stats.loraFrames, stats.loraLost,
+           (unsigned)kept.lora.readings, stats.loraAirtimeMs / 1000.0, (unsigned)kept.lora.deferred, (unsigned)loraDeviceAddress(identity.clientId));
+  }
+  printf("awake %.1f s (radio %.1f s), %.3f mAh, %.3f mAh per wake\n", stats.awakeMs / 1000.0, stats.radioMs / 1000.0, stats.consumedmAh,
+         stats.wakes ? stats.consumedmAh / stats.wakes : 0.0f);
+  return 0;
+}
+// MAIN END ==================================================================================================================================================
+#endif
\ No newline at end of file
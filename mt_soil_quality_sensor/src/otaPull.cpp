@@ -0,0 +1,143 @@
+#include <string.h>
+#include "otaPull.h"
+#include "deviceConfig.h"
+#include "energyAccount.h"
+#include "hal.h"
+#include "macros.h"
+#include "telemetryReport.h"
+
+// OFFER -----------------------------------------------------------------------------------------------------------------------------------------------------
+void otaPullBegin(OtaPull& ota, uint32_t runningVersion){
+  if(ota.magic != OTA_PULL_MAGIC){                                                                               // Power-on: nothing offered yet, the response to the first connect says
+    memset(&ota, 0, sizeof(ota));
+    ota.magic = OTA_PULL_MAGIC;
+  }
+  ota.runningVersion = runningVersion;
+}
+
+bool handleOtaAttributes(OtaPull& ota, const uint8_t* payload, size_t len){
+  char json[DEVICE_CONFIG_MESSAGE_MAX_LEN];
+  if(len >= sizeof(json)) return false;
+  memcpy(json, payload, len);
+  json[len] = '\0';
+
+  uint32_t version;
+  char url[OTA_URL_MAX_LEN];
+  const char* text = findAttribute(json, "fwVersion");
+  if(text == NULL || !parseAttributeUnsigned(text, version)) return false;                                       // A push of other keys, or no update published
+  if(version <= ota.runningVersion){
+    if(ota.offeredVersion != 0) ota.reportDue = true;                                                            // Offer withdrawn on the server (fwVersion set back)
+    ota.offeredVersion = 0;
+    return false;
+  }
+  text = findAttribute(json, "fwUrl");
+  if(version == ota.failedVersion || text == NULL || !parseAttributeString(text, url, sizeof(url))) return false;
+  if(version == ota.offeredVersion && strcmp(url, ota.url) == 0) return false;                                   // Same offer, the download resumes where it stopped
+
+  ota.offeredVersion = version;
+  strcpy(ota.url, url);
+  ota.fileOffset = 0;
+  ota.written = 0;
+  return true;
+}
+
+bool otaPullDue(const OtaPull& ota, float batteryVolts){
+  return ota.offeredVersion > ota.runningVersion && ota.offeredVersion != ota.failedVersion && batteryStateOfCharge(batteryVolts) >= OTA_MIN_SOC;
+}
+// OFFER END -------------------------------------------------------------------------------------------------------------------------------------------------
+
+// DOWNLOAD --------------------------------------------------------------------------------------------------------------------------------------------------
+static bool headerValid(const OtaPull& ota){
+  const OtaImageHeader& header = ota.header;
+  return header.magic == OTA_IMAGE_MAGIC && header.version == ota.offeredVersion && header.imageSize > 0 && header.imageSize <= halOtaSlotSize() &&
+         header.blockSize > 0 && header.blockSize <= OTA_BLOCK_MAX_LEN && header.blockSize % HAL_LOG_SECTOR_SIZE == 0 && // Every block starts on a sector, see halOtaWrite()
+         header.signatureLen <= OTA_SIGNATURE_MAX_LEN && halVerifySignature((const uint8_t*)&header, OTA_SIGNED_LEN, header.signature, header.signatureLen);
+}
+
+static OtaStatus rejectOffer(OtaPull& ota){                                                                      // Not an image of ours or corrupt on the server: no radio time for it until a newer version is offered
+  ota.failedVersion = ota.offeredVersion;
+  ota.offeredVersion = 0;
+  ota.reportDue = true;
+  return OTA_REJECTED;
+}
+
+OtaStatus otaPullStep(OtaPull& ota, uint32_t budgetMs, uint32_t maxBytes){
+  static uint8_t packed[OTA_BLOCK_MAX_LEN];                                                                      // Static: two blocks would not fit on the loop task stack
+  static uint8_t block[OTA_BLOCK_MAX_LEN];
+  if(ota.offeredVersion == 0) return OTA_IDLE;
+
+  uint32_t startMs = halMillis();
+  if(!halHttpOpen(ota.url, ota.fileOffset)) return OTA_RETRY;
+  if(ota.fileOffset == 0){                                                                                       // Nothing written before the signature checks out
+    if(!halHttpRead((uint8_t*)&ota.header, sizeof(ota.header))){
+      halHttpClose();
+      return OTA_RETRY;
+    }
+    if(!headerValid(ota)){
+      halHttpClose();
+      return rejectOffer(ota);
+    }
+    ota.fileOffset = sizeof(ota.header);
+    ota.written = 0;
+  }
+
+  uint32_t startOffset = ota.fileOffset;
+  OtaStatus status = OTA_PARTIAL;
+  while(ota.written < ota.header.imageSize && halMillis() - startMs < budgetMs && ota.fileOffset - startOffset < maxBytes){
+    uint32_t record;
+    uint32_t blockLen = ota.header.imageSize - ota.written < ota.header.blockSize ? ota.header.imageSize - ota.written : ota.header.blockSize;
+    if(!halHttpRead((uint8_t*)&record, sizeof(record))){
+      status = OTA_RETRY;
+      break;
+    }
+    uint32_t packedLen = record & ~OTA_BLOCK_STORED;
+    if(packedLen > sizeof(packed) || ((record & OTA_BLOCK_STORED) && packedLen != blockLen)){
+      status = rejectOffer(ota);
+      break;
+    }
+    if(!halHttpRead(packed, packedLen)){                                                                         // Cut mid-record: this block is fetched again next time
+      status = OTA_RETRY;
+      break;
+    }
+    const uint8_t* data = packed;
+    if(!(record & OTA_BLOCK_STORED)){
+      if(halInflate(packed, packedLen, block, sizeof(block)) != blockLen){
+        status = rejectOffer(ota);
+        break;
+      }
+      data = block;
+    }
+    if(!halOtaWrite(ota.written, data, blockLen)){
+      status = OTA_RETRY;
+      break;
+    }
+    ota.written += blockLen;                                                                                     // Only after the flash write: a reset in between rewrites the block
+    ota.fileOffset += sizeof(record) + packedLen;
+  }
+  halHttpClose();
+  if(status != OTA_PARTIAL || ota.written < ota.header.imageSize) return status;
+
+  uint8_t digest[32];
+  if(!halOtaDigest(ota.header.imageSize, digest) || memcmp(digest, ota.header.sha256, sizeof(digest)) != 0 || !halOtaActivate()){
+    return rejectOffer(ota);                                                                                     // Read back from the flash, so a bad write is caught too
+  }
+  ota.offeredVersion = 0;
+  ota.reportDue = true;
+  return OTA_READY;
+}
+
+void otaPullConfirm(OtaPull& ota){
+  halOtaConfirm();
+  ota.reportDue = true;                                                                                          // fwRunning is the new version now
+}
+// DOWNLOAD END ----------------------------------------------------------------------------------------------------------------------------------------------
+
+// MQTT ------------------------------------------------------------------------------------------------------------------------------------------------------
+bool publishOtaStatus(OtaPull& ota){
+  if(ota.offeredVersion == 0 && !ota.reportDue) return false;
+
+  uint32_t progress = ota.fileOffset && ota.header.imageSize ? (uint32_t)(ota.written * 100ULL / ota.header.imageSize) : 0;
+  const TelemetryValue values[] = {ota.runningVersion, ota.offeredVersion, progress, ota.failedVersion};         // Same order as OTA_REPORT_FIELDS
+  return publishAttributeReport<OTA_REPORT_MAX_LEN>(ota.reportDue, OTA_REPORT_FIELDS, values);
+}
+// MQTT END --------------------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
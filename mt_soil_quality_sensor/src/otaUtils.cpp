@@ -38,4 +38,11 @@ void setupOTA(){
 
   Debugln(F("OTA service started!"));
 }
-// SETUP OTA END ---------------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
+// SETUP OTA END ---------------------------------------------------------------------------------------------------------------------------------------------
+
+// STOP OTA --------------------------------------------------------------------------------------------------------------------------------------------------
+void stopOTA(){
+  ArduinoOTA.end();                                                                                              // Closes the UDP listener and mDNS
+  Debugln(F("OTA service stopped"));
+}
+// STOP OTA END ----------------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -9,29 +9,31 @@ void setupPower(AXP20X_Class& axp192, const uint8_t pmuIRQPin, void (*isr)()){
     axp192.setPowerOutPut(AXP192_LDO3, AXP202_OFF);                                                                   // Disable GPS power
     Debugln(F("GPS and LoRa powered off"));
 
-    axp192.adc1Enable(AXP202_BATT_VOL_ADC1, true);                                                                    // Enable ADC for battery voltage
+    axp192.adc1Enable(AXP202_BATT_VOL_ADC1 | AXP202_BATT_CUR_ADC1 | AXP202_VBUS_VOL_ADC1 | AXP202_VBUS_CUR_ADC1, true);// Enable ADCs for battery voltage/current and VBUS
+    axp192.EnableCoulombcounter();                                                                                    // Never cleared here: it must keep counting across deep sleep for the energy ledger
 
     pinMode(pmuIRQPin, INPUT);                                                                                   // Set up PEK button IRQ pin
 
     axp192.clearIRQ();                                                                                                // Clear any existing IRQs
-    axp192.enableIRQ(AXP202_PEK_LONGPRESS_IRQ, true);                                                                 // Enable PEK IRQ for long press
+    axp192.enableIRQ(AXP202_ALL_IRQ, false);                                                                          // Only the PEK may pull the IRQ line, it also wakes the ESP32 from deep sleep
+    axp192.enableIRQ(AXP202_PEK_SHORTPRESS_IRQ | AXP202_PEK_LONGPRESS_IRQ, true);                                     // Enable PEK IRQs for short and long press
     attachInterrupt(digitalPinToInterrupt(PMU_IRQ_PIN), isr, FALLING);                                    // Enable the interruption to notify the ESP32 to give access to execute the code to power off the device
 }
 
-void pekThreadRoutine(volatile bool* pekPressedFlag, AXP20X_Class& axp192, SemaphoreHandle_t serialSemaphore){
-    if(*pekPressedFlag){                                                                                                // Check for PEK press ISR flag
-        *pekPressedFlag = false;
-        axp192.readIRQ();                                                                                               // The task checks the type of IRQ
-
-        if(axp192.isPEKLongtPressIRQ()){                                                                                // If the IRQ is long-press type, the device is switched off
-            if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
-                Debugln(F("Long press detected: Shutting down..."));
-                xSemaphoreGive(serialSemaphore);
-            }
-            vTaskDelay(pdMS_TO_TICKS(100));                                                                            // Delay to get to see the print
-            axp192.shutdown();
-        }
+PekAction pekThreadRoutine(AXP20X_Class& axp192, SemaphoreHandle_t serialSemaphore){
+    PekAction action = PEK_NONE;
+    axp192.readIRQ();                                                                                                   // The task checks the type of IRQ
 
-        axp192.clearIRQ();
+    if(axp192.isPEKLongtPressIRQ()){                                                                                    // If the IRQ is long-press type, the device is switched off
+        if(serialSemaphore == NULL || xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
+            Debugln(F("Long press detected: Shutting down..."));
+            if(serialSemaphore != NULL) xSemaphoreGive(serialSemaphore);
+        }
+        vTaskDelay(pdMS_TO_TICKS(100));                                                                                // Delay to get to see the print
+        axp192.shutdown();
     }
+    if(axp192.isPEKShortPressIRQ()) action = PEK_SHORT;                                                                 // The caller decides what a short press means at this point of the wake
+
+    axp192.clearIRQ();                                                                                                  // Releases the IRQ line, so the next press gives a new falling edge
+    return action;
 }
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include <string.h>
+#include "probeBus.h"
+
+// SEARCH THE BUS, KEEPING THE SLOT OF EVERY KNOWN PROBE -----------------------------------------------------------------------------------------------------
+static void searchBus(ProbeBus& bus){
+  uint8_t found[PROBE_MAX_COUNT][HAL_PROBE_ROM_LEN];
+  uint8_t count = halTemperatureSearch(found, PROBE_MAX_COUNT);
+  bool placed[PROBE_MAX_COUNT] = {};
+  bool kept[PROBE_MAX_COUNT] = {};
+
+  for(uint8_t slot = 0; slot < bus.count; slot++){
+    for(uint8_t i = 0; i < count; i++){
+      if(!placed[i] && memcmp(bus.roms[slot], found[i], HAL_PROBE_ROM_LEN) == 0) kept[slot] = placed[i] = true;
+    }
+  }
+
+  uint8_t slot = 0;
+  for(uint8_t i = 0; i < count; i++){                                                                            // New probes take the slots of the ones that vanished, then the free ones
+    if(placed[i]) continue;
+    while(slot < bus.count && kept[slot]) slot++;
+    memcpy(bus.roms[slot], found[i], HAL_PROBE_ROM_LEN);
+    kept[slot] = true;
+    if(slot >= bus.count) bus.count = slot + 1;
+  }
+  bus.missing = 0;
+  for(uint8_t slot = 0; slot < bus.count; slot++) if(!kept[slot]) bus.missing |= 1 << slot;
+  bus.silentWakes = 0;                                                                                           // A vanished probe keeps its slot, reported as HAL_PROBE_DISCONNECTED_C
+}
+// SEARCH THE BUS END ----------------------------------------------------------------------------------------------------------------------------------------
+
+// CACHE -----------------------------------------------------------------------------------------------------------------------------------------------------
+uint8_t probeBusBegin(ProbeBus& bus){
+  if(bus.magic != PROBE_BUS_MAGIC || bus.count > PROBE_MAX_COUNT){                                               // Power-on or a count out of range: search again
+    memset(&bus, 0, sizeof(bus));
+    bus.magic = PROBE_BUS_MAGIC;
+    searchBus(bus);
+  }else if(bus.silentWakes >= PROBE_RESEARCH_WAKES){
+    searchBus(bus);                                                                                              // Unplugged, replaced or added probe
+  }
+  return bus.count;
+}
+
+void probeBusReport(ProbeBus& bus, const float* temperaturesC){
+  bool silent = bus.count == 0;
+  for(uint8_t slot = 0; slot < bus.count; slot++){
+    bool answered = temperaturesC[slot] != HAL_PROBE_DISCONNECTED_C;
+    if(answered) bus.missing &= ~(1 << slot);                                                                    // Plugged back in, its next silence counts again
+    else silent |= !(bus.missing & (1 << slot));
+  }
+
+  if(!silent) bus.silentWakes = 0;
+  else if(bus.silentWakes < PROBE_RESEARCH_WAKES) bus.silentWakes++;
+}
+// CACHE END -------------------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,28 @@
+#include "rejoinCache.h"
+
+// CHECK IF THE CACHED LEASE CAN BE REUSED -------------------------------------------------------------------------------------------------------------------
+bool leaseReusable(const RejoinCache& cache, uint64_t nowMs, uint32_t maxAgeS){
+  if(!cache.valid || cache.ip == 0 || cache.channel == 0) return false;
+  if(nowMs < cache.leaseObtainedMs) return false;                                                                // The clock was stepped back by an NTP sync, the age is unknown
+  return (nowMs - cache.leaseObtainedMs) < (uint64_t)maxAgeS * 1000ULL;
+}
+// CHECK IF THE CACHED LEASE CAN BE REUSED END ---------------------------------------------------------------------------------------------------------------
+
+// BROKER ADDRESS CACHE --------------------------------------------------------------------------------------------------------------------------------------
+bool brokerAddressCached(const RejoinCache& cache, uint64_t nowMs){
+  return cache.brokerIp != 0 && nowMs < cache.brokerExpiresMs;
+}
+
+void storeBrokerAddress(RejoinCache& cache, uint32_t ip, uint64_t nowMs, uint32_t ttlS){
+  if(ip == cache.brokerIp && brokerAddressCached(cache, nowMs)) return;                                          // Same address as cached: keep the original expiry
+  cache.brokerIp = ip;
+  cache.brokerExpiresMs = nowMs + (uint64_t)ttlS * 1000ULL;
+}
+// BROKER ADDRESS CACHE END ----------------------------------------------------------------------------------------------------------------------------------
+
+// FORGET EVERYTHING (NEXT JOIN SCANS AND USES DHCP/DNS) -----------------------------------------------------------------------------------------------------
+void forgetRejoin(RejoinCache& cache){
+  cache.valid = false;
+  cache.brokerIp = 0;
+}
+// FORGET EVERYTHING END -------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
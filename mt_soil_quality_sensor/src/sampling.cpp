@@ -0,0 +1,76 @@
+#include <math.h>
+#include "sampling.h"
+#include "hal.h"
+#include "macros.h"
+#include "signalFilters.h"
+
+// SOIL TEMPERATURES: MEDIAN OF "X" CONVERSIONS PER PROBE ----------------------------------------------------------------------------------------------------
+void sampleTemperatureMediansC(const ProbeBus& bus, uint8_t samples, float* mediansC){
+  RunningMedian<float, TEMPERATURE_MAX_SAMPLES> medians[PROBE_MAX_COUNT] = {};                                   // Each conversion goes in as it is read
+  if(samples > TEMPERATURE_MAX_SAMPLES) samples = TEMPERATURE_MAX_SAMPLES;
+  for(uint8_t slot = 0; slot < PROBE_MAX_COUNT; slot++) mediansC[slot] = NAN;
+  if(bus.count == 0) mediansC[0] = HAL_PROBE_DISCONNECTED_C;                                                     // Same value as a single probe that does not answer
+  if(samples == 0 || bus.count == 0) return;
+
+  uint32_t conversionMs = halTemperatureConversionMs();
+  for(uint8_t i = 0; i < samples; i++){
+    halTemperatureRequest();                                                                                     // One broadcast converts every probe, the wait does not grow with them
+    halDelayMs(conversionMs);                                                                                    // The CPU is free for Wi-Fi/TLS while the DS18B20s convert
+    while(!halTemperatureReady()){
+      halDelayMs(5);
+    }
+    for(uint8_t slot = 0; slot < bus.count; slot++){
+      float celsius = halTemperatureReadC(bus.roms[slot]);                                                       // About 11 ms each, no search
+      if(celsius != HAL_PROBE_DISCONNECTED_C && celsius != HAL_PROBE_RESET_C) medians[slot].push(celsius);       // Error codes never reach the median
+    }
+  }
+  for(uint8_t slot = 0; slot < bus.count; slot++){
+    mediansC[slot] = medians[slot].empty() ? HAL_PROBE_DISCONNECTED_C : medians[slot].median();
+  }
+}
+// SOIL TEMPERATURES END -------------------------------------------------------------------------------------------------------------------------------------
+
+// SOIL MOISTURE: MEDIAN OF "X" DECIMATED BLOCKS OF ONE ADC BURST -------------------------------------------------------------------------------------------
+#define MOISTURE_MAX_BLOCKS (MOISTURE_ADAPTIVE_MAX_SAMPLES > MOISTURE_SAMPLES ? MOISTURE_ADAPTIVE_MAX_SAMPLES : MOISTURE_SAMPLES)
+
+static uint16_t moistureRaw[MOISTURE_MAX_BLOCKS * MOISTURE_BLOCK_LEN];                                           // Too big for the stack of the sampling task
+
+float decimatedMedian(const uint16_t* raw, size_t count, uint16_t blockLen){
+  RunningMedian<float, MOISTURE_MAX_BLOCKS> means = {};
+  uint32_t sum = 0;
+  for(size_t i = 0; i < count && means.count < MOISTURE_MAX_BLOCKS; i++){
+    sum += raw[i];
+    if((i + 1) % blockLen == 0){
+      means.push((float)sum / blockLen);                                                                         // Boxcar: white noise down by sqrt(blockLen)
+      sum = 0;
+    }
+  }
+  return means.empty() ? NAN : means.median();                                                                   // The median drops a block hit by a Wi-Fi TX burst
+}
+
+float soilMoisturePercent(float millivolts, const MoistureCalibration& calibration){
+  float percent = (millivolts - calibration.dryMv) * 100.0f / (calibration.wetMv - calibration.dryMv);
+  if(percent < 0.0f) return 0.0f;
+  if(percent > 100.0f) return 100.0f;
+  return percent;
+}
+
+float sampleMoistureMillivolts(uint8_t blocks){
+  if(blocks == 0) return NAN;
+  if(blocks > MOISTURE_MAX_BLOCKS) blocks = MOISTURE_MAX_BLOCKS;
+
+  size_t count = halAnalogBurst(SOIL_MOIST_PIN, moistureRaw, (size_t)blocks * MOISTURE_BLOCK_LEN);
+  float raw = decimatedMedian(moistureRaw, count, MOISTURE_BLOCK_LEN);
+  if(isnan(raw)) return NAN;
+
+  uint16_t below = (uint16_t)raw;                                                                                // Averaging gives sub-LSB resolution, keep it through the curve
+  float low = halAnalogMillivolts(below);
+  float high = halAnalogMillivolts(below < 4095 ? below + 1 : below);
+  return low + (high - low) * (raw - below);
+}
+
+float sampleMoisturePercent(const MoistureCalibration& calibration, uint8_t blocks){
+  if(blocks == 0) return 0.0f;
+  return soilMoisturePercent(sampleMoistureMillivolts(blocks), calibration);
+}
+// SOIL MOISTURE END -----------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -2,33 +2,43 @@
 // LIBRARY INCLUSION
 // ===========================================================================================================================================================
 #include <Arduino.h>                                                                                             // Library for PlatformIO to use the Arduino environment
-#include <OneWire.h>
-#include <DallasTemperature.h>
-#include <QuickMedianLib.h>
 #include "sensors.h"
+#include "hal.h"
+#include "sampling.h"
 #include "macros.h"
 // LIBRARY INCLUSION END =====================================================================================================================================
 
 // ===========================================================================================================================================================
 // CONSTRUCTORES DE OBJETOS DE CLASE DE LIBRERIA, VARIABLES GLOBALES, CONSTANTES...
 // ===========================================================================================================================================================
-static OneWire oneWireBus(ONE_WIRE_PIN);
-static DallasTemperature tempSensor(&oneWireBus);
+static portMUX_TYPE acquisitionMux = portMUX_INITIALIZER_UNLOCKED;                                               // Guards the running flags, the tasks run on the other core
+static bool temperatureRunning = false;                                                                          // Cleared by the task itself, after it has given the semaphore
+static SemaphoreHandle_t temperatureDone = NULL;                                                                 // Given by the acquisition task once the median is ready
+static bool moistureRunning = false;
+static SemaphoreHandle_t moistureDone = NULL;
 // CONSTRUCTORES END =========================================================================================================================================
 
 // ===========================================================================================================================================================
 // GLOBAL VARIABLES
 // ===========================================================================================================================================================
-static const float humedadAire = 605.0f;
-static const float humedadAgua = 500.0f;
+static const ProbeBus* temperatureBus = NULL;
+static uint8_t temperatureSamples = 0;
+static float medianTemperatures[PROBE_MAX_COUNT];
+static MoistureCalibration moistureCalibration;
+static MoisturePower* moisturePower = NULL;
+static MoisturePowerStats* moisturePowerStats = NULL;
+static uint8_t moistureBlocks = 0;
+static bool moistureRadioOff = false;
+static float moisturePercent = NAN;
 // GLOBAL VARIABLES END ======================================================================================================================================
 
 // ===========================================================================================================================================================
 // SETUP FUNCTIONS
 // ===========================================================================================================================================================
-void initSensors() {
-  analogSetAttenuation(ADC_11db);                                                                                // Set the attenuation to -11 dB to go from 0V to 3V3 in the range of 0 to 4095
-  tempSensor.begin();                                                                                            // Start the OneWire bus for the DS18B20
+void initSensors(const MoistureCalibration& calibration) {
+  halAnalogBegin();                                                                                              // FC-38 on the ADC, millivolts through the eFuse calibration
+  moistureCalibration = calibration;                                                                             // Dry and wet points of this probe, set remotely or on the bench
+  halTemperatureBegin();                                                                                         // DS18B20s on the OneWire bus, conversions do not block
 }
 // SETUP FUNCTIONS END =======================================================================================================================================
 
@@ -36,52 +46,105 @@ void initSensors() {
 // LOOP FUNCTIONS
 // ===========================================================================================================================================================
 // SOIL TEMPERATURE FUNCTIONS --------------------------------------------------------------------------------------------------------------------------------
-// READ TEMPERATURE FUNCTION
-static float readTemperatureC() {
-  tempSensor.requestTemperatures();                                                                              // Ask the OneWire bus to be available to read the temperature
-  return tempSensor.getTempCByIndex(0);                                                                          // Read temperature from the first (and only) device
+// CLAIM OR RELEASE AN ACQUISITION, NO TASK HANDLE IS KEPT
+static bool acquisitionClaim(bool& running) {
+  portENTER_CRITICAL(&acquisitionMux);
+  bool claimed = !running;
+  running = true;
+  portEXIT_CRITICAL(&acquisitionMux);
+  return claimed;
 }
 
-// GET MEDIAN TEMPERATURE FROM "X" SAMPLES
-float getMedianTemperatureC(uint8_t samples) {
-  if (samples == 0) return 0.0f;                                                                               // If the function is called like "getMedianTemperature(0)", just return 0
+static void acquisitionFinished(bool& running) {
+  portENTER_CRITICAL(&acquisitionMux);                                                                           // A handle cleared here could be overwritten by xTaskCreate() returning late
+  running = false;
+  portEXIT_CRITICAL(&acquisitionMux);
+}
 
-  float measurements[samples];                                                                                 // Create a local array of measurements of size "samples"
+// BACKGROUND ACQUISITION TASK
+static void temperatureTask(void *pvParameters) {
+  sampleTemperatureMediansC(*temperatureBus, temperatureSamples, medianTemperatures);                            // Delays yield, so Wi-Fi/TLS run while the DS18B20s convert
+  xSemaphoreGive(temperatureDone);
+  acquisitionFinished(temperatureRunning);
+  vTaskDelete(NULL);
+}
 
-  for (uint8_t i = 0; i < samples; i++) {                                                                      // For each loop cycle,
-    measurements[i] = readTemperatureC();                                                                    // add each measurement to its corresponding index
-    delay(10);                                                                                               // Small delay between samples
+// START "X" CONVERSIONS IN THE BACKGROUND
+void startTemperatureAcquisition(const ProbeBus& bus, uint8_t samples) {
+  if (temperatureDone == NULL) {
+    temperatureDone = xSemaphoreCreateBinary();
   }
+  if (!acquisitionClaim(temperatureRunning)) return;                                                             // Already running
+  xSemaphoreTake(temperatureDone, 0);                                                                            // Discard the result of a previous acquisition
 
-  return QuickMedian<float>::GetMedian(measurements, samples);                                                 // Return the median value corresponding to the measurements array
+  temperatureBus = &bus;
+  temperatureSamples = constrain(samples, 1, TEMPERATURE_MAX_SAMPLES);
+  if (xTaskCreatePinnedToCore(temperatureTask, "TempTask", 3072, NULL, 2, NULL, 1) != pdPASS) {                  // Short OneWire transactions, kept away from the Wi-Fi core
+    acquisitionFinished(temperatureRunning);
+  }
+}
+
+// WAIT FOR THE MEDIANS OF THE BACKGROUND ACQUISITION
+bool waitMedianTemperaturesC(float* mediansC, uint32_t timeoutMs) {
+  if (temperatureDone == NULL || xSemaphoreTake(temperatureDone, pdMS_TO_TICKS(timeoutMs)) != pdTRUE) {          // Nothing was started, or the bus hung
+    for (uint8_t slot = 0; slot < PROBE_MAX_COUNT; slot++) mediansC[slot] = HAL_PROBE_DISCONNECTED_C;
+    return false;
+  }
+  memcpy(mediansC, medianTemperatures, sizeof(medianTemperatures));
+  return true;
+}
+
+// GET MEDIAN TEMPERATURES FROM "X" SAMPLES
+void getMedianTemperaturesC(const ProbeBus& bus, uint8_t samples, float* mediansC) {
+  if (samples == 0) {                                                                                            // If the function is called like "getMedianTemperatures(bus, 0, ...)", just return 0
+    for (uint8_t slot = 0; slot < PROBE_MAX_COUNT; slot++) mediansC[slot] = 0.0f;
+    return;
+  }
+
+  startTemperatureAcquisition(bus, samples);
+  waitMedianTemperaturesC(mediansC, TEMPERATURE_TIMEOUT_MS);                                                     // Blocking version kept for callers that have nothing to overlap
 }
 // SOIL TEMPERATURE FUNCTIONS END ----------------------------------------------------------------------------------------------------------------------------
 
 // SOIL MOISTURE FUNCTIONS -----------------------------------------------------------------------------------------------------------------------------------
-// ADAPTION OF MAP FUNCTION TO WORK WITH FLOATS
-static float fmap(float x, float in_min, float in_max, float out_min, float out_max) {
-  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+// GET MOISTURE FROM "X" DECIMATED BLOCKS OF ONE DMA BURST
+float getMoisturePercent(uint8_t blocks) {
+  return sampleMoisturePercent(moistureCalibration, blocks);                                                     // A few ms, where the old analogRead() loop waited 10 ms per sample
 }
 
-// READ MOISTURE FUNCTION
-static float readSoilMoisturePercent() {
-  int raw = analogRead(SOIL_MOIST_PIN);
-  float percent = fmap(raw, humedadAire, humedadAgua, 0.0f, 100.0f);
-  return constrain(percent, 0.0f, 100.0f);
+// BACKGROUND SETTLE AND BURST TASK
+static void moistureTask(void *pvParameters) {
+  moisturePowerWait(*moisturePower);                                                                             // Usually nothing left, the probe was switched on at the start of setup()
+  moisturePercent = sampleMoisturePercent(moistureCalibration, moistureBlocks);
+  moisturePowerOff(*moisturePower, *moisturePowerStats, moistureRadioOff);
+  xSemaphoreGive(moistureDone);
+  acquisitionFinished(moistureRunning);
+  vTaskDelete(NULL);
 }
 
-// GET MEDIAN MOISTURE FROM "X" SAMPLES
-float getMedianSoilMoisture(uint8_t samples) {
-  if (samples == 0) return 0.0;
-
-  float values[samples];
+// START THE BURST AS SOON AS THE PROBE HAS SETTLED
+void startMoistureAcquisition(MoisturePower& power, MoisturePowerStats& stats, uint8_t blocks, bool radioOff) {
+  if (moistureDone == NULL) {
+    moistureDone = xSemaphoreCreateBinary();
+  }
+  if (!acquisitionClaim(moistureRunning)) return;                                                                // Already running
+  xSemaphoreTake(moistureDone, 0);                                                                               // Discard the result of a previous acquisition
 
-  for (uint8_t i = 0; i < samples; i++) {
-    values[i] = readSoilMoisturePercent();
-    delay(10);
+  moisturePowerOn(power, stats);                                                                                 // No-op if setup() already switched it on
+  moisturePower = &power;
+  moisturePowerStats = &stats;
+  moistureBlocks = blocks;
+  moistureRadioOff = radioOff;
+  moisturePercent = NAN;
+  if (xTaskCreatePinnedToCore(moistureTask, "MoistTask", 3072, NULL, 2, NULL, 1) != pdPASS) {                    // Waits out the settle time while Wi-Fi associates on the other task
+    acquisitionFinished(moistureRunning);
   }
+}
 
-  return QuickMedian<float>::GetMedian(values, samples);
+// WAIT FOR THE BACKGROUND BURST
+float waitMoisturePercent(uint32_t timeoutMs) {
+  if (moistureDone == NULL || xSemaphoreTake(moistureDone, pdMS_TO_TICKS(timeoutMs)) != pdTRUE) return NAN;      // Nothing was started, or the ADC hung
+  return moisturePercent;
 }
 // SOIL MOISTURE FUNCTIONS END -------------------------------------------------------------------------------------------------------------------------------
 // LOOP FUNCTIONS END ========================================================================================================================================
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include <math.h>
+#include "sleepScheduler.h"
+#include "energyAccount.h"
+#include "timeUtils.h"
+
+// HELPERS ---------------------------------------------------------------------------------------------------------------------------------------------------
+static float clamp01(float value){
+  if(isnan(value) || value < 0.0f) return 0.0f;
+  return value > 1.0f ? 1.0f : value;
+}
+
+static bool isNight(uint64_t epochMs, const SleepLimits& limits){
+  if(epochMs < VALID_EPOCH_MS || limits.nightStartH == limits.nightEndH) return false;                           // Unsynced clock or night disabled
+
+  int32_t hour = (int32_t)((epochMs / 3600000ULL) % 24) + limits.utcOffsetH;
+  hour = (hour % 24 + 24) % 24;
+  if(limits.nightStartH < limits.nightEndH) return hour >= limits.nightStartH && hour < limits.nightEndH;
+  return hour >= limits.nightStartH || hour < limits.nightEndH;                                                  // Wraps around midnight
+}
+// HELPERS END -----------------------------------------------------------------------------------------------------------------------------------------------
+
+// PLAN THE NEXT SLEEP ---------------------------------------------------------------------------------------------------------------------------------------
+SleepPlan planSleep(const SleepInputs& inputs, const SleepLimits& limits){
+  SleepPlan plan;
+  float hoursPerWake = (inputs.lastSleepS ? inputs.lastSleepS : limits.minS) / 3600.0f;
+
+  // Soil dynamics, geometric between the bounds so a stable soil gets the long sleeps quickly --------------------------------------------------------------
+  float temperatureRate = fabsf(inputs.temperatureTrendC) / hoursPerWake;
+  float moistureRate = fabsf(inputs.moistureTrend) / hoursPerWake;
+  float temperatureLevel = clamp01(temperatureRate / limits.fastTemperatureCph);
+  float moistureLevel = clamp01(moistureRate / limits.fastMoisturePph);
+  plan.dynamics = temperatureLevel > moistureLevel ? temperatureLevel : moistureLevel;
+  float seconds = limits.minS * powf((float)limits.maxS / limits.minS, 1.0f - plan.dynamics);
+
+  // Battery -------------------------------------------------------------------------------------------------------------------------------------------------
+  float soc = batteryStateOfCharge(inputs.batteryVolts);
+  plan.batteryStretch = 1.0f;
+  if(!isnan(soc) && soc < limits.lowSoc){
+    plan.batteryStretch = 1.0f + (limits.lowSocStretch - 1.0f) * (limits.lowSoc - soc) / limits.lowSoc;
+  }
+  if(inputs.batteryTrendVph < -limits.drainVph) plan.batteryStretch *= 2.0f;
+  seconds *= plan.batteryStretch;
+
+  // Time of day ---------------------------------------------------------------------------------------------------------------------------------------------
+  plan.night = isNight(inputs.epochMs, limits);
+  if(plan.night) seconds *= limits.nightStretch;
+
+  if(!isnan(soc) && soc < limits.criticalSoc) seconds = limits.maxS;
+  if(seconds < limits.minS) seconds = limits.minS;
+  if(seconds > limits.maxS) seconds = limits.maxS;
+  plan.seconds = (uint32_t)lroundf(seconds);
+  return plan;
+}
+// PLAN THE NEXT SLEEP END -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
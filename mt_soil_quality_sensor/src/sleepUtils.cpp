@@ -1,11 +1,15 @@
 #include <Arduino.h>    
 #include <esp_sleep.h>
+#include "hal.h"
 
 void sleep_interrupt(gpio_num_t gpio, uint8_t mode) {
     esp_sleep_enable_ext0_wakeup(gpio, mode);
 }
 
+void sleep_interrupt_low(uint64_t gpioMask) {
+    esp_sleep_enable_ext1_wakeup(gpioMask, ESP_EXT1_WAKEUP_ALL_LOW);                                             // EXT1, so it can be used together with sleep_interrupt()
+}
+
 void sleep_seconds(uint64_t seconds) {
-    esp_sleep_enable_timer_wakeup(seconds * 1000000ULL);
-    esp_deep_sleep_start();
+    halDeepSleep(seconds);
 }
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include "telemetryBuffer.h"
+#include "timeUtils.h"
+
+// CLEAR BUFFER ----------------------------------------------------------------------------------------------------------------------------------------------
+void clearTelemetryBuffer(TelemetryBuffer& buffer){
+  buffer.head = 0;
+  buffer.count = 0;
+}
+// CLEAR BUFFER END ------------------------------------------------------------------------------------------------------------------------------------------
+
+// PUSH RECORD -----------------------------------------------------------------------------------------------------------------------------------------------
+void pushTelemetryRecord(TelemetryBuffer& buffer, const TelemetryRecord& record){
+  if(buffer.head >= TELEMETRY_BUFFER_CAPACITY || buffer.count > TELEMETRY_BUFFER_CAPACITY){                      // Never index past the ring, whatever the RTC copy holds
+    clearTelemetryBuffer(buffer);
+  }
+
+  uint8_t tail = (buffer.head + buffer.count) % TELEMETRY_BUFFER_CAPACITY;
+  buffer.records[tail] = record;
+
+  if(buffer.count < TELEMETRY_BUFFER_CAPACITY){
+    buffer.count++;
+  }else{
+    buffer.head = (buffer.head + 1) % TELEMETRY_BUFFER_CAPACITY;                                                 // Buffer full: the oldest reading is dropped
+  }
+}
+// PUSH RECORD END -------------------------------------------------------------------------------------------------------------------------------------------
+
+// RECORD AT INDEX (0 IS THE OLDEST) -------------------------------------------------------------------------------------------------------------------------
+const TelemetryRecord& telemetryRecordAt(const TelemetryBuffer& buffer, uint8_t index){
+  return buffer.records[(buffer.head + index) % TELEMETRY_BUFFER_CAPACITY];
+}
+// RECORD AT INDEX END ---------------------------------------------------------------------------------------------------------------------------------------
+
+// DROP THE OLDEST RECORDS -----------------------------------------------------------------------------------------------------------------------------------
+void popTelemetryRecords(TelemetryBuffer& buffer, uint8_t count){
+  if(count > buffer.count) count = buffer.count;
+  buffer.head = (buffer.head + count) % TELEMETRY_BUFFER_CAPACITY;
+  buffer.count -= count;
+}
+// DROP THE OLDEST RECORDS END -------------------------------------------------------------------------------------------------------------------------------
+
+// CHECK IF THE RADIO HAS TO BE WOKEN UP ---------------------------------------------------------------------------------------------------------------------
+bool telemetryFlushDue(const TelemetryBuffer& buffer, uint64_t nowMs, uint8_t depth, uint32_t maxAgeS, uint8_t pending){
+  uint16_t total = buffer.count + pending;                                                                       // 'pending' counts a reading still being acquired, so the radio can start early
+  if(total == 0) return false;
+  if(total >= depth) return true;
+  if(buffer.count == 0) return false;
+
+  uint64_t oldestMs = telemetryRecordAt(buffer, 0).timestampMs;
+  return nowMs >= oldestMs && (nowMs - oldestMs) >= (uint64_t)maxAgeS * 1000ULL;
+}
+// CHECK IF THE RADIO HAS TO BE WOKEN UP END -----------------------------------------------------------------------------------------------------------------
+
+// FIX TIMESTAMPS TAKEN BEFORE THE FIRST CLOCK SYNC ----------------------------------------------------------------------------------------------------------
+void shiftUnsyncedTimestamps(TelemetryBuffer& buffer, int64_t deltaMs){
+  for(uint8_t i = 0; i < buffer.count; i++){
+    TelemetryRecord& record = buffer.records[(buffer.head + i) % TELEMETRY_BUFFER_CAPACITY];
+    if(record.timestampMs < VALID_EPOCH_MS){                                                                     // Only readings stamped with the unsynced RTC clock are moved
+      record.timestampMs += deltaMs;
+    }
+  }
+}
+// FIX TIMESTAMPS END ----------------------------------------------------------------------------------------------------------------------------------------
+
+// SERIALIZE THE BUFFER AS A THINGSBOARD TIMESTAMPED ARRAY ---------------------------------------------------------------------------------------------------
+size_t serializeTelemetryBatch(const TelemetryBuffer& buffer, int treeId, char* out, size_t outSize){
+  JsonWriter writer(out, outSize);
+  writer.raw('[');
+
+  for(uint8_t i = 0; i < buffer.count; i++){
+    const TelemetryRecord& record = telemetryRecordAt(buffer, i);
+    const TelemetryValue values[] = {treeId, record.bootCnt, record.soilTemp[0], record.soilTemp[1], record.soilTemp[2], record.soilTemp[3],
+                                       record.soilMoist, record.batVolt, record.sleepS};                         // Same order as TELEMETRY_FIELDS
+
+    if(i) writer.raw(',');
+    writeTimestampedTelemetry(writer, record.timestampMs, TELEMETRY_FIELDS, values);
+  }
+
+  writer.raw(']');
+  return writer.finish();                                                                                        // 0 if it does not fit, the caller must size the buffer with TELEMETRY_BATCH_MAX_LEN
+}
+// SERIALIZE END ---------------------------------------------------------------------------------------------------------------------------------------------
+
+// ENCODE THE BUFFER AS A COMPACT BINARY FRAME (SEE telemetryCodec.h) ----------------------------------------------------------------------------------------
+size_t encodeTelemetryBatch(const TelemetryBuffer& buffer, int treeId, uint8_t* out, size_t outSize){
+  BinaryWriter writer(out, outSize);
+  writeBinaryHeader(writer, TELEMETRY_FIELDS, buffer.count);
+
+  uint64_t previousMs = 0;
+  for(uint8_t i = 0; i < buffer.count; i++){
+    const TelemetryRecord& record = telemetryRecordAt(buffer, i);
+    const TelemetryValue values[] = {treeId, record.bootCnt, record.soilTemp[0], record.soilTemp[1], record.soilTemp[2], record.soilTemp[3],
+                                       record.soilMoist, record.batVolt, record.sleepS};                         // Same order as TELEMETRY_FIELDS
+    writeBinaryTelemetry(writer, record.timestampMs, previousMs, TELEMETRY_FIELDS, values);                      // Records 30 s apart cost about a dozen bytes each
+  }
+
+  return writer.finish();                                                                                        // 0 if it does not fit, size the buffer with TELEMETRY_FRAME_MAX_LEN
+}
+// ENCODE END ------------------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include <string.h>
+#include "telemetryLog.h"
+#include "hal.h"
+#include "timeUtils.h"
+#include "macros.h"
+
+#define ERASED_WORD 0xFFFFFFFFUL
+#define SLOTS_PER_SECTOR (HAL_LOG_SECTOR_SIZE / sizeof(TelemetryLogEntry))
+
+// FLASH SLOTS -----------------------------------------------------------------------------------------------------------------------------------------------
+static uint32_t slotOffset(uint32_t slot){
+  return (slot / SLOTS_PER_SECTOR) * HAL_LOG_SECTOR_SIZE + (slot % SLOTS_PER_SECTOR) * sizeof(TelemetryLogEntry);
+}
+
+static uint32_t nextSlot(const TelemetryLog& log, uint32_t slot){
+  return (slot + 1) % log.slots;
+}
+
+static bool readEntry(uint32_t slot, TelemetryLogEntry& entry){
+  return halLogRead(slotOffset(slot), &entry, sizeof(entry));
+}
+
+static bool writeMarker(uint32_t slot, size_t field){
+  uint32_t mark = TELEMETRY_LOG_MARK;
+  return halLogWrite(slotOffset(slot) + field, &mark, sizeof(mark));
+}
+
+static uint32_t entryCrc(const TelemetryLogEntry& entry){
+  uint8_t bytes[sizeof(entry.seq) + sizeof(entry.record)];
+  memcpy(bytes, &entry.seq, sizeof(entry.seq));
+  memcpy(bytes + sizeof(entry.seq), &entry.record, sizeof(entry.record));
+
+  uint32_t crc = ERASED_WORD;
+  for(size_t i = 0; i < sizeof(bytes); i++){                                                                     // Bitwise CRC-32, a table would cost 1 kB of flash for a few slots per wake
+    crc ^= bytes[i];
+    for(uint8_t bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320UL & (0UL - (crc & 1)));
+  }
+  return ~crc;
+}
+
+static bool entryValid(const TelemetryLogEntry& entry){
+  return entry.seq != ERASED_WORD && entry.committed == TELEMETRY_LOG_MARK && entry.crc == entryCrc(entry);
+}
+// FLASH SLOTS END -------------------------------------------------------------------------------------------------------------------------------------------
+
+// RECOVER THE CURSOR AFTER A POWER-ON -----------------------------------------------------------------------------------------------------------------------
+static void recoverCursor(TelemetryLog& log){
+  const uint32_t sectors = log.slots / SLOTS_PER_SECTOR;
+  TelemetryLogEntry entry;
+
+  uint32_t newestSector = sectors;
+  uint32_t newestSeq = 0;
+  for(uint32_t sector = 0; sector < sectors; sector++){                                                          // The first slot of every sector is enough to order them
+    if(!readEntry(sector * SLOTS_PER_SECTOR, entry) || entry.seq == ERASED_WORD) continue;
+    if(newestSector == sectors || entry.seq > newestSeq){
+      newestSector = sector;
+      newestSeq = entry.seq;
+    }
+  }
+
+  log.readSlot = 0;
+  log.writeSlot = 0;
+  log.nextSeq = 1;
+  if(newestSector == sectors) return;                                                                            // Blank partition
+
+  uint32_t slot = newestSector * SLOTS_PER_SECTOR;
+  for(uint32_t i = 0; i < SLOTS_PER_SECTOR && readEntry(slot + i, entry) && entry.seq != ERASED_WORD; i++){      // Slots are written in order, the first erased one is free
+    log.writeSlot = slot + i;
+    log.nextSeq = entry.seq + 1;
+  }
+  log.writeSlot = nextSlot(log, log.writeSlot);
+
+  uint32_t oldest = log.writeSlot;                                                                               // Walk back to the last delivered batch or the oldest slot still in flash
+  uint32_t newerSeq = log.nextSeq;
+  uint32_t walkable = log.slots - SLOTS_PER_SECTOR + log.writeSlot % SLOTS_PER_SECTOR;                           // Never into the free end of the newest sector
+  for(uint32_t walked = 0; walked < walkable; walked++){
+    uint32_t previous = (oldest + log.slots - 1) % log.slots;
+    if(!readEntry(previous, entry) || entry.seq == ERASED_WORD || entry.seq >= newerSeq) break;
+    if(entry.consumed == TELEMETRY_LOG_MARK) break;
+    oldest = previous;
+    newerSeq = entry.seq;
+  }
+  log.readSlot = oldest;
+}
+
+bool telemetryLogBegin(TelemetryLog& log){
+  uint32_t slots = (halLogSize() / HAL_LOG_SECTOR_SIZE) * SLOTS_PER_SECTOR;
+  if(log.magic == TELEMETRY_LOG_MAGIC && log.slots == slots && log.readSlot < slots && log.writeSlot < slots){
+    return slots > 0;                                                                                            // Deep sleep wake, the RTC cursor is still good
+  }
+
+  memset(&log, 0, sizeof(log));
+  log.slots = slots < 2 * SLOTS_PER_SECTOR ? 0 : slots;                                                          // The ring needs a sector to erase ahead of the oldest one
+  if(log.slots > 0) recoverCursor(log);
+  log.sessionSeq = log.nextSeq;
+  log.magic = TELEMETRY_LOG_MAGIC;
+  return log.slots > 0;
+}
+// RECOVER THE CURSOR END ------------------------------------------------------------------------------------------------------------------------------------
+
+// APPEND ----------------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t telemetryLogPending(const TelemetryLog& log){
+  return log.slots ? (log.writeSlot + log.slots - log.readSlot) % log.slots : 0;
+}
+
+bool telemetryLogAppend(TelemetryLog& log, const TelemetryRecord& record){
+  if(log.slots == 0) return false;
+
+  if(log.writeSlot % SLOTS_PER_SECTOR == 0 && !halLogErase(slotOffset(log.writeSlot))) return false;             // Entering a sector: one erase per SLOTS_PER_SECTOR readings
+
+  TelemetryLogEntry entry;
+  memset(&entry, 0xFF, sizeof(entry));                                                                           // Markers stay erased, padding too
+  entry.seq = log.nextSeq;
+  entry.record = record;
+  entry.crc = entryCrc(entry);
+
+  if(!halLogWrite(slotOffset(log.writeSlot), &entry, sizeof(entry))) return false;
+  if(!writeMarker(log.writeSlot, offsetof(TelemetryLogEntry, committed))) return false;                          // A reset before this leaves a torn slot, skipped on replay
+  log.writeSlot = nextSlot(log, log.writeSlot);
+  log.nextSeq++;
+
+  uint32_t sectorEnd = log.writeSlot + SLOTS_PER_SECTOR;
+  if(log.writeSlot % SLOTS_PER_SECTOR == 0 && log.readSlot >= log.writeSlot && log.readSlot < sectorEnd){
+    log.dropped += sectorEnd - log.readSlot;                                                                     // Ring full: the oldest undelivered sector is erased next
+    log.readSlot = sectorEnd % log.slots;
+  }
+  return true;
+}
+
+uint8_t spillTelemetryBuffer(TelemetryLog& log, TelemetryBuffer& buffer){
+  uint8_t written = 0;
+  while(written < buffer.count && telemetryLogAppend(log, telemetryRecordAt(buffer, written))) written++;
+
+  popTelemetryRecords(buffer, written);                                                                          // A reset in between replays some readings twice, ThingsBoard keeps one value per key and ts
+  return written;
+}
+// APPEND END ------------------------------------------------------------------------------------------------------------------------------------------------
+
+// REPLAY ----------------------------------------------------------------------------------------------------------------------------------------------------
+void telemetryLogClockSynced(TelemetryLog& log, int64_t deltaMs){
+  if(log.clockShiftMs == 0) log.clockShiftMs = deltaMs;
+}
+
+uint32_t loadTelemetryLog(const TelemetryLog& log, uint32_t fromSlot, TelemetryBuffer& batch, uint8_t& skipped, uint8_t maxRecords){
+  clearTelemetryBuffer(batch);
+  skipped = 0;
+  if(log.slots == 0) return 0;
+
+  uint32_t slot = fromSlot;
+  TelemetryLogEntry entry;
+  while(slot != log.writeSlot && batch.count < maxRecords && readEntry(slot, entry)){
+    slot = nextSlot(log, slot);
+    if(!entryValid(entry)) continue;                                                                             // Torn by a reset while appending
+
+    if(entry.record.timestampMs < VALID_EPOCH_MS){                                                               // Stamped before the first NTP sync of its power-on
+      if(entry.seq < log.sessionSeq){
+        skipped++;                                                                                               // That boot time is gone, it cannot be placed any more
+        continue;
+      }
+      entry.record.timestampMs += log.clockShiftMs;                                                              // Still 0 if NTP failed, as for the RTC batch
+    }
+    pushTelemetryRecord(batch, entry.record);
+  }
+  return slot;
+}
+
+void consumeTelemetryLog(TelemetryLog& log, uint32_t endSlot, uint8_t skipped){
+  if(log.slots == 0 || endSlot == log.readSlot) return;
+  writeMarker((endSlot + log.slots - 1) % log.slots, offsetof(TelemetryLogEntry, consumed));                     // One write per batch, the next power-on resumes after it
+  log.readSlot = endSlot;
+  log.dropped += skipped;
+}
+// REPLAY END ------------------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
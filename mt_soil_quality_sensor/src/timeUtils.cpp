@@ -0,0 +1,34 @@
+#include "timeUtils.h"
+#include "hal.h"
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+// CURRENT EPOCH TIME IN MS ----------------------------------------------------------------------------------------------------------------------------------
+uint64_t epochMs(){
+  return halEpochMs();                                                                                           // RTC timer on the ESP32, simulated clock on the host
+}
+
+bool clockIsValid(){
+  return epochMs() >= VALID_EPOCH_MS;
+}
+// CURRENT EPOCH TIME IN MS END ------------------------------------------------------------------------------------------------------------------------------
+
+#ifdef ARDUINO
+// SYNC CLOCK VIA SNTP ---------------------------------------------------------------------------------------------------------------------------------------
+bool syncClock(const char* ntpServer, uint32_t timeoutMs){
+  configTime(0, 0, ntpServer);                                                                                   // Starts SNTP in the background, it keeps correcting the RTC drift while awake
+
+  uint32_t start = millis();
+  while(!clockIsValid() && (millis() - start) < timeoutMs){                                                      // Only blocks when the clock has never been synced
+    delay(50);
+  }
+
+  return clockIsValid();
+}
+// SYNC CLOCK VIA SNTP END -----------------------------------------------------------------------------------------------------------------------------------
+#else
+bool syncClock(const char*, uint32_t){
+  return clockIsValid();                                                                                         // The simulated clock starts at the host time
+}
+#endif
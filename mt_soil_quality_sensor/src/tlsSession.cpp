@@ -0,0 +1,46 @@
+#include <string.h>
+#include "tlsSession.h"
+
+// RUNNING AVERAGE -------------------------------------------------------------------------------------------------------------------------------------------
+static uint32_t updateAverage(uint32_t average, uint32_t sample, uint32_t count){
+  if(count <= 1) return sample;                                                                                  // The first sample seeds the average
+  return (average * 7 + sample) / 8;
+}
+// RUNNING AVERAGE END ---------------------------------------------------------------------------------------------------------------------------------------
+
+// RECORD A SUCCESSFUL HANDSHAKE -----------------------------------------------------------------------------------------------------------------------------
+void recordTlsHandshake(TlsSessionStats& stats, bool resumed, uint32_t elapsedMs){
+  stats.lastHandshakeMs = elapsedMs;
+
+  if(resumed){
+    stats.resumedHandshakes++;
+    stats.resumedAvgMs = updateAverage(stats.resumedAvgMs, elapsedMs, stats.resumedHandshakes);
+
+    if(stats.fullHandshakes > 0 && stats.fullAvgMs > elapsedMs){                                                 // Saving only counts once a full handshake has been measured
+      stats.savedMs += stats.fullAvgMs - elapsedMs;
+    }
+  }else{
+    stats.fullHandshakes++;
+    stats.fullAvgMs = updateAverage(stats.fullAvgMs, elapsedMs, stats.fullHandshakes);
+  }
+}
+
+void recordTlsHandshakeFailure(TlsSessionStats& stats){
+  stats.failedHandshakes++;
+}
+// RECORD A SUCCESSFUL HANDSHAKE END -------------------------------------------------------------------------------------------------------------------------
+
+// RESUMPTION HIT RATE (%) -----------------------------------------------------------------------------------------------------------------------------------
+uint8_t tlsResumptionRate(const TlsSessionStats& stats){
+  uint32_t total = stats.fullHandshakes + stats.resumedHandshakes;
+  if(total == 0) return 0;
+  return (uint8_t)((stats.resumedHandshakes * 100ULL) / total);
+}
+// RESUMPTION HIT RATE END -----------------------------------------------------------------------------------------------------------------------------------
+
+
+// RESUMED OR FULL HANDSHAKE ---------------------------------------------------------------------------------------------------------------------------------
+bool tlsSessionResumed(const uint8_t* offeredMaster, const uint8_t* negotiatedMaster){
+  return offeredMaster != NULL && memcmp(offeredMaster, negotiatedMaster, TLS_MASTER_SECRET_LEN) == 0;           // A full handshake derives a new one. The session ID is no proof: a ticket is offered with a fresh ID
+}
+// RESUMED OR FULL HANDSHAKE END -----------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,253 @@
+// ===========================================================================================================================================================
+// LIBRARY INCLUSION
+// ===========================================================================================================================================================
+#include <Arduino.h>
+#include <mbedtls/platform.h>                                                                                    // mbedtls_free() for the peer certificate dropped before saving
+#include "tlsSessionClient.h"
+#include "macros.h"
+// LIBRARY INCLUSION END =====================================================================================================================================
+
+// ===========================================================================================================================================================
+// CONSTRUCTOR
+// ===========================================================================================================================================================
+SessionTLSClient::SessionTLSClient(Client& transport, TlsSessionCache& cache, TlsSessionStats& stats)
+  : transport(transport), cache(cache), stats(stats) {
+  mbedtls_ssl_init(&ssl);
+  mbedtls_ssl_config_init(&conf);
+  mbedtls_ctr_drbg_init(&drbg);
+  mbedtls_entropy_init(&entropy);
+  mbedtls_x509_crt_init(&caCert);
+}
+
+SessionTLSClient::~SessionTLSClient(){
+  stop();
+  mbedtls_x509_crt_free(&caCert);
+  mbedtls_entropy_free(&entropy);
+  mbedtls_ctr_drbg_free(&drbg);
+}
+
+void SessionTLSClient::setCACert(const char* rootCa){
+  this->rootCa = rootCa;
+}
+
+void SessionTLSClient::setHostname(const char* hostname){
+  this->hostname = hostname;
+}
+// CONSTRUCTOR END ===========================================================================================================================================
+
+// ===========================================================================================================================================================
+// BIO CALLBACKS
+// ===========================================================================================================================================================
+int SessionTLSClient::sendCallback(void* ctx, const unsigned char* buf, size_t len){
+  Client& transport = static_cast<SessionTLSClient*>(ctx)->transport;
+  if(!transport.connected()) return MBEDTLS_ERR_NET_CONN_RESET;
+
+  size_t written = transport.write(buf, len);
+  return written > 0 ? (int)written : MBEDTLS_ERR_SSL_WANT_WRITE;
+}
+
+int SessionTLSClient::recvCallback(void* ctx, unsigned char* buf, size_t len){
+  Client& transport = static_cast<SessionTLSClient*>(ctx)->transport;
+  if(!transport.available()){
+    return transport.connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+  }
+
+  int received = transport.read(buf, len);
+  return received > 0 ? received : MBEDTLS_ERR_SSL_WANT_READ;
+}
+// BIO CALLBACKS END =========================================================================================================================================
+
+// ===========================================================================================================================================================
+// CONNECTION
+// ===========================================================================================================================================================
+int SessionTLSClient::connect(IPAddress ip, uint16_t port){
+  stop();
+  if(!transport.connect(ip, port)) return 0;
+  return handshake();
+}
+
+int SessionTLSClient::connect(const char* host, uint16_t port){
+  if(hostname == NULL) hostname = host;
+
+  stop();
+  if(!transport.connect(host, port)) return 0;
+  return handshake();
+}
+
+// HANDSHAKE (RESUMED WHEN POSSIBLE) -------------------------------------------------------------------------------------------------------------------------
+int SessionTLSClient::handshake(){
+  uint32_t startMs = millis();
+
+  if(caCert.version == 0 && mbedtls_x509_crt_parse(&caCert, (const unsigned char*)rootCa, strlen(rootCa) + 1) != 0){
+    Debugln(F("TLS: invalid root CA"));
+    transport.stop();
+    return 0;
+  }
+
+  if(drbg.f_entropy == NULL){                                                                                    // Seeded once, the DRBG is reused by later reconnections
+    mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy, NULL, 0);                                       // No personalization string, the hardware entropy differs per device
+  }
+
+  mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+  mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+  mbedtls_ssl_conf_ca_chain(&conf, &caCert, NULL);
+  mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+  mbedtls_ssl_conf_session_tickets(&conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+
+  if(mbedtls_ssl_setup(&ssl, &conf) != 0 || mbedtls_ssl_set_hostname(&ssl, hostname) != 0){
+    freeContexts();
+    transport.stop();
+    return 0;
+  }
+  mbedtls_ssl_set_bio(&ssl, this, sendCallback, recvCallback, NULL);
+
+  uint8_t offeredMaster[TLS_MASTER_SECRET_LEN];
+  bool offered = false;
+  if(cache.len > 0 && cache.len <= TLS_SESSION_MAX_LEN){                                                         // Offer the session from the previous wake
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    offered = mbedtls_ssl_session_load(&session, cache.data, cache.len) == 0 && mbedtls_ssl_set_session(&ssl, &session) == 0;
+    if(offered) memcpy(offeredMaster, session.master, TLS_MASTER_SECRET_LEN);
+    mbedtls_ssl_session_free(&session);
+  }
+
+  int ret;
+  while((ret = mbedtls_ssl_handshake(&ssl)) != 0){
+    if(ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) break;
+    if(millis() - startMs > TLS_HANDSHAKE_TIMEOUT_MS) break;
+    delay(1);
+  }
+
+  if(ret != 0){
+    Debugf("TLS: handshake failed (-0x%04x)\n", -ret);
+    if(offered) cache.len = 0;                                                                                   // Do not offer a session that may be the cause again
+    recordTlsHandshakeFailure(stats);
+    freeContexts();
+    transport.stop();
+    return 0;
+  }
+  uint32_t elapsedMs = millis() - startMs;
+
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+  bool resumed = false;
+  if(mbedtls_ssl_get_session(&ssl, &session) == 0){
+    resumed = tlsSessionResumed(offered ? offeredMaster : NULL, session.master);
+    saveSession(session);
+  }else{
+    cache.len = 0;
+  }
+  mbedtls_ssl_session_free(&session);
+
+  recordTlsHandshake(stats, resumed, elapsedMs);
+  Debugf("TLS: %s handshake in %lu ms\n", resumed ? "resumed" : "full", (unsigned long)elapsedMs);
+  secured = true;
+  return 1;
+}
+
+// STORE THE SESSION FOR THE NEXT WAKE -----------------------------------------------------------------------------------------------------------------------
+void SessionTLSClient::saveSession(mbedtls_ssl_session& session){
+#if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+  if(session.peer_cert != NULL){                                                                                 // Verified on the full handshake and not needed to resume, most of the 2 KB it would take
+    mbedtls_x509_crt_free(session.peer_cert);
+    mbedtls_free(session.peer_cert);
+    session.peer_cert = NULL;
+  }
+#endif
+  size_t len = 0;
+  if(mbedtls_ssl_session_save(&session, cache.data, TLS_SESSION_MAX_LEN, &len) == 0){
+    cache.len = len;
+  }else{
+    cache.len = 0;                                                                                               // Ticket too big for the RTC cache: next wake does a full handshake
+  }
+}
+
+void SessionTLSClient::freeContexts(){
+  mbedtls_ssl_free(&ssl);
+  mbedtls_ssl_config_free(&conf);
+  mbedtls_ssl_init(&ssl);
+  mbedtls_ssl_config_init(&conf);
+}
+
+void SessionTLSClient::stop(){
+  if(secured){
+    mbedtls_ssl_close_notify(&ssl);
+    secured = false;
+  }
+  peeked = -1;
+  freeContexts();
+  transport.stop();
+}
+
+uint8_t SessionTLSClient::connected(){
+  return secured && transport.connected();
+}
+// CONNECTION END ============================================================================================================================================
+
+// ===========================================================================================================================================================
+// DATA
+// ===========================================================================================================================================================
+size_t SessionTLSClient::write(uint8_t b){
+  return write(&b, 1);
+}
+
+size_t SessionTLSClient::write(const uint8_t* buf, size_t size){
+  if(!secured) return 0;
+
+  size_t sent = 0;
+  while(sent < size){
+    int ret = mbedtls_ssl_write(&ssl, buf + sent, size - sent);
+    if(ret > 0){
+      sent += ret;
+    }else if(ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE){
+      stop();
+      break;
+    }
+  }
+  return sent;
+}
+
+int SessionTLSClient::available(){
+  if(!secured) return 0;
+
+  int ret = mbedtls_ssl_read(&ssl, NULL, 0);                                                                     // Processes any pending record so the byte count is up to date
+  if(ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE){
+    stop();
+    return 0;
+  }
+  return mbedtls_ssl_get_bytes_avail(&ssl) + (peeked >= 0 ? 1 : 0);
+}
+
+int SessionTLSClient::read(){
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int SessionTLSClient::read(uint8_t* buf, size_t size){
+  if(!secured || size == 0) return -1;
+
+  size_t offset = 0;
+  if(peeked >= 0){
+    buf[offset++] = (uint8_t)peeked;
+    peeked = -1;
+    if(offset == size) return offset;
+  }
+
+  int ret = mbedtls_ssl_read(&ssl, buf + offset, size - offset);
+  if(ret > 0) return offset + ret;
+  if(ret == 0 || (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)) stop();
+  return offset > 0 ? (int)offset : -1;
+}
+
+int SessionTLSClient::peek(){
+  if(peeked < 0 && available() > 0){
+    uint8_t b;
+    if(mbedtls_ssl_read(&ssl, &b, 1) == 1) peeked = b;
+  }
+  return peeked;
+}
+
+void SessionTLSClient::flush(){
+  transport.flush();
+}
+// DATA END ==================================================================================================================================================
@@ -0,0 +1,119 @@
+#include <string.h>
+#include "uplink.h"
+#include "hal.h"
+#include "macros.h"
+
+// HELPERS ---------------------------------------------------------------------------------------------------------------------------------------------------
+static size_t encodeBatch(const TelemetryBuffer& buffer, int treeId, uint8_t* payload, size_t payloadSize, const char*& topic){
+#if TELEMETRY_BINARY
+  topic = MQTT_TOPIC_PUB_BINARY;
+  return encodeTelemetryBatch(buffer, treeId, payload, payloadSize);                                             // Same readings as the JSON array in a fraction of the bytes
+#else
+  topic = MQTT_TOPIC_PUB;
+  return serializeTelemetryBatch(buffer, treeId, (char*)payload, payloadSize);                                   // ThingsBoard timestamped array
+#endif
+}
+
+static bool send(Uplink& up, const char* topic, const uint8_t* payload, size_t len, UplinkMessage& message){
+  if(up.nextPacketId == 0) up.nextPacketId = 1;                                                                  // 0 is not a valid packet identifier
+  message.packetId = up.nextPacketId++;
+  message.sentMs = halMillis();
+  if(!halMqttPublishQos1(topic, payload, len, message.packetId)) return false;
+  up.inflight[up.count++] = message;
+  return true;
+}
+
+static void markAcked(Uplink& up, uint16_t packetId){
+  for(uint8_t i = 0; i < up.count; i++){
+    if(!up.inflight[i].acked && up.inflight[i].packetId == packetId){
+      up.inflight[i].acked = true;
+      return;
+    }
+  }
+}
+
+static void release(Uplink& up, WakeState& state, TelemetryLog& log){
+  uint8_t done = 0;
+  for(; done < up.count && up.inflight[done].acked; done++){                                                     // Brokers acknowledge in order, a gap waits for its PUBACK
+    const UplinkMessage& message = up.inflight[done];
+    if(message.live){
+      clearTelemetryBuffer(state.buffer);
+      up.liveAcked = true;
+    }else{
+      consumeTelemetryLog(log, message.endSlot, message.skipped);
+    }
+    if(message.packetId != 0) up.messagesAcked++;
+    up.readingsAcked += message.readings;
+  }
+  up.count -= done;
+  memmove(up.inflight, up.inflight + done, up.count * sizeof(UplinkMessage));
+}
+// HELPERS END -----------------------------------------------------------------------------------------------------------------------------------------------
+
+// WINDOW ----------------------------------------------------------------------------------------------------------------------------------------------------
+void uplinkBegin(Uplink& up, uint8_t window){
+  memset(&up, 0, sizeof(up));
+  up.window = window < 1 ? 1 : (window > UPLINK_WINDOW_MAX ? UPLINK_WINDOW_MAX : window);
+  up.nextPacketId = 1;
+}
+
+void uplinkRewind(Uplink& up, const TelemetryLog& log){
+  if(up.count > 0) up.rewinds++;
+  up.count = 0;
+  up.sendSlot = log.readSlot;                                                                                    // Not acknowledged means still in flash
+  up.liveSent = up.liveAcked;
+}
+
+bool uplinkIdle(const Uplink& up){
+  return up.count == 0;
+}
+
+UplinkStatus uplinkPump(Uplink& up, WakeState& state, TelemetryLog& log, TelemetryBuffer& batch, int treeId, uint8_t* payload, size_t payloadSize,
+                        bool drainLog){
+  const char* topic;
+
+  if(!up.liveSent && state.buffer.count == 0){
+    up.liveSent = true;                                                                                          // Nothing taken since the last flush (e.g. a second pass through SERVE)
+    up.liveAcked = true;
+  }else if(!up.liveSent){
+    UplinkMessage message = {};
+    message.live = true;
+    message.readings = state.buffer.count;
+    size_t len = encodeBatch(state.buffer, treeId, payload, payloadSize, topic);
+    if(len == 0 || !send(up, topic, payload, len, message)) return UPLINK_FAILED;
+    up.liveSent = true;
+  }
+
+  while(drainLog && up.count < up.window && up.sendSlot != log.writeSlot){                                       // Pipelined behind the RTC batch, one round trip for the whole window
+    UplinkMessage message = {};
+    message.endSlot = loadTelemetryLog(log, up.sendSlot, batch, message.skipped);
+    if(message.endSlot == up.sendSlot) return UPLINK_FAILED;                                                     // Flash read error
+    up.sendSlot = message.endSlot;
+    message.readings = batch.count;
+
+    if(batch.count == 0){
+      message.acked = true;                                                                                      // Only torn or unplaceable slots, released in order like the rest
+      up.inflight[up.count++] = message;
+      continue;
+    }
+    size_t len = encodeBatch(batch, treeId, payload, payloadSize, topic);
+    if(len == 0 || !send(up, topic, payload, len, message)) return UPLINK_FAILED;
+  }
+
+  bool moreToSend = drainLog && up.sendSlot != log.writeSlot;
+  int32_t ack = HAL_MQTT_NO_ACK;
+  if(up.count > 0){
+    ack = halMqttPollAck(up.count < up.window && moreToSend ? 0 : UPLINK_POLL_MS);                               // Only block with a full window or nothing left to send
+    while(ack >= 0){
+      markAcked(up, (uint16_t)ack);
+      ack = halMqttPollAck(0);
+    }
+  }
+  release(up, state, log);
+
+  if(ack == HAL_MQTT_LOST) return UPLINK_FAILED;
+  if(up.count > 0 && halMillis() - up.inflight[0].sentMs >= MQTT_ACK_TIMEOUT_MS) return UPLINK_FAILED;
+  if(up.liveAcked && up.count == 0 && !moreToSend) return UPLINK_DONE;
+  return UPLINK_BUSY;
+}
+// WINDOW END ------------------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include <math.h>
+#include <string.h>
+#include "wakeCycle.h"
+#include "hal.h"
+#include "macros.h"
+
+// ADAPTIVE ACQUISITION (RESOLUTION AND SAMPLES FROM THE RECENT VARIANCE AND TREND) --------------------------------------------------------------------------
+AcquisitionPlan planWakeTemperature(const WakeState& state, const DeviceConfig& config){
+  const AcquisitionLimits temperatureLimits = {
+    TEMPERATURE_QUIET_STDDEV_C, TEMPERATURE_NOISY_STDDEV_C, TEMPERATURE_QUIET_TREND_C, TEMPERATURE_NOISY_TREND_C,
+    (uint8_t)config.tempMinSamples, (uint8_t)config.tempMaxSamples
+  };
+  AcquisitionPlan plan = planAcquisition(state.temperatureHistory, temperatureLimits);
+  if(plan.resolutionBits > config.tempMaxBits) plan.resolutionBits = config.tempMaxBits;                         // 750 ms per conversion at 12 bits, the fleet may trade it for battery
+  return plan;
+}
+
+uint8_t planWakeMoistureSamples(const WakeState& state, const DeviceConfig& config){
+  const AcquisitionLimits moistureLimits = {
+    MOISTURE_QUIET_STDDEV, MOISTURE_NOISY_STDDEV, MOISTURE_QUIET_TREND, MOISTURE_NOISY_TREND,
+    (uint8_t)config.moistMinSamples, (uint8_t)config.moistMaxSamples
+  };
+  return planAcquisition(state.moistureHistory, moistureLimits).samples;
+}
+// ADAPTIVE ACQUISITION END ----------------------------------------------------------------------------------------------------------------------------------
+
+// STORE THE READING OF THIS WAKE AND PLAN THE NEXT SLEEP ----------------------------------------------------------------------------------------------------
+SleepPlan storeWakeReading(WakeState& state, const DeviceConfig& config, uint64_t timestampMs, const float* rawTemps, float soilMoist, float batVolt){
+  float soilTemps[PROBE_MAX_COUNT];
+  for(uint8_t slot = 0; slot < PROBE_MAX_COUNT; slot++){
+    soilTemps[slot] = rawTemps[slot];
+    if(isnan(rawTemps[slot]) || rawTemps[slot] == HAL_PROBE_DISCONNECTED_C) continue;                            // Unused slot or silent probe, reported as is
+    soilTemps[slot] = state.temperatureFilters[slot].update(rawTemps[slot], OUTLIER_K, TEMPERATURE_OUTLIER_MIN_SIGMA_C);
+  }
+
+  recordAcquisition(state.temperatureHistory, soilTemps[0]);                                                     // The shallowest probe moves the most, it drives the adaptive acquisition
+  recordAcquisition(state.moistureHistory, soilMoist);
+  if(timestampMs < state.batteryRecordedMs || timestampMs - state.batteryRecordedMs >= BATTERY_TREND_PERIOD_S * 1000ULL){
+    recordAcquisition(state.batteryHistory, batVolt);                                                            // Spaced out, the radio sag would swamp a per-wake trend
+    state.batteryRecordedMs = timestampMs;
+  }
+
+  SleepInputs inputs;
+  inputs.batteryVolts = batVolt;
+  inputs.batteryTrendVph = historyTrend(state.batteryHistory) * 3600.0f / BATTERY_TREND_PERIOD_S;
+  inputs.temperatureTrendC = historyTrend(state.temperatureHistory);
+  inputs.moistureTrend = historyTrend(state.moistureHistory);
+  inputs.lastSleepS = state.sleepS;
+  inputs.epochMs = timestampMs;
+  const SleepLimits sleepLimits = {
+    config.sleepMinS, config.sleepMaxS, SLEEP_FAST_TEMPERATURE_CPH, SLEEP_FAST_MOISTURE_PPH, SLEEP_LOW_SOC, SLEEP_LOW_SOC_STRETCH, SLEEP_CRITICAL_SOC,
+    SLEEP_DRAIN_VPH, SLEEP_NIGHT_STRETCH, SLEEP_NIGHT_START_H, SLEEP_NIGHT_END_H, SLEEP_UTC_OFFSET_H
+  };
+  SleepPlan sleep = planSleep(inputs, sleepLimits);
+  state.sleepS = sleep.seconds;
+
+  TelemetryRecord record;
+  record.timestampMs = timestampMs;
+  record.bootCnt = state.bootCount;
+  memcpy(record.soilTemp, soilTemps, sizeof(record.soilTemp));
+  record.soilMoist = soilMoist;
+  record.batVolt = batVolt;
+  record.sleepS = sleep.seconds;
+
+  pushTelemetryRecord(state.buffer, record);
+  state.bootCount++;
+  return sleep;
+}
+uint32_t temperatureOutliers(const WakeState& state){
+  uint32_t rejected = 0;
+  for(uint8_t slot = 0; slot < PROBE_MAX_COUNT; slot++) rejected += state.temperatureFilters[slot].rejected;
+  return rejected;
+}
+// STORE THE READING END -------------------------------------------------------------------------------------------------------------------------------------
+
+// STORE AND FORWARD THROUGH THE FLASH LOG -------------------------------------------------------------------------------------------------------------------
+uint8_t spillWakeBatch(WakeState& state, TelemetryLog& log, bool linkFailed){
+  if(!linkFailed && state.buffer.count < TELEMETRY_BUFFER_CAPACITY) return 0;                                    // Flash writes only when a reading would be lost otherwise
+  return spillTelemetryBuffer(log, state.buffer);
+}
+// STORE AND FORWARD END -------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
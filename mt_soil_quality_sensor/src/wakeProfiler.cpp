@@ -0,0 +1,84 @@
+#include <math.h>
+#include <string.h>
+#include "wakeProfiler.h"
+#include "hal.h"
+#include "macros.h"
+#include "telemetryReport.h"
+
+// CHARGE INTEGRATION ----------------------------------------------------------------------------------------------------------------------------------------
+#define US_PER_HOUR 3.6e9f
+
+static float sampleCharge(WakeProfiler& profiler){                                                               // Trapezoid between phase boundaries, returns the running charge
+  uint64_t nowUs = halMicros();
+  float mA = halBatteryCurrentmA();
+  if(isnan(mA)) return profiler.chargemAh;                                                                       // PMU not up yet
+
+  float avgmA = profiler.currentValid ? (profiler.lastmA + mA) / 2.0f : mA;
+  profiler.chargemAh += avgmA * (float)(nowUs - profiler.lastSampleUs) / US_PER_HOUR;
+  if(!profiler.currentValid){
+    profiler.current.phasemAh[PHASE_BOOT] = mA * profiler.current.phaseUs[PHASE_BOOT] / US_PER_HOUR;             // Nothing can be measured before setup(), the first reading is the best estimate
+  }
+  profiler.lastSampleUs = nowUs;
+  profiler.lastmA = mA;
+  profiler.currentValid = true;
+  return profiler.chargemAh;
+}
+// CHARGE INTEGRATION END ------------------------------------------------------------------------------------------------------------------------------------
+
+// PHASE TIMING ----------------------------------------------------------------------------------------------------------------------------------------------
+void profileBegin(WakeProfiler& profiler){
+  memset(&profiler, 0, sizeof(profiler));
+  profiler.current.phaseUs[PHASE_BOOT] = (uint32_t)halMicros();                                                  // The timer starts at reset, so this is the boot time
+  profiler.lastSampleUs = profiler.current.phaseUs[PHASE_BOOT];
+  sampleCharge(profiler);
+}
+
+void profileStart(WakeProfiler& profiler, WakePhase phase){
+  if(profiler.startUs[phase] != 0) return;                                                                       // Already running: a retry keeps the original start
+  profiler.startUs[phase] = halMicros();
+  profiler.startmAh[phase] = sampleCharge(profiler);
+}
+
+void profileEnd(WakeProfiler& profiler, WakePhase phase){
+  if(profiler.startUs[phase] == 0) return;                                                                       // Never started
+  profiler.current.phaseUs[phase] += (uint32_t)(halMicros() - profiler.startUs[phase]);
+  profiler.current.phasemAh[phase] += sampleCharge(profiler) - profiler.startmAh[phase];
+  profiler.startUs[phase] = 0;
+}
+
+void profileFinish(WakeProfiler& profiler, WakeProfileHistory& history, bool flushed){
+  profiler.current.totalUs = (uint32_t)halMicros();
+  profiler.current.totalmAh = sampleCharge(profiler) + profiler.current.phasemAh[PHASE_BOOT];
+
+  if(flushed){
+    history.lastFlush = profiler.current;
+    history.flushes++;
+    history.valid = true;
+  }else{
+    history.lastQuietUs = profiler.current.totalUs;
+    history.lastQuietmAh = profiler.current.totalmAh;
+  }
+}
+// PHASE TIMING END ------------------------------------------------------------------------------------------------------------------------------------------
+
+// SAMPLED PUBLISHING OF THE PREVIOUS BREAKDOWN --------------------------------------------------------------------------------------------------------------
+bool profilePublishDue(const WakeProfileHistory& history, uint16_t every){
+  return every > 0 && history.valid && (history.flushes % every) == 0;                                           // 0 disables it, 1 publishes on every flush
+}
+
+size_t serializeWakeProfile(const WakeProfileHistory& history, char* out, size_t outSize){
+  const WakeProfile& p = history.lastFlush;
+  const TelemetryValue values[] = {                                                                              // Same order as WAKE_PROFILE_FIELDS
+    p.phaseUs[PHASE_BOOT] / 1000.0f, p.phaseUs[PHASE_POWER] / 1000.0f, p.phaseUs[PHASE_SENSORS] / 1000.0f,
+    p.phaseUs[PHASE_SAMPLING] / 1000.0f, p.phaseUs[PHASE_WIFI] / 1000.0f, p.phaseUs[PHASE_OTA] / 1000.0f,
+    p.phaseUs[PHASE_MQTT] / 1000.0f, p.phaseUs[PHASE_PUBLISH] / 1000.0f,
+    p.totalUs / 1000.0f, history.lastQuietUs / 1000.0f,
+  };
+  return serializeTelemetry(out, outSize, WAKE_PROFILE_FIELDS, values);
+}
+
+bool publishWakeProfile(const WakeProfileHistory& history){
+  char profileStr[WAKE_PROFILE_MAX_LEN];
+  return publishReport(MQTT_TOPIC_PUB, profileStr, serializeWakeProfile(history, profileStr, sizeof(profileStr)));// Best effort, the readings have already been delivered
+}
+// SAMPLED PUBLISHING END ------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,253 @@
+#include <string.h>
+#include "wakeRunner.h"
+#include "hal.h"
+#include "timeUtils.h"
+#include "macros.h"
+
+static void report(WakeRunner& run, WakeNote note, uint32_t detail = 0){
+  if(run.hooks->report) run.hooks->report(run, note, detail);
+}
+
+// START OF THE WAKE -----------------------------------------------------------------------------------------------------------------------------------------
+void wakeBegin(WakeRunner& run, WakeRetained& kept, const DeviceIdentity& identity, const WakeHooks& hooks){
+  memset(&run, 0, sizeof(run));
+  run.kept = &kept;
+  run.identity = &identity;
+  run.hooks = &hooks;
+  profileBegin(run.profiler);                                                                                    // Boot time so far, every phase is timed against the same reset-based clock
+}
+
+AcquisitionPlan wakePlanAcquisition(WakeRunner& run){
+  WakeRetained& kept = *run.kept;
+  run.readingTimestampMs = epochMs();
+  run.temperaturePlan = planWakeTemperature(kept.wake, kept.config);                                             // Cheap acquisition while the soil is stable, full one when it is noisy or changing
+  run.moistureSamples = planWakeMoistureSamples(kept.wake, kept.config);
+  halTemperatureResolution(run.temperaturePlan.resolutionBits);
+  return run.temperaturePlan;
+}
+
+WakeKind wakeDecide(WakeRunner& run){
+  WakeRetained& kept = *run.kept;
+  bool maintenanceDue = maintenanceRadioDue(kept.maintenance);
+  if(run.identity->loraUplink && !run.forceFlush && !maintenanceDue){                                            // A LoRa node still joins Wi-Fi for a PEK press or a trial image, e.g. a technician's hotspot
+    run.kind = WAKE_LORA;
+  }else if(run.forceFlush || maintenanceDue ||
+           (telemetryFlushDue(kept.wake.buffer, epochMs(), kept.config.batchDepth, BATCH_MAX_AGE_S, 1) &&        // The reading of this wake counts, it is stored before the flush
+            linkRadioDue(kept.linkStats))){                                                                      // ...and not right after wakes that could not reach the broker
+    run.kind = WAKE_RADIO;
+  }else{
+    run.kind = WAKE_QUIET;
+  }
+  return run.kind;
+}
+// START OF THE WAKE END -------------------------------------------------------------------------------------------------------------------------------------
+
+// STORE THE READING -----------------------------------------------------------------------------------------------------------------------------------------
+void wakeStoreReading(WakeRunner& run){
+  if(run.readingStored) return;                                                                                  // The radio loop may get here again after a reconnect
+  WakeRetained& kept = *run.kept;
+
+  run.hooks->acquire(run, run.lastTemperaturesC, run.lastMoisturePercent);
+  probeBusReport(kept.probeBus, run.lastTemperaturesC);                                                          // A probe that stays silent gets the bus searched again
+  profileEnd(run.profiler, PHASE_SAMPLING);
+  halSensorPower(false);                                                                                         // Turn off the sensors after measurements have been taken
+
+  float batVolt = halBatteryVoltage();
+  storeWakeReading(kept.wake, kept.config, run.readingTimestampMs, run.lastTemperaturesC, run.lastMoisturePercent, batVolt);
+  updateEnergyLedger(kept.energyLedger, halBatteryDrawnmAh(), epochMs(), batVolt);
+  run.readingStored = true;
+  report(run, WAKE_READING);
+}
+// STORE THE READING END -------------------------------------------------------------------------------------------------------------------------------------
+
+// SHARED ATTRIBUTES -----------------------------------------------------------------------------------------------------------------------------------------
+void wakeHandleAttributes(WakeRunner& run, const char* topic, const uint8_t* payload, size_t len){
+  WakeRetained& kept = *run.kept;
+  uint8_t message[DEVICE_CONFIG_MESSAGE_MAX_LEN];                                                                // payload is in the MQTT client buffer, a request sent by the first handler overwrites it
+  if(len >= sizeof(message)) return;                                                                             // Too long for every handler
+  memcpy(message, payload, len);
+  ConfigResult result = handleDeviceConfigMessage(kept.config, run.configSync, topic, message, len, halMillis(), &run.badKey);
+  if(result != CONFIG_IGNORED) report(run, WAKE_CONFIG, result);
+  if(handleOtaAttributes(kept.otaPull, message, len)) report(run, WAKE_FIRMWARE_OFFERED, kept.otaPull.offeredVersion);
+  if(handleMaintenanceAttributes(kept.maintenance, message, len)) report(run, WAKE_MAINTENANCE_REQUESTED);
+}
+// SHARED ATTRIBUTES END -------------------------------------------------------------------------------------------------------------------------------------
+
+// WAKES WITHOUT WI-FI ---------------------------------------------------------------------------------------------------------------------------------------
+static void spillAndSleep(WakeRunner& run, bool flushed){
+  WakeRetained& kept = *run.kept;
+  uint8_t spilled = spillWakeBatch(kept.wake, kept.log, false);                                                  // Skipped radio wakes after an outage fill the RTC ring
+  if(spilled > 0) report(run, WAKE_SPILLED, spilled);
+  profileFinish(run.profiler, kept.profileHistory, flushed);
+  halDeepSleep(kept.wake.sleepS);
+}
+
+void runQuietWake(WakeRunner& run){
+  wakeStoreReading(run);
+  spillAndSleep(run, false);
+}
+
+void runLoraWake(WakeRunner& run){
+  WakeRetained& kept = *run.kept;
+  loraUplinkBegin(kept.lora);
+  wakeStoreReading(run);
+  LoraStatus status = LORA_IDLE;
+  if(loraFlushDue(kept.lora, kept.wake, kept.log, kept.config.batchDepth, epochMs())){                           // Radio powered for this frame only, a few hundred ms
+    profileStart(run.profiler, PHASE_PUBLISH);
+    status = loraUplinkSend(kept.lora, kept.wake, kept.log, run.logBatch, *run.identity, kept.config.batchDepth, epochMs());
+    profileEnd(run.profiler, PHASE_PUBLISH);
+  }
+  report(run, WAKE_LORA_SENT, status);
+  spillAndSleep(run, status == LORA_SENT);
+}
+// WAKES WITHOUT WI-FI END -----------------------------------------------------------------------------------------------------------------------------------
+
+// RADIO WAKE ------------------------------------------------------------------------------------------------------------------------------------------------
+static void syncClockAndTimestamps(WakeRunner& run){
+  uint64_t beforeSyncMs = epochMs();
+  uint32_t startMs = halMillis();
+
+  if(syncClock(NTP_SERVER, NTP_SYNC_TIMEOUT_MS) && beforeSyncMs < VALID_EPOCH_MS){                               // First sync since power-on: move the readings taken so far
+    int64_t deltaMs = (int64_t)(epochMs() - beforeSyncMs) - (int64_t)(halMillis() - startMs);
+    shiftUnsyncedTimestamps(run.kept->wake.buffer, deltaMs);
+    telemetryLogClockSynced(run.kept->log, deltaMs);                                                             // Those already in flash are fixed when replayed
+  }
+}
+
+static void serveMaintenance(WakeRunner& run){
+  WakeRetained& kept = *run.kept;
+  if(!maintenanceRadioDue(kept.maintenance) && !run.maintenanceWindow.open) return;                              // The usual case: no mDNS, no UDP listener, no PMU reads
+
+  const WakeHooks& hooks = *run.hooks;
+  float batteryVolts = halBatteryVoltage();
+  float vbusVolts = halVbusVoltage();
+  uint16_t refused = kept.maintenance.refused;
+  bool wasOpen = run.maintenanceWindow.open;
+  if(openMaintenance(kept.maintenance, run.maintenanceWindow, batteryVolts, vbusVolts, halMillis())){
+    profileStart(run.profiler, PHASE_OTA);
+    if(hooks.maintenanceOpen) hooks.maintenanceOpen();                                                           // Only the wakes that need them pay for the services
+    profileEnd(run.profiler, PHASE_OTA);
+  }
+  bool active = maintenanceActive(kept.maintenance, run.maintenanceWindow, batteryVolts, vbusVolts, halMillis());
+  if(active && hooks.maintenanceServe) hooks.maintenanceServe();                                                 // Blocks for the whole transfer once an upload starts
+  if(wasOpen && !active){
+    if(hooks.maintenanceClose) hooks.maintenanceClose();
+    publishMaintenance(kept.maintenance);                                                                        // maintOpenS, while the broker is still connected
+  }
+
+  if(!wasOpen && active) report(run, WAKE_MAINTENANCE_OPENED);
+  if(wasOpen && !active) report(run, WAKE_MAINTENANCE_CLOSED, kept.maintenance.lastOpenS);
+  if(kept.maintenance.refused != refused) report(run, WAKE_MAINTENANCE_REFUSED);
+}
+
+static void publishAfterFlush(WakeRunner& run){                                                                  // Once per wake, right after the live batch was acknowledged
+  WakeRetained& kept = *run.kept;
+  if(run.trialBoot){
+    otaPullConfirm(kept.otaPull);                                                                                // This image can reach the broker: keep it
+    run.trialBoot = false;
+    report(run, WAKE_TRIAL_CONFIRMED, kept.otaPull.runningVersion);
+  }
+  if(run.hooks->publishStats) run.hooks->publishStats(run);                                                      // Connection counters go in their own frames, once per flush
+  publishLinkFailures(kept.linkStats);
+  publishOtaStatus(kept.otaPull);                                                                                // fwOffered/fwProgress while an update is open, once more when it ends
+  publishMaintenance(kept.maintenance);                                                                          // Report left over from a window that closed without the broker
+  if(profilePublishDue(kept.profileHistory, WAKE_PROFILE_EVERY)){
+    publishWakeProfile(kept.profileHistory);                                                                     // Breakdown of the previous flush, this one is only complete right before sleeping
+    publishWakeEnergy(kept.profileHistory, kept.energyLedger, kept.config.batchDepth * kept.wake.sleepS);
+    publishMoisturePower(kept.moisturePowerStats, kept.wake.sleepS);                                             // Probe on-time, duty cycle and its share of the average current
+  }
+  profileEnd(run.profiler, PHASE_PUBLISH);
+  profileFinish(run.profiler, kept.profileHistory, true);
+}
+
+static void pullFirmware(WakeRunner& run){
+  WakeRetained& kept = *run.kept;
+  halMqttDisconnect();                                                                                           // Frees the MQTT TLS session before the download opens its own
+  OtaStatus status = otaPullStep(kept.otaPull, OTA_WAKE_BUDGET_MS, OTA_BYTES_PER_WAKE);
+  if(status != OTA_IDLE) report(run, WAKE_FIRMWARE, status);
+  if(status == OTA_READY && run.hooks->restart) run.hooks->restart();                                            // Readings already acked, nothing in RTC memory is waiting on this wake
+}
+
+void runRadioWake(WakeRunner& run, uint32_t linkSeed){
+  WakeRetained& kept = *run.kept;
+  const WakeHooks& hooks = *run.hooks;
+  LinkEvent event = LINK_TICK;
+  bool flushStarted = false;
+  bool published = false;
+  uint32_t drainStartMs = 0;
+
+  linkBegin(run.link, halMillis(), LINK_WAKE_BUDGET_MS, linkSeed);                                               // Bounds the radio part of this wake
+  uplinkBegin(run.uplink, MQTT_INFLIGHT_WINDOW);
+  while(true){
+    switch(linkStep(run.link, kept.linkStats, event, halMillis())){                                              // Retries, backoff and the wake budget live in linkFsm
+      case LINK_DO_JOIN:
+        profileStart(run.profiler, PHASE_WIFI);
+        event = hooks.join(run, linkAttemptMs(run.link, halMillis(), WIFI_CONNECT_TIMEOUT_MS)) ? LINK_WIFI_UP : LINK_WIFI_FAILED;
+        profileEnd(run.profiler, PHASE_WIFI);
+        break;
+
+      case LINK_DO_CONNECT:
+        profileStart(run.profiler, PHASE_MQTT);
+        event = hooks.connect(run) ? LINK_MQTT_UP : LINK_MQTT_FAILED;
+        profileEnd(run.profiler, PHASE_MQTT);
+        if(event == LINK_MQTT_UP){
+          uplinkRewind(run.uplink, kept.log);                                                                    // Clean session: what was in flight on the previous connection goes again
+          requestDeviceConfig(run.configSync, halMillis(), OTA_ATTRIBUTE_KEYS "," MAINTENANCE_ATTRIBUTE_KEY);    // Subscriptions are gone too. The response comes back with the PUBACKs
+        }
+        break;
+
+      case LINK_DO_WAIT:
+        halDelayMs(linkWaitMs(run.link, halMillis()));                                                           // Backoff, nothing to poll meanwhile
+        event = LINK_TICK;
+        break;
+
+      case LINK_DO_SERVE:{
+        serveMaintenance(run);                                                                                   // Opens, serves and closes the maintenance window, nothing at all on most wakes
+        if(uplinkIdle(run.uplink)) halMqttLoop();                                                                // Keepalive and attributes. While QoS 1 messages are in flight halMqttPollAck() does it
+        event = LINK_TICK;
+
+        if(!flushStarted){
+          wakeStoreReading(run);                                                                                 // On the ESP32 the conversions ran during the join and the TLS handshake
+          profileStart(run.profiler, PHASE_PUBLISH);
+          syncClockAndTimestamps(run);                                                                           // Readings taken before the first NTP sync are stamped relative to boot
+          drainStartMs = halMillis();
+          flushStarted = true;
+        }
+
+        UplinkStatus status = uplinkPump(run.uplink, kept.wake, kept.log, run.logBatch, run.identity->treeId, run.payload, sizeof(run.payload),
+                                         halMillis() - drainStartMs < TELEMETRY_LOG_DRAIN_MS);                   // RTC batch first, then the flash backlog, up to MQTT_INFLIGHT_WINDOW messages in flight
+        if(status == UPLINK_FAILED){
+          report(run, WAKE_PUBLISH_FAILED);
+          halMqttDisconnect();
+          event = LINK_MQTT_LOST;                                                                                // Reconnect after a backoff and send again whatever was not acknowledged
+        }else if(run.uplink.liveAcked && !published){
+          report(run, WAKE_ACKED);
+          publishAfterFlush(run);
+          published = true;
+        }
+        publishDeviceConfig(kept.config, run.configSync);                                                        // cfgApplied/cfgRejected once a new set was handled
+
+        if(status == UPLINK_DONE && !deviceConfigPending(run.configSync, halMillis()) &&
+           !run.maintenanceWindow.open && !maintenanceRadioDue(kept.maintenance)){                               // Everything acknowledged, backlog drained (or out of time), settings answered and no maintenance window
+          if(otaPullDue(kept.otaPull, halBatteryVoltage())) pullFirmware(run);                                   // Last thing before sleeping, restarts on a verified image
+          report(run, WAKE_FLUSHED);
+          halDeepSleep(kept.wake.sleepS);                                                                        // Interval planned by wakeStoreReading() from the battery and the soil dynamics
+          return;
+        }
+
+        if(uplinkIdle(run.uplink)) halDelayMs(WAKE_SERVE_TICK_MS);                                               // Otherwise uplinkPump() already waited for the PUBACKs
+        if(event == LINK_TICK && !halNetworkConnected()) event = LINK_WIFI_LOST;
+        else if(event == LINK_TICK && !halMqttConnected()) event = LINK_MQTT_LOST;
+        break;
+      }
+
+      case LINK_DO_SLEEP:
+        wakeStoreReading(run);
+        report(run, WAKE_BUDGET_SPENT, spillWakeBatch(kept.wake, kept.log, true));
+        profileFinish(run.profiler, kept.profileHistory, false);                                                 // The overrun is what the quiet wake figures should show
+        halDeepSleep(kept.wake.sleepS);
+        return;
+    }
+  }
+}
+// RADIO WAKE END --------------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -1,84 +1,118 @@
 #include <Arduino.h>
 #include <WiFi.h>                                                                                                // Library to connect to Wi-Fi
-#include <axp20x.h>
 #include "wifiUtils.h"
+#include "timeUtils.h"
 #include "macros.h"
 
-// Connect to Wi-Fi during setup ---------------------------------------------------------------------------------------------------------------------------
-void connectToWiFi(bool stateLED, AXP20X_Class& axp192, const char* ssid, const char* password, const uint8_t ledPin, const uint8_t pmuIRQPin) {
-  pinMode(ledPin, OUTPUT);
-  digitalWrite(ledPin, stateLED);
-  
-  Debug(F("Connecting to WIFI SSID "));
-  Debugln(ssid);
+#define WIFI_GOT_IP_BIT BIT0
+#define WIFI_DISCONNECTED_BIT BIT1
 
-  WiFi.mode(WIFI_STA);
-  WiFi.disconnect();
-  delay(100);
-  WiFi.begin(ssid, password);
-
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Debug(".");
-    stateLED = !stateLED;
-    digitalWrite(ledPin, stateLED);
-
-    if (digitalRead(pmuIRQPin) == LOW) {
-      axp192.readIRQ();
-
-      if (axp192.isPEKLongtPressIRQ()) {
-        Debugln(F("Long press detected: Shutting down..."));
-        delay(100);
-        axp192.shutdown();
-      }
-
-      axp192.clearIRQ();
-    }
+static EventGroupHandle_t wifiEvents = NULL;
+
+// Wi-Fi events --------------------------------------------------------------------------------------------------------------------------------------------
+static void onWiFiEvent(WiFiEvent_t event){
+  if(event == ARDUINO_EVENT_WIFI_STA_GOT_IP){
+    xEventGroupClearBits(wifiEvents, WIFI_DISCONNECTED_BIT);
+    xEventGroupSetBits(wifiEvents, WIFI_GOT_IP_BIT);
+  }else if(event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED){
+    xEventGroupClearBits(wifiEvents, WIFI_GOT_IP_BIT);
+    xEventGroupSetBits(wifiEvents, WIFI_DISCONNECTED_BIT);
   }
+}
 
-  Debugln(F(""));
-  Debug(F("WiFi connected, IP address: "));
-  Debugln(WiFi.localIP());
+static void initWiFiEvents(){
+  if(wifiEvents != NULL) return;
 
-  if (stateLED) {
-    digitalWrite(ledPin, LOW);
-  }
+  wifiEvents = xEventGroupCreate();
+  WiFi.onEvent(onWiFiEvent);
+  WiFi.persistent(false);                                                                                        // Credentials come from macros.h, do not rewrite them to flash on every wake
+  WiFi.mode(WIFI_STA);
 }
-// Connect to Wi-Fi during setup END -----------------------------------------------------------------------------------------------------------------------
 
-// Connect to Wi-Fi during the execution of the thread ---------------------------------------------------------------------------------------------------
-void reconnectToWiFi(bool stateLED, const char* ssid, const char* password, const uint8_t ledPin, SemaphoreHandle_t serialSemaphore){
-    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
-    Debug(F("Connecting to WIFI SSID "));
+static bool waitForWiFi(uint32_t timeoutMs, bool abortOnDisconnect){                                             // Blocks on the event group instead of polling the status
+  EventBits_t waitBits = WIFI_GOT_IP_BIT | (abortOnDisconnect ? WIFI_DISCONNECTED_BIT : 0);
+  EventBits_t bits = xEventGroupWaitBits(wifiEvents, waitBits, pdFALSE, pdFALSE, pdMS_TO_TICKS(timeoutMs));
+  return (bits & WIFI_GOT_IP_BIT) != 0;
+}
+// Wi-Fi events END ----------------------------------------------------------------------------------------------------------------------------------------
+
+// Connect to Wi-Fi (one bounded attempt) ------------------------------------------------------------------------------------------------------------------
+bool connectToWiFi(bool stateLED, const char* ssid, const char* password, const uint8_t ledPin, RejoinCache& cache, uint32_t timeoutMs) {
+  pinMode(ledPin, OUTPUT);
+  digitalWrite(ledPin, !stateLED);                                                                               // LED on while joining
+
+  uint32_t startMs = millis();
+  initWiFiEvents();
+  xEventGroupClearBits(wifiEvents, WIFI_GOT_IP_BIT | WIFI_DISCONNECTED_BIT);
+
+  bool fast = false;
+  if(leaseReusable(cache, epochMs(), WIFI_LEASE_REUSE_S)){                                                       // Fast rejoin: known AP and channel (no scan), previous lease as static IP (no DHCP)
+    Debug(F("Rejoining WIFI SSID "));
     Debugln(ssid);
-    xSemaphoreGive(serialSemaphore);
+
+    WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+    WiFi.begin(ssid, password, cache.channel, cache.bssid);
+    fast = waitForWiFi(FAST_REJOIN_TIMEOUT_MS < timeoutMs ? FAST_REJOIN_TIMEOUT_MS : timeoutMs, true);
+
+    if(!fast){
+      Debugln(F("Fast rejoin failed, falling back to scan + DHCP"));
+      forgetRejoin(cache);
+      WiFi.disconnect();
+      xEventGroupClearBits(wifiEvents, WIFI_GOT_IP_BIT | WIFI_DISCONNECTED_BIT);
     }
+  }
 
-    WiFi.mode(WIFI_STA);
-    WiFi.disconnect();
-    vTaskDelay(pdMS_TO_TICKS(100));
+  if(!fast){
+    Debug(F("Connecting to WIFI SSID "));
+    Debugln(ssid);
+
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, INADDR_NONE);                                             // Back to DHCP
     WiFi.begin(ssid, password);
 
-    while(WiFi.status() != WL_CONNECTED){
-    vTaskDelay(pdMS_TO_TICKS(500));
-    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
-      Debug(".");
-      xSemaphoreGive(serialSemaphore);
-    }
-    stateLED = !stateLED;
-    digitalWrite(ledPin, stateLED);
+    uint32_t spentMs = millis() - startMs;
+    if(spentMs >= timeoutMs || !waitForWiFi(timeoutMs - spentMs, false)){                                        // Whatever the fast rejoin left of the attempt
+      Debugln(F("WiFi connection timed out"));
+      digitalWrite(ledPin, stateLED);
+      return false;
     }
 
-    if(xSemaphoreTake(serialSemaphore, portMAX_DELAY)){
-      Debugln(F(""));
+    memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));                                                      // Remember everything needed to skip the scan and DHCP next time
+    cache.channel = WiFi.channel();
+    cache.ip = WiFi.localIP();
+    cache.gateway = WiFi.gatewayIP();
+    cache.subnet = WiFi.subnetMask();
+    cache.dns = WiFi.dnsIP(0);
+    cache.leaseObtainedMs = epochMs();
+    cache.valid = true;
+  }
 
-      Debug(F("WiFi connected, IP address: "));
-      Debugln(WiFi.localIP());
-      xSemaphoreGive(serialSemaphore);
-    }
+  cache.lastRejoinMs = millis() - startMs;
+  cache.lastRejoinFast = fast;
 
-    if(stateLED){
-      digitalWrite(ledPin, LOW);
-    }
+  Debugf("WiFi connected in %lu ms (%s), IP address: ", (unsigned long)cache.lastRejoinMs, fast ? "fast" : "full");
+  Debugln(WiFi.localIP());
+
+  digitalWrite(ledPin, stateLED);
+  return true;
+}
+// Connect to Wi-Fi END ------------------------------------------------------------------------------------------------------------------------------------
+
+// Resolve the broker (cached in RTC memory) ---------------------------------------------------------------------------------------------------------------
+IPAddress resolveBroker(RejoinCache& cache, const char* host){
+  cache.lastBrokerCached = brokerAddressCached(cache, epochMs());
+  if(cache.lastBrokerCached){
+    return IPAddress(cache.brokerIp);                                                                            // No DNS lookup on this wake
+  }
+
+  IPAddress ip;
+  if(!WiFi.hostByName(host, ip)){
+    return INADDR_NONE;
+  }
+  storeBrokerAddress(cache, ip, epochMs(), BROKER_DNS_TTL_S);
+  return ip;
+}
+
+void rememberBrokerAddress(RejoinCache& cache, IPAddress ip){                                                    // Called with the address that actually answered, replaces a stale cached one
+  storeBrokerAddress(cache, ip, epochMs(), BROKER_DNS_TTL_S);
 }
-// Connect to Wi-Fi during the execution of the thread END -----------------------------------------------------------------------------------------------
\ No newline at end of file
+// Resolve the broker END ----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -0,0 +1,136 @@
+// Adaptive acquisition (acquisitionPolicy.h, planWakeTemperature() and planWakeMoistureSamples()) replayed over the soil traces in traces.h
+//   pio test -e native -f test_acquisition_policy
+#include <unity.h>
+#include <string.h>
+#include "wakeCycle.h"
+#include "deviceConfig.h"
+#include "traces.h"
+
+struct PlanSpan {                                                                                                // Expected plan from wake 'first' to 'last' included
+  uint8_t first;
+  uint8_t last;
+  uint8_t resolutionBits;
+  uint8_t temperatureSamples;
+  uint8_t moistureSamples;
+};
+
+#define FULL_PLAN(last) {0, last, 12, TEMPERATURE_ADAPTIVE_MAX_SAMPLES, MOISTURE_ADAPTIVE_MAX_SAMPLES}           // Fewer than 3 wakes of history after power-on
+#define QUIET 9, TEMPERATURE_ADAPTIVE_MIN_SAMPLES
+
+static WakeState state;
+static DeviceConfig config;
+
+// Plans the acquisition of every wake, then records what the trace says it measured, as a wake does
+static void replay(const TraceRow* rows, size_t count, const PlanSpan* spans, size_t spanCount){
+  size_t span = 0;
+  for(size_t wake = 0; wake < count; wake++){
+    while(span < spanCount && wake > spans[span].last) span++;
+    TEST_ASSERT_TRUE_MESSAGE(span < spanCount && wake >= spans[span].first, "wake outside the expected spans");
+
+    char where[24];
+    snprintf(where, sizeof(where), "wake %u", (unsigned)wake);
+    AcquisitionPlan temperature = planWakeTemperature(state, config);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(spans[span].resolutionBits, temperature.resolutionBits, where);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(spans[span].temperatureSamples, temperature.samples, where);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(spans[span].moistureSamples, planWakeMoistureSamples(state, config), where);
+
+    recordAcquisition(state.temperatureHistory, rows[wake].temperatureC);
+    recordAcquisition(state.moistureHistory, rows[wake].moisture);
+  }
+}
+
+void setUp(){
+  memset(&state, 0, sizeof(state));
+  memset(&config, 0, sizeof(config));                                                                            // Not a deep sleep wake: defaults again
+  deviceConfigBegin(config);
+}
+
+void tearDown(){}
+
+// Tests -----------------------------------------------------------------------------------------------------------------------------------------------------
+static void test_still_night_stays_on_the_cheapest_plan(){
+  static const PlanSpan spans[] = {FULL_PLAN(2), {3, 35, QUIET, 1}};
+  replay(NIGHT, TRACE_LEN(NIGHT), spans, TRACE_LEN(spans));
+}
+
+static void test_irrigation_raises_both_plans(){
+  static const PlanSpan spans[] = {
+    FULL_PLAN(2),
+    {3, 16, QUIET, 1},
+    {17, 17, 10, 3, 11},                                                                                         // The wake right after the water arrived
+    {18, 18, 10, 3, 15},
+    {19, 22, 11, 7, 15},                                                                                         // The 0.8 C dip dominates the temperature history
+    {23, 23, 10, 3, 15},
+    {24, 24, 10, 3, 11},
+    {25, 47, QUIET, 1},                                                                                          // Step out of the 8-wake history, drying is below the quiet trend
+  };
+  replay(IRRIGATION, TRACE_LEN(IRRIGATION), spans, TRACE_LEN(spans));
+}
+
+static void test_warm_up_follows_the_trend(){
+  static const PlanSpan spans[] = {
+    FULL_PLAN(2),
+    {3, 4, QUIET, 1},
+    {5, 8, 10, 3, 1},
+    {9, 30, 11, 7, 1},                                                                                           // 0.15 C per wake: between the quiet and noisy trends
+    {31, 33, 10, 3, 1},
+    {34, 39, QUIET, 1},
+  };
+  replay(WARM_UP, TRACE_LEN(WARM_UP), spans, TRACE_LEN(spans));
+}
+
+static void test_error_codes_do_not_look_like_activity(){
+  static const PlanSpan spans[] = {FULL_PLAN(2), {3, 3, 10, 3, 1}, {4, 31, QUIET, 1}};                           // 85 C and -127 C never reach the history
+  replay(GLITCHES, TRACE_LEN(GLITCHES), spans, TRACE_LEN(spans));
+  for(uint8_t i = 0; i < state.temperatureHistory.count; i++){
+    TEST_ASSERT_TRUE(state.temperatureHistory.values[i] > -127.0f && state.temperatureHistory.values[i] < 85.0f);
+  }
+}
+
+static void test_noisy_moisture_takes_more_moisture_samples_only(){
+  static const PlanSpan spans[] = {FULL_PLAN(2), {3, 21, QUIET, 11}, {22, 29, QUIET, 15}, {30, 31, QUIET, 11}};
+  replay(NOISY_MOISTURE, TRACE_LEN(NOISY_MOISTURE), spans, TRACE_LEN(spans));
+}
+
+static void test_config_caps_the_resolution(){
+  config.tempMaxBits = 10;                                                                                       // Fleet trading accuracy for battery
+  static const PlanSpan spans[] = {
+    {0, 2, 10, TEMPERATURE_ADAPTIVE_MAX_SAMPLES, MOISTURE_ADAPTIVE_MAX_SAMPLES},
+    {3, 4, QUIET, 1},
+    {5, 8, 10, 3, 1},
+    {9, 30, 10, 7, 1},                                                                                           // Samples still follow the trend
+    {31, 33, 10, 3, 1},
+    {34, 39, QUIET, 1},
+  };
+  replay(WARM_UP, TRACE_LEN(WARM_UP), spans, TRACE_LEN(spans));
+}
+
+static void test_config_sample_bounds(){
+  config.tempMinSamples = 3;
+  config.tempMaxSamples = 5;
+  config.moistMinSamples = 5;
+  config.moistMaxSamples = 9;
+  static const PlanSpan spans[] = {
+    {0, 2, 12, 5, 9},
+    {3, 16, 9, 3, 5},
+    {17, 17, 10, 3, 7},
+    {18, 18, 10, 3, 9},
+    {19, 22, 11, 5, 9},                                                                                          // 4 would be even: one more for a true median
+    {23, 23, 10, 3, 9},
+    {24, 24, 10, 3, 7},
+    {25, 47, 9, 3, 5},
+  };
+  replay(IRRIGATION, TRACE_LEN(IRRIGATION), spans, TRACE_LEN(spans));
+}
+
+int main(int argc, char** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_still_night_stays_on_the_cheapest_plan);
+  RUN_TEST(test_irrigation_raises_both_plans);
+  RUN_TEST(test_warm_up_follows_the_trend);
+  RUN_TEST(test_error_codes_do_not_look_like_activity);
+  RUN_TEST(test_noisy_moisture_takes_more_moisture_samples_only);
+  RUN_TEST(test_config_caps_the_resolution);
+  RUN_TEST(test_config_sample_bounds);
+  return UNITY_END();
+}
\ No newline at end of file
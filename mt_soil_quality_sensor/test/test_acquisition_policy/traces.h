@@ -0,0 +1,57 @@
+#pragma once                                                                                                     // Per-wake soil readings replayed by test_acquisition_policy, 300 s apart
+
+// One row per wake: shallowest probe (C, DS18B20 12-bit steps of 0.0625) and moisture (percentage points), as they reach recordAcquisition().
+// 85 C and -127 C are the DS18B20 power-on and disconnected codes, passed through as the bus returns them.
+
+struct TraceRow {
+  float temperatureC;
+  float moisture;
+};
+
+#define TRACE_LEN(trace) (sizeof(trace) / sizeof(trace[0]))
+
+// Still night: 3 h of a steady soil, probe and FC-38 noise only
+static const TraceRow NIGHT[] = {
+  {14.25f, 31.1f}, {14.125f, 31.0f}, {14.1875f, 31.1f}, {14.1875f, 31.0f}, {14.1875f, 31.1f}, {14.1875f, 30.9f}, {14.125f, 31.0f}, {14.1875f, 30.9f},
+  {14.125f, 30.9f}, {14.1875f, 31.1f}, {14.1875f, 31.0f}, {14.125f, 30.9f}, {14.1875f, 30.9f}, {14.1875f, 30.9f}, {14.1875f, 31.0f}, {14.25f, 31.0f},
+  {14.1875f, 30.9f}, {14.1875f, 31.0f}, {14.1875f, 31.0f}, {14.1875f, 31.0f}, {14.125f, 31.1f}, {14.125f, 31.0f}, {14.125f, 31.0f},
+  {14.1875f, 31.1f}, {14.1875f, 30.9f}, {14.25f, 31.0f}, {14.25f, 31.1f}, {14.25f, 31.0f}, {14.1875f, 30.9f}, {14.125f, 30.9f}, {14.25f, 30.9f},
+  {14.125f, 31.0f}, {14.1875f, 31.1f}, {14.25f, 31.0f}, {14.25f, 31.0f}, {14.125f, 30.9f},
+};
+
+// Drip irrigation at wake 16: moisture 22 -> 37.5 % in two wakes then drying, the cold water takes the soil down 0.8 C
+static const TraceRow IRRIGATION[] = {
+  {17.0f, 22.2f}, {17.0f, 22.1f}, {17.0f, 21.8f}, {16.9375f, 22.1f}, {17.0f, 21.9f}, {17.0f, 22.2f}, {16.9375f, 21.8f}, {17.0f, 21.9f},
+  {17.0f, 22.0f}, {17.0625f, 22.1f}, {17.0625f, 22.1f}, {17.0f, 22.0f}, {17.0f, 21.8f}, {17.0f, 22.0f}, {16.9375f, 22.2f}, {17.0f, 22.1f},
+  {16.6875f, 30.1f}, {16.375f, 37.6f}, {16.1875f, 37.6f}, {16.25f, 37.2f}, {16.25f, 37.2f}, {16.25f, 37.0f}, {16.25f, 37.0f}, {16.1875f, 36.9f},
+  {16.125f, 37.0f}, {16.125f, 37.0f}, {16.1875f, 36.8f}, {16.1875f, 36.7f}, {16.1875f, 36.5f}, {16.1875f, 36.4f}, {16.1875f, 36.7f},
+  {16.1875f, 36.2f}, {16.125f, 36.3f}, {16.1875f, 36.0f}, {16.25f, 36.2f}, {16.125f, 36.1f}, {16.1875f, 36.1f}, {16.1875f, 35.8f}, {16.125f, 36.0f},
+  {16.125f, 35.7f}, {16.1875f, 35.8f}, {16.1875f, 35.6f}, {16.125f, 35.3f}, {16.1875f, 35.5f}, {16.125f, 35.3f}, {16.25f, 35.3f}, {16.25f, 35.4f},
+  {16.125f, 35.0f},
+};
+
+// Morning sun: +0.15 C per wake (1.8 C/h) from wake 4 to 27, then flat
+static const TraceRow WARM_UP[] = {
+  {12.0f, 26.1f}, {11.9375f, 26.2f}, {12.0f, 26.1f}, {11.9375f, 26.0f}, {12.1875f, 25.9f}, {12.375f, 26.0f}, {12.375f, 26.1f}, {12.6875f, 26.1f},
+  {12.75f, 26.1f}, {12.9375f, 25.9f}, {13.0625f, 25.9f}, {13.1875f, 26.2f}, {13.3125f, 26.0f}, {13.5625f, 26.1f}, {13.5625f, 26.0f}, {13.75f, 26.2f},
+  {13.875f, 25.8f}, {14.125f, 25.9f}, {14.3125f, 25.9f}, {14.375f, 26.0f}, {14.5625f, 26.0f}, {14.625f, 26.1f}, {14.875f, 26.1f}, {15.0f, 26.2f},
+  {15.1875f, 26.0f}, {15.375f, 26.0f}, {15.375f, 25.8f}, {15.625f, 26.0f}, {15.625f, 26.1f}, {15.6875f, 26.2f}, {15.625f, 25.9f}, {15.625f, 26.1f},
+  {15.6875f, 26.0f}, {15.625f, 26.1f}, {15.5625f, 25.9f}, {15.6875f, 25.8f}, {15.625f, 26.0f}, {15.6875f, 26.0f}, {15.6875f, 26.1f},
+  {15.6875f, 25.8f},
+};
+
+// Steady soil on a flaky bus: 85 C power-on readings at wakes 6 and 19, disconnected (-127 C) at 12, 13 and 25
+static const TraceRow GLITCHES[] = {
+  {16.5625f, 27.9f}, {16.5625f, 28.1f}, {16.4375f, 27.9f}, {16.5f, 28.1f}, {16.5f, 28.2f}, {16.4375f, 28.2f}, {85.0f, 28.1f}, {16.5625f, 28.0f},
+  {16.5f, 28.1f}, {16.5625f, 28.0f}, {16.5625f, 27.9f}, {16.5f, 28.0f}, {-127.0f, 28.0f}, {-127.0f, 28.1f}, {16.5f, 28.1f}, {16.5f, 28.2f},
+  {16.5f, 27.9f}, {16.4375f, 27.8f}, {16.5f, 28.0f}, {85.0f, 28.1f}, {16.5f, 28.0f}, {16.5625f, 28.1f}, {16.5f, 28.0f}, {16.5f, 28.0f},
+  {16.5625f, 28.1f}, {-127.0f, 28.2f}, {16.5625f, 28.1f}, {16.5625f, 28.0f}, {16.5f, 28.0f}, {16.5f, 28.1f}, {16.5f, 27.8f}, {16.4375f, 28.1f},
+};
+
+// Corroded FC-38: moisture scattered by about 3 points around 33 %, temperature steady
+static const TraceRow NOISY_MOISTURE[] = {
+  {15.0625f, 37.0f}, {14.9375f, 31.4f}, {15.0625f, 33.0f}, {15.0f, 34.6f}, {15.0625f, 33.0f}, {15.0f, 31.7f}, {15.0625f, 38.7f}, {15.0625f, 32.6f},
+  {15.0f, 36.0f}, {15.0f, 32.9f}, {15.0625f, 32.2f}, {14.9375f, 34.0f}, {15.0f, 31.3f}, {15.0f, 35.8f}, {15.0f, 30.9f}, {15.0f, 36.7f},
+  {15.0f, 38.3f}, {15.0f, 32.5f}, {15.0f, 32.9f}, {15.0625f, 33.8f}, {14.9375f, 33.2f}, {14.9375f, 27.4f}, {15.0f, 37.0f}, {15.0f, 38.4f},
+  {14.9375f, 33.9f}, {15.0625f, 33.6f}, {15.0f, 34.9f}, {15.0f, 31.5f}, {15.0f, 33.4f}, {15.0625f, 31.8f}, {15.0f, 32.9f}, {15.0f, 34.5f},
+};
\ No newline at end of file
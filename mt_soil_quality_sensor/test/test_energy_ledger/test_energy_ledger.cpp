@@ -0,0 +1,119 @@
+// Coulomb counter windows (energyAccount.h) fed with scripted AXP192 readings through halNative.cpp, one reading per simulated wake
+//   pio test -e native -f test_energy_ledger
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include "energyAccount.h"
+#include "halNative.h"
+#include "hal.h"
+#include "macros.h"
+
+#define TEST_COULOMB_LSB_MAH 0.364f                                                                              // AXP192 counter step, as in halNative.cpp
+#define TEST_SLEEP_S 300
+
+static EnergyLedger ledger;
+static float drawnmAh;                                                                                           // Exact charge drawn so far, the counter reads it quantized
+
+// One wake: the PMU reads as scripted, the ledger is updated like wakeStoreReading() does, then deep sleep for 'sleepS'
+static void wake(float volts, float vbusVolts, uint32_t sleepS){
+  simBeginWake();
+  const SimPmuReading reading = {floorf(drawnmAh / TEST_COULOMB_LSB_MAH) * TEST_COULOMB_LSB_MAH, volts, vbusVolts};
+  simSetPmuReading(&reading);
+  updateEnergyLedger(ledger, halBatteryDrawnmAh(), halEpochMs(), halBatteryVoltage());
+  halDeepSleep(sleepS);
+  simEndWake();
+}
+
+static void drain(float currentmA, uint32_t wakes, float volts = 3.8f){
+  for(uint32_t i = 0; i < wakes; i++){
+    wake(volts, 0.0f, TEST_SLEEP_S);
+    drawnmAh += currentmA * TEST_SLEEP_S / 3600.0f;
+  }
+}
+
+void setUp(){
+  memset(&ledger, 0, sizeof(ledger));
+  drawnmAh = 100.0f;
+}
+
+void tearDown(){
+  simSetPmuReading(NULL);
+}
+
+// Tests -----------------------------------------------------------------------------------------------------------------------------------------------------
+static void test_no_estimate_before_a_window_closes(){
+  drain(2.0f, 20);                                                                                               // 3.2 mAh, under ENERGY_WINDOW_MAH
+  TEST_ASSERT_FALSE(ledger.avgCurrentmA.seeded);
+  TEST_ASSERT_TRUE(isnan(remainingRuntimeH(ledger, BATTERY_CAPACITY_MAH)));
+  TEST_ASSERT_TRUE(isnan(reportChargemAh(ledger, 4 * TEST_SLEEP_S)));
+}
+
+static void test_steady_drain_gives_the_average_current(){
+  drain(2.0f, 100);
+  TEST_ASSERT_TRUE(ledger.avgCurrentmA.seeded);
+  TEST_ASSERT_FLOAT_WITHIN(0.2f, 2.0f, ledger.avgCurrentmA.value);                                               // Under 10 % despite the 0.364 mAh counter steps
+  TEST_ASSERT_FLOAT_WITHIN(0.1f * 675.0f, 675.0f, remainingRuntimeH(ledger, BATTERY_CAPACITY_MAH));              // 45 % of 3000 mAh at 2 mA
+  TEST_ASSERT_FLOAT_WITHIN(0.1f * 2.0f / 3, 2.0f / 3, reportChargemAh(ledger, 4 * TEST_SLEEP_S));                // Four wakes of 300 s
+}
+
+static void test_average_follows_a_current_change(){
+  drain(2.0f, 100);
+  float before = ledger.avgCurrentmA.value;
+  drain(8.0f, 10);                                                                                               // One window at the new current moves the average by a quarter
+  TEST_ASSERT_TRUE(ledger.avgCurrentmA.value > before);
+  TEST_ASSERT_TRUE(ledger.avgCurrentmA.value < 5.0f);
+  drain(8.0f, 200);
+  TEST_ASSERT_FLOAT_WITHIN(0.8f, 8.0f, ledger.avgCurrentmA.value);
+}
+
+static void test_charging_restarts_the_window(){
+  drain(2.0f, 100);
+  float average = ledger.avgCurrentmA.value;
+  drawnmAh -= 40.0f;                                                                                             // Net charge in from USB: the counter goes down
+  wake(4.1f, 5.0f, TEST_SLEEP_S);
+  TEST_ASSERT_EQUAL_FLOAT(average, ledger.avgCurrentmA.value);                                                   // No window spans the charge
+  TEST_ASSERT_FLOAT_WITHIN(TEST_COULOMB_LSB_MAH, drawnmAh, ledger.windowStartmAh);                               // Counted from the charged reading on
+
+  static WakeProfileHistory history;
+  char energy[ENERGY_MAX_LEN];
+  TEST_ASSERT_GREATER_THAN(0, serializeWakeEnergy(history, ledger, 4 * TEST_SLEEP_S, 5.0f, energy, sizeof(energy)));
+  TEST_ASSERT_NOT_NULL(strstr(energy, "\"runtimeH\":null"));                                                     // Meaningless while on USB power
+  TEST_ASSERT_NOT_NULL(strstr(energy, "\"vbusV\":5.00"));
+}
+
+static void test_clock_jump_discards_the_window(){
+  drain(2.0f, 10);
+  wake(3.8f, 0.0f, ENERGY_WINDOW_MAX_S + 60);                                                                    // More than a week, as the first NTP sync can make it look
+  drawnmAh += 20.0f;
+  wake(3.8f, 0.0f, TEST_SLEEP_S);
+  wake(3.8f, 0.0f, TEST_SLEEP_S);
+  TEST_ASSERT_FALSE(ledger.avgCurrentmA.seeded);
+}
+
+static void test_runtime_by_battery_voltage(){
+  static const struct { float volts; float runtimeH; } cases[] = {                                               // 3000 mAh at 2 mA, scaled by the LiPo curve
+    {4.20f, 1500.0f},
+    {4.00f, 1125.0f},
+    {3.75f, 525.0f},
+    {3.65f, 210.0f},
+    {3.30f, 0.0f},
+    {3.00f, 0.0f},
+  };
+  drain(2.0f, 100);
+  ledger.avgCurrentmA.value = 2.0f;                                                                              // Exact, the drain is covered above
+  for(const auto& c : cases){
+    wake(c.volts, 0.0f, TEST_SLEEP_S);
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, c.runtimeH, remainingRuntimeH(ledger, BATTERY_CAPACITY_MAH));
+  }
+}
+
+int main(int argc, char** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_no_estimate_before_a_window_closes);
+  RUN_TEST(test_steady_drain_gives_the_average_current);
+  RUN_TEST(test_average_follows_a_current_change);
+  RUN_TEST(test_charging_restarts_the_window);
+  RUN_TEST(test_clock_jump_discards_the_window);
+  RUN_TEST(test_runtime_by_battery_voltage);
+  return UNITY_END();
+}
\ No newline at end of file
@@ -0,0 +1,253 @@
+// Link state machine (linkFsm.h) driven like runRadioWake() drives it, against a fake transport that refuses, times out or half-opens the connection
+//   pio test -e native -f test_link_fsm
+#include <unity.h>
+#include <string.h>
+#include "linkFsm.h"
+#include "macros.h"
+#include "wakeRunner.h"
+
+#define TEST_REFUSED_MS 30                                                                                       // RST from the broker, or wrong PSK: fails right away
+#define TEST_JOIN_MS 1200
+#define TEST_CONNECT_MS 300
+#define TEST_HALF_OPEN_MS 15000                                                                                  // Session looks up until the keepalive finds nobody on the other end
+#define TEST_MAX_STEPS 1000                                                                                      // 40 s of serve ticks fit
+
+enum Outcome : uint8_t { OK, REFUSE, TIME_OUT, HALF_OPEN, DROP_WIFI };
+
+struct FakeTransport {                                                                                           // Scripted outcomes, the last one repeats
+  const Outcome* joins;
+  uint8_t joinCount;
+  const Outcome* connects;
+  uint8_t connectCount;
+  uint8_t joinAt;
+  uint8_t connectAt;
+  uint32_t nowMs;
+};
+
+struct Trace {
+  LinkAction actions[TEST_MAX_STEPS];
+  LinkState states[TEST_MAX_STEPS];                                                                              // After each step
+  uint32_t waitsMs[TEST_MAX_STEPS];
+  uint16_t steps;
+  uint16_t waits;
+  uint16_t served;
+};
+
+static LinkFsm fsm;
+static LinkStats stats;
+static Trace trace;
+
+static Outcome next(const Outcome* script, uint8_t count, uint8_t& at){
+  Outcome outcome = script[at < count ? at : count - 1];
+  at++;
+  return outcome;
+}
+
+// The loop of runRadioWake() with the transport faked and time only moving forward in it, stops at the first LINK_DO_SLEEP or after 'serveMs' up
+static void drive(FakeTransport& transport, uint32_t seed, uint32_t serveMs = 0){
+  memset(&trace, 0, sizeof(trace));
+  linkBegin(fsm, transport.nowMs, LINK_WAKE_BUDGET_MS, seed);
+  LinkEvent event = LINK_TICK;
+  uint32_t upSinceMs = 0;
+  Outcome session = OK;
+  while(trace.steps < TEST_MAX_STEPS){
+    LinkAction action = linkStep(fsm, stats, event, transport.nowMs);
+    trace.actions[trace.steps] = action;
+    trace.states[trace.steps++] = fsm.state;
+    event = LINK_TICK;
+
+    switch(action){
+      case LINK_DO_JOIN:{
+        uint32_t timeoutMs = linkAttemptMs(fsm, transport.nowMs, WIFI_CONNECT_TIMEOUT_MS);
+        Outcome outcome = next(transport.joins, transport.joinCount, transport.joinAt);
+        transport.nowMs += outcome == OK ? TEST_JOIN_MS : outcome == REFUSE ? TEST_REFUSED_MS : timeoutMs;
+        event = outcome == OK ? LINK_WIFI_UP : LINK_WIFI_FAILED;
+        break;
+      }
+      case LINK_DO_CONNECT:{
+        uint32_t timeoutMs = linkAttemptMs(fsm, transport.nowMs, LINK_MQTT_TIMEOUT_S * 1000UL);
+        session = next(transport.connects, transport.connectCount, transport.connectAt);
+        transport.nowMs += session == REFUSE ? TEST_REFUSED_MS : session == TIME_OUT ? timeoutMs : TEST_CONNECT_MS;
+        event = session == REFUSE || session == TIME_OUT ? LINK_MQTT_FAILED : LINK_MQTT_UP;
+        upSinceMs = transport.nowMs;
+        break;
+      }
+      case LINK_DO_WAIT:
+        trace.waitsMs[trace.waits++] = linkWaitMs(fsm, transport.nowMs);
+        transport.nowMs += linkWaitMs(fsm, transport.nowMs);
+        break;
+      case LINK_DO_SERVE:
+        trace.served++;
+        transport.nowMs += WAKE_SERVE_TICK_MS;
+        if(session == HALF_OPEN){
+          if(transport.nowMs - upSinceMs >= TEST_HALF_OPEN_MS) event = LINK_MQTT_LOST;                           // Publish never acknowledged, halMqttConnected() turns false
+        }else if(session == DROP_WIFI) event = LINK_WIFI_LOST;
+        else if(transport.nowMs - upSinceMs >= serveMs) return;
+        break;
+      case LINK_DO_SLEEP:
+        return;
+    }
+  }
+  TEST_FAIL_MESSAGE("linkStep() never settled");
+}
+
+static bool performed(LinkAction action){
+  for(uint16_t i = 0; i < trace.steps; i++) if(trace.actions[i] == action) return true;
+  return false;
+}
+
+void setUp(){
+  memset(&stats, 0, sizeof(stats));
+}
+
+void tearDown(){}
+
+// Tests -----------------------------------------------------------------------------------------------------------------------------------------------------
+static void test_clean_connection(){
+  static const Outcome ok[] = {OK};
+  FakeTransport transport = {ok, 1, ok, 1, 0, 0, 1000};
+  drive(transport, 1);
+
+  TEST_ASSERT_EQUAL(LINK_DO_JOIN, trace.actions[0]);
+  TEST_ASSERT_EQUAL(LINK_DO_CONNECT, trace.actions[1]);
+  TEST_ASSERT_EQUAL(LINK_DO_SERVE, trace.actions[2]);
+  TEST_ASSERT_EQUAL(LINK_UP, fsm.state);
+  TEST_ASSERT_EQUAL(2, stats.lastAttempts);
+  TEST_ASSERT_EQUAL(1000 + TEST_JOIN_MS + TEST_CONNECT_MS, stats.lastUpMs);
+  TEST_ASSERT_EQUAL(0, trace.waits);
+}
+
+static void test_refused_connect_backs_off_exponentially(){
+  static const Outcome ok[] = {OK}, refuse[] = {REFUSE};
+  FakeTransport transport = {ok, 1, refuse, 1, 0, 0, 0};
+  drive(transport, 7);
+
+  TEST_ASSERT_EQUAL(1, transport.joinAt);                                                                        // Wi-Fi stays up, only the CONNECT is retried
+  TEST_ASSERT_EQUAL(LINK_EXPIRED, fsm.state);
+  TEST_ASSERT_EQUAL(transport.connectAt, stats.mqttFailures);
+  TEST_ASSERT_GREATER_THAN(5, trace.waits);
+  for(uint16_t i = 0; i < trace.waits; i++){
+    uint32_t fullMs = LINK_BACKOFF_BASE_MS << (i < 16 ? i : 16);
+    if(fullMs > LINK_BACKOFF_MAX_MS) fullMs = LINK_BACKOFF_MAX_MS;
+    TEST_ASSERT_GREATER_OR_EQUAL(fullMs / 2, trace.waitsMs[i]);                                                  // Doubled each time, capped, jittered by up to -50 %
+    TEST_ASSERT_LESS_OR_EQUAL(fullMs, trace.waitsMs[i]);
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(LINK_WAKE_BUDGET_MS, transport.nowMs);                                               // Expired before a retry could overrun the budget
+  TEST_ASSERT_EQUAL(1, stats.expiredWakes);
+  TEST_ASSERT_EQUAL(1, stats.skipWakes);
+  TEST_ASSERT_FALSE(performed(LINK_DO_SERVE));
+}
+
+static void test_timeouts_never_overrun_the_budget(){
+  static const Outcome timeOut[] = {TIME_OUT};
+  FakeTransport transport = {timeOut, 1, timeOut, 1, 0, 0, 500};
+  drive(transport, 3);
+
+  TEST_ASSERT_EQUAL(LINK_EXPIRED, fsm.state);
+  TEST_ASSERT_EQUAL(0, transport.connectAt);
+  TEST_ASSERT_EQUAL(transport.joinAt, stats.wifiFailures);
+  TEST_ASSERT_EQUAL(2, transport.joinAt);                                                                        // 20 s, a backoff, then what is left of the 40 s
+  TEST_ASSERT_LESS_OR_EQUAL(500 + LINK_WAKE_BUDGET_MS, transport.nowMs);
+}
+
+static void test_stalled_broker_then_recovery(){
+  static const Outcome ok[] = {OK}, connects[] = {TIME_OUT, REFUSE, OK};
+  FakeTransport transport = {ok, 1, connects, 3, 0, 0, 0};
+  drive(transport, 11, 2000);
+
+  TEST_ASSERT_EQUAL(LINK_UP, fsm.state);
+  TEST_ASSERT_EQUAL(2, stats.mqttFailures);
+  TEST_ASSERT_EQUAL(4, stats.lastAttempts);                                                                      // One join, three CONNECTs
+  TEST_ASSERT_EQUAL(0, fsm.failures);                                                                            // The next loss starts from the base delay again
+  TEST_ASSERT_EQUAL(2, trace.waits);
+}
+
+static void test_half_open_session_reconnects(){
+  static const Outcome ok[] = {OK}, connects[] = {HALF_OPEN, OK};
+  FakeTransport transport = {ok, 1, connects, 2, 0, 0, 0};
+  drive(transport, 5, 2000);
+
+  TEST_ASSERT_EQUAL(LINK_UP, fsm.state);
+  TEST_ASSERT_EQUAL(1, stats.linkLosses);
+  TEST_ASSERT_EQUAL(0, stats.mqttFailures);
+  TEST_ASSERT_EQUAL(1, transport.joinAt);                                                                        // Wi-Fi was fine: CONNECT again without a rejoin
+  TEST_ASSERT_EQUAL(2, transport.connectAt);
+  TEST_ASSERT_EQUAL(1, trace.waits);
+  TEST_ASSERT_LESS_OR_EQUAL(LINK_BACKOFF_BASE_MS, trace.waitsMs[0]);                                             // Failures were reset by the first MQTT up
+  bool backedOff = false;
+  for(uint16_t i = 0; i < trace.steps; i++) if(trace.states[i] == LINK_BACKOFF) backedOff = true;
+  TEST_ASSERT_TRUE(backedOff);
+}
+
+static void test_lost_wifi_rejoins(){
+  static const Outcome ok[] = {OK}, connects[] = {DROP_WIFI, OK};
+  FakeTransport transport = {ok, 1, connects, 2, 0, 0, 0};
+  drive(transport, 9, 2000);
+
+  TEST_ASSERT_EQUAL(LINK_UP, fsm.state);
+  TEST_ASSERT_EQUAL(1, stats.linkLosses);
+  TEST_ASSERT_EQUAL(2, transport.joinAt);
+}
+
+static void test_half_open_until_the_budget_runs_out(){
+  static const Outcome ok[] = {OK}, halfOpen[] = {HALF_OPEN};
+  FakeTransport transport = {ok, 1, halfOpen, 1, 0, 0, 0};
+  drive(transport, 13);
+
+  TEST_ASSERT_EQUAL(LINK_DO_SLEEP, trace.actions[trace.steps - 1]);
+  TEST_ASSERT_EQUAL(LINK_EXPIRED, fsm.state);
+  TEST_ASSERT_EQUAL(transport.connectAt, stats.linkLosses);
+  TEST_ASSERT_EQUAL(1, stats.expiredWakes);
+}
+
+static void test_expired_wakes_skip_the_radio_across_wakes(){
+  static const Outcome ok[] = {OK}, refuse[] = {REFUSE};
+  static const uint8_t skips[] = {1, 3, 7, LINK_MAX_SKIP_WAKES, LINK_MAX_SKIP_WAKES};
+  for(uint8_t skip : skips){
+    FakeTransport transport = {ok, 1, refuse, 1, 0, 0, 0};
+    drive(transport, skip);
+    TEST_ASSERT_EQUAL(skip, stats.skipWakes);
+    for(uint8_t i = 0; i < skip; i++) TEST_ASSERT_FALSE(linkRadioDue(stats));
+    TEST_ASSERT_TRUE(linkRadioDue(stats));
+  }
+
+  static const Outcome okConnect[] = {OK};
+  FakeTransport transport = {ok, 1, okConnect, 1, 0, 0, 0};
+  drive(transport, 17);
+  TEST_ASSERT_EQUAL(0, stats.consecutiveExpired);                                                                // One good wake and the next failure skips a single wake again
+}
+
+static void test_jitter_spreads_a_fleet(){
+  static const Outcome ok[] = {OK}, refuse[] = {REFUSE};
+  uint32_t firstWaitMs[8];
+  for(uint32_t node = 0; node < 8; node++){
+    FakeTransport transport = {ok, 1, refuse, 1, 0, 0, 0};
+    drive(transport, 1000 + node);
+    firstWaitMs[node] = trace.waitsMs[2];
+  }
+  uint8_t distinct = 0;
+  for(uint8_t i = 0; i < 8; i++){
+    bool seen = false;
+    for(uint8_t j = 0; j < i; j++) if(firstWaitMs[j] == firstWaitMs[i]) seen = true;
+    if(!seen) distinct++;
+  }
+  TEST_ASSERT_GREATER_THAN(4, distinct);                                                                         // Nodes that lost the same broker do not retry in lockstep
+
+  FakeTransport again = {ok, 1, refuse, 1, 0, 0, 0};
+  drive(again, 1000);
+  TEST_ASSERT_EQUAL(firstWaitMs[0], trace.waitsMs[2]);                                                           // Same seed, same delays
+}
+
+int main(int argc, char** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_clean_connection);
+  RUN_TEST(test_refused_connect_backs_off_exponentially);
+  RUN_TEST(test_timeouts_never_overrun_the_budget);
+  RUN_TEST(test_stalled_broker_then_recovery);
+  RUN_TEST(test_half_open_session_reconnects);
+  RUN_TEST(test_lost_wifi_rejoins);
+  RUN_TEST(test_half_open_until_the_budget_runs_out);
+  RUN_TEST(test_expired_wakes_skip_the_radio_across_wakes);
+  RUN_TEST(test_jitter_spreads_a_fleet);
+  return UNITY_END();
+}
\ No newline at end of file
@@ -0,0 +1,204 @@
+// LoRa uplink (loraUplink.h, loraFrame.h) against the simulated radio of halNative.cpp: what the gateway receives, duty cycle, daily airtime, sessions
+//   pio test -e native -f test_lora_uplink
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "loraUplink.h"
+#include "halNative.h"
+#include "hal.h"
+
+#define TEST_RADIO_FILE "test_lora_uplink.frames"                                                                // What the gateway would read, one line per frame
+#define TEST_EPOCH_MS 1760000000000ULL                                                                           // Synced clock, October 2025
+#define TEST_DEPTH 4
+#define TEST_READING_EVERY_MS 300000ULL
+
+static LoraUplink lora;
+static WakeState state;
+static TelemetryLog flashLog;                                                                                    // No slots: no flash backlog
+static TelemetryBuffer batch;
+static DeviceIdentity identity;
+
+static TelemetryRecord reading(uint32_t bootCnt){
+  TelemetryRecord record = {TEST_EPOCH_MS + bootCnt * TEST_READING_EVERY_MS, bootCnt, {18.25f, 17.5f, 16.0625f, 15.75f}, 34.2f, 3.912f, 300};
+  return record;
+}
+
+static void fillBatch(uint32_t firstBoot){
+  for(uint32_t boot = firstBoot; boot < firstBoot + TEST_DEPTH; boot++) pushTelemetryRecord(state.buffer, reading(boot));
+}
+
+static uint64_t batchDueMs(){                                                                                    // Right after the newest reading
+  return telemetryRecordAt(state.buffer, state.buffer.count - 1).timestampMs + 1000;
+}
+
+// Last frame the simulated radio let through, MIC included
+static size_t lastFrame(uint8_t* frame){
+  FILE* file = fopen(TEST_RADIO_FILE, "r");
+  TEST_ASSERT_NOT_NULL(file);
+  char line[2 * HAL_LORA_MAX_LEN + 64];
+  char hex[2 * HAL_LORA_MAX_LEN + 1] = "";
+  unsigned long long rxMs;
+  float rssi, snr;
+  while(fgets(line, sizeof(line), file)) sscanf(line, "%llu %f %f %510s", &rxMs, &rssi, &snr, hex);
+  fclose(file);
+  size_t len = strlen(hex) / 2;
+  for(size_t i = 0; i < len; i++){
+    unsigned int b;
+    sscanf(hex + 2 * i, "%2x", &b);
+    frame[i] = (uint8_t)b;
+  }
+  return len;
+}
+
+static bool micValid(const uint8_t* frame, size_t len){                                                          // As ThingsBoard/loraGateway checks it
+  uint8_t mac[32];
+  halHmacSha256((const uint8_t*)identity.token, strlen(identity.token), frame, len - LORA_MIC_LEN, mac);
+  return memcmp(mac, frame + len - LORA_MIC_LEN, LORA_MIC_LEN) == 0;
+}
+
+static float number(const TelemetryValue& value){
+  return value.kind == TelemetryValue::Real ? value.f : value.kind == TelemetryValue::Unsigned ? (float)value.u : (float)value.i;
+}
+
+void setUp(){
+  memset(&lora, 0, sizeof(lora));                                                                                // Power-on
+  memset(&state, 0, sizeof(state));
+  memset(&flashLog, 0, sizeof(flashLog));
+  loadDeviceIdentity(identity);
+  loraUplinkBegin(lora);
+}
+
+void tearDown(){}
+
+// Tests -----------------------------------------------------------------------------------------------------------------------------------------------------
+static void test_gateway_decodes_what_was_sent(){
+  fillBatch(1);
+  uint64_t nowMs = batchDueMs();
+  TEST_ASSERT_TRUE(loraFlushDue(lora, state, flashLog, TEST_DEPTH, nowMs));
+  TEST_ASSERT_EQUAL(LORA_SENT, loraUplinkSend(lora, state, flashLog, batch, identity, TEST_DEPTH, nowMs));
+  TEST_ASSERT_EQUAL(TEST_DEPTH, lora.lastReadings);
+  TEST_ASSERT_EQUAL(0, state.buffer.count);                                                                      // Released, no downlink to wait for
+
+  uint8_t frame[HAL_LORA_MAX_LEN];
+  size_t len = lastFrame(frame);
+  TEST_ASSERT_TRUE(len <= loraMaxPayload(LORA_SPREADING_FACTOR));
+  TEST_ASSERT_TRUE(micValid(frame, len));
+  TEST_ASSERT_EQUAL(loraAirtimeMs(len, LORA_SPREADING_FACTOR, LORA_BANDWIDTH_HZ, LORA_CODING_RATE), lora.lastAirtimeMs);
+
+  LoraFrameHeader header;
+  LoraReading readings[LORA_FRAME_MAX_RECORDS];
+  TEST_ASSERT_TRUE(decodeLoraFrame(frame, len - LORA_MIC_LEN, header, readings, LORA_FRAME_MAX_RECORDS));
+  TEST_ASSERT_EQUAL(LORA_FRAME_VERSION, header.version);
+  TEST_ASSERT_EQUAL_UINT32(loraDeviceAddress(identity.clientId), header.address);
+  TEST_ASSERT_EQUAL(lora.session, header.session);
+  TEST_ASSERT_EQUAL(0, header.counter);
+  TEST_ASSERT_EQUAL(TEST_DEPTH, header.records);
+  for(uint8_t r = 0; r < header.records; r++){
+    TelemetryRecord record = reading(1 + r);
+    TEST_ASSERT_EQUAL((nowMs - record.timestampMs + 500) / 1000, readings[r].ageS);
+    TEST_ASSERT_EQUAL(record.bootCnt, readings[r].bootCnt);
+    const float expected[LORA_FIELD_COUNT] = {record.soilTemp[0], record.soilTemp[1], record.soilTemp[2], record.soilTemp[3], record.soilMoist,
+                                              record.batVolt, (float)record.sleepS};
+    for(size_t i = 0; i < LORA_FIELD_COUNT; i++){
+      TEST_ASSERT_FLOAT_WITHIN(0.5f * powf(10.0f, -LORA_FIELDS[i].decimals) + 1e-4f, expected[i], number(readings[r].values[i]));
+    }
+  }
+}
+
+static void test_mic_covers_the_header(){
+  fillBatch(1);
+  TEST_ASSERT_EQUAL(LORA_SENT, loraUplinkSend(lora, state, flashLog, batch, identity, TEST_DEPTH, batchDueMs()));
+  uint8_t frame[HAL_LORA_MAX_LEN];
+  size_t len = lastFrame(frame);
+  for(size_t at = 0; at < LORA_FRAME_HEADER_LEN; at++){                                                          // Session and counter included: a forged restart fails it
+    frame[at] ^= 0x01;
+    TEST_ASSERT_FALSE(micValid(frame, len));
+    frame[at] ^= 0x01;
+  }
+  TEST_ASSERT_TRUE(micValid(frame, len));
+}
+
+static void test_duty_cycle_holds_the_next_frame(){
+  fillBatch(1);
+  uint64_t sentMs = batchDueMs();
+  TEST_ASSERT_EQUAL(LORA_SENT, loraUplinkSend(lora, state, flashLog, batch, identity, TEST_DEPTH, sentMs));
+  uint64_t offMs = (uint64_t)(lora.lastAirtimeMs * 100.0f / LORA_DUTY_CYCLE_PCT);
+  TEST_ASSERT_EQUAL(sentMs + offMs, lora.channelFreeMs);                                                         // 99 times the airtime off, after the frame itself
+
+  fillBatch(1 + TEST_DEPTH);                                                                                     // Due again, long before the channel is free
+  uint64_t earlyMs = lora.channelFreeMs - 1;
+  TEST_ASSERT_FALSE(loraFlushDue(lora, state, flashLog, TEST_DEPTH, earlyMs));                                   // The radio stays off
+  TEST_ASSERT_EQUAL(LORA_DEFERRED, loraUplinkSend(lora, state, flashLog, batch, identity, TEST_DEPTH, earlyMs));
+  TEST_ASSERT_EQUAL(1, lora.deferred);
+  TEST_ASSERT_EQUAL(TEST_DEPTH, state.buffer.count);                                                             // Nothing lost while waiting
+
+  uint32_t framesBefore = simStats().loraFrames;
+  TEST_ASSERT_TRUE(loraFlushDue(lora, state, flashLog, TEST_DEPTH, lora.channelFreeMs));
+  TEST_ASSERT_EQUAL(LORA_SENT, loraUplinkSend(lora, state, flashLog, batch, identity, TEST_DEPTH, lora.channelFreeMs));
+  TEST_ASSERT_EQUAL(framesBefore + 1, simStats().loraFrames);
+  TEST_ASSERT_EQUAL(2, lora.frames);
+  TEST_ASSERT_EQUAL(2, lora.frameCounter);
+}
+
+static void test_daily_airtime_is_capped(){
+  uint64_t nowMs = TEST_EPOCH_MS;
+  uint32_t sent = 0;
+  uint32_t framesBefore = simStats().loraFrames;
+  for(uint32_t boot = 1; sent < 10000; boot += TEST_DEPTH){                                                      // Every frame as soon as the duty cycle allows
+    if(state.buffer.count == 0) fillBatch(boot);
+    nowMs = nowMs > lora.channelFreeMs ? nowMs : lora.channelFreeMs;
+    LoraStatus status = loraUplinkSend(lora, state, flashLog, batch, identity, TEST_DEPTH, nowMs);
+    if(status != LORA_SENT) break;
+    sent++;
+  }
+  TEST_ASSERT_TRUE(lora.airtimeTodayMs <= LORA_DAILY_AIRTIME_MS);
+  TEST_ASSERT_TRUE(lora.airtimeTodayMs + lora.lastAirtimeMs > LORA_DAILY_AIRTIME_MS);                            // Stopped by the cap, not by the loop
+  TEST_ASSERT_EQUAL(sent, lora.frames);
+  TEST_ASSERT_EQUAL(framesBefore + sent, simStats().loraFrames);                                                 // Deferred before the radio is powered
+  TEST_ASSERT_EQUAL(1, lora.deferred);
+
+  uint64_t tomorrowMs = (nowMs / LORA_DAY_MS + 1) * LORA_DAY_MS;
+  TEST_ASSERT_TRUE(loraFlushDue(lora, state, flashLog, TEST_DEPTH, tomorrowMs));
+  TEST_ASSERT_EQUAL(LORA_SENT, loraUplinkSend(lora, state, flashLog, batch, identity, TEST_DEPTH, tomorrowMs));
+  TEST_ASSERT_EQUAL(lora.lastAirtimeMs, lora.airtimeTodayMs);
+}
+
+static void test_power_on_starts_a_new_session(){
+  uint16_t firstSession = lora.session;
+  fillBatch(1);
+  TEST_ASSERT_EQUAL(LORA_SENT, loraUplinkSend(lora, state, flashLog, batch, identity, TEST_DEPTH, batchDueMs()));
+  uint64_t freeMs = lora.channelFreeMs;
+
+  loraUplinkBegin(lora);                                                                                         // Deep sleep wake: same session, the counter goes on
+  TEST_ASSERT_EQUAL(firstSession, lora.session);
+  TEST_ASSERT_EQUAL(1, lora.frameCounter);
+  TEST_ASSERT_EQUAL(freeMs, lora.channelFreeMs);
+
+  lora.magic = 0;                                                                                                // Power-on
+  loraUplinkBegin(lora);
+  TEST_ASSERT_EQUAL(0, lora.frameCounter);
+  TEST_ASSERT_NOT_EQUAL(firstSession, lora.session);
+
+  fillBatch(1);
+  TEST_ASSERT_EQUAL(LORA_SENT, loraUplinkSend(lora, state, flashLog, batch, identity, TEST_DEPTH, batchDueMs()));
+  uint8_t frame[HAL_LORA_MAX_LEN];
+  size_t len = lastFrame(frame);
+  LoraFrameHeader header;
+  LoraReading readings[LORA_FRAME_MAX_RECORDS];
+  TEST_ASSERT_TRUE(decodeLoraFrame(frame, len - LORA_MIC_LEN, header, readings, LORA_FRAME_MAX_RECORDS));
+  TEST_ASSERT_EQUAL(0, header.counter);                                                                          // Counter 0 again, told apart by the session
+  TEST_ASSERT_EQUAL(lora.session, header.session);
+}
+
+int main(int argc, char** argv){
+  remove(TEST_RADIO_FILE);
+  TEST_ASSERT_TRUE(simSetLoraFile(TEST_RADIO_FILE));
+  UNITY_BEGIN();
+  RUN_TEST(test_gateway_decodes_what_was_sent);
+  RUN_TEST(test_mic_covers_the_header);
+  RUN_TEST(test_duty_cycle_holds_the_next_frame);
+  RUN_TEST(test_daily_airtime_is_capped);
+  RUN_TEST(test_power_on_starts_a_new_session);
+  return UNITY_END();
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+// MQTT framing (lib/MqttPacket) and the PUBACK scanner the ESP32 puts under PubSubClient
+//   pio test -e native -f test_mqtt_packet
+#include <unity.h>
+#include <string.h>
+#include "mqttPacket.h"
+
+void setUp(){}
+
+void tearDown(){}
+
+static uint32_t readLength(const uint8_t* bytes, size_t& used){
+  uint32_t length = 0;
+  used = 0;
+  while(mqttLengthDigit(length, used, bytes[used]) > 0) used++;
+  used++;
+  return length;
+}
+
+static void test_remaining_length_round_trip(){
+  static const uint32_t lengths[] = {0, 127, 128, 16383, 16384, 2097151, 2097152, 268435455};
+  for(uint32_t length : lengths){
+    uint8_t bytes[MQTT_LENGTH_MAX_LEN];
+    size_t written = mqttPutRemainingLength(bytes, length), used;
+    TEST_ASSERT_EQUAL(length, readLength(bytes, used));
+    TEST_ASSERT_EQUAL(written, used);
+  }
+  uint32_t length;
+  const uint8_t fiveDigits[] = {0xFF, 0xFF, 0xFF, 0xFF, 0x01};
+  for(uint8_t i = 0; i < 4; i++) TEST_ASSERT_EQUAL(1, mqttLengthDigit(length, i, fiveDigits[i]));
+  TEST_ASSERT_EQUAL(-1, mqttLengthDigit(length, 4, fiveDigits[4]));
+}
+
+static void test_publish_header(){
+  uint8_t header[MQTT_PUBLISH_HEADER_MAX_LEN(32)];
+  size_t n = mqttPublishHeader(header, sizeof(header), "v1/devices/me/telemetry", 300, 0x1234);
+  const uint8_t expected[] = {0x32, 0xC7, 0x02, 0x00, 23, 'v', '1', '/', 'd', 'e', 'v', 'i', 'c', 'e', 's', '/', 'm', 'e', '/',
+                              't', 'e', 'l', 'e', 'm', 'e', 't', 'r', 'y', 0x12, 0x34};                          // 2 + 23 + 2 + 300 = 327
+  TEST_ASSERT_EQUAL(sizeof(expected), n);
+  TEST_ASSERT_EQUAL_MEMORY(expected, header, n);
+  TEST_ASSERT_EQUAL(5, mqttPublishHeader(header, sizeof(header), "t", 0, -1));                                   // QoS 0: no packet id
+  TEST_ASSERT_EQUAL(MQTT_PUBLISH, header[0]);
+  TEST_ASSERT_EQUAL(0, mqttPublishHeader(header, 8, "v1/devices/me/telemetry", 0, 1));                           // Too small: nothing written
+}
+
+static void test_connect_packet(){
+  uint8_t packet[64];
+  size_t n = mqttConnectPacket(packet, sizeof(packet), "node", "TOKEN", 15);
+  const uint8_t expected[] = {0x10, 23, 0, 4, 'M', 'Q', 'T', 'T', 4, 0x82, 0, 15, 0, 4, 'n', 'o', 'd', 'e', 0, 5, 'T', 'O', 'K', 'E', 'N'};
+  TEST_ASSERT_EQUAL(sizeof(expected), n);
+  TEST_ASSERT_EQUAL_MEMORY(expected, packet, n);
+  const uint8_t accepted[] = {0, 0}, refused[] = {0, 5};
+  TEST_ASSERT_TRUE(mqttConnackAccepted(MQTT_CONNACK, accepted, 2));
+  TEST_ASSERT_FALSE(mqttConnackAccepted(MQTT_CONNACK, refused, 2));                                              // Not authorized: bad token
+}
+
+static void test_split_publish(){
+  const uint8_t body[] = {0, 3, 'a', '/', 'b', '{', '}'};
+  char topic[8];
+  const uint8_t* payload;
+  size_t payloadLen;
+  TEST_ASSERT_TRUE(mqttSplitPublish(body, sizeof(body), topic, sizeof(topic), payload, payloadLen));
+  TEST_ASSERT_EQUAL_STRING("a/b", topic);
+  TEST_ASSERT_EQUAL(2, payloadLen);
+  TEST_ASSERT_FALSE(mqttSplitPublish(body, 4, topic, sizeof(topic), payload, payloadLen));                       // Topic runs past the body
+  TEST_ASSERT_FALSE(mqttSplitPublish(body, sizeof(body), topic, 3, payload, payloadLen));                        // No room for the topic
+}
+
+static void test_ack_scanner_in_a_mixed_stream(){                                                                // What PubSubClient reads during a flush
+  const uint8_t stream[] = {
+    0x40, 0x02, 0x00, 0x07,                                                                                      // PUBACK 7
+    0xD0, 0x00,                                                                                                  // PINGRESP
+    0x90, 0x03, 0x00, 0x01, 0x00,                                                                                // SUBACK
+    0x30, 0x09, 0x00, 0x03, 'a', '/', 'b', 0x40, 0x02, 0x00, 0x09,                                               // Publish whose payload looks like a PUBACK
+    0x40, 0x02, 0x01, 0x00,                                                                                      // PUBACK 256
+  };
+  MqttAckScanner scanner = {};
+  for(uint8_t b : stream) scanner.feed(b);
+  uint16_t packetId;
+  TEST_ASSERT_TRUE(scanner.take(packetId));
+  TEST_ASSERT_EQUAL(7, packetId);
+  TEST_ASSERT_TRUE(scanner.take(packetId));
+  TEST_ASSERT_EQUAL(256, packetId);
+  TEST_ASSERT_FALSE(scanner.take(packetId));
+}
+
+static void test_ack_scanner_keeps_the_newest_on_overflow(){
+  MqttAckScanner scanner = {};
+  for(uint16_t id = 1; id <= MQTT_ACK_SCANNER_CAPACITY + 3; id++){
+    const uint8_t puback[] = {MQTT_PUBACK, 2, (uint8_t)(id >> 8), (uint8_t)id};
+    for(uint8_t b : puback) scanner.feed(b);
+  }
+  uint16_t packetId;
+  TEST_ASSERT_TRUE(scanner.take(packetId));
+  TEST_ASSERT_EQUAL(4, packetId);
+  scanner.reset();                                                                                               // New connection
+  TEST_ASSERT_FALSE(scanner.take(packetId));
+}
+
+int main(int argc, char** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_remaining_length_round_trip);
+  RUN_TEST(test_publish_header);
+  RUN_TEST(test_connect_packet);
+  RUN_TEST(test_split_publish);
+  RUN_TEST(test_ack_scanner_in_a_mixed_stream);
+  RUN_TEST(test_ack_scanner_keeps_the_newest_on_overflow);
+  return UNITY_END();
+}
\ No newline at end of file
@@ -0,0 +1,285 @@
+// Pull OTA (otaPull.h) through the host HAL against an HTTP server thread inside the test, with images signed by a key made for the run
+//   pio test -e native -f test_ota_pull
+#include <unity.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <vector>
+#include <zlib.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/sha.h>
+#include "otaPull.h"
+#include "halNative.h"
+#include "hal.h"
+#include "macros.h"
+
+#define TEST_RUNNING_VERSION 1
+#define TEST_OFFERED_VERSION 2
+#define TEST_IMAGE_SIZE (5 * OTA_BLOCK_MAX_LEN - 1000)                                                           // Last block shorter
+
+static OtaPull ota;
+static std::vector<uint8_t> firmware;
+static std::vector<uint8_t> image;                                                                               // What the server sends: header and block records
+static EVP_PKEY* signingKey;
+static char publicKeyPem[256];
+static int listener = -1;
+static uint16_t serverPort;
+static pthread_t serverThread;
+static volatile size_t cutAfter;                                                                                 // Body bytes sent before the server drops the connection, 0 for all
+static volatile bool ignoreRange;                                                                                // 200 with the whole file, like 'python3 -m http.server'
+static volatile long rangesAsked[8];                                                                             // Range start of each request, -1 without one
+static volatile uint8_t requests;
+
+// Image packing as ThingsBoard/otaImage does it ------------------------------------------------------------------------------------------------------------
+static void signHeader(OtaImageHeader& header, EVP_PKEY* key){
+  size_t signatureLen = sizeof(header.signature);
+  EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+  TEST_ASSERT_TRUE(EVP_DigestSignInit(ctx, NULL, EVP_sha256(), NULL, key) == 1 &&
+                   EVP_DigestSign(ctx, header.signature, &signatureLen, (const uint8_t*)&header, OTA_SIGNED_LEN) == 1);
+  header.signatureLen = signatureLen;
+  EVP_MD_CTX_free(ctx);
+}
+
+static void packImage(uint32_t version, EVP_PKEY* key){
+  OtaImageHeader header = {};
+  header.magic = OTA_IMAGE_MAGIC;
+  header.version = version;
+  header.imageSize = firmware.size();
+  header.blockSize = OTA_BLOCK_MAX_LEN;
+  SHA256(firmware.data(), firmware.size(), header.sha256);
+  signHeader(header, key);
+
+  image.assign((const uint8_t*)&header, (const uint8_t*)&header + sizeof(header));
+  for(size_t offset = 0; offset < firmware.size(); offset += header.blockSize){
+    size_t blockLen = firmware.size() - offset < header.blockSize ? firmware.size() - offset : header.blockSize;
+    uint8_t packed[OTA_BLOCK_MAX_LEN + 64];
+    uLongf packedLen = sizeof(packed);
+    uint32_t record;
+    const uint8_t* data = packed;
+    if(compress2(packed, &packedLen, &firmware[offset], blockLen, Z_BEST_COMPRESSION) == Z_OK && packedLen < blockLen){
+      record = packedLen;
+    }else{
+      record = blockLen | OTA_BLOCK_STORED;
+      packedLen = blockLen;
+      data = &firmware[offset];
+    }
+    image.insert(image.end(), (const uint8_t*)&record, (const uint8_t*)&record + sizeof(record));
+    image.insert(image.end(), data, data + packedLen);
+  }
+}
+
+// HTTP server: GET with an optional 'Range: bytes=N-', one request per connection ------------------------------------------------------------------------
+static void serveClient(int fd){
+  char request[1024];
+  size_t n = 0;
+  while(n < sizeof(request) - 1 && (n < 4 || memcmp(request + n - 4, "\r\n\r\n", 4) != 0)){
+    if(recv(fd, request + n, 1, 0) != 1) return;
+    n++;
+  }
+  request[n] = '\0';
+  const char* range = strstr(request, "Range: bytes=");
+  long start = range ? atol(range + 13) : -1;
+  if(requests < 8) rangesAsked[requests] = start;
+  requests++;
+
+  char headers[256];
+  int headersLen;
+  size_t from = 0;
+  if(start > 0 && !ignoreRange && (size_t)start < image.size()){
+    from = start;
+    headersLen = snprintf(headers, sizeof(headers), "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %lu-%lu/%lu\r\nContent-Length: %lu\r\n"
+                          "Connection: close\r\n\r\n", (unsigned long)from, (unsigned long)image.size() - 1, (unsigned long)image.size(),
+                          (unsigned long)(image.size() - from));
+  }else{
+    headersLen = snprintf(headers, sizeof(headers), "HTTP/1.1 200 OK\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n", (unsigned long)image.size());
+  }
+  size_t bodyLen = image.size() - from;
+  if(cutAfter > 0 && cutAfter < bodyLen) bodyLen = cutAfter;
+  if(send(fd, headers, headersLen, MSG_NOSIGNAL) == headersLen) send(fd, image.data() + from, bodyLen, MSG_NOSIGNAL);
+}
+
+static void* server(void*){
+  int fd;
+  while((fd = accept(listener, NULL, NULL)) >= 0){
+    serveClient(fd);
+    shutdown(fd, SHUT_RDWR);
+    close(fd);
+  }
+  return NULL;
+}
+
+static void startServer(){
+  struct sockaddr_in address = {};
+  socklen_t addressLen = sizeof(address);
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  TEST_ASSERT_TRUE(bind(listener, (struct sockaddr*)&address, sizeof(address)) == 0 && listen(listener, 4) == 0);
+  getsockname(listener, (struct sockaddr*)&address, &addressLen);                                                // Any free port
+  serverPort = ntohs(address.sin_port);
+  pthread_create(&serverThread, NULL, server, NULL);
+}
+
+// Node side -------------------------------------------------------------------------------------------------------------------------------------------------
+static void offer(uint32_t version){
+  char attributes[160];
+  int len = snprintf(attributes, sizeof(attributes), "{\"shared\":{\"fwVersion\":%u,\"fwUrl\":\"http://127.0.0.1:%u/firmware.sqota\"}}", (unsigned)version,
+                     (unsigned)serverPort);
+  TEST_ASSERT_TRUE(handleOtaAttributes(ota, (const uint8_t*)attributes, len));
+}
+
+static OtaStatus step(uint32_t maxBytes = OTA_BYTES_PER_WAKE){                                                   // One flush of a radio wake
+  simBeginWake();
+  TEST_ASSERT_TRUE(halNetworkUp(WIFI_CONNECT_TIMEOUT_MS));
+  OtaStatus status = otaPullStep(ota, OTA_WAKE_BUDGET_MS, maxBytes);
+  simEndWake();
+  return status;
+}
+
+static bool slotHoldsFirmware(){
+  uint8_t expected[32], digest[32];
+  SHA256(firmware.data(), firmware.size(), expected);
+  return halOtaDigest(firmware.size(), digest) && memcmp(expected, digest, sizeof(digest)) == 0;
+}
+
+void setUp(){
+  memset(&ota, 0, sizeof(ota));
+  otaPullBegin(ota, TEST_RUNNING_VERSION);
+  packImage(TEST_OFFERED_VERSION, signingKey);
+  cutAfter = 0;
+  ignoreRange = false;
+  requests = 0;
+  simBeginWake();
+  halOtaWrite(0, firmware.data(), 1);                                                                            // Erases the first sector: the slot no longer holds the firmware
+  simEndWake();
+}
+
+void tearDown(){}
+
+// Tests -----------------------------------------------------------------------------------------------------------------------------------------------------
+static void test_good_image_is_written_and_activated(){
+  uint32_t activations = simStats().otaActivations;
+  offer(TEST_OFFERED_VERSION);
+  TEST_ASSERT_TRUE(otaPullDue(ota, 4.0f));
+  TEST_ASSERT_EQUAL(OTA_READY, step());
+
+  TEST_ASSERT_TRUE(slotHoldsFirmware());
+  TEST_ASSERT_EQUAL(activations + 1, simStats().otaActivations);
+  TEST_ASSERT_EQUAL(TEST_IMAGE_SIZE, ota.written);
+  TEST_ASSERT_EQUAL(image.size(), ota.fileOffset);
+  TEST_ASSERT_EQUAL(0, ota.offeredVersion);
+  TEST_ASSERT_TRUE(ota.reportDue);
+  TEST_ASSERT_EQUAL(1, requests);
+}
+
+static void test_bad_signature_is_rejected_before_writing(){
+  EVP_PKEY* otherKey = EVP_EC_gen("P-256");
+  packImage(TEST_OFFERED_VERSION, otherKey);                                                                     // Well formed, signed by someone else
+  EVP_PKEY_free(otherKey);
+  offer(TEST_OFFERED_VERSION);
+  TEST_ASSERT_EQUAL(OTA_REJECTED, step());
+
+  TEST_ASSERT_EQUAL(0, ota.written);
+  TEST_ASSERT_FALSE(slotHoldsFirmware());
+  TEST_ASSERT_EQUAL(TEST_OFFERED_VERSION, ota.failedVersion);
+  TEST_ASSERT_FALSE(otaPullDue(ota, 4.0f));                                                                      // No radio time for it again...
+  char attributes[160];
+  int len = snprintf(attributes, sizeof(attributes), "{\"fwVersion\":%u,\"fwUrl\":\"http://127.0.0.1:%u/firmware.sqota\"}", TEST_OFFERED_VERSION,
+                     (unsigned)serverPort);
+  TEST_ASSERT_FALSE(handleOtaAttributes(ota, (const uint8_t*)attributes, len));                                  // ...even when offered again
+}
+
+static void test_tampered_header_is_rejected(){
+  offer(TEST_OFFERED_VERSION);
+  image[offsetof(OtaImageHeader, imageSize)] ^= 0x01;                                                            // Signed fields changed after signing
+  TEST_ASSERT_EQUAL(OTA_REJECTED, step());
+  TEST_ASSERT_EQUAL(0, ota.written);
+}
+
+static void test_truncated_download_resumes_with_range(){
+  offer(TEST_OFFERED_VERSION);
+  cutAfter = sizeof(OtaImageHeader) + 2 * OTA_BLOCK_MAX_LEN;                                                     // Drops in the middle of a record
+  TEST_ASSERT_EQUAL(OTA_RETRY, step());
+  uint32_t resumeAt = ota.fileOffset;
+  TEST_ASSERT_GREATER_THAN(sizeof(OtaImageHeader), resumeAt);                                                    // Whole blocks kept
+  TEST_ASSERT_LESS_THAN(cutAfter, resumeAt);
+  TEST_ASSERT_GREATER_THAN(0, ota.written);
+  TEST_ASSERT_TRUE(otaPullDue(ota, 4.0f));
+
+  cutAfter = 0;
+  TEST_ASSERT_EQUAL(OTA_READY, step());
+  TEST_ASSERT_TRUE(slotHoldsFirmware());
+  TEST_ASSERT_EQUAL(2, requests);
+  TEST_ASSERT_EQUAL(0, rangesAsked[0]);
+  TEST_ASSERT_EQUAL(resumeAt, rangesAsked[1]);                                                                   // Only the rest of the file is fetched
+}
+
+static void test_resume_without_range_support(){
+  offer(TEST_OFFERED_VERSION);
+  ignoreRange = true;
+  cutAfter = sizeof(OtaImageHeader) + OTA_BLOCK_MAX_LEN + 100;
+  TEST_ASSERT_EQUAL(OTA_RETRY, step());
+  cutAfter = 0;
+  TEST_ASSERT_EQUAL(OTA_READY, step());                                                                          // The node skips what it already has
+  TEST_ASSERT_TRUE(slotHoldsFirmware());
+}
+
+static void test_slices_spread_the_download_over_wakes(){
+  offer(TEST_OFFERED_VERSION);
+  uint8_t wakes = 0;
+  OtaStatus status;
+  uint32_t written = 0;
+  while((status = step(1)) == OTA_PARTIAL){                                                                      // A byte cap stops after the first record: one block per flush
+    TEST_ASSERT_GREATER_THAN(written, ota.written);
+    written = ota.written;
+    TEST_ASSERT_TRUE(++wakes < 10);
+  }
+  TEST_ASSERT_EQUAL(OTA_READY, status);
+  TEST_ASSERT_EQUAL((TEST_IMAGE_SIZE + OTA_BLOCK_MAX_LEN - 1) / OTA_BLOCK_MAX_LEN - 1, wakes);                   // The last block completes it
+  TEST_ASSERT_TRUE(slotHoldsFirmware());
+}
+
+static void test_corrupt_block_fails_the_digest(){
+  size_t lastRecord = image.size() - 1;                                                                          // Inside the last block: a random one, stored as is
+  image[lastRecord] ^= 0xFF;
+  offer(TEST_OFFERED_VERSION);
+  TEST_ASSERT_EQUAL(OTA_REJECTED, step());                                                                       // Header fine, SHA-256 of the slot is not
+  TEST_ASSERT_EQUAL(TEST_OFFERED_VERSION, ota.failedVersion);
+}
+
+int main(int argc, char** argv){
+  firmware.resize(TEST_IMAGE_SIZE);
+  uint32_t rng = 12345;
+  for(size_t i = 0; i < firmware.size(); i++){
+    rng = rng * 1103515245 + 12345;
+    bool dense = (i / OTA_BLOCK_MAX_LEN) % 2 == 0;                                                               // Even blocks random (stored), odd ones compress
+    firmware[i] = dense ? (uint8_t)(rng >> 16) : (uint8_t)(i % 64);
+  }
+  signingKey = EVP_EC_gen("P-256");
+  BIO* pem = BIO_new(BIO_s_mem());
+  PEM_write_bio_PUBKEY(pem, signingKey);
+  int pemLen = BIO_read(pem, publicKeyPem, sizeof(publicKeyPem) - 1);
+  publicKeyPem[pemLen > 0 ? pemLen : 0] = '\0';
+  BIO_free(pem);
+  simSetOtaPublicKey(publicKeyPem);
+  startServer();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_good_image_is_written_and_activated);
+  RUN_TEST(test_bad_signature_is_rejected_before_writing);
+  RUN_TEST(test_tampered_header_is_rejected);
+  RUN_TEST(test_truncated_download_resumes_with_range);
+  RUN_TEST(test_resume_without_range_support);
+  RUN_TEST(test_slices_spread_the_download_over_wakes);
+  RUN_TEST(test_corrupt_block_fails_the_digest);
+  int failures = UNITY_END();
+  shutdown(listener, SHUT_RDWR);
+  close(listener);
+  EVP_PKEY_free(signingKey);
+  return failures;
+}
\ No newline at end of file
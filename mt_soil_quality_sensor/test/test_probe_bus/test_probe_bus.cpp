@@ -0,0 +1,81 @@
+// Probe bus cache (probeBus.h) on the simulated OneWire bus of halNative.cpp: when a wake pays for a ROM search
+//   pio test -e native -f test_probe_bus
+#include <unity.h>
+#include <string.h>
+#include "probeBus.h"
+#include "halNative.h"
+#include "hal.h"
+
+#define TEST_WAKES (10 * PROBE_RESEARCH_WAKES)
+
+static ProbeBus bus;
+
+// One wake: the cached map, one addressed read per slot, the report. Returns the searches it ran
+static uint32_t wake(){
+  uint32_t searches = simStats().probeSearches;
+  probeBusBegin(bus);
+  float temperaturesC[PROBE_MAX_COUNT];
+  for(uint8_t slot = 0; slot < PROBE_MAX_COUNT; slot++){
+    temperaturesC[slot] = slot < bus.count ? halTemperatureReadC(bus.roms[slot]) : HAL_PROBE_DISCONNECTED_C;
+  }
+  probeBusReport(bus, temperaturesC);
+  return simStats().probeSearches - searches;
+}
+
+static uint32_t wakes(uint32_t count){
+  uint32_t searches = 0;
+  for(uint32_t i = 0; i < count; i++) searches += wake();
+  return searches;
+}
+
+void setUp(){
+  memset(&bus, 0, sizeof(bus));                                                                                  // Power-on
+  simSetProbeCount(PROBE_MAX_COUNT);
+  halSensorPower(true);
+}
+
+void tearDown(){}
+
+// Tests -----------------------------------------------------------------------------------------------------------------------------------------------------
+static void test_power_on_searches_once(){
+  TEST_ASSERT_EQUAL(1, wake());
+  TEST_ASSERT_EQUAL(PROBE_MAX_COUNT, bus.count);
+  TEST_ASSERT_EQUAL(0, wakes(TEST_WAKES));
+}
+
+static void test_removed_probe_is_searched_for_once(){
+  wake();
+  simSetProbeCount(PROBE_MAX_COUNT - 1);                                                                         // Deepest one unplugged for good
+  TEST_ASSERT_EQUAL(0, wakes(PROBE_RESEARCH_WAKES));
+  TEST_ASSERT_EQUAL(1, wakes(1));
+  TEST_ASSERT_EQUAL(PROBE_MAX_COUNT, bus.count);                                                                 // It keeps its slot...
+  TEST_ASSERT_EQUAL(0, wakes(TEST_WAKES));                                                                       // ...but its silence is known now
+}
+
+static void test_replugged_probe_is_watched_again(){
+  wake();
+  simSetProbeCount(PROBE_MAX_COUNT - 1);
+  TEST_ASSERT_EQUAL(1, wakes(PROBE_RESEARCH_WAKES + 1));
+  simSetProbeCount(PROBE_MAX_COUNT);                                                                             // Same probe back: answers by its cached ROM
+  TEST_ASSERT_EQUAL(0, wakes(TEST_WAKES));
+  simSetProbeCount(PROBE_MAX_COUNT - 1);
+  TEST_ASSERT_EQUAL(1, wakes(PROBE_RESEARCH_WAKES + 1));
+}
+
+static void test_second_removal_is_searched_for(){
+  wake();
+  simSetProbeCount(PROBE_MAX_COUNT - 1);
+  TEST_ASSERT_EQUAL(1, wakes(PROBE_RESEARCH_WAKES + 1));
+  simSetProbeCount(PROBE_MAX_COUNT - 2);                                                                         // Another slot goes silent
+  TEST_ASSERT_EQUAL(1, wakes(PROBE_RESEARCH_WAKES + 1));
+  TEST_ASSERT_EQUAL(0, wakes(TEST_WAKES));
+}
+
+int main(int argc, char** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_power_on_searches_once);
+  RUN_TEST(test_removed_probe_is_searched_for_once);
+  RUN_TEST(test_replugged_probe_is_watched_again);
+  RUN_TEST(test_second_removal_is_searched_for);
+  return UNITY_END();
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+// Schema serializer (telemetrySerializer.h) against the snprintf batch it replaced: same values, time per record
+//   pio test -e native -f test_serializer_bench
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "halNative.h"
+#include "telemetryBuffer.h"
+
+#define TEST_RECORDS 2000                                                                                        // Compared one by one
+#define TEST_RUNS 2000                                                                                           // Full batches timed per round
+#define TEST_ROUNDS 5                                                                                            // Best round kept, the others absorb host noise
+
+static TelemetryBuffer buffer;
+static char serialized[TELEMETRY_BATCH_MAX_LEN];
+static char printed[TELEMETRY_BATCH_MAX_LEN];
+static volatile size_t sink;                                                                                     // Keeps the optimizer from dropping the work
+static uint32_t seed;
+
+static float randomIn(float low, float high){
+  seed = seed * 1664525u + 1013904223u;                                                                          // Same LCG on every host, repeatable runs
+  return low + (high - low) * (seed >> 8) / 16777216.0f;
+}
+
+static TelemetryRecord randomRecord(uint32_t bootCnt){
+  TelemetryRecord record = {1760000000000ULL + bootCnt * 300000ULL, bootCnt, {}, randomIn(0.0f, 100.0f), randomIn(3.3f, 4.2f), 300};
+  for(uint8_t slot = 0; slot < PROBE_MAX_COUNT; slot++) record.soilTemp[slot] = roundf(randomIn(-10.0f, 45.0f) * 16) / 16; // DS18B20 steps of 0.0625 C
+  return record;
+}
+
+// serializeTelemetryBatch() before the schema serializer, with the keys of TELEMETRY_FIELDS
+static size_t sprintfTelemetryBatch(const TelemetryBuffer& source, int treeId, char* out, size_t outSize){
+  size_t len = 0;
+  out[len++] = '[';
+  for(uint8_t i = 0; i < source.count; i++){
+    const TelemetryRecord& record = telemetryRecordAt(source, i);
+    int written = snprintf(out + len, outSize - len,
+                           "%s{\"ts\":%llu,\"values\":{\"treeId\":%d,\"bootCnt\":%lu,\"soilTemperature\":%.2f,\"soilTemperature2\":%.2f,"
+                           "\"soilTemperature3\":%.2f,\"soilTemperature4\":%.2f,\"soilMoisture\":%.2f,\"batVoltage\":%.3f,\"sleepS\":%lu}}",
+                           i ? "," : "", (unsigned long long)record.timestampMs, treeId, (unsigned long)record.bootCnt,
+                           record.soilTemp[0], record.soilTemp[1], record.soilTemp[2], record.soilTemp[3], record.soilMoist, record.batVolt,
+                           (unsigned long)record.sleepS);
+    if(written < 0 || (size_t)written >= outSize - len) return 0;
+    len += written;
+  }
+  if(len + 2 > outSize) return 0;
+  out[len++] = ']';
+  out[len] = '\0';
+  return len;
+}
+
+// Same text around the numbers and the same numbers to the last printed decimal (printf rounds ties to even, the serializer away from zero)
+static void assertSameValues(const char* expected, const char* actual){
+  while(*expected != '\0' && *actual != '\0'){
+    if((*expected == '-' || (*expected >= '0' && *expected <= '9')) && (*actual == '-' || (*actual >= '0' && *actual <= '9'))){
+      char* expectedEnd;
+      char* actualEnd;
+      double e = strtod(expected, &expectedEnd);
+      double a = strtod(actual, &actualEnd);
+      const char* point = (const char*)memchr(actual, '.', actualEnd - actual);
+      double lsb = point ? pow(10.0, -(double)(actualEnd - point - 1)) : 0.0;
+      TEST_ASSERT_TRUE_MESSAGE(fabs(e - a) <= lsb * 1.001, actual);
+      expected = expectedEnd;
+      actual = actualEnd;
+      continue;
+    }
+    TEST_ASSERT_TRUE_MESSAGE(*expected == *actual, actual);
+    expected++;
+    actual++;
+  }
+  TEST_ASSERT_TRUE(*expected == '\0' && *actual == '\0');
+}
+
+// Best time of TEST_ROUNDS, in ns per record
+static double timePerRecordNs(size_t (*serialize)(const TelemetryBuffer&, int, char*, size_t), char* out){
+  double best = INFINITY;
+  for(uint8_t round = 0; round < TEST_ROUNDS; round++){
+    uint64_t startUs = simHostMicros();
+    for(uint32_t run = 0; run < TEST_RUNS; run++) sink = serialize(buffer, 99, out, TELEMETRY_BATCH_MAX_LEN);
+    double ns = (simHostMicros() - startUs) * 1000.0 / TEST_RUNS / buffer.count;
+    if(ns < best) best = ns;
+  }
+  return best;
+}
+
+void setUp(){
+  seed = 7;
+  clearTelemetryBuffer(buffer);
+  for(uint32_t i = 0; i < TELEMETRY_BUFFER_CAPACITY; i++) pushTelemetryRecord(buffer, randomRecord(i));
+}
+
+void tearDown(){}
+
+// Tests -----------------------------------------------------------------------------------------------------------------------------------------------------
+static void test_same_values_as_sprintf(){
+  for(uint32_t i = 0; i < TEST_RECORDS; i++){
+    clearTelemetryBuffer(buffer);
+    pushTelemetryRecord(buffer, randomRecord(i));
+    TEST_ASSERT_GREATER_THAN(0, sprintfTelemetryBatch(buffer, 99, printed, sizeof(printed)));
+    TEST_ASSERT_GREATER_THAN(0, serializeTelemetryBatch(buffer, 99, serialized, sizeof(serialized)));
+    assertSameValues(printed, serialized);
+  }
+}
+
+static void test_full_batch_fits_both_ways(){
+  size_t printedLen = sprintfTelemetryBatch(buffer, 99, printed, sizeof(printed));
+  size_t serializedLen = serializeTelemetryBatch(buffer, 99, serialized, sizeof(serialized));
+  TEST_ASSERT_GREATER_THAN(0, printedLen);
+  TEST_ASSERT_EQUAL(printedLen, serializedLen);                                                                  // No width padding on either side
+  assertSameValues(printed, serialized);
+}
+
+static void test_serializer_is_faster_than_sprintf(){
+  double sprintfNs = timePerRecordNs(sprintfTelemetryBatch, printed);
+  double serializerNs = timePerRecordNs(serializeTelemetryBatch, serialized);
+  printf("%u records per batch, ns per record: snprintf %.0f, serializer %.0f (%.1fx)\n",
+         (unsigned)buffer.count, sprintfNs, serializerNs, sprintfNs / serializerNs);
+  TEST_ASSERT_TRUE(serializerNs < sprintfNs);
+}
+
+int main(int argc, char** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_same_values_as_sprintf);
+  RUN_TEST(test_full_batch_fits_both_ways);
+  RUN_TEST(test_serializer_is_faster_than_sprintf);
+  return UNITY_END();
+}
\ No newline at end of file
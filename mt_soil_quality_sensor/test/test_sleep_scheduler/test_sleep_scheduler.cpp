@@ -0,0 +1,93 @@
+// Sleep scheduler (sleepScheduler.h): battery, soil trend and config inputs against the expected sleep length, one table row per case
+//   pio test -e native -f test_sleep_scheduler
+#include <unity.h>
+#include <math.h>
+#include "sleepScheduler.h"
+#include "macros.h"
+
+#define TEST_DAY_MS 1760000000000ULL                                                                             // 09:53 local (UTC+1)
+#define TEST_HOUR_MS 3600000ULL
+#define TEST_FAST_C (SLEEP_FAST_TEMPERATURE_CPH / 2)                                                             // Per wake of TEST_WAKE_S: the fastest rate
+#define TEST_WAKE_S 1800
+
+struct SleepCase {
+  const char* name;
+  float batteryVolts;
+  float batteryTrendVph;
+  float temperatureTrendC;
+  float moistureTrend;
+  uint32_t lastSleepS;
+  uint64_t epochMs;
+  uint16_t sleepMinS;                                                                                            // Shared attributes, see deviceConfig.h
+  uint16_t sleepMaxS;
+  uint8_t nightEndH;                                                                                             // SLEEP_NIGHT_START_H disables the night
+  uint32_t expectedS;
+  bool night;
+};
+
+static const SleepCase cases[] = {
+  // Soil dynamics, geometric between 30 and 900 s: 30 * 30^(1 - dynamics) ---------------------------------------------------------------------------------
+  {"stable soil",                  4.10f,  0.0f,  0.0f,               0.0f,  TEST_WAKE_S, TEST_DAY_MS, 30, 900, 6, 900, false},
+  {"fast temperature",             4.10f,  0.0f,  TEST_FAST_C,        0.0f,  TEST_WAKE_S, TEST_DAY_MS, 30, 900, 6, 30,  false},
+  {"cooling as fast",              4.10f,  0.0f,  -TEST_FAST_C,       0.0f,  TEST_WAKE_S, TEST_DAY_MS, 30, 900, 6, 30,  false},
+  {"half the fast rate",           4.10f,  0.0f,  TEST_FAST_C / 2,    0.0f,  TEST_WAKE_S, TEST_DAY_MS, 30, 900, 6, 164, false},
+  {"moisture drives",              4.10f,  0.0f,  TEST_FAST_C / 2,    2.5f,  TEST_WAKE_S, TEST_DAY_MS, 30, 900, 6, 30,  false},
+  {"trend over a short sleep",     4.10f,  0.0f,  0.1f,               0.0f,  30,          TEST_DAY_MS, 30, 900, 6, 30,  false},
+  {"first wake, no last sleep",    4.10f,  0.0f,  0.1f,               0.0f,  0,           TEST_DAY_MS, 30, 900, 6, 30,  false},
+  {"no trend yet",                 4.10f,  0.0f,  NAN,                NAN,   TEST_WAKE_S, TEST_DAY_MS, 30, 900, 6, 900, false},
+  // Battery --------------------------------------------------------------------------------------------------------------------------------------------------
+  {"low battery",                  3.70f,  0.0f,  TEST_FAST_C / 2,    0.0f,  TEST_WAKE_S, TEST_DAY_MS, 30, 900, 6, 329, false}, // 20 % charge: 2x
+  {"fast drain",                   4.10f, -0.1f,  TEST_FAST_C / 2,    0.0f,  TEST_WAKE_S, TEST_DAY_MS, 30, 900, 6, 329, false},
+  {"slow drain",                   4.10f, -0.01f, TEST_FAST_C / 2,    0.0f,  TEST_WAKE_S, TEST_DAY_MS, 30, 900, 6, 164, false},
+  {"low and draining",             3.70f, -0.1f,  TEST_FAST_C / 2,    0.0f,  TEST_WAKE_S, TEST_DAY_MS, 30, 900, 6, 657, false},
+  {"critical battery",             3.40f,  0.0f,  TEST_FAST_C,        0.0f,  TEST_WAKE_S, TEST_DAY_MS, 30, 900, 6, 900, false}, // Longest sleep whatever the soil does
+  {"no battery reading",           NAN,    0.0f,  TEST_FAST_C / 2,    0.0f,  TEST_WAKE_S, TEST_DAY_MS, 30, 900, 6, 164, false},
+  // Time of day ----------------------------------------------------------------------------------------------------------------------------------------------
+  {"night",                        4.10f,  0.0f,  TEST_FAST_C / 2,    0.0f,  TEST_WAKE_S, TEST_DAY_MS + 13 * TEST_HOUR_MS, 30, 900, 6, 329, true}, // 22:53
+  {"after midnight",               4.10f,  0.0f,  TEST_FAST_C / 2,    0.0f,  TEST_WAKE_S, TEST_DAY_MS - 4 * TEST_HOUR_MS,  30, 900, 6, 329, true}, // 05:53
+  {"morning",                      4.10f,  0.0f,  TEST_FAST_C / 2,    0.0f,  TEST_WAKE_S, TEST_DAY_MS - 3 * TEST_HOUR_MS,  30, 900, 6, 164, false}, // 06:53
+  {"stable at night",              4.10f,  0.0f,  0.0f,               0.0f,  TEST_WAKE_S, TEST_DAY_MS + 13 * TEST_HOUR_MS, 30, 900, 6, 900, true}, // Clamped to the maximum
+  {"unsynced clock",               4.10f,  0.0f,  TEST_FAST_C / 2,    0.0f,  TEST_WAKE_S, 5000,                            30, 900, 6, 164, false}, // 01:00 after power-on, not night
+  {"night disabled",               4.10f,  0.0f,  TEST_FAST_C / 2,    0.0f,  TEST_WAKE_S, TEST_DAY_MS + 13 * TEST_HOUR_MS, 30, 900, 22, 164, false},
+  // Config bounds (sleepMinS, sleepMaxS) -------------------------------------------------------------------------------------------------------------------
+  {"narrower bounds",              4.10f,  0.0f,  TEST_FAST_C / 2,    0.0f,  TEST_WAKE_S, TEST_DAY_MS, 60, 600, 6, 190, false}, // 60 * 10^0.5
+  {"narrower, stable",             4.10f,  0.0f,  0.0f,               0.0f,  TEST_WAKE_S, TEST_DAY_MS, 60, 600, 6, 600, false},
+  {"narrower, critical",           3.40f,  0.0f,  TEST_FAST_C,        0.0f,  TEST_WAKE_S, TEST_DAY_MS, 60, 600, 6, 600, false},
+  {"fixed interval",               3.70f, -0.1f,  TEST_FAST_C,        0.0f,  TEST_WAKE_S, TEST_DAY_MS + 13 * TEST_HOUR_MS, 120, 120, 6, 120, true},
+};
+
+void setUp(){}
+
+void tearDown(){}
+
+// Tests -----------------------------------------------------------------------------------------------------------------------------------------------------
+static void test_sleep_lengths(){
+  for(const SleepCase& c : cases){
+    const SleepInputs inputs = {c.batteryVolts, c.batteryTrendVph, c.temperatureTrendC, c.moistureTrend, c.lastSleepS, c.epochMs};
+    const SleepLimits limits = {                                                                                 // As storeWakeReading() builds them
+      c.sleepMinS, c.sleepMaxS, SLEEP_FAST_TEMPERATURE_CPH, SLEEP_FAST_MOISTURE_PPH, SLEEP_LOW_SOC, SLEEP_LOW_SOC_STRETCH, SLEEP_CRITICAL_SOC,
+      SLEEP_DRAIN_VPH, SLEEP_NIGHT_STRETCH, SLEEP_NIGHT_START_H, c.nightEndH, SLEEP_UTC_OFFSET_H
+    };
+    SleepPlan plan = planSleep(inputs, limits);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(c.expectedS, plan.seconds, c.name);
+    TEST_ASSERT_EQUAL_MESSAGE(c.night, plan.night, c.name);
+  }
+}
+
+static void test_dynamics_and_stretch_are_reported(){
+  const SleepInputs inputs = {3.70f, -0.1f, TEST_FAST_C / 2, 0.0f, TEST_WAKE_S, TEST_DAY_MS};
+  const SleepLimits limits = {
+    SLEEP_MIN_S, SLEEP_MAX_S, SLEEP_FAST_TEMPERATURE_CPH, SLEEP_FAST_MOISTURE_PPH, SLEEP_LOW_SOC, SLEEP_LOW_SOC_STRETCH, SLEEP_CRITICAL_SOC,
+    SLEEP_DRAIN_VPH, SLEEP_NIGHT_STRETCH, SLEEP_NIGHT_START_H, SLEEP_NIGHT_END_H, SLEEP_UTC_OFFSET_H
+  };
+  SleepPlan plan = planSleep(inputs, limits);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.5f, plan.dynamics);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 4.0f, plan.batteryStretch);                                                   // 2x for 20 % charge, 2x for the drain
+}
+
+int main(int argc, char** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_sleep_lengths);
+  RUN_TEST(test_dynamics_and_stretch_are_reported);
+  return UNITY_END();
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+// Binary telemetry frames (telemetryCodec.h): encodeTelemetryBatch() expanded by binaryFrameToJson() must give the JSON serializeTelemetryBatch() sends
+//   pio test -e native -f test_telemetry_codec
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "telemetryBuffer.h"
+
+#define TEST_TREE_ID 17
+#define TEST_EPOCH_MS 1760000000000ULL                                                                           // Synced clock, October 2025
+
+static TelemetryBuffer buffer;
+static uint8_t frame[TELEMETRY_FRAME_MAX_LEN];
+static char expected[TELEMETRY_BATCH_MAX_LEN];
+static char decoded[TELEMETRY_BATCH_MAX_LEN];
+
+static TelemetryRecord reading(uint64_t timestampMs, uint32_t bootCnt){
+  TelemetryRecord record = {timestampMs, bootCnt, {18.25f, 17.5f, NAN, NAN}, 34.17f, 3.912f, 300};
+  return record;
+}
+
+// Encodes the buffer, expands the frame and checks it against the JSON path, returns the frame length
+static size_t roundTrip(){
+  size_t frameLen = encodeTelemetryBatch(buffer, TEST_TREE_ID, frame, sizeof(frame));
+  TEST_ASSERT_GREATER_THAN(0, frameLen);
+  TEST_ASSERT_GREATER_THAN(0, serializeTelemetryBatch(buffer, TEST_TREE_ID, expected, sizeof(expected)));
+  TEST_ASSERT_GREATER_THAN(0, binaryFrameToJson(frame, frameLen, TELEMETRY_FIELDS, decoded, sizeof(decoded)));
+  TEST_ASSERT_EQUAL_STRING(expected, decoded);
+  return frameLen;
+}
+
+// Value of 'key' in record 'index' of a decoded array, as printed
+static const char* fieldOf(const char* json, uint8_t index, const char* key, char* value, size_t valueSize){
+  const char* record = json;
+  for(uint8_t i = 0; i <= index; i++){
+    record = strstr(record + 1, "{\"ts\":");
+    if(!record) return NULL;
+  }
+  char pattern[40];
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  const char* at = strstr(record, pattern);
+  if(!at) return NULL;
+  at += strlen(pattern);
+  size_t len = strcspn(at, ",}");
+  if(len >= valueSize) return NULL;
+  memcpy(value, at, len);
+  value[len] = '\0';
+  return value;
+}
+
+void setUp(){
+  clearTelemetryBuffer(buffer);
+}
+
+void tearDown(){}
+
+// Tests -----------------------------------------------------------------------------------------------------------------------------------------------------
+static void test_fields_survive_the_round_trip(){
+  TelemetryRecord record = {TEST_EPOCH_MS + 123, 4000000000UL, {-5.25f, 0.0f, 0.01f, 41.99f}, 100.0f, 4.2f, 86400};
+  pushTelemetryRecord(buffer, record);
+  roundTrip();
+
+  char value[24];
+  TEST_ASSERT_EQUAL_STRING("1760000000123", fieldOf(decoded, 0, "ts", value, sizeof(value)));
+  TEST_ASSERT_EQUAL_STRING("17", fieldOf(decoded, 0, "treeId", value, sizeof(value)));
+  TEST_ASSERT_EQUAL_STRING("4000000000", fieldOf(decoded, 0, "bootCnt", value, sizeof(value)));                  // Unsigned, above INT32_MAX
+  TEST_ASSERT_EQUAL_STRING("-5.25", fieldOf(decoded, 0, "soilTemperature", value, sizeof(value)));
+  TEST_ASSERT_EQUAL_STRING("0.00", fieldOf(decoded, 0, "soilTemperature2", value, sizeof(value)));               // Zero is a value, not a missing probe
+  TEST_ASSERT_EQUAL_STRING("100.00", fieldOf(decoded, 0, "soilMoisture", value, sizeof(value)));
+  TEST_ASSERT_EQUAL_STRING("4.200", fieldOf(decoded, 0, "batVoltage", value, sizeof(value)));
+  TEST_ASSERT_EQUAL_STRING("86400", fieldOf(decoded, 0, "sleepS", value, sizeof(value)));
+}
+
+static void test_missing_probes_come_back_null(){
+  TelemetryRecord record = reading(TEST_EPOCH_MS, 1);
+  pushTelemetryRecord(buffer, record);
+  record.timestampMs += 30000;
+  record.soilTemp[0] = NAN;                                                                                      // Probe lost between two readings
+  record.soilTemp[3] = INFINITY;
+  record.soilMoist = NAN;
+  pushTelemetryRecord(buffer, record);
+  roundTrip();
+
+  char value[24];
+  TEST_ASSERT_EQUAL_STRING("18.25", fieldOf(decoded, 0, "soilTemperature", value, sizeof(value)));
+  TEST_ASSERT_EQUAL_STRING("null", fieldOf(decoded, 0, "soilTemperature3", value, sizeof(value)));
+  TEST_ASSERT_EQUAL_STRING("null", fieldOf(decoded, 1, "soilTemperature", value, sizeof(value)));
+  TEST_ASSERT_EQUAL_STRING("17.50", fieldOf(decoded, 1, "soilTemperature2", value, sizeof(value)));
+  TEST_ASSERT_EQUAL_STRING("null", fieldOf(decoded, 1, "soilTemperature4", value, sizeof(value)));
+  TEST_ASSERT_EQUAL_STRING("null", fieldOf(decoded, 1, "soilMoisture", value, sizeof(value)));
+}
+
+static void test_timestamps_going_backwards(){
+  pushTelemetryRecord(buffer, reading(TEST_EPOCH_MS + 60000, 1));
+  pushTelemetryRecord(buffer, reading(TEST_EPOCH_MS, 2));                                                        // Clock stepped back by the NTP sync
+  pushTelemetryRecord(buffer, reading(5000, 3));                                                                 // Stamped before the first sync
+  pushTelemetryRecord(buffer, reading(TEST_EPOCH_MS + 30000, 4));
+  roundTrip();
+
+  char value[24];
+  TEST_ASSERT_EQUAL_STRING("1760000060000", fieldOf(decoded, 0, "ts", value, sizeof(value)));
+  TEST_ASSERT_EQUAL_STRING("1760000000000", fieldOf(decoded, 1, "ts", value, sizeof(value)));
+  TEST_ASSERT_EQUAL_STRING("5000", fieldOf(decoded, 2, "ts", value, sizeof(value)));
+  TEST_ASSERT_EQUAL_STRING("1760000030000", fieldOf(decoded, 3, "ts", value, sizeof(value)));
+}
+
+static void test_full_buffer_fits_both_limits(){
+  for(uint16_t i = 0; i < TELEMETRY_BUFFER_CAPACITY + 5; i++){                                                   // Wrapped ring: head is not slot 0
+    TelemetryRecord record = reading(TEST_EPOCH_MS + i * 30000ULL, i);
+    record.soilTemp[i % PROBE_MAX_COUNT] = -40.0f + i * 0.37f;
+    record.batVolt = 3.3f + i * 0.011f;
+    pushTelemetryRecord(buffer, record);
+  }
+  TEST_ASSERT_EQUAL(TELEMETRY_BUFFER_CAPACITY, buffer.count);
+  size_t frameLen = roundTrip();
+
+  char value[24];
+  TEST_ASSERT_EQUAL_STRING("5", fieldOf(decoded, 0, "bootCnt", value, sizeof(value)));                           // Oldest kept reading first
+  TEST_ASSERT_EQUAL_STRING("36", fieldOf(decoded, TELEMETRY_BUFFER_CAPACITY - 1, "bootCnt", value, sizeof(value)));
+  TEST_ASSERT_TRUE(frameLen * 4 < strlen(decoded));                                                              // The point of the binary frame
+  TEST_ASSERT_EQUAL(0, encodeTelemetryBatch(buffer, TEST_TREE_ID, frame, frameLen - 1));                         // One byte short: nothing half written
+}
+
+static void test_damaged_frames_are_rejected(){
+  pushTelemetryRecord(buffer, reading(TEST_EPOCH_MS, 1));
+  pushTelemetryRecord(buffer, reading(TEST_EPOCH_MS + 30000, 2));
+  size_t frameLen = roundTrip();
+
+  TEST_ASSERT_EQUAL(0, binaryFrameToJson(frame, frameLen - 1, TELEMETRY_FIELDS, decoded, sizeof(decoded)));      // Truncated
+  frame[frameLen] = 0x01;
+  TEST_ASSERT_EQUAL(0, binaryFrameToJson(frame, frameLen + 1, TELEMETRY_FIELDS, decoded, sizeof(decoded)));      // Trailing garbage
+  frame[1]++;
+  TEST_ASSERT_EQUAL(0, binaryFrameToJson(frame, frameLen, TELEMETRY_FIELDS, decoded, sizeof(decoded)));          // Other schema
+  frame[1]--;
+  TEST_ASSERT_EQUAL(0, binaryFrameToJson(frame, frameLen, TELEMETRY_FIELDS, decoded, 64));                       // No room for the JSON
+}
+
+int main(int argc, char** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_fields_survive_the_round_trip);
+  RUN_TEST(test_missing_probes_come_back_null);
+  RUN_TEST(test_timestamps_going_backwards);
+  RUN_TEST(test_full_buffer_fits_both_limits);
+  RUN_TEST(test_damaged_frames_are_rejected);
+  return UNITY_END();
+}
\ No newline at end of file
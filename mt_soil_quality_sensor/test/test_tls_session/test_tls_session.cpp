@@ -0,0 +1,247 @@
+// TLS session resumption across simulated wakes (tlsSession.h) against a TLS broker thread inside the test, OpenSSL standing in for mbedTLS on both sides
+//   pio test -e native -f test_tls_session
+#include <unity.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include "halNative.h"
+#include "mqttPacket.h"
+#include "tlsSession.h"
+
+#define TEST_WAKES 6
+#define TEST_SESSION_MAX_LEN 2048                                                                                // OpenSSL keeps the peer certificate in the session, the device drops it (tlsSessionClient.cpp)
+
+struct HostSessionCache {                                                                                        // TlsSessionCache with room for OpenSSL's encoding
+  uint16_t len;
+  uint8_t data[TEST_SESSION_MAX_LEN];
+};
+
+static EVP_PKEY* brokerKey;
+static X509* brokerCert;
+static SSL_CTX* brokerContext;
+static pthread_mutex_t brokerLock = PTHREAD_MUTEX_INITIALIZER;
+static volatile bool brokerPlain;                                                                                // Answers without TLS, every handshake fails
+static int listener = -1;
+static uint16_t brokerPort;
+static pthread_t brokerThread;
+
+static HostSessionCache cache;                                                                                   // What the RTC copy keeps across deep sleep
+static TlsSessionStats stats;
+
+// Broker: TLS 1.2 with session tickets and a session cache, CONNACK to the CONNECT --------------------------------------------------------------------------
+static SSL_CTX* newBrokerContext(){                                                                              // Fresh ticket keys and session cache, as after a restart
+  SSL_CTX* context = SSL_CTX_new(TLS_server_method());
+  SSL_CTX_set_max_proto_version(context, TLS1_2_VERSION);                                                        // mbedTLS 2.28 on the ESP32 has no TLS 1.3
+  SSL_CTX_use_certificate(context, brokerCert);
+  SSL_CTX_use_PrivateKey(context, brokerKey);
+  SSL_CTX_set_session_id_context(context, (const uint8_t*)"broker", 6);
+  return context;
+}
+
+static void serveClient(int fd){
+  pthread_mutex_lock(&brokerLock);
+  SSL* ssl = brokerPlain ? NULL : SSL_new(brokerContext);
+  pthread_mutex_unlock(&brokerLock);
+  if(ssl == NULL){
+    send(fd, "HTTP/1.1 400\r\n\r\n", 16, MSG_NOSIGNAL);                                                          // Not a TLS server on that port
+    return;
+  }
+  SSL_set_fd(ssl, fd);
+  uint8_t header[2];
+  uint8_t body[128];
+  if(SSL_accept(ssl) == 1 && SSL_read(ssl, header, 2) == 2 && header[0] == MQTT_CONNECT && header[1] <= sizeof(body) &&
+     SSL_read(ssl, body, header[1]) == header[1]){
+    const uint8_t connack[] = {MQTT_CONNACK, 2, 0, 0};
+    SSL_write(ssl, connack, sizeof(connack));
+    SSL_read(ssl, header, 1);                                                                                    // Until the node closes
+  }
+  SSL_free(ssl);
+}
+
+static void* broker(void*){
+  int fd;
+  while((fd = accept(listener, NULL, NULL)) >= 0){
+    serveClient(fd);
+    close(fd);
+  }
+  return NULL;
+}
+
+static void startBroker(){
+  brokerKey = EVP_EC_gen("P-256");
+  brokerCert = X509_new();
+  ASN1_INTEGER_set(X509_get_serialNumber(brokerCert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(brokerCert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(brokerCert), 3600);
+  X509_NAME_add_entry_by_txt(X509_get_subject_name(brokerCert), "CN", MBSTRING_ASC, (const uint8_t*)"localhost", -1, -1, 0);
+  X509_set_issuer_name(brokerCert, X509_get_subject_name(brokerCert));
+  X509_set_pubkey(brokerCert, brokerKey);
+  X509_sign(brokerCert, brokerKey, EVP_sha256());
+  brokerContext = newBrokerContext();
+
+  struct sockaddr_in address = {};
+  socklen_t addressLen = sizeof(address);
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  TEST_ASSERT_TRUE(bind(listener, (struct sockaddr*)&address, sizeof(address)) == 0 && listen(listener, 1) == 0);
+  getsockname(listener, (struct sockaddr*)&address, &addressLen);                                                // Any free port
+  brokerPort = ntohs(address.sin_port);
+  pthread_create(&brokerThread, NULL, broker, NULL);
+}
+
+static void restartBroker(){
+  pthread_mutex_lock(&brokerLock);
+  SSL_CTX_free(brokerContext);
+  brokerContext = newBrokerContext();
+  pthread_mutex_unlock(&brokerLock);
+}
+
+// Node side: the steps of SessionTLSClient::handshake() on a context that, like the device after deep sleep, only has the cache --------------------------
+struct WakeResult {
+  bool connected;
+  bool resumed;                                                                                                  // As the node decides it, from the master secrets
+  bool reused;                                                                                                   // As the TLS library knows it
+};
+
+static WakeResult wake(){
+  WakeResult result = {false, false, false};
+  SSL_CTX* context = SSL_CTX_new(TLS_client_method());
+  SSL_CTX_set_max_proto_version(context, TLS1_2_VERSION);
+  X509_STORE_add_cert(SSL_CTX_get_cert_store(context), brokerCert);                                              // Root CA: the self-signed broker certificate
+  SSL_CTX_set_verify(context, SSL_VERIFY_PEER, NULL);
+
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(brokerPort);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  TEST_ASSERT_TRUE(connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0);
+  SSL* ssl = SSL_new(context);
+  SSL_set_fd(ssl, fd);
+  SSL_set1_host(ssl, "localhost");
+
+  uint8_t offeredMaster[TLS_MASTER_SECRET_LEN];
+  bool offered = false;
+  if(cache.len > 0){
+    const uint8_t* data = cache.data;
+    SSL_SESSION* session = d2i_SSL_SESSION(NULL, &data, cache.len);
+    offered = session != NULL && SSL_SESSION_get_master_key(session, offeredMaster, sizeof(offeredMaster)) == sizeof(offeredMaster) &&
+              SSL_set_session(ssl, session) == 1;
+    SSL_SESSION_free(session);
+  }
+
+  uint64_t startUs = simHostMicros();
+  if(SSL_connect(ssl) != 1){
+    if(offered) cache.len = 0;
+    recordTlsHandshakeFailure(stats);
+  }else{
+    uint32_t elapsedMs = (simHostMicros() - startUs + 999) / 1000;
+    SSL_SESSION* session = SSL_get_session(ssl);
+    uint8_t negotiatedMaster[TLS_MASTER_SECRET_LEN];
+    TEST_ASSERT_EQUAL(sizeof(negotiatedMaster), SSL_SESSION_get_master_key(session, negotiatedMaster, sizeof(negotiatedMaster)));
+    result.resumed = tlsSessionResumed(offered ? offeredMaster : NULL, negotiatedMaster);
+    result.reused = SSL_session_reused(ssl);
+    recordTlsHandshake(stats, result.resumed, elapsedMs);
+
+    int len = i2d_SSL_SESSION(session, NULL);
+    uint8_t* out = cache.data;
+    cache.len = len > 0 && len <= TEST_SESSION_MAX_LEN ? i2d_SSL_SESSION(session, &out) : 0;
+
+    const uint8_t connect[] = {MQTT_CONNECT, 12, 0, 4, 'M', 'Q', 'T', 'T', 4, 2, 0, 60, 0, 0};                   // Clean session, empty client ID
+    uint8_t connack[4];
+    result.connected = SSL_write(ssl, connect, sizeof(connect)) == (int)sizeof(connect) && SSL_read(ssl, connack, 4) == 4 &&
+                       connack[0] == MQTT_CONNACK && connack[3] == 0;
+    SSL_shutdown(ssl);
+  }
+  SSL_free(ssl);
+  close(fd);
+  SSL_CTX_free(context);
+  return result;
+}
+
+void setUp(){
+  memset(&cache, 0, sizeof(cache));
+  memset(&stats, 0, sizeof(stats));
+  brokerPlain = false;
+}
+
+void tearDown(){}
+
+// Tests -----------------------------------------------------------------------------------------------------------------------------------------------------
+static void test_later_wakes_resume(){
+  for(uint8_t i = 0; i < TEST_WAKES; i++){
+    WakeResult result = wake();
+    TEST_ASSERT_TRUE(result.connected);
+    TEST_ASSERT_EQUAL(i > 0, result.resumed);
+    TEST_ASSERT_EQUAL(result.reused, result.resumed);
+    TEST_ASSERT_GREATER_THAN(0, cache.len);
+  }
+  TEST_ASSERT_EQUAL(1, stats.fullHandshakes);
+  TEST_ASSERT_EQUAL(TEST_WAKES - 1, stats.resumedHandshakes);
+  TEST_ASSERT_EQUAL(0, stats.failedHandshakes);
+  TEST_ASSERT_EQUAL(100 * (TEST_WAKES - 1) / TEST_WAKES, tlsResumptionRate(stats));
+}
+
+static void test_broker_restart_falls_back_to_a_full_handshake(){
+  wake();
+  TEST_ASSERT_TRUE(wake().resumed);
+  restartBroker();                                                                                               // The ticket and the ID are both unknown now
+  WakeResult result = wake();
+  TEST_ASSERT_TRUE(result.connected);
+  TEST_ASSERT_FALSE(result.resumed);
+  TEST_ASSERT_EQUAL(result.reused, result.resumed);
+  TEST_ASSERT_EQUAL(0, stats.failedHandshakes);                                                                  // Refused resumption is not a failure
+  TEST_ASSERT_TRUE(wake().resumed);                                                                              // The new session is the one kept
+  TEST_ASSERT_EQUAL(2, stats.fullHandshakes);
+  TEST_ASSERT_EQUAL(2, stats.resumedHandshakes);
+}
+
+static void test_damaged_cache_still_connects(){
+  for(uint16_t at = 0; at < 256; at += 8){                                                                       // Whatever the damage hits, the next wakes get a link
+    wake();
+    if(at >= cache.len) break;
+    cache.data[at] ^= 0xFF;
+    WakeResult result = wake();
+    if(!result.connected) TEST_ASSERT_TRUE(wake().connected);                                                    // At most one wake lost, the session is dropped
+    else TEST_ASSERT_EQUAL(result.reused, result.resumed);
+  }
+}
+
+static void test_failed_handshake_drops_the_offered_session(){
+  wake();
+  brokerPlain = true;
+  TEST_ASSERT_FALSE(wake().connected);
+  TEST_ASSERT_EQUAL(1, stats.failedHandshakes);
+  TEST_ASSERT_EQUAL(0, cache.len);                                                                               // Not offered again
+  brokerPlain = false;
+  WakeResult result = wake();
+  TEST_ASSERT_TRUE(result.connected);
+  TEST_ASSERT_FALSE(result.resumed);
+  TEST_ASSERT_EQUAL(2, stats.fullHandshakes);
+}
+
+static void test_nothing_offered_is_never_resumed(){
+  uint8_t master[TLS_MASTER_SECRET_LEN] = {};
+  TEST_ASSERT_FALSE(tlsSessionResumed(NULL, master));
+  TEST_ASSERT_TRUE(tlsSessionResumed(master, master));
+}
+
+int main(int argc, char** argv){
+  startBroker();
+  UNITY_BEGIN();
+  RUN_TEST(test_later_wakes_resume);
+  RUN_TEST(test_broker_restart_falls_back_to_a_full_handshake);
+  RUN_TEST(test_damaged_cache_still_connects);
+  RUN_TEST(test_failed_handshake_drops_the_offered_session);
+  RUN_TEST(test_nothing_offered_is_never_resumed);
+  int failures = UNITY_END();
+  shutdown(listener, SHUT_RDWR);
+  close(listener);
+  return failures;
+}
\ No newline at end of file
@@ -0,0 +1,167 @@
+// Flash backlog drain rate by QoS 1 window and broker round trip, against a broker thread inside the test (no external broker)
+//   pio test -e native -f test_uplink_throughput
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "hal.h"
+#include "halNative.h"
+#include "macros.h"
+#include "mqttPacket.h"
+#include "telemetryLog.h"
+#include "uplink.h"
+#include "wakeCycle.h"
+
+#define TEST_MESSAGES 24                                                                                         // Full batches drained per run, well inside the simulated flash log
+#define TEST_LATENCY_MS 20
+
+static WakeState wake;
+static TelemetryLog logRing;
+static TelemetryBuffer logBatch;
+static Uplink uplink;
+static uint8_t payload[WAKE_PAYLOAD_MAX_LEN];
+static int listener = -1;
+static uint16_t brokerPort;
+static pthread_t brokerThread;
+
+// Broker: CONNACK, PUBACK and SUBACK straight away, simSetMqttLatencyMs() holds the PUBACKs back on the node side -----------------------------------------
+static bool readAll(int fd, uint8_t* data, size_t len){
+  while(len > 0){
+    ssize_t got = recv(fd, data, len, 0);
+    if(got <= 0) return false;
+    data += got;
+    len -= got;
+  }
+  return true;
+}
+
+static void serveClient(int fd){
+  static uint8_t body[64 * 1024];
+  uint8_t type, digit;
+  while(readAll(fd, &type, 1)){
+    uint32_t length = 0;
+    int more = 1;
+    for(uint8_t i = 0; more > 0; i++){
+      if(!readAll(fd, &digit, 1) || (more = mqttLengthDigit(length, i, digit)) < 0) return;
+    }
+    if(length > sizeof(body) || !readAll(fd, body, length)) return;
+
+    uint8_t reply[5] = {0};
+    size_t replyLen = 0;
+    if(type == MQTT_CONNECT){
+      reply[0] = MQTT_CONNACK; reply[1] = 2; replyLen = 4;
+    }else if(type == (MQTT_PUBLISH | MQTT_QOS1)){
+      size_t idAt = 2 + ((body[0] << 8) | body[1]);
+      reply[0] = MQTT_PUBACK; reply[1] = 2; reply[2] = body[idAt]; reply[3] = body[idAt + 1]; replyLen = 4;
+    }else if(type == MQTT_SUBSCRIBE){
+      reply[0] = 0x90; reply[1] = 3; reply[2] = body[0]; reply[3] = body[1]; replyLen = 5;                       // SUBACK, QoS 0 granted
+    }else if(type == MQTT_DISCONNECT){
+      return;
+    }
+    if(replyLen > 0 && send(fd, reply, replyLen, MSG_NOSIGNAL) != (ssize_t)replyLen) return;
+  }
+}
+
+static void* broker(void*){
+  int fd;
+  while((fd = accept(listener, NULL, NULL)) >= 0){                                                               // One connection at a time, like the node
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));                                         // Every PUBACK leaves at once, as from a real broker
+    serveClient(fd);
+    close(fd);
+  }
+  return NULL;
+}
+
+static void startBroker(){
+  struct sockaddr_in address = {};
+  socklen_t addressLen = sizeof(address);
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  TEST_ASSERT_TRUE(bind(listener, (struct sockaddr*)&address, sizeof(address)) == 0 && listen(listener, 1) == 0);
+  getsockname(listener, (struct sockaddr*)&address, &addressLen);                                                // Any free port
+  brokerPort = ntohs(address.sin_port);
+  pthread_create(&brokerThread, NULL, broker, NULL);
+}
+
+// One drain -------------------------------------------------------------------------------------------------------------------------------------------------
+static double drainMessagesPerS(uint8_t window, uint32_t latencyMs){
+  TelemetryRecord record = {halEpochMs(), 0, {21.5f, 19.0f, 17.5f, 16.5f}, 35.0f, 3.9f, SLEEP_DURATION_S};
+  for(uint32_t i = 0; i < TEST_MESSAGES * TELEMETRY_BUFFER_CAPACITY; i++){
+    record.bootCnt = i;
+    record.timestampMs += 1000;
+    TEST_ASSERT_TRUE(telemetryLogAppend(logRing, record));
+  }
+
+  simSetMqttLatencyMs(latencyMs);
+  simBeginWake();
+  clearTelemetryBuffer(wake.buffer);
+  TEST_ASSERT_TRUE(halNetworkUp(WIFI_CONNECT_TIMEOUT_MS));
+  TEST_ASSERT_TRUE(halMqttConnect("127.0.0.1", brokerPort, "throughput", NULL));
+  uplinkBegin(uplink, window);
+  uplinkRewind(uplink, logRing);
+  uint64_t startUs = simHostMicros();
+  UplinkStatus status = UPLINK_BUSY;
+  while(status == UPLINK_BUSY) status = uplinkPump(uplink, wake, logRing, logBatch, 99, payload, sizeof(payload), true);
+  double elapsedS = (simHostMicros() - startUs) / 1e6;
+  halMqttDisconnect();
+  halNetworkDown();
+  simEndWake();
+
+  TEST_ASSERT_EQUAL(UPLINK_DONE, status);
+  TEST_ASSERT_EQUAL(0, telemetryLogPending(logRing));
+  TEST_ASSERT_EQUAL(TEST_MESSAGES, uplink.messagesAcked);
+  TEST_ASSERT_EQUAL(TEST_MESSAGES * TELEMETRY_BUFFER_CAPACITY, uplink.readingsAcked);
+  double rate = uplink.messagesAcked / elapsedS;
+  printf("%5u ms  %6u  %10.1f  %10.1f\n", (unsigned)latencyMs, window, rate, uplink.readingsAcked / elapsedS);
+  return rate;
+}
+
+void setUp(){}
+
+void tearDown(){}
+
+// Tests -----------------------------------------------------------------------------------------------------------------------------------------------------
+static void test_stop_and_wait_is_bound_by_the_round_trip(){
+  double rate = drainMessagesPerS(1, TEST_LATENCY_MS);
+  TEST_ASSERT_TRUE(rate <= 1000.0 / TEST_LATENCY_MS * 1.05);                                                     // One PUBACK per round trip at most
+}
+
+static void test_window_overlaps_the_round_trips(){
+  double single = drainMessagesPerS(1, TEST_LATENCY_MS);
+  double windowed = drainMessagesPerS(MQTT_INFLIGHT_WINDOW, TEST_LATENCY_MS);
+  TEST_ASSERT_TRUE(windowed >= single * MQTT_INFLIGHT_WINDOW / 2);                                               // Half the ideal speedup leaves room for a busy CI host
+}
+
+static void test_rates_by_window_and_latency(){                                                                  // The whole table, printed for comparison with a real broker
+  static const uint32_t latenciesMs[] = {0, 20, 50};
+  static const uint8_t windows[] = {1, 2, 4, 8, 16};
+  for(uint32_t latencyMs : latenciesMs){
+    double previous = 0.0;
+    for(uint8_t window : windows){
+      double rate = drainMessagesPerS(window, latencyMs);
+      if(latencyMs > 0 && window <= TEST_MESSAGES / 4) TEST_ASSERT_TRUE(rate >= previous * 0.9);                 // A larger window never slows the drain down
+      previous = rate;
+    }
+  }
+}
+
+int main(int argc, char** argv){
+  startBroker();
+  wake = {1, {}, {}, {}, {}, 0, SLEEP_DURATION_S, {}};
+  telemetryLogBegin(logRing);
+  printf("latency  window  messages/s  readings/s (%u readings per message)\n", TELEMETRY_BUFFER_CAPACITY);
+  UNITY_BEGIN();
+  RUN_TEST(test_stop_and_wait_is_bound_by_the_round_trip);
+  RUN_TEST(test_window_overlaps_the_round_trips);
+  RUN_TEST(test_rates_by_window_and_latency);
+  int failures = UNITY_END();
+  shutdown(listener, SHUT_RDWR);
+  close(listener);
+  return failures;
+}
\ No newline at end of file
@@ -0,0 +1,129 @@
+// Wake orchestration (wakeRunner.h) on the simulated clock of halNative.cpp, with scripted readings and no network
+//   pio test -e native -f test_wake_cycle
+#include <unity.h>
+#include <math.h>
+#include "wakeRunner.h"
+#include "halNative.h"
+#include "hal.h"
+
+static WakeRetained kept;
+static WakeRunner run;
+static DeviceIdentity identity;
+static uint32_t joins;
+static uint32_t notes[WAKE_BUDGET_SPENT + 1];
+
+#define TEST_MOISTURE 42.5f
+#define TEST_TEMPERATURE_C 15.5f
+#define TEST_BATCH_DEPTH 4                                                                                       // Filled well before BATCH_MAX_AGE_S, whatever the sleeps planned
+
+// Scripted hooks ---------------------------------------------------------------------------------------------------------------------------------------------
+static void acquire(WakeRunner&, float* temperaturesC, float& moisturePercent){
+  for(uint8_t slot = 0; slot < PROBE_MAX_COUNT; slot++) temperaturesC[slot] = slot == 0 ? TEST_TEMPERATURE_C : NAN;
+  moisturePercent = TEST_MOISTURE;
+}
+
+static bool join(WakeRunner&, uint32_t timeoutMs){                                                               // AP out of reach: every attempt spends its timeout
+  joins++;
+  halDelayMs(timeoutMs);
+  return false;
+}
+
+static bool connect(WakeRunner&){
+  return false;
+}
+
+static void report(WakeRunner&, WakeNote note, uint32_t){
+  notes[note]++;
+}
+
+static const WakeHooks hooks = {acquire, join, connect, NULL, NULL, NULL, NULL, report, NULL};
+
+// One wake as simMain.cpp runs it ---------------------------------------------------------------------------------------------------------------------------
+static WakeKind wake(){
+  simBeginWake();
+  wakeBegin(run, kept, identity, hooks);
+  wakePlanAcquisition(run);
+  WakeKind kind = wakeDecide(run);
+  switch(kind){
+    case WAKE_QUIET: runQuietWake(run); break;
+    case WAKE_LORA:  runLoraWake(run); break;
+    case WAKE_RADIO: runRadioWake(run, 1); break;
+  }
+  simEndWake();
+  return kind;
+}
+
+void setUp(){
+  static const WakeRetained fresh = WAKE_RETAINED_INIT;
+  kept = fresh;
+  joins = 0;
+  memset(notes, 0, sizeof(notes));
+  loadDeviceIdentity(identity);
+  identity.loraUplink = false;
+  deviceConfigBegin(kept.config);
+  kept.config.batchDepth = TEST_BATCH_DEPTH;
+  telemetryLogBegin(kept.log);
+}
+
+void tearDown(){}
+
+// Tests -----------------------------------------------------------------------------------------------------------------------------------------------------
+static void test_quiet_wakes_store_the_acquired_reading(){
+  for(uint16_t i = 1; i < kept.config.batchDepth; i++){
+    TEST_ASSERT_EQUAL(WAKE_QUIET, wake());
+    TEST_ASSERT_EQUAL(i, kept.wake.buffer.count);
+    const TelemetryRecord& record = telemetryRecordAt(kept.wake.buffer, kept.wake.buffer.count - 1);
+    TEST_ASSERT_EQUAL_FLOAT(TEST_MOISTURE, record.soilMoist);                                                    // What acquire() measured, not a placeholder
+    TEST_ASSERT_EQUAL_FLOAT(TEST_TEMPERATURE_C, record.soilTemp[0]);
+  }
+  TEST_ASSERT_EQUAL(0, joins);
+  TEST_ASSERT_EQUAL(kept.config.batchDepth - 1, notes[WAKE_READING]);
+}
+
+static void test_radio_wake_when_this_reading_completes_the_batch(){
+  for(uint16_t i = 1; i < kept.config.batchDepth; i++) wake();
+  simBeginWake();
+  wakeBegin(run, kept, identity, hooks);
+  wakePlanAcquisition(run);
+  TEST_ASSERT_EQUAL(WAKE_RADIO, wakeDecide(run));                                                                // batchDepth - 1 stored plus the one about to be taken
+  simEndWake();
+}
+
+static void test_forced_flush_brings_the_radio_up(){
+  simBeginWake();
+  wakeBegin(run, kept, identity, hooks);
+  run.forceFlush = true;
+  wakePlanAcquisition(run);
+  TEST_ASSERT_EQUAL(WAKE_RADIO, wakeDecide(run));
+  simEndWake();
+}
+
+static void test_lora_node_stays_off_wifi(){
+  identity.loraUplink = true;
+  TEST_ASSERT_EQUAL(WAKE_LORA, wake());
+  TEST_ASSERT_EQUAL(0, joins);
+  TEST_ASSERT_EQUAL(1, notes[WAKE_LORA_SENT]);
+  TEST_ASSERT_EQUAL(1, kept.wake.buffer.count);
+}
+
+static void test_spent_budget_moves_the_batch_to_flash(){
+  uint32_t pending = telemetryLogPending(kept.log);
+  for(uint16_t i = 1; i < kept.config.batchDepth; i++) wake();
+  TEST_ASSERT_EQUAL(WAKE_RADIO, wake());
+  TEST_ASSERT_GREATER_THAN(1, joins);                                                                            // Retried with backoff until the budget ran out
+  TEST_ASSERT_EQUAL(1, notes[WAKE_BUDGET_SPENT]);
+  TEST_ASSERT_EQUAL(0, kept.wake.buffer.count);
+  TEST_ASSERT_EQUAL(pending + kept.config.batchDepth, telemetryLogPending(kept.log));
+  TEST_ASSERT_EQUAL(1, kept.linkStats.expiredWakes);
+  TEST_ASSERT_GREATER_OR_EQUAL(LINK_WAKE_BUDGET_MS * 1000, kept.profileHistory.lastQuietUs);                     // The overrun is profiled like any wake that did not flush
+}
+
+int main(int argc, char** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_quiet_wakes_store_the_acquired_reading);
+  RUN_TEST(test_radio_wake_when_this_reading_completes_the_batch);
+  RUN_TEST(test_forced_flush_brings_the_radio_up);
+  RUN_TEST(test_lora_node_stays_off_wifi);
+  RUN_TEST(test_spent_budget_moves_the_batch_to_flash);
+  return UNITY_END();
+}
\ No newline at end of file
@@ -21,6 +21,8 @@ via MQTT at a fixed frequency, measuring soil temperature and moisture using a D
 // ESP32 libs ------------------------------------------------------------------------------------------------------------------------------------------------
 #include <esp_sleep.h>                                                                                           // Library to send the ESP32 to sleep
 #include "rom/rtc.h"                                                                                             // Libreria para usar la memoria RTC del ESP32, donde se pueden guardar variables cuyos valores sobreviven al deep sleep
+// Telemetry libs --------------------------------------------------------------------------------------------------------------------------------------------
+#include "telemetrySerializer.h"                                                                                 // Shared with mt_soil_quality_sensor, writes the JSON without printf
 // LIBRERIAS END =============================================================================================================================================
 
 // ===========================================================================================================================================================
@@ -70,6 +72,13 @@ static const char* root_ca = R"EOF(-----BEGIN CERTIFICATE-----
 -----END CERTIFICATE-----)EOF";                                                                                  // Certificado para el cifrado TLS de MQTT en Thingsboard
 
 static const uint64_t SLEEP_DURATION_US = 30ULL * 1000000;                                                       // Sleep time between messages
+
+static constexpr TelemetryField TELEMETRY_FIELDS[] = {                                                           // Payload schema: key names and decimals
+  {"bootCnt", 0},
+  {"soilTemperature", 2},
+  {"soilMoisture", 2},
+  {"batVoltage", 3},
+};
 // Variables -------------------------------------------------------------------------------------------------------------------------------------------------
 static bool ledState = LOW;
 static RTC_DATA_ATTR uint32_t bootCount = 0;
@@ -152,8 +161,8 @@ void loop() {
     float soilMoist = random(0, 10000) / 100.0f;
     float batVolt = (axp.getBattVoltage()) / 1000.0f;
 
-    sprintf(dataStr, "{\"bootCnt\":%lu,\"soilTemperature\":%4.2f,\"soilMoisture\":%5.2f,\"batVoltage\":%4.3f}",
-            (unsigned long)bootCount, soilTemp, soilMoist, batVolt);                                             // La funcion 'sprintf' de C++ se usa para poder introducir las medidas y elegir el ancho de numero y su precision. Las medidas se separan con una coma ','
+    const TelemetryValue values[] = {bootCount, soilTemp, soilMoist, batVolt};
+    serializeTelemetry(dataStr, sizeof(dataStr), TELEMETRY_FIELDS, values);                                      // La tabla TELEMETRY_FIELDS define las claves y la precision de cada medida
     
     if(mqttClient.publish(mqttTopicPub, dataStr)){                                                               // Se publica el string con los datos de los sensores en el topico 'moya/sensores'
       Debugln(dataStr);                                                                                          // Muestra en el serial de Arduino el string
@@ -21,6 +21,8 @@ via MQTT at a fixed frequency, measuring soil temperature and moisture using a D
 // ESP32 libs ------------------------------------------------------------------------------------------------------------------------------------------------
 #include <esp_sleep.h>                                                                                           // Library to send the ESP32 to sleep
 #include "rom/rtc.h"                                                                                             // Library to use the ESP32 RTC memory, where I can store variable whose values survive deep sleep
+// Telemetry libs --------------------------------------------------------------------------------------------------------------------------------------------
+#include "telemetrySerializer.h"                                                                                 // Shared with mt_soil_quality_sensor, writes the JSON without printf
 // LIBRERIAS END =============================================================================================================================================
 
 // ===========================================================================================================================================================
@@ -73,6 +75,13 @@ static const char* root_ca = R"EOF(-----BEGIN CERTIFICATE-----
 -----END CERTIFICATE-----)EOF";                                                                                  // Certificate for MQTT over TLS on Thingsboard
 
 static const uint64_t SLEEP_DURATION_US = 30ULL * 1000000;                                                       // Sleep time between messages
+
+static constexpr TelemetryField TELEMETRY_FIELDS[] = {                                                           // Payload schema: key names and decimals
+  {"bootCnt", 0},
+  {"soilTemperature", 2},
+  {"soilMoisture", 2},
+  {"batVoltage", 3},
+};
 // Variables -------------------------------------------------------------------------------------------------------------------------------------------------
 static bool ledState = LOW;
 static volatile bool pekPressed = false;
@@ -161,8 +170,8 @@ static void MQTTTask(void *pvParameters){
       float soilMoist = random(0, 10000) / 100.0f;
       float batVolt = (axp.getBattVoltage()) / 1000.0f;
 
-      sprintf(dataStr, "{\"bootCnt\":%lu,\"soilTemperature\":%4.2f,\"soilMoisture\":%5.2f,\"batVoltage\":%4.3f}",
-              (unsigned long)bootCount, soilTemp, soilMoist, batVolt);                                             // 'sprintf' C++ function is used to introduce the values of the sensor variables with the optimal formatting
+      const TelemetryValue values[] = {bootCount, soilTemp, soilMoist, batVolt};
+      serializeTelemetry(dataStr, sizeof(dataStr), TELEMETRY_FIELDS, values);                                    // The TELEMETRY_FIELDS table sets the key and precision of each value
       
       if(mqttClient.publish(mqttTopicPub, dataStr)){                                                               // The string is published on ThingsBoard topic
         if(xSemaphoreTake(semaphoreSerial, portMAX_DELAY)){